@@ -6,6 +6,7 @@
 #include "enet/enet.h"
 
 static ENetCallbacks callbacks = { malloc, free, abort };
+static ENetSocketHooks socketHooks = { NULL, NULL };
 
 int
 enet_initialize_with_callbacks (ENetVersion version, const ENetCallbacks * inits)
@@ -51,3 +52,41 @@ enet_free (void * memory)
    callbacks.free (memory);
 }
 
+
+void
+enet_socket_set_hooks (const ENetSocketHooks * hooks)
+{
+   if (hooks != NULL)
+     socketHooks = * hooks;
+   else
+   {
+      socketHooks.send = NULL;
+      socketHooks.receive = NULL;
+   }
+}
+
+int
+enet_socket_send (ENetSocket socket,
+                  const ENetAddress * peerAddress,
+                  const ENetAddress * localAddress,
+                  const ENetBuffer * buffers,
+                  size_t bufferCount)
+{
+   if (socketHooks.send != NULL)
+     return socketHooks.send (socket, peerAddress, localAddress, buffers, bufferCount);
+
+   return enet_socket_send_direct (socket, peerAddress, localAddress, buffers, bufferCount);
+}
+
+int
+enet_socket_receive (ENetSocket socket,
+                     ENetAddress * peerAddress,
+                     ENetAddress * localAddress,
+                     ENetBuffer * buffers,
+                     size_t bufferCount)
+{
+   if (socketHooks.receive != NULL)
+     return socketHooks.receive (socket, peerAddress, localAddress, buffers, bufferCount);
+
+   return enet_socket_receive_direct (socket, peerAddress, localAddress, buffers, bufferCount);
+}
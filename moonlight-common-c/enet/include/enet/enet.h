@@ -346,6 +346,14 @@ typedef enet_uint32 (ENET_CALLBACK * ENetChecksumCallback) (const ENetBuffer * b
 /** Callback for intercepting received raw UDP packets. Should return 1 to intercept, 0 to ignore, or -1 to propagate an error. */
 typedef int (ENET_CALLBACK * ENetInterceptCallback) (struct _ENetHost * host, struct _ENetEvent * event);
 
+/** Replacements for the datagram I/O of all ENet sockets, e.g. to inject network impairments.
+    A hook reaches the network with enet_socket_send_direct() or enet_socket_receive_direct(). */
+typedef struct _ENetSocketHooks
+{
+   int (ENET_CALLBACK * send) (ENetSocket socket, const ENetAddress * peerAddress, const ENetAddress * localAddress, const ENetBuffer * buffers, size_t bufferCount);
+   int (ENET_CALLBACK * receive) (ENetSocket socket, ENetAddress * peerAddress, ENetAddress * localAddress, ENetBuffer * buffers, size_t bufferCount);
+} ENetSocketHooks;
+
 /** An ENet host for communicating with peers.
   *
   * No fields should be modified unless otherwise stated.
@@ -504,6 +512,9 @@ ENET_API ENetSocket enet_socket_accept (ENetSocket, ENetAddress *);
 ENET_API int        enet_socket_connect (ENetSocket, const ENetAddress *);
 ENET_API int        enet_socket_send (ENetSocket, const ENetAddress *, const ENetAddress *, const ENetBuffer *, size_t);
 ENET_API int        enet_socket_receive (ENetSocket, ENetAddress *, ENetAddress *, ENetBuffer *, size_t);
+ENET_API int        enet_socket_send_direct (ENetSocket, const ENetAddress *, const ENetAddress *, const ENetBuffer *, size_t);
+ENET_API int        enet_socket_receive_direct (ENetSocket, ENetAddress *, ENetAddress *, ENetBuffer *, size_t);
+ENET_API void       enet_socket_set_hooks (const ENetSocketHooks *);
 ENET_API int        enet_socket_wait (ENetSocket, enet_uint32 *, enet_uint32);
 ENET_API int        enet_socket_set_option (ENetSocket, ENetSocketOption, int);
 ENET_API int        enet_socket_get_option (ENetSocket, ENetSocketOption, int *);
@@ -431,11 +431,11 @@ enet_socket_destroy (ENetSocket socket)
 }
 
 int
-enet_socket_send (ENetSocket socket,
-                  const ENetAddress * peerAddress,
-                  const ENetAddress * localAddress,
-                  const ENetBuffer * buffers,
-                  size_t bufferCount)
+enet_socket_send_direct (ENetSocket socket,
+                         const ENetAddress * peerAddress,
+                         const ENetAddress * localAddress,
+                         const ENetBuffer * buffers,
+                         size_t bufferCount)
 {
     DWORD sentLength;
     WSAMSG msg = { 0 };
@@ -591,11 +591,11 @@ enet_socket_send (ENetSocket socket,
 }
 
 int
-enet_socket_receive (ENetSocket socket,
-                     ENetAddress * peerAddress,
-                     ENetAddress * localAddress,
-                     ENetBuffer * buffers,
-                     size_t bufferCount)
+enet_socket_receive_direct (ENetSocket socket,
+                            ENetAddress * peerAddress,
+                            ENetAddress * localAddress,
+                            ENetBuffer * buffers,
+                            size_t bufferCount)
 {
     DWORD recvLength;
     WSAMSG msg = { 0 };
@@ -0,0 +1,228 @@
+#define LC_ALLOCATION_TRACKER
+#include "Limelight-internal.h"
+
+// Allocation counts are kept per source file, which is identified by the __FILE__
+// string passed by the allocation macros in Limelight-internal.h. The counters are
+// only touched while tracking is active, so an untracked allocation costs a flag
+// check. Frees are counted where they happen, since a free doesn't know which file
+// made the allocation.
+
+#define MAX_ALLOCATION_SUBSYSTEMS 48
+
+typedef struct _ALLOCATION_SUBSYSTEM {
+    const char* file;
+    ALLOCATION_STATS stats;
+
+    // Counts when the connection was established
+    uint64_t steadyStateAllocations;
+    uint64_t steadyStateBytes;
+} ALLOCATION_SUBSYSTEM, *PALLOCATION_SUBSYSTEM;
+
+static bool allocationTrackingEnabled;
+static bool allocationTrackingActive;
+static PLT_MUTEX allocationLock;
+static ALLOCATION_SUBSYSTEM subsystems[MAX_ALLOCATION_SUBSYSTEMS];
+static int subsystemCount;
+static uint64_t steadyStateStartUs;
+static uint64_t trackingEndUs;
+
+void LiSetAllocationTrackingEnabled(bool enabled) {
+    allocationTrackingEnabled = enabled;
+}
+
+// Returns the subsystem of a source file, adding it if it is new. The caller must
+// hold allocationLock.
+static PALLOCATION_SUBSYSTEM getSubsystem(const char* file) {
+    PALLOCATION_SUBSYSTEM subsystem;
+    const char* name;
+    const char* separator;
+    size_t length;
+    int i;
+
+    // The same file usually passes the same string
+    for (i = 0; i < subsystemCount; i++) {
+        if (subsystems[i].file == file || strcmp(subsystems[i].file, file) == 0) {
+            return &subsystems[i];
+        }
+    }
+
+    if (subsystemCount == MAX_ALLOCATION_SUBSYSTEMS) {
+        return NULL;
+    }
+
+    subsystem = &subsystems[subsystemCount++];
+    memset(subsystem, 0, sizeof(*subsystem));
+    subsystem->file = file;
+
+    // __FILE__ may include the path
+    name = file;
+    for (separator = file; *separator != 0; separator++) {
+        if (*separator == '/' || *separator == '\\') {
+            name = separator + 1;
+        }
+    }
+    separator = strrchr(name, '.');
+    length = separator != NULL ? (size_t)(separator - name) : strlen(name);
+    if (length >= sizeof(subsystem->stats.name)) {
+        length = sizeof(subsystem->stats.name) - 1;
+    }
+    memcpy(subsystem->stats.name, name, length);
+
+    return subsystem;
+}
+
+static void recordAllocation(const char* file, size_t size) {
+    PALLOCATION_SUBSYSTEM subsystem;
+
+    if (!allocationTrackingActive) {
+        return;
+    }
+
+    PltLockMutex(&allocationLock);
+    subsystem = getSubsystem(file);
+    if (subsystem != NULL) {
+        subsystem->stats.allocations++;
+        subsystem->stats.bytes += size;
+    }
+    PltUnlockMutex(&allocationLock);
+}
+
+void* trackedMalloc(size_t size, const char* file) {
+    recordAllocation(file, size);
+    return malloc(size);
+}
+
+void* trackedCalloc(size_t count, size_t size, const char* file) {
+    recordAllocation(file, count * size);
+    return calloc(count, size);
+}
+
+void* trackedRealloc(void* ptr, size_t size, const char* file) {
+    recordAllocation(file, size);
+    return realloc(ptr, size);
+}
+
+char* trackedStrdup(const char* str, const char* file) {
+    recordAllocation(file, strlen(str) + 1);
+    return strdup(str);
+}
+
+void trackedFree(void* ptr, const char* file) {
+    PALLOCATION_SUBSYSTEM subsystem;
+
+    if (ptr != NULL && allocationTrackingActive) {
+        PltLockMutex(&allocationLock);
+        subsystem = getSubsystem(file);
+        if (subsystem != NULL) {
+            subsystem->stats.frees++;
+        }
+        PltUnlockMutex(&allocationLock);
+    }
+
+    free(ptr);
+}
+
+void markAllocationSteadyState(void) {
+    int i;
+
+    if (!allocationTrackingActive) {
+        return;
+    }
+
+    PltLockMutex(&allocationLock);
+    for (i = 0; i < subsystemCount; i++) {
+        subsystems[i].steadyStateAllocations = subsystems[i].stats.allocations;
+        subsystems[i].steadyStateBytes = subsystems[i].stats.bytes;
+    }
+    steadyStateStartUs = PltGetMicroseconds();
+    PltUnlockMutex(&allocationLock);
+}
+
+static int compareAllocationStats(const void* a, const void* b) {
+    const ALLOCATION_STATS* statsA = (const ALLOCATION_STATS*)a;
+    const ALLOCATION_STATS* statsB = (const ALLOCATION_STATS*)b;
+
+    if (statsA->allocationsPerSecond != statsB->allocationsPerSecond) {
+        return statsA->allocationsPerSecond > statsB->allocationsPerSecond ? -1 : 1;
+    }
+    if (statsA->allocations != statsB->allocations) {
+        return statsA->allocations > statsB->allocations ? -1 : 1;
+    }
+
+    return strcmp(statsA->name, statsB->name);
+}
+
+int LiGetAllocationStats(PALLOCATION_STATS stats, int maxSubsystems) {
+    ALLOCATION_STATS sorted[MAX_ALLOCATION_SUBSYSTEMS];
+    bool active = allocationTrackingActive;
+    uint64_t steadyStateUs = 0;
+    int count = 0;
+    int i;
+
+    // The counters only change during a connection
+    if (active) {
+        PltLockMutex(&allocationLock);
+    }
+
+    if (steadyStateStartUs != 0) {
+        steadyStateUs = (active ? PltGetMicroseconds() : trackingEndUs) - steadyStateStartUs;
+    }
+
+    for (i = 0; i < subsystemCount; i++) {
+        PALLOCATION_SUBSYSTEM subsystem = &subsystems[i];
+
+        sorted[count] = subsystem->stats;
+        if (steadyStateUs > 0) {
+            sorted[count].allocationsPerSecond =
+                (float)(subsystem->stats.allocations - subsystem->steadyStateAllocations) * 1000000 / steadyStateUs;
+            sorted[count].bytesPerSecond =
+                (float)(subsystem->stats.bytes - subsystem->steadyStateBytes) * 1000000 / steadyStateUs;
+        }
+        count++;
+    }
+
+    if (active) {
+        PltUnlockMutex(&allocationLock);
+    }
+
+    qsort(sorted, count, sizeof(*sorted), compareAllocationStats);
+    if (count > maxSubsystems) {
+        count = maxSubsystems;
+    }
+    memcpy(stats, sorted, count * sizeof(*stats));
+    return count;
+}
+
+int initializeAllocationTracker(void) {
+    int err;
+
+    // The counts of the previous connection are replaced
+    subsystemCount = 0;
+    steadyStateStartUs = 0;
+    trackingEndUs = 0;
+
+    if (!allocationTrackingEnabled) {
+        return 0;
+    }
+
+    err = PltCreateMutex(&allocationLock, NULL);
+    if (err != 0) {
+        return err;
+    }
+
+    allocationTrackingActive = true;
+    return 0;
+}
+
+void cleanupAllocationTracker(void) {
+    if (!allocationTrackingActive) {
+        return;
+    }
+
+    PltLockMutex(&allocationLock);
+    allocationTrackingActive = false;
+    trackingEndUs = PltGetMicroseconds();
+    PltUnlockMutex(&allocationLock);
+
+    PltDeleteMutex(&allocationLock);
+}
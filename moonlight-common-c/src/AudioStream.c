@@ -5,7 +5,9 @@ static SOCKET rtpSocket = INVALID_SOCKET;
 static LINKED_BLOCKING_QUEUE packetQueue;
 static RTP_AUDIO_QUEUE rtpAudioQueue;
 
-static PLT_THREAD udpPingThread;
+static PLT_TIMER udpPingTimer;
+static LC_SOCKADDR udpPingAddr;
+static int udpPingCount;
 static PLT_THREAD receiveThread;
 static PLT_THREAD decoderThread;
 
@@ -13,8 +15,9 @@ static PPLT_CRYPTO_CONTEXT audioDecryptionCtx;
 static uint32_t avRiKeyId;
 
 static unsigned short lastSeq;
+static uint32_t currentTimestamp;
 
-static bool pingThreadStarted;
+static bool udpPingStarted;
 static bool receivedDataFromPeer;
 static uint64_t firstReceiveTime;
 
@@ -25,6 +28,8 @@ static uint8_t opusHeaderByte;
 
 #define MAX_PACKET_SIZE 1400
 
+#define UDP_PING_INTERVAL_MS 500
+
 typedef struct _QUEUE_AUDIO_PACKET_HEADER {
     LINKED_BLOCKING_QUEUE_ENTRY lentry;
     int size;
@@ -35,42 +40,48 @@ typedef struct _QUEUED_AUDIO_PACKET {
     char data[MAX_PACKET_SIZE];
 } QUEUED_AUDIO_PACKET, *PQUEUED_AUDIO_PACKET;
 
-static void AudioPingThreadProc(void* context) {
+static void AudioPingTimerFunc(void* context) {
     char legacyPingData[] = { 0x50, 0x49, 0x4E, 0x47 };
-    LC_SOCKADDR saddr;
-
-    LC_ASSERT(AudioPortNumber != 0);
-
-    memcpy(&saddr, &RemoteAddr, sizeof(saddr));
-    SET_PORT(&saddr, AudioPortNumber);
 
     // We do not check for errors here. Socket errors will be handled
     // on the read-side in ReceiveThreadProc(). This avoids potential
     // issues related to receiving ICMP port unreachable messages due
     // to sending a packet prior to the host PC binding to that port.
-    int pingCount = 0;
-    while (!PltIsThreadInterrupted(&udpPingThread)) {
-        if (AudioPingPayload.payload[0] != 0) {
-            pingCount++;
-            AudioPingPayload.sequenceNumber = BE32(pingCount);
-
-            sendto(rtpSocket, (char*)&AudioPingPayload, sizeof(AudioPingPayload), 0, (struct sockaddr*)&saddr, AddrLen);
-        }
-        else {
-            sendto(rtpSocket, legacyPingData, sizeof(legacyPingData), 0, (struct sockaddr*)&saddr, AddrLen);
-        }
+    if (AudioPingPayload.payload[0] != 0) {
+        udpPingCount++;
+        AudioPingPayload.sequenceNumber = BE32(udpPingCount);
 
-        PltSleepMsInterruptible(&udpPingThread, 500);
+        sendUdpSocket(rtpSocket, (char*)&AudioPingPayload, sizeof(AudioPingPayload), (struct sockaddr*)&udpPingAddr, AddrLen);
     }
+    else {
+        sendUdpSocket(rtpSocket, legacyPingData, sizeof(legacyPingData), (struct sockaddr*)&udpPingAddr, AddrLen);
+    }
+}
+
+static void startUdpPing(void) {
+    LC_ASSERT(AudioPortNumber != 0);
+
+    memcpy(&udpPingAddr, &RemoteAddr, sizeof(udpPingAddr));
+    SET_PORT(&udpPingAddr, AudioPortNumber);
+    udpPingCount = 0;
+
+    PltInitializeTimer(&udpPingTimer, AudioPingTimerFunc, NULL);
+    PltScheduleTimer(&udpPingTimer, 0, UDP_PING_INTERVAL_MS);
+}
+
+static void stopUdpPing(void) {
+    PltCancelTimer(&udpPingTimer);
+    PltJoinTimer(&udpPingTimer);
 }
 
 // Initialize the audio stream and start
 int initializeAudioStream(void) {
-    LbqInitializeLinkedBlockingQueue(&packetQueue, 30);
+    LbqInitializeLinkedBlockingQueue(&packetQueue, 30, "AudioPacketQueue");
     RtpaInitializeQueue(&rtpAudioQueue);
     lastSeq = 0;
+    currentTimestamp = 0;
     receivedDataFromPeer = false;
-    pingThreadStarted = false;
+    udpPingStarted = false;
     firstReceiveTime = 0;
     audioDecryptionCtx = PltCreateCryptoContext();
 #ifdef LC_DEBUG
@@ -88,15 +99,16 @@ int initializeAudioStream(void) {
 // number is parsed out of it. Alternatively, it's also called if parsing fails
 // and will use the well known audio port instead.
 int notifyAudioPortNegotiationComplete(void) {
-    LC_ASSERT(!pingThreadStarted);
+    LC_ASSERT(!udpPingStarted);
     LC_ASSERT(AudioPortNumber != 0);
 
-    // For GFE 3.22 compatibility, we must start the audio ping thread before the RTSP handshake.
+    // For GFE 3.22 compatibility, we must start the audio ping before the RTSP handshake.
     // It will not reply to our RTSP PLAY request until the audio ping has been received.
     rtpSocket = bindUdpSocket(RemoteAddr.ss_family, &LocalAddr, AddrLen, 0, SOCK_QOS_TYPE_AUDIO);
     if (rtpSocket == INVALID_SOCKET) {
         return LastSocketFail();
     }
+    registerImpairedSocket(rtpSocket, IMPAIR_STREAM_AUDIO);
 
     // Record the time the socket was bound so the receive thread can compute
     // how long packets have been accumulating in the OS buffer and drop them.
@@ -104,12 +116,9 @@ int notifyAudioPortNegotiationComplete(void) {
 
     // We may receive audio before our threads are started, but that's okay. We'll
     // drop the first 1 second of audio packets to catch up with the backlog.
-    int err = PltCreateThread("AudioPing", AudioPingThreadProc, NULL, &udpPingThread);
-    if (err != 0) {
-        return err;
-    }
+    startUdpPing();
 
-    pingThreadStarted = true;
+    udpPingStarted = true;
     return 0;
 }
 
@@ -129,9 +138,8 @@ static void freePacketList(PLINKED_BLOCKING_QUEUE_ENTRY entry) {
 // Tear down the audio stream once we're done with it
 void destroyAudioStream(void) {
     if (rtpSocket != INVALID_SOCKET) {
-        if (pingThreadStarted) {
-            PltInterruptThread(&udpPingThread);
-            PltJoinThread(&udpPingThread);
+        if (udpPingStarted) {
+            stopUdpPing();
         }
 
         closeSocket(rtpSocket);
@@ -168,6 +176,7 @@ static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
     // packet. Trigger packet loss concealment logic in libopus by
     // invoking the decoder with a NULL buffer.
     if (packet->header.size == 0) {
+        currentTimestamp += AudioPacketDuration;
         AudioCallbacks.decodeAndPlaySample(NULL, 0);
         return;
     }
@@ -178,6 +187,7 @@ static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
     }
 
     lastSeq = rtp->sequenceNumber;
+    currentTimestamp = rtp->timestamp;
 
     if (AudioEncryptionEnabled) {
         // We must have room for the AES padding which may be written to the buffer
@@ -240,10 +250,77 @@ static void decodeInputData(PQUEUED_AUDIO_PACKET packet) {
     }
 }
 
+// Hands a received packet to the RTP queue and passes on anything that is ready
+// to be decoded. Returns false if an exit signal was received. The packet is set
+// to NULL if ownership was taken.
+static bool queueAudioPacket(PQUEUED_AUDIO_PACKET* packet) {
+    PRTP_PACKET rtp;
+    int queueStatus;
+
+    rtp = (PRTP_PACKET)&(*packet)->data[0];
+
+    // Convert fields to host byte-order
+    rtp->sequenceNumber = BE16(rtp->sequenceNumber);
+    rtp->timestamp = BE32(rtp->timestamp);
+    rtp->ssrc = BE32(rtp->ssrc);
+
+    LiRecordFlightEvent(FLIGHT_EVENT_AUDIO_PACKET, rtp->sequenceNumber, (*packet)->header.size);
+
+    queueStatus = RtpaAddPacket(&rtpAudioQueue, rtp, (uint16_t)(*packet)->header.size);
+    if (RTPQ_HANDLE_NOW(queueStatus)) {
+        if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
+            if (!queuePacketToLbq(packet)) {
+                // An exit signal was received
+                return false;
+            }
+            else {
+                // Ownership should have been taken by the LBQ
+                LC_ASSERT(*packet == NULL);
+            }
+        }
+        else {
+            decodeInputData(*packet);
+        }
+    }
+    else {
+        if (RTPQ_PACKET_CONSUMED(queueStatus)) {
+            // The queue consumed our packet, so we must allocate a new one
+            *packet = NULL;
+        }
+
+        if (RTPQ_PACKET_READY(queueStatus)) {
+            // If packets are ready, pull them and send them to the decoder
+            uint16_t length;
+            PQUEUED_AUDIO_PACKET queuedPacket;
+            while ((queuedPacket = (PQUEUED_AUDIO_PACKET)RtpaGetQueuedPacket(&rtpAudioQueue, sizeof(QUEUED_AUDIO_PACKET_HEADER), &length)) != NULL) {
+                // Populate header data (not preserved in queued packets)
+                queuedPacket->header.size = length;
+
+                if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
+                    if (!queuePacketToLbq(&queuedPacket)) {
+                        // An exit signal was received
+                        free(queuedPacket);
+                        return false;
+                    }
+                    else {
+                        // Ownership should have been taken by the LBQ
+                        LC_ASSERT(queuedPacket == NULL);
+                    }
+                }
+                else {
+                    decodeInputData(queuedPacket);
+                    free(queuedPacket);
+                }
+            }
+        }
+    }
+
+    return true;
+}
+
 static void AudioReceiveThreadProc(void* context) {
     PRTP_PACKET rtp;
     PQUEUED_AUDIO_PACKET packet;
-    int queueStatus;
     bool useSelect;
     uint32_t packetsToDrop;
     int waitingForAudioMs;
@@ -322,63 +399,11 @@ static void AudioReceiveThreadProc(void* context) {
             continue;
         }
 
-        // Convert fields to host byte-order
-        rtp->sequenceNumber = BE16(rtp->sequenceNumber);
-        rtp->timestamp = BE32(rtp->timestamp);
-        rtp->ssrc = BE32(rtp->ssrc);
-
-        queueStatus = RtpaAddPacket(&rtpAudioQueue, (PRTP_PACKET)&packet->data[0], (uint16_t)packet->header.size);
-        if (RTPQ_HANDLE_NOW(queueStatus)) {
-            if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-                if (!queuePacketToLbq(&packet)) {
-                    // An exit signal was received
-                    break;
-                }
-                else {
-                    // Ownership should have been taken by the LBQ
-                    LC_ASSERT(packet == NULL);
-                }
-            }
-            else {
-                decodeInputData(packet);
-            }
-        }
-        else {
-            if (RTPQ_PACKET_CONSUMED(queueStatus)) {
-                // The queue consumed our packet, so we must allocate a new one
-                packet = NULL;
-            }
+        capturePacket(CAPTURE_STREAM_AUDIO, &packet->data[0], packet->header.size);
 
-            if (RTPQ_PACKET_READY(queueStatus)) {
-                // If packets are ready, pull them and send them to the decoder
-                uint16_t length;
-                PQUEUED_AUDIO_PACKET queuedPacket;
-                while ((queuedPacket = (PQUEUED_AUDIO_PACKET)RtpaGetQueuedPacket(&rtpAudioQueue, sizeof(QUEUED_AUDIO_PACKET_HEADER), &length)) != NULL) {
-                    // Populate header data (not preserved in queued packets)
-                    queuedPacket->header.size = length;
-
-                    if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-                        if (!queuePacketToLbq(&queuedPacket)) {
-                            // An exit signal was received
-                            free(queuedPacket);
-                            break;
-                        }
-                        else {
-                            // Ownership should have been taken by the LBQ
-                            LC_ASSERT(queuedPacket == NULL);
-                        }
-                    }
-                    else {
-                        decodeInputData(queuedPacket);
-                        free(queuedPacket);
-                    }
-                }
-                
-                // Break on exit
-                if (queuedPacket != NULL) {
-                    break;
-                }
-            }
+        if (!queueAudioPacket(&packet)) {
+            // An exit signal was received
+            break;
         }
     }
     
@@ -426,32 +451,41 @@ void stopAudioStream(void) {
     AudioCallbacks.cleanup();
 }
 
-int startAudioStream(void* audioContext, int arFlags) {
-    int err;
-    OPUS_MULTISTREAM_CONFIGURATION chosenConfig;
-
+// Returns the Opus configuration that the audio renderer is initialized with
+void getChosenOpusConfig(POPUS_MULTISTREAM_CONFIGURATION chosenConfig) {
     if (HighQualitySurroundEnabled) {
         LC_ASSERT(HighQualitySurroundSupported);
         LC_ASSERT(HighQualityOpusConfig.channelCount != 0);
         LC_ASSERT(HighQualityOpusConfig.streams != 0);
-        chosenConfig = HighQualityOpusConfig;
+        *chosenConfig = HighQualityOpusConfig;
     }
     else {
         LC_ASSERT(NormalQualityOpusConfig.channelCount != 0);
         LC_ASSERT(NormalQualityOpusConfig.streams != 0);
-        chosenConfig = NormalQualityOpusConfig;
+        *chosenConfig = NormalQualityOpusConfig;
     }
 
-    chosenConfig.samplesPerFrame = 48 * AudioPacketDuration;
+    chosenConfig->samplesPerFrame = 48 * AudioPacketDuration;
+}
+
+static int initializeAudioRenderer(void* audioContext, int arFlags) {
+    OPUS_MULTISTREAM_CONFIGURATION chosenConfig;
 
-    err = AudioCallbacks.init(StreamConfig.audioConfiguration, &chosenConfig, audioContext, arFlags);
+    getChosenOpusConfig(&chosenConfig);
+    return AudioCallbacks.init(StreamConfig.audioConfiguration, &chosenConfig, audioContext, arFlags);
+}
+
+int startAudioStream(void* audioContext, int arFlags) {
+    int err;
+
+    err = initializeAudioRenderer(audioContext, arFlags);
     if (err != 0) {
         return err;
     }
 
     AudioCallbacks.start();
 
-    err = PltCreateThread("AudioRecv", AudioReceiveThreadProc, NULL, &receiveThread);
+    err = PltCreateThread("AudioRecv", THREAD_CLASS_REALTIME_MEDIA, AudioReceiveThreadProc, NULL, &receiveThread);
     if (err != 0) {
         AudioCallbacks.stop();
         closeSocket(rtpSocket);
@@ -460,7 +494,7 @@ int startAudioStream(void* audioContext, int arFlags) {
     }
 
     if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
-        err = PltCreateThread("AudioDec", AudioDecoderThreadProc, NULL, &decoderThread);
+        err = PltCreateThread("AudioDec", THREAD_CLASS_REALTIME_MEDIA, AudioDecoderThreadProc, NULL, &decoderThread);
         if (err != 0) {
             AudioCallbacks.stop();
             PltInterruptThread(&receiveThread);
@@ -474,6 +508,61 @@ int startAudioStream(void* audioContext, int arFlags) {
     return 0;
 }
 
+// Start the audio stream without sockets to replay a packet capture
+int startAudioReplay(void* audioContext, int arFlags) {
+    int err;
+
+    err = initializeAudioRenderer(audioContext, arFlags);
+    if (err != 0) {
+        return err;
+    }
+
+    AudioCallbacks.start();
+
+    if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
+        err = PltCreateThread("AudioDec", THREAD_CLASS_REALTIME_MEDIA, AudioDecoderThreadProc, NULL, &decoderThread);
+        if (err != 0) {
+            AudioCallbacks.stop();
+            AudioCallbacks.cleanup();
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+void stopAudioReplay(void) {
+    AudioCallbacks.stop();
+
+    if ((AudioCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
+        // Let the decoder finish the queued packets
+        LbqSignalQueueDrain(&packetQueue);
+        PltJoinThread(&decoderThread);
+    }
+
+    AudioCallbacks.cleanup();
+}
+
+// Feeds a captured audio packet to the RTP queue as the receive thread would
+void replayAudioPacket(const char* data, int length) {
+    PQUEUED_AUDIO_PACKET packet;
+
+    if (length < (int)sizeof(RTP_PACKET) || length > MAX_PACKET_SIZE) {
+        return;
+    }
+
+    packet = (PQUEUED_AUDIO_PACKET)malloc(sizeof(*packet));
+    if (packet == NULL) {
+        return;
+    }
+
+    memcpy(&packet->data[0], data, length);
+    packet->header.size = length;
+
+    queueAudioPacket(&packet);
+    free(packet);
+}
+
 int LiGetPendingAudioFrames(void) {
     return LbqGetItemCount(&packetQueue);
 }
@@ -481,3 +570,7 @@ int LiGetPendingAudioFrames(void) {
 int LiGetPendingAudioDuration(void) {
     return LiGetPendingAudioFrames() * AudioPacketDuration;
 }
+
+uint32_t LiGetCurrentAudioTimestamp(void) {
+    return currentTimestamp;
+}
@@ -0,0 +1,599 @@
+#include "Limelight-internal.h"
+
+// This parses just enough of the AV1 bitstream (OBU headers, sequence headers,
+// and the start of frame headers) to classify frames. Section numbers refer
+// to the AV1 Bitstream & Decoding Process Specification.
+
+typedef struct _BIT_READER {
+    const uint8_t* data;
+    uint32_t length;
+    uint32_t bitPosition;
+    bool overrun;
+} BIT_READER, *PBIT_READER;
+
+static void initializeBitReader(PBIT_READER reader, const char* data, int length) {
+    reader->data = (const uint8_t*)data;
+    reader->length = (uint32_t)length;
+    reader->bitPosition = 0;
+    reader->overrun = false;
+}
+
+// f(n) in the specification
+static uint32_t readBits(PBIT_READER reader, int n) {
+    uint32_t value = 0;
+
+    LC_ASSERT(n <= 32);
+
+    for (int i = 0; i < n; i++) {
+        if (reader->bitPosition >= reader->length * 8) {
+            reader->overrun = true;
+            return 0;
+        }
+
+        uint8_t byte = reader->data[reader->bitPosition / 8];
+        value = (value << 1) | ((byte >> (7 - (reader->bitPosition % 8))) & 1);
+        reader->bitPosition++;
+    }
+
+    return value;
+}
+
+static bool readFlag(PBIT_READER reader) {
+    return readBits(reader, 1) != 0;
+}
+
+// uvlc() in section 4.10.3
+static uint32_t readUvlc(PBIT_READER reader) {
+    int leadingZeros = 0;
+
+    while (!reader->overrun && !readFlag(reader)) {
+        leadingZeros++;
+    }
+
+    if (leadingZeros >= 32) {
+        return UINT32_MAX;
+    }
+
+    return readBits(reader, leadingZeros) + (uint32_t)((1ULL << leadingZeros) - 1);
+}
+
+// leb128() in section 4.10.5. Returns the number of bytes consumed or 0 on failure.
+static int readLeb128(const uint8_t* data, uint32_t length, uint32_t* value) {
+    uint64_t result = 0;
+
+    for (uint32_t i = 0; i < 8 && i < length; i++) {
+        result |= (uint64_t)(data[i] & 0x7F) << (i * 7);
+        if (!(data[i] & 0x80)) {
+            if (result > UINT32_MAX) {
+                return 0;
+            }
+            *value = (uint32_t)result;
+            return (int)i + 1;
+        }
+    }
+
+    return 0;
+}
+
+typedef struct _AV1_OBU_HEADER {
+    int type;
+    uint8_t temporalId;
+    uint8_t spatialId;
+    uint32_t headerLength;
+
+    // Length of the payload that follows the header
+    uint32_t payloadLength;
+} AV1_OBU_HEADER, *PAV1_OBU_HEADER;
+
+// obu_header() and obu_size in section 5.3. OBUs without a size field extend to the
+// end of the data. Returns false if the header isn't entirely contained in the data.
+static bool parseObuHeader(const uint8_t* data, uint32_t length, PAV1_OBU_HEADER obu) {
+    uint32_t offset = 1;
+
+    if (length < 1 || (data[0] & 0x80)) {
+        return false;
+    }
+
+    obu->type = (data[0] >> 3) & 0xF;
+    obu->temporalId = 0;
+    obu->spatialId = 0;
+
+    if (data[0] & 0x04) {
+        if (length < 2) {
+            return false;
+        }
+        obu->temporalId = (data[1] >> 5) & 0x7;
+        obu->spatialId = (data[1] >> 3) & 0x3;
+        offset++;
+    }
+
+    if (data[0] & 0x02) {
+        int sizeLength = readLeb128(&data[offset], length - offset, &obu->payloadLength);
+        if (sizeLength == 0) {
+            return false;
+        }
+        offset += sizeLength;
+    }
+    else {
+        obu->payloadLength = length - offset;
+    }
+
+    obu->headerLength = offset;
+    return true;
+}
+
+// color_config() in section 5.5.2
+static void parseColorConfig(PBIT_READER reader, PAV1_SEQUENCE_INFO info) {
+    bool highBitdepth = readFlag(reader);
+    if (info->profile == 2 && highBitdepth) {
+        info->bitDepth = readFlag(reader) ? 12 : 10;
+    }
+    else {
+        info->bitDepth = highBitdepth ? 10 : 8;
+    }
+
+    info->monochrome = info->profile == 1 ? false : readFlag(reader);
+
+    if (readFlag(reader)) {
+        info->colorPrimaries = (uint8_t)readBits(reader, 8);
+        info->transferCharacteristics = (uint8_t)readBits(reader, 8);
+        info->matrixCoefficients = (uint8_t)readBits(reader, 8);
+    }
+    else {
+        // CP_UNSPECIFIED, TC_UNSPECIFIED, and MC_UNSPECIFIED
+        info->colorPrimaries = 2;
+        info->transferCharacteristics = 2;
+        info->matrixCoefficients = 2;
+    }
+
+    info->chromaSamplePosition = 0;
+
+    if (info->monochrome) {
+        info->fullRange = readFlag(reader);
+        info->subsamplingX = info->subsamplingY = 1;
+        return;
+    }
+    else if (info->colorPrimaries == 1 && info->transferCharacteristics == 13 && info->matrixCoefficients == 0) {
+        // sRGB
+        info->fullRange = true;
+        info->subsamplingX = info->subsamplingY = 0;
+    }
+    else {
+        info->fullRange = readFlag(reader);
+        if (info->profile == 0) {
+            info->subsamplingX = info->subsamplingY = 1;
+        }
+        else if (info->profile == 1) {
+            info->subsamplingX = info->subsamplingY = 0;
+        }
+        else if (info->bitDepth == 12) {
+            info->subsamplingX = readFlag(reader);
+            info->subsamplingY = info->subsamplingX ? readFlag(reader) : 0;
+        }
+        else {
+            info->subsamplingX = 1;
+            info->subsamplingY = 0;
+        }
+
+        if (info->subsamplingX && info->subsamplingY) {
+            info->chromaSamplePosition = (uint8_t)readBits(reader, 2);
+        }
+    }
+
+    // separate_uv_delta_q
+    readFlag(reader);
+}
+
+// sequence_header_obu() in section 5.5.1
+static bool parseSequenceHeader(const char* data, int length, PAV1_SEQUENCE_HEADER seq) {
+    BIT_READER reader;
+    PAV1_SEQUENCE_INFO info = &seq->info;
+    uint8_t bufferDelayLength = 0;
+
+    memset(seq, 0, sizeof(*seq));
+    initializeBitReader(&reader, data, length);
+
+    info->profile = (uint8_t)readBits(&reader, 3);
+    readFlag(&reader); // still_picture
+    seq->reducedStillPictureHeader = readFlag(&reader);
+
+    if (seq->reducedStillPictureHeader) {
+        seq->operatingPointCount = 1;
+        info->level = (uint8_t)readBits(&reader, 5);
+    }
+    else {
+        bool initialDisplayDelayPresent;
+
+        if (readFlag(&reader)) {
+            // timing_info()
+            readBits(&reader, 32); // num_units_in_display_tick
+            readBits(&reader, 32); // time_scale
+            seq->equalPictureInterval = readFlag(&reader);
+            if (seq->equalPictureInterval) {
+                readUvlc(&reader); // num_ticks_per_picture_minus_1
+            }
+
+            seq->decoderModelInfoPresent = readFlag(&reader);
+            if (seq->decoderModelInfoPresent) {
+                // decoder_model_info()
+                bufferDelayLength = (uint8_t)readBits(&reader, 5) + 1;
+                readBits(&reader, 32); // num_units_in_decoding_tick
+                seq->bufferRemovalTimeLength = (uint8_t)readBits(&reader, 5) + 1;
+                seq->framePresentationTimeLength = (uint8_t)readBits(&reader, 5) + 1;
+            }
+        }
+
+        initialDisplayDelayPresent = readFlag(&reader);
+        seq->operatingPointCount = (uint8_t)readBits(&reader, 5) + 1;
+        for (int i = 0; i < seq->operatingPointCount; i++) {
+            uint8_t levelIdx, tier = 0;
+
+            seq->operatingPointIdc[i] = (uint16_t)readBits(&reader, 12);
+            levelIdx = (uint8_t)readBits(&reader, 5);
+            if (levelIdx > 7) {
+                tier = (uint8_t)readBits(&reader, 1);
+            }
+
+            if (i == 0) {
+                info->level = levelIdx;
+                info->tier = tier;
+            }
+
+            if (seq->decoderModelInfoPresent) {
+                seq->decoderModelPresentForOp[i] = readFlag(&reader);
+                if (seq->decoderModelPresentForOp[i]) {
+                    // operating_parameters_info()
+                    readBits(&reader, bufferDelayLength); // decoder_buffer_delay
+                    readBits(&reader, bufferDelayLength); // encoder_buffer_delay
+                    readFlag(&reader); // low_delay_mode_flag
+                }
+            }
+
+            if (initialDisplayDelayPresent && readFlag(&reader)) {
+                readBits(&reader, 4); // initial_display_delay_minus_1
+            }
+        }
+    }
+
+    int frameWidthBits = (int)readBits(&reader, 4) + 1;
+    int frameHeightBits = (int)readBits(&reader, 4) + 1;
+    info->maxWidth = readBits(&reader, frameWidthBits) + 1;
+    info->maxHeight = readBits(&reader, frameHeightBits) + 1;
+
+    if (!seq->reducedStillPictureHeader) {
+        seq->frameIdNumbersPresent = readFlag(&reader);
+    }
+    if (seq->frameIdNumbersPresent) {
+        uint8_t deltaFrameIdLength = (uint8_t)readBits(&reader, 4) + 2;
+        seq->frameIdLength = (uint8_t)readBits(&reader, 3) + 1 + deltaFrameIdLength;
+    }
+
+    readFlag(&reader); // use_128x128_superblock
+    readFlag(&reader); // enable_filter_intra
+    readFlag(&reader); // enable_intra_edge_filter
+
+    // SELECT_SCREEN_CONTENT_TOOLS and SELECT_INTEGER_MV
+    seq->forceScreenContentTools = 2;
+    seq->forceIntegerMv = 2;
+
+    if (!seq->reducedStillPictureHeader) {
+        bool enableOrderHint;
+
+        readFlag(&reader); // enable_interintra_compound
+        readFlag(&reader); // enable_masked_compound
+        readFlag(&reader); // enable_warped_motion
+        readFlag(&reader); // enable_dual_filter
+        enableOrderHint = readFlag(&reader);
+        if (enableOrderHint) {
+            readFlag(&reader); // enable_jnt_comp
+            readFlag(&reader); // enable_ref_frame_mvs
+        }
+
+        if (!readFlag(&reader)) {
+            seq->forceScreenContentTools = (uint8_t)readBits(&reader, 1);
+        }
+        if (seq->forceScreenContentTools > 0) {
+            if (!readFlag(&reader)) {
+                seq->forceIntegerMv = (uint8_t)readBits(&reader, 1);
+            }
+        }
+
+        if (enableOrderHint) {
+            seq->orderHintBits = (uint8_t)readBits(&reader, 3) + 1;
+        }
+    }
+
+    readFlag(&reader); // enable_superres
+    readFlag(&reader); // enable_cdef
+    readFlag(&reader); // enable_restoration
+
+    parseColorConfig(&reader, info);
+
+    readFlag(&reader); // film_grain_params_present
+
+    return !reader.overrun;
+}
+
+bool LiParseAv1SequenceHeader(const char* data, int length, PAV1_SEQUENCE_INFO info) {
+    AV1_OBU_HEADER obu;
+    AV1_SEQUENCE_HEADER seq;
+
+    if (!parseObuHeader((const uint8_t*)data, (uint32_t)length, &obu) ||
+            obu.type != AV1_OBU_SEQUENCE_HEADER ||
+            obu.headerLength + obu.payloadLength > (uint32_t)length) {
+        return false;
+    }
+
+    if (!parseSequenceHeader(&data[obu.headerLength], (int)obu.payloadLength, &seq)) {
+        return false;
+    }
+
+    *info = seq.info;
+    return true;
+}
+
+void av1InitializeParser(PAV1_PARSER parser) {
+    memset(parser, 0, sizeof(*parser));
+    memset(parser->refFrameType, -1, sizeof(parser->refFrameType));
+}
+
+void av1BeginTemporalUnit(PAV1_PARSER parser) {
+    // If the previous temporal unit was never completed, we don't know which
+    // reference slots it refreshed.
+    if (parser->inTemporalUnit) {
+        memset(parser->refFrameType, -1, sizeof(parser->refFrameType));
+    }
+
+    parser->inTemporalUnit = true;
+    parser->obuBytesRemaining = 0;
+    parser->scanFailed = false;
+    parser->frameHeaderCount = 0;
+    parser->allNonReference = true;
+    parser->allShowExisting = true;
+    parser->sequenceChanged = false;
+}
+
+// The start of uncompressed_header() in section 5.9.2, up to refresh_frame_flags
+static bool parseFrameHeader(PAV1_PARSER parser, PAV1_OBU_HEADER obu, const char* data, int length) {
+    PAV1_SEQUENCE_HEADER seq = &parser->seq;
+    BIT_READER reader;
+    int frameType;
+    bool showFrame, errorResilientMode, frameIsIntra;
+    uint8_t refreshFrameFlags;
+
+    initializeBitReader(&reader, data, length);
+
+    if (seq->reducedStillPictureHeader) {
+        frameType = AV1_KEY_FRAME;
+        showFrame = true;
+        errorResilientMode = true;
+    }
+    else {
+        if (readFlag(&reader)) {
+            // show_existing_frame
+            int frameToShow = (int)readBits(&reader, 3);
+            if (reader.overrun) {
+                return false;
+            }
+
+            // Showing an existing key frame refreshes every reference slot with it,
+            // so only other frame types can be skipped.
+            if (parser->refFrameType[frameToShow] != AV1_INTER_FRAME &&
+                    parser->refFrameType[frameToShow] != AV1_INTRA_ONLY_FRAME) {
+                parser->allNonReference = false;
+            }
+            if (parser->refFrameType[frameToShow] == AV1_KEY_FRAME) {
+                memset(parser->refFrameType, AV1_KEY_FRAME, sizeof(parser->refFrameType));
+            }
+            return true;
+        }
+
+        frameType = (int)readBits(&reader, 2);
+        showFrame = readFlag(&reader);
+        if (showFrame && seq->decoderModelInfoPresent && !seq->equalPictureInterval) {
+            readBits(&reader, seq->framePresentationTimeLength); // frame_presentation_time
+        }
+        if (!showFrame) {
+            readFlag(&reader); // showable_frame
+        }
+        if (frameType == AV1_SWITCH_FRAME || (frameType == AV1_KEY_FRAME && showFrame)) {
+            errorResilientMode = true;
+        }
+        else {
+            errorResilientMode = readFlag(&reader);
+        }
+    }
+
+    parser->allShowExisting = false;
+    frameIsIntra = frameType == AV1_INTRA_ONLY_FRAME || frameType == AV1_KEY_FRAME;
+
+    if (frameType == AV1_SWITCH_FRAME || (frameType == AV1_KEY_FRAME && showFrame)) {
+        refreshFrameFlags = 0xFF;
+    }
+    else {
+        bool allowScreenContentTools;
+
+        readFlag(&reader); // disable_cdf_update
+
+        if (seq->forceScreenContentTools == 2) {
+            allowScreenContentTools = readFlag(&reader);
+        }
+        else {
+            allowScreenContentTools = seq->forceScreenContentTools != 0;
+        }
+        if (allowScreenContentTools && seq->forceIntegerMv == 2) {
+            readFlag(&reader); // force_integer_mv
+        }
+
+        if (seq->frameIdNumbersPresent) {
+            readBits(&reader, seq->frameIdLength); // current_frame_id
+        }
+
+        if (!seq->reducedStillPictureHeader) {
+            readFlag(&reader); // frame_size_override_flag
+        }
+
+        readBits(&reader, seq->orderHintBits); // order_hint
+
+        if (!frameIsIntra && !errorResilientMode) {
+            readBits(&reader, 3); // primary_ref_frame
+        }
+
+        if (seq->decoderModelInfoPresent && readFlag(&reader)) {
+            // buffer_removal_time_present_flag
+            for (int i = 0; i < seq->operatingPointCount; i++) {
+                if (seq->decoderModelPresentForOp[i]) {
+                    uint16_t idc = seq->operatingPointIdc[i];
+                    bool inTemporalLayer = (idc >> obu->temporalId) & 1;
+                    bool inSpatialLayer = (idc >> (obu->spatialId + 8)) & 1;
+                    if (idc == 0 || (inTemporalLayer && inSpatialLayer)) {
+                        readBits(&reader, seq->bufferRemovalTimeLength); // buffer_removal_time
+                    }
+                }
+            }
+        }
+
+        refreshFrameFlags = (uint8_t)readBits(&reader, 8);
+    }
+
+    if (reader.overrun) {
+        return false;
+    }
+
+    if (refreshFrameFlags != 0) {
+        parser->allNonReference = false;
+    }
+    for (int i = 0; i < AV1_NUM_REF_FRAMES; i++) {
+        if (refreshFrameFlags & (1 << i)) {
+            parser->refFrameType[i] = (int8_t)frameType;
+        }
+    }
+
+    return true;
+}
+
+static void handleSequenceHeader(PAV1_PARSER parser, PAV1_OBU_HEADER obu, const char* data) {
+    AV1_SEQUENCE_HEADER seq;
+    int obuLength = (int)(obu->headerLength + obu->payloadLength);
+
+    if (!parseSequenceHeader(&data[obu->headerLength], (int)obu->payloadLength, &seq)) {
+        parser->scanFailed = true;
+        return;
+    }
+
+    // Sequence headers are repeated with every key frame, so compare the
+    // entire OBU to detect an actual change.
+    if (!parser->hasSequenceHeader ||
+            obuLength != parser->sequenceHeaderObuLength ||
+            memcmp(data, parser->sequenceHeaderObu, obuLength) != 0) {
+        if (parser->hasSequenceHeader) {
+            parser->sequenceChanged = true;
+        }
+
+        if (obuLength <= AV1_MAX_SEQUENCE_HEADER_SIZE) {
+            memcpy(parser->sequenceHeaderObu, data, obuLength);
+            parser->sequenceHeaderObuLength = obuLength;
+        }
+        else {
+            parser->sequenceHeaderObuLength = 0;
+        }
+    }
+
+    parser->seq = seq;
+    parser->hasSequenceHeader = true;
+}
+
+void av1ScanTemporalUnit(PAV1_PARSER parser, const char* data, int length,
+                         int* seqHdrOffset, int* seqHdrLength) {
+    uint32_t offset = 0;
+
+    *seqHdrOffset = -1;
+    *seqHdrLength = 0;
+
+    while (!parser->scanFailed && offset < (uint32_t)length) {
+        AV1_OBU_HEADER obu;
+        uint32_t available;
+
+        // Skip the rest of an OBU that started in an earlier packet
+        if (parser->obuBytesRemaining > 0) {
+            uint32_t skip = parser->obuBytesRemaining;
+            if (skip > (uint32_t)length - offset) {
+                skip = (uint32_t)length - offset;
+            }
+            parser->obuBytesRemaining -= skip;
+            offset += skip;
+            continue;
+        }
+
+        // OBUs without a size field would extend into the FEC padding, and headers
+        // split across packets aren't worth reassembling. Either way, we just
+        // stop classifying this temporal unit.
+        if (!parseObuHeader((const uint8_t*)&data[offset], (uint32_t)length - offset, &obu) ||
+                !(data[offset] & 0x02)) {
+            parser->scanFailed = true;
+            break;
+        }
+
+        available = (uint32_t)length - offset - obu.headerLength;
+
+        switch (obu.type) {
+        case AV1_OBU_SEQUENCE_HEADER:
+            if (obu.payloadLength > available) {
+                parser->scanFailed = true;
+                break;
+            }
+            handleSequenceHeader(parser, &obu, &data[offset]);
+            if (!parser->scanFailed) {
+                *seqHdrOffset = (int)offset;
+                *seqHdrLength = (int)(obu.headerLength + obu.payloadLength);
+            }
+            break;
+
+        case AV1_OBU_FRAME_HEADER:
+        case AV1_OBU_FRAME:
+            // We can't parse frame headers until we've seen a sequence header
+            if (!parser->hasSequenceHeader ||
+                    !parseFrameHeader(parser, &obu, &data[offset + obu.headerLength],
+                                      (int)(obu.payloadLength < available ? obu.payloadLength : available))) {
+                parser->scanFailed = true;
+                break;
+            }
+            parser->frameHeaderCount++;
+            break;
+
+        default:
+            break;
+        }
+
+        offset += obu.headerLength;
+        parser->obuBytesRemaining = obu.payloadLength;
+    }
+}
+
+uint8_t av1EndTemporalUnit(PAV1_PARSER parser) {
+    uint8_t flags = 0;
+
+    parser->inTemporalUnit = false;
+
+    if (parser->sequenceChanged) {
+        flags |= FRAME_FLAG_SEQUENCE_CHANGED;
+    }
+
+    // Without a complete picture of the temporal unit, it must be treated as a
+    // regular frame. Reference slots it may have refreshed are now unknown.
+    if (parser->scanFailed || parser->frameHeaderCount == 0) {
+        if (parser->scanFailed) {
+            memset(parser->refFrameType, -1, sizeof(parser->refFrameType));
+        }
+        return flags;
+    }
+
+    if (parser->allShowExisting) {
+        flags |= FRAME_FLAG_SHOW_EXISTING;
+    }
+    if (parser->allNonReference) {
+        flags |= FRAME_FLAG_NON_REFERENCE;
+    }
+
+    return flags;
+}
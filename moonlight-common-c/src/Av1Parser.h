@@ -0,0 +1,79 @@
+#pragma once
+
+#include "Limelight.h"
+
+// OBU types (AV1 spec section 6.2.2)
+#define AV1_OBU_SEQUENCE_HEADER        1
+#define AV1_OBU_TEMPORAL_DELIMITER     2
+#define AV1_OBU_FRAME_HEADER           3
+#define AV1_OBU_TILE_GROUP             4
+#define AV1_OBU_METADATA               5
+#define AV1_OBU_FRAME                  6
+#define AV1_OBU_REDUNDANT_FRAME_HEADER 7
+#define AV1_OBU_TILE_LIST              8
+#define AV1_OBU_PADDING                15
+
+// Frame types (AV1 spec section 6.8.2)
+#define AV1_KEY_FRAME        0
+#define AV1_INTER_FRAME      1
+#define AV1_INTRA_ONLY_FRAME 2
+#define AV1_SWITCH_FRAME     3
+
+#define AV1_NUM_REF_FRAMES 8
+#define AV1_MAX_OPERATING_POINTS 32
+
+// Sequence headers are a few dozen bytes in practice. Larger ones are
+// still parsed, but aren't cached for change detection.
+#define AV1_MAX_SEQUENCE_HEADER_SIZE 256
+
+// The subset of the sequence header needed to parse frame headers
+typedef struct _AV1_SEQUENCE_HEADER {
+    AV1_SEQUENCE_INFO info;
+
+    bool reducedStillPictureHeader;
+    bool decoderModelInfoPresent;
+    bool equalPictureInterval;
+    uint8_t bufferRemovalTimeLength;
+    uint8_t framePresentationTimeLength;
+    uint8_t operatingPointCount;
+    uint16_t operatingPointIdc[AV1_MAX_OPERATING_POINTS];
+    bool decoderModelPresentForOp[AV1_MAX_OPERATING_POINTS];
+    bool frameIdNumbersPresent;
+    uint8_t frameIdLength;
+    uint8_t forceScreenContentTools;
+    uint8_t forceIntegerMv;
+    uint8_t orderHintBits;
+} AV1_SEQUENCE_HEADER, *PAV1_SEQUENCE_HEADER;
+
+// Tracks the bitstream state across the temporal units (frames) of a session.
+// The depacketizer feeds it each packet of a frame in order.
+typedef struct _AV1_PARSER {
+    AV1_SEQUENCE_HEADER seq;
+    bool hasSequenceHeader;
+    uint8_t sequenceHeaderObu[AV1_MAX_SEQUENCE_HEADER_SIZE];
+    int sequenceHeaderObuLength;
+
+    // Frame type last stored in each reference slot, or -1 if unknown
+    int8_t refFrameType[AV1_NUM_REF_FRAMES];
+
+    // State of the temporal unit being scanned
+    bool inTemporalUnit;
+    uint32_t obuBytesRemaining;
+    bool scanFailed;
+    int frameHeaderCount;
+    bool allNonReference;
+    bool allShowExisting;
+    bool sequenceChanged;
+} AV1_PARSER, *PAV1_PARSER;
+
+void av1InitializeParser(PAV1_PARSER parser);
+void av1BeginTemporalUnit(PAV1_PARSER parser);
+
+// Scans the OBUs in the next chunk of the temporal unit. If a complete sequence header
+// OBU is found, its offset and length within the chunk are returned so the caller can
+// split it into its own buffer. Otherwise *seqHdrOffset is set to -1.
+void av1ScanTemporalUnit(PAV1_PARSER parser, const char* data, int length,
+                         int* seqHdrOffset, int* seqHdrLength);
+
+// Returns the FRAME_FLAG_* values for the temporal unit that was just scanned
+uint8_t av1EndTemporalUnit(PAV1_PARSER parser);
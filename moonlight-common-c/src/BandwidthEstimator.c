@@ -0,0 +1,439 @@
+#include "Limelight-internal.h"
+
+// The estimator follows the video packets as they arrive. Packets with the same
+// RTP timestamp belong to one frame, which the host sends as a burst. How far
+// apart a frame's packets arrive gives the rate the path delivered them at
+// (packet dispersion), and how the arrival of each frame moves against its
+// timestamp gives the change in queueing delay (delay gradient). Timestamps are
+// taken when frames are captured, so the variation of the encoding time adds
+// noise, which the trend line over several frames averages out.
+//
+// The estimate is updated by the video receive thread once per frame, and readers
+// copy the published estimate under a lock.
+
+// Frames in the trend line of the queueing delay
+#define BWE_TREND_FRAMES 20
+
+// Smoothing of the relative delay of each frame
+#define BWE_DELAY_SMOOTHING 0.9
+
+// The queueing delay must grow or shrink by this much per second, for this long,
+// to report overuse or underuse of the path
+#define BWE_GRADIENT_THRESHOLD_MS_PER_S 20.0
+#define BWE_OVERUSE_TIME_US 100000
+
+// While overusing, the stream should back off to this share of the received bitrate
+#define BWE_OVERUSE_BACKOFF 0.85
+
+// The lowest delay is kept over two windows of this length, so clock drift and
+// route changes eventually age out of it
+#define BWE_BASE_DELAY_WINDOW_US 5000000
+
+// Frames of at least this many packets, arriving over at least this long, are
+// dispersion samples. Shorter trains are mostly timer resolution.
+#define BWE_DISPERSION_MIN_PACKETS 4
+#define BWE_DISPERSION_MIN_US 200
+#define BWE_DISPERSION_SAMPLES 31
+
+// Window of the received bitrate and the recent loss rate
+#define BWE_RATE_WINDOW_US 1000000
+
+// Larger sequence jumps are a restarted stream rather than a loss
+#define BWE_MAX_SEQUENCE_GAP 1000
+
+// Packets are counted as lost once this many newer packets arrived, so packets
+// that were reordered by less than that aren't
+#define BWE_REORDER_WINDOW 64
+
+typedef struct _PACKET_GROUP {
+    // The RTP timestamp since the first frame, extended to 64 bits
+    uint64_t timestamp;
+    uint64_t firstArrivalUs;
+    uint64_t lastArrivalUs;
+    uint32_t packets;
+
+    // Bytes of the packets after the first, which arrived during the dispersion
+    uint32_t trainBytes;
+} PACKET_GROUP, *PPACKET_GROUP;
+
+static bool estimatorActive;
+static PLT_MUTEX estimateLock;
+static BANDWIDTH_ESTIMATE publishedEstimate;
+static bool estimatePublished;
+
+// The state below is only used by the video receive thread
+static PACKET_GROUP currentGroup;
+static bool haveGroup;
+static uint32_t lastTimestamp;
+static uint64_t streamStartUs;
+
+static double smoothedDelayMs;
+static double trendTimeMs[BWE_TREND_FRAMES];
+static double trendDelayMs[BWE_TREND_FRAMES];
+static int trendCount;
+static int trendNext;
+static double baseDelayMs[2];
+static uint64_t baseWindowStartUs;
+
+static uint32_t dispersionKbps[BWE_DISPERSION_SAMPLES];
+static int dispersionCount;
+static int dispersionNext;
+
+static int congestionState;
+static uint64_t gradientStartUs;
+static int gradientSign;
+
+static bool haveSequence;
+static uint16_t highestSequence;
+static uint64_t receivedMask;
+static uint32_t currentLossBurst;
+static uint32_t skippedPackets;
+static uint64_t receivedPackets;
+static uint64_t lostPackets;
+static uint32_t lossBursts;
+static uint32_t maxLossBurst;
+static uint64_t burstLostPackets;
+
+static uint64_t windowStartUs;
+static uint64_t windowBytes;
+static uint32_t windowPackets;
+static uint32_t windowLostPackets;
+static uint32_t receivedKbps;
+static float windowLossPercent;
+
+bool LiGetBandwidthEstimate(PBANDWIDTH_ESTIMATE estimate) {
+    bool active = estimatorActive;
+    bool published;
+
+    // The estimate only changes during a connection
+    if (active) {
+        PltLockMutex(&estimateLock);
+    }
+
+    published = estimatePublished;
+    if (published) {
+        *estimate = publishedEstimate;
+    }
+
+    if (active) {
+        PltUnlockMutex(&estimateLock);
+    }
+
+    return published;
+}
+
+static int compareKbps(const void* a, const void* b) {
+    uint32_t kbpsA = *(const uint32_t*)a;
+    uint32_t kbpsB = *(const uint32_t*)b;
+
+    return kbpsA < kbpsB ? -1 : (kbpsA > kbpsB ? 1 : 0);
+}
+
+static uint32_t getCapacityKbps(void) {
+    uint32_t sorted[BWE_DISPERSION_SAMPLES];
+
+    if (dispersionCount == 0) {
+        return 0;
+    }
+
+    // The median rejects trains that were split or compressed by cross traffic
+    memcpy(sorted, dispersionKbps, dispersionCount * sizeof(sorted[0]));
+    qsort(sorted, dispersionCount, sizeof(sorted[0]), compareKbps);
+    return sorted[dispersionCount / 2];
+}
+
+// Returns the slope of the least squares line through the smoothed delays, in ms per second
+static double getDelayGradient(void) {
+    double meanTime = 0, meanDelay = 0;
+    double numerator = 0, denominator = 0;
+    int i;
+
+    for (i = 0; i < trendCount; i++) {
+        meanTime += trendTimeMs[i];
+        meanDelay += trendDelayMs[i];
+    }
+    meanTime /= trendCount;
+    meanDelay /= trendCount;
+
+    for (i = 0; i < trendCount; i++) {
+        numerator += (trendTimeMs[i] - meanTime) * (trendDelayMs[i] - meanDelay);
+        denominator += (trendTimeMs[i] - meanTime) * (trendTimeMs[i] - meanTime);
+    }
+
+    return denominator > 0 ? numerator / denominator * 1000 : 0;
+}
+
+static void updateCongestionState(double gradient, uint64_t nowUs) {
+    int sign = 0;
+    int newState;
+
+    if (gradient > BWE_GRADIENT_THRESHOLD_MS_PER_S) {
+        sign = 1;
+    }
+    else if (gradient < -BWE_GRADIENT_THRESHOLD_MS_PER_S) {
+        sign = -1;
+    }
+
+    if (sign != gradientSign) {
+        gradientSign = sign;
+        gradientStartUs = nowUs;
+    }
+
+    // A growing delay must last before it's reported, since single frames that
+    // took longer to encode look like a short rise
+    if (sign > 0) {
+        newState = nowUs - gradientStartUs >= BWE_OVERUSE_TIME_US ? CONGESTION_STATE_OVERUSE : congestionState;
+    }
+    else if (sign < 0) {
+        newState = CONGESTION_STATE_UNDERUSE;
+    }
+    else {
+        newState = CONGESTION_STATE_NORMAL;
+    }
+
+    if (newState != congestionState) {
+        congestionState = newState;
+        LiRecordFlightEvent(FLIGHT_EVENT_CONGESTION_STATE, newState, receivedKbps);
+    }
+}
+
+// Updates the estimate with a frame whose packets have all arrived
+static void processGroup(PPACKET_GROUP group) {
+    BANDWIDTH_ESTIMATE estimate;
+    uint64_t dispersionUs = group->lastArrivalUs - group->firstArrivalUs;
+    double delayMs;
+    double gradient = 0;
+
+    if (group->packets >= BWE_DISPERSION_MIN_PACKETS && dispersionUs >= BWE_DISPERSION_MIN_US) {
+        dispersionKbps[dispersionNext] = (uint32_t)((uint64_t)group->trainBytes * 8 * 1000 / dispersionUs);
+        dispersionNext = (dispersionNext + 1) % BWE_DISPERSION_SAMPLES;
+        if (dispersionCount < BWE_DISPERSION_SAMPLES) {
+            dispersionCount++;
+        }
+    }
+
+    // The delay of the first packet leaves out the time the burst itself takes to
+    // send. It's relative to an unknown clock offset, which cancels out in both the
+    // queueing delay and its gradient.
+    delayMs = (group->firstArrivalUs - streamStartUs) / 1000.0 - group->timestamp / 90.0;
+    if (trendCount == 0) {
+        smoothedDelayMs = delayMs;
+        baseDelayMs[0] = baseDelayMs[1] = delayMs;
+        baseWindowStartUs = group->firstArrivalUs;
+    }
+    else {
+        smoothedDelayMs = BWE_DELAY_SMOOTHING * smoothedDelayMs + (1 - BWE_DELAY_SMOOTHING) * delayMs;
+    }
+
+    if (group->firstArrivalUs - baseWindowStartUs >= BWE_BASE_DELAY_WINDOW_US) {
+        baseDelayMs[1] = baseDelayMs[0];
+        baseDelayMs[0] = delayMs;
+        baseWindowStartUs = group->firstArrivalUs;
+    }
+    else if (delayMs < baseDelayMs[0]) {
+        baseDelayMs[0] = delayMs;
+    }
+
+    trendTimeMs[trendNext] = (group->firstArrivalUs - streamStartUs) / 1000.0;
+    trendDelayMs[trendNext] = smoothedDelayMs;
+    trendNext = (trendNext + 1) % BWE_TREND_FRAMES;
+    if (trendCount < BWE_TREND_FRAMES) {
+        trendCount++;
+    }
+    if (trendCount >= BWE_TREND_FRAMES / 2) {
+        gradient = getDelayGradient();
+        updateCongestionState(gradient, group->lastArrivalUs);
+    }
+
+    if (group->lastArrivalUs - windowStartUs >= BWE_RATE_WINDOW_US) {
+        receivedKbps = (uint32_t)(windowBytes * 8 * 1000 / (group->lastArrivalUs - windowStartUs));
+        windowLossPercent = windowPackets + windowLostPackets != 0 ?
+            (float)windowLostPackets * 100 / (windowPackets + windowLostPackets) : 0;
+        windowStartUs = group->lastArrivalUs;
+        windowBytes = 0;
+        windowPackets = windowLostPackets = 0;
+    }
+
+    memset(&estimate, 0, sizeof(estimate));
+    estimate.capacityKbps = getCapacityKbps();
+    estimate.receivedKbps = receivedKbps;
+    estimate.availableKbps = estimate.capacityKbps;
+    if (congestionState == CONGESTION_STATE_OVERUSE && receivedKbps != 0) {
+        uint32_t backoffKbps = (uint32_t)(receivedKbps * BWE_OVERUSE_BACKOFF);
+
+        if (estimate.availableKbps == 0 || backoffKbps < estimate.availableKbps) {
+            estimate.availableKbps = backoffKbps;
+        }
+    }
+    estimate.queueingDelayMs = (float)(smoothedDelayMs - (baseDelayMs[0] < baseDelayMs[1] ? baseDelayMs[0] : baseDelayMs[1]));
+    if (estimate.queueingDelayMs < 0) {
+        estimate.queueingDelayMs = 0;
+    }
+    estimate.delayGradientMsPerSecond = (float)gradient;
+    estimate.congestionState = congestionState;
+    estimate.receivedPackets = receivedPackets;
+    estimate.lostPackets = lostPackets;
+    estimate.lossBursts = lossBursts;
+    estimate.maxLossBurstPackets = maxLossBurst;
+    estimate.meanLossBurstPackets = lossBursts != 0 ? (float)burstLostPackets / lossBursts : 0;
+    estimate.lossPercent = windowLossPercent;
+
+    PltLockMutex(&estimateLock);
+    publishedEstimate = estimate;
+    estimatePublished = true;
+    PltUnlockMutex(&estimateLock);
+}
+
+// Counts a packet that left the reorder window, either received or lost
+static void retirePacket(bool received) {
+    if (!received) {
+        currentLossBurst++;
+        lostPackets++;
+        windowLostPackets++;
+        return;
+    }
+
+    if (currentLossBurst != 0) {
+        lossBursts++;
+        burstLostPackets += currentLossBurst;
+        if (currentLossBurst > maxLossBurst) {
+            maxLossBurst = currentLossBurst;
+        }
+        currentLossBurst = 0;
+    }
+}
+
+static void trackSequenceNumber(uint16_t sequenceNumber) {
+    int16_t distance;
+    int i;
+
+    if (!haveSequence) {
+        haveSequence = true;
+        highestSequence = sequenceNumber;
+
+        // There were no packets to lose before the first one
+        receivedMask = ~0ULL;
+        return;
+    }
+
+    distance = (int16_t)(sequenceNumber - highestSequence);
+    if (distance <= 0) {
+        // A late packet fills its place in the window, or a duplicate changes nothing
+        if (-distance < BWE_REORDER_WINDOW) {
+            receivedMask |= 1ULL << -distance;
+        }
+        return;
+    }
+
+    if (distance >= BWE_MAX_SEQUENCE_GAP) {
+        highestSequence = sequenceNumber;
+        receivedMask = ~0ULL;
+        skippedPackets = 0;
+        return;
+    }
+
+    // Packets of completed frames are skipped before their header is decrypted.
+    // They follow the last packet that was read, so they fill the start of the gap.
+    for (i = 0; i < distance; i++) {
+        bool received = (uint32_t)i < skippedPackets;
+
+        retirePacket((receivedMask >> (BWE_REORDER_WINDOW - 1)) & 1);
+        receivedMask = (receivedMask << 1) | (received ? 1 : 0);
+    }
+    receivedMask |= 1;
+    highestSequence = sequenceNumber;
+    skippedPackets = 0;
+}
+
+void addBandwidthEstimatorPacket(uint16_t sequenceNumber, uint32_t timestamp, int length, uint64_t arrivalUs) {
+    if (!estimatorActive) {
+        return;
+    }
+
+    receivedPackets++;
+    windowPackets++;
+    windowBytes += length;
+    trackSequenceNumber(sequenceNumber);
+
+    if (!haveGroup) {
+        haveGroup = true;
+        streamStartUs = arrivalUs;
+        windowStartUs = arrivalUs;
+        lastTimestamp = timestamp;
+
+        memset(&currentGroup, 0, sizeof(currentGroup));
+        currentGroup.firstArrivalUs = currentGroup.lastArrivalUs = arrivalUs;
+        currentGroup.packets = 1;
+        return;
+    }
+
+    if ((int32_t)(timestamp - lastTimestamp) < 0) {
+        // A reordered packet of an earlier frame
+        return;
+    }
+
+    if (timestamp != lastTimestamp) {
+        processGroup(&currentGroup);
+
+        // The 32-bit timestamp wraps after 13 hours
+        currentGroup.timestamp += (uint32_t)(timestamp - lastTimestamp);
+        lastTimestamp = timestamp;
+
+        currentGroup.firstArrivalUs = currentGroup.lastArrivalUs = arrivalUs;
+        currentGroup.packets = 1;
+        currentGroup.trainBytes = 0;
+        return;
+    }
+
+    currentGroup.lastArrivalUs = arrivalUs;
+    currentGroup.packets++;
+    currentGroup.trainBytes += length;
+}
+
+void addBandwidthEstimatorSkippedPacket(int length) {
+    if (!estimatorActive) {
+        return;
+    }
+
+    receivedPackets++;
+    windowPackets++;
+    windowBytes += length;
+    skippedPackets++;
+}
+
+void initializeBandwidthEstimator(void) {
+    estimatePublished = false;
+    haveGroup = false;
+    haveSequence = false;
+    currentLossBurst = 0;
+    skippedPackets = 0;
+    receivedPackets = lostPackets = burstLostPackets = 0;
+    lossBursts = maxLossBurst = 0;
+    windowBytes = 0;
+    windowPackets = windowLostPackets = 0;
+    receivedKbps = 0;
+    windowLossPercent = 0;
+    trendCount = trendNext = 0;
+    dispersionCount = dispersionNext = 0;
+    congestionState = CONGESTION_STATE_NORMAL;
+    gradientSign = 0;
+
+    // Without the lock there is no estimate
+    if (PltCreateMutex(&estimateLock, "BandwidthEstimate") != 0) {
+        return;
+    }
+
+    estimatorActive = true;
+}
+
+void cleanupBandwidthEstimator(void) {
+    if (!estimatorActive) {
+        return;
+    }
+
+    PltLockMutex(&estimateLock);
+    estimatorActive = false;
+    PltUnlockMutex(&estimateLock);
+
+    PltDeleteMutex(&estimateLock);
+}
@@ -116,7 +116,7 @@ void LiStopConnection(void) {
         Limelog("done\n");
     }
     if (stage == STAGE_RTSP_HANDSHAKE) {
-        // Nothing to do
+        stopPacketCapture();
         stage--;
     }
     if (stage == STAGE_AUDIO_STREAM_INIT) {
@@ -145,6 +145,9 @@ void LiStopConnection(void) {
 
 static void terminationCallbackThreadFunc(void* context)
 {
+    // Save the events that led up to the termination
+    dumpFlightRecorderNow("connection-terminated");
+
     // Invoke the client's termination callback
     originalTerminationCallback(terminationCallbackErrorCode);
 }
@@ -168,7 +171,7 @@ static void ClInternalConnectionTerminated(int errorCode)
     alreadyTerminated = true;
 
     // Invoke the termination callback on a separate thread
-    err = PltCreateThread("AsyncTerm", terminationCallbackThreadFunc, NULL, &terminationCallbackThread);
+    err = PltCreateThread("AsyncTerm", THREAD_CLASS_INTERACTIVE, terminationCallbackThreadFunc, NULL, &terminationCallbackThread);
     if (err != 0) {
         // Nothing we can safely do here, so we'll just assert on debug builds
         Limelog("Failed to create termination thread: %d\n", err);
@@ -245,10 +248,10 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     memcpy(&VideoCallbacks, drCallbacks, sizeof(VideoCallbacks));
     memcpy(&AudioCallbacks, arCallbacks, sizeof(AudioCallbacks));
 
-#ifdef LC_DEBUG_RECORD_MODE
     // Install the pass-through recorder callbacks
-    setRecorderCallbacks(&VideoCallbacks, &AudioCallbacks);
-#endif
+    if (isSessionRecordingEnabled()) {
+        setRecorderCallbacks(&VideoCallbacks, &AudioCallbacks);
+    }
 
     // Hook the termination callback so we can avoid issuing a termination callback
     // after LiStopConnection() is called.
@@ -437,6 +440,9 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     ListenerCallbacks.stageComplete(STAGE_RTSP_HANDSHAKE);
     Limelog("done\n");
 
+    // The stream parameters are final once the handshake is done
+    startPacketCapture();
+
     Limelog("Initializing control stream...");
     ListenerCallbacks.stageStarting(STAGE_CONTROL_STREAM_INIT);
     err = initializeControlStream();
@@ -524,6 +530,9 @@ int LiStartConnection(PSERVER_INFORMATION serverInfo, PSTREAM_CONFIGURATION stre
     LiSendMouseMoveEvent(-1, -1);
     PltSleepMs(10);
 
+    // Allocations from here on are the steady state of the stream
+    markAllocationSteadyState();
+
     ListenerCallbacks.connectionStarted();
 
 Cleanup:
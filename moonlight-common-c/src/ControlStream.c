@@ -72,11 +72,13 @@ static ENetPeer* peer;
 static PLT_MUTEX enetMutex;
 static bool usePeriodicPing;
 
-static PLT_THREAD lossStatsThread;
-static PLT_THREAD invalidateRefFramesThread;
-static PLT_THREAD requestIdrFrameThread;
+static PLT_TIMER lossStatsTimer;
+static PLT_TIMER invalidateRefFramesTimer;
+static PLT_TIMER requestIdrFrameTimer;
+static PLT_TIMER asyncCallbackTimer;
 static PLT_THREAD controlReceiveThread;
-static PLT_THREAD asyncCallbackThread;
+static char periodicPingPayload[8];
+static char* lossStatsPayload;
 static uint32_t lastGoodFrame;
 static uint32_t lastSeenFrame;
 static bool stopping;
@@ -96,7 +98,6 @@ static uint64_t firstFrameTimeMs;
 static LINKED_BLOCKING_QUEUE invalidReferenceFrameTuples;
 static LINKED_BLOCKING_QUEUE frameFecStatusQueue;
 static LINKED_BLOCKING_QUEUE asyncCallbackQueue;
-static PLT_EVENT idrFrameRequiredEvent;
 
 static PPLT_CRYPTO_CONTEXT encryptionCtx;
 static PPLT_CRYPTO_CONTEXT decryptionCtx;
@@ -277,11 +278,10 @@ static bool supportsIdrFrameRequest;
 // Initializes the control stream
 int initializeControlStream(void) {
     stopping = false;
-    PltCreateEvent(&idrFrameRequiredEvent);
-    LbqInitializeLinkedBlockingQueue(&invalidReferenceFrameTuples, 20);
-    LbqInitializeLinkedBlockingQueue(&frameFecStatusQueue, 8); // Limits number of frame status reports per periodic ping interval
-    LbqInitializeLinkedBlockingQueue(&asyncCallbackQueue, 30);
-    PltCreateMutex(&enetMutex);
+    LbqInitializeLinkedBlockingQueue(&invalidReferenceFrameTuples, 20, "RfiQueue");
+    LbqInitializeLinkedBlockingQueue(&frameFecStatusQueue, 8, "FecStatusQueue"); // Limits number of frame status reports per periodic ping interval
+    LbqInitializeLinkedBlockingQueue(&asyncCallbackQueue, 30, "AsyncCallbackQueue");
+    PltCreateMutex(&enetMutex, "ENet");
 
     encryptedControlStream = APP_VERSION_AT_LEAST(7, 1, 431);
 
@@ -329,6 +329,7 @@ int initializeControlStream(void) {
     firstFrameTimeMs = 0;
     currentEnetSequenceNumber = 0;
     usePeriodicPing = APP_VERSION_AT_LEAST(7, 1, 415);
+    lossStatsPayload = NULL;
     encryptionCtx = PltCreateCryptoContext();
     decryptionCtx = PltCreateCryptoContext();
     hdrEnabled = false;
@@ -347,12 +348,27 @@ static void freeBasicLbqList(PLINKED_BLOCKING_QUEUE_ENTRY entry) {
     }
 }
 
+// Stops a control stream that was initialized but never started, which
+// is the case when a packet capture is replayed without a host
+void abandonControlStream(void) {
+    stopping = true;
+}
+
 // Cleans up control stream
 void destroyControlStream(void) {
     LC_ASSERT(stopping);
+
+    // Requests that raced with stopControlStream() or a failed start
+    // may have left timers armed that still reference the queues
+    PltCancelTimer(&requestIdrFrameTimer);
+    PltCancelTimer(&invalidateRefFramesTimer);
+    PltCancelTimer(&asyncCallbackTimer);
+    PltJoinTimer(&requestIdrFrameTimer);
+    PltJoinTimer(&invalidateRefFramesTimer);
+    PltJoinTimer(&asyncCallbackTimer);
+
     PltDestroyCryptoContext(encryptionCtx);
     PltDestroyCryptoContext(decryptionCtx);
-    PltCloseEvent(&idrFrameRequiredEvent);
     freeBasicLbqList(LbqDestroyLinkedBlockingQueue(&invalidReferenceFrameTuples));
     freeBasicLbqList(LbqDestroyLinkedBlockingQueue(&frameFecStatusQueue));
     freeBasicLbqList(LbqDestroyLinkedBlockingQueue(&asyncCallbackQueue));
@@ -369,12 +385,21 @@ static void queueFrameInvalidationTuple(uint32_t startFrame, uint32_t endFrame)
         if (qfit != NULL) {
             qfit->startFrame = startFrame;
             qfit->endFrame = endFrame;
-            if (LbqOfferQueueItem(&invalidReferenceFrameTuples, qfit, &qfit->entry) == LBQ_BOUND_EXCEEDED) {
+            int err = LbqOfferQueueItem(&invalidReferenceFrameTuples, qfit, &qfit->entry);
+            if (err == LBQ_BOUND_EXCEEDED) {
                 // Too many invalidation tuples, so we need an IDR frame now
                 Limelog("RFI range list reached maximum size limit\n");
                 free(qfit);
                 LiRequestIdrFrame();
             }
+            else if (err == LBQ_SUCCESS) {
+                if (!stopping) {
+                    PltScheduleTimer(&invalidateRefFramesTimer, 0, 0);
+                }
+            }
+            else {
+                free(qfit);
+            }
         }
         else {
             LiRequestIdrFrame();
@@ -391,8 +416,10 @@ void LiRequestIdrFrame(void) {
     // We require a full IDR frame to recover.
     freeBasicLbqList(LbqFlushQueueItems(&invalidReferenceFrameTuples));
 
-    // Request the IDR frame
-    PltSetEvent(&idrFrameRequiredEvent);
+    // Request the IDR frame. Requests made while one is pending are coalesced.
+    if (!stopping) {
+        PltScheduleTimer(&requestIdrFrameTimer, 0, 0);
+    }
 }
 
 // Invalidate reference frames lost by the network
@@ -450,10 +477,13 @@ void connectionSawFrame(uint32_t frameIndex) {
                 // interval above CONN_IMMEDIATE_POOR_LOSS_RATE to notify of a poor connection.
                 ListenerCallbacks.connectionStatusUpdate(CONN_STATUS_POOR);
                 lastConnectionStatusUpdate = CONN_STATUS_POOR;
+                LiRecordFlightEvent(FLIGHT_EVENT_CONNECTION_STATUS, CONN_STATUS_POOR, frameLossPercent);
+                LiTriggerFlightRecorderDump("connection-poor");
             }
             else if (frameLossPercent <= CONN_OKAY_LOSS_RATE && lastConnectionStatusUpdate != CONN_STATUS_OKAY) {
                 ListenerCallbacks.connectionStatusUpdate(CONN_STATUS_OKAY);
                 lastConnectionStatusUpdate = CONN_STATUS_OKAY;
+                LiRecordFlightEvent(FLIGHT_EVENT_CONNECTION_STATUS, CONN_STATUS_OKAY, frameLossPercent);
             }
 
             lastIntervalLossPercentage = frameLossPercent;
@@ -841,6 +871,8 @@ static bool sendMessageAndDiscardReply(short ptype, short paylen, const void* pa
 // pending receives first. It works around what appears to be a bug in ENet
 // where pending disconnects can cause loss of unprocessed received data.
 static int ignoreDisconnectIntercept(ENetHost* host, ENetEvent* event) {
+    capturePacket(CAPTURE_STREAM_CONTROL, (const char*)host->receivedData, (int)host->receivedDataLength);
+
     if (host->receivedDataLength == sizeof(ENetProtocolHeader) + sizeof(ENetProtocolDisconnect)) {
         ENetProtocolHeader* protoHeader = (ENetProtocolHeader*)host->receivedData;
         ENetProtocolDisconnect* disconnect = (ENetProtocolDisconnect*)(protoHeader + 1);
@@ -858,10 +890,10 @@ static int ignoreDisconnectIntercept(ENetHost* host, ENetEvent* event) {
     return 0;
 }
 
-static void asyncCallbackThreadFunc(void* context) {
+static void asyncCallbackTimerFunc(void* context) {
     PQUEUED_ASYNC_CALLBACK queuedCb, nextCb;
 
-    while (LbqWaitForQueueElement(&asyncCallbackQueue, (void**)&queuedCb) == LBQ_SUCCESS) {
+    while (LbqPollQueueElement(&asyncCallbackQueue, (void**)&queuedCb) == LBQ_SUCCESS) {
         switch (queuedCb->typeIndex) {
         case IDX_RUMBLE_DATA:
             // Look for another rumble packet to batch with
@@ -1033,7 +1065,10 @@ static void queueAsyncCallback(PNVCTL_ENET_PACKET_HEADER_V1 ctlHdr, int packetLe
     if (err != LBQ_SUCCESS) {
         Limelog("Failed to queue async callback: %d\n", err);
         free(queuedCb);
+        return;
     }
+
+    PltScheduleTimer(&asyncCallbackTimer, 0, 0);
 }
 
 static void controlReceiveThreadFunc(void* context) {
@@ -1109,7 +1144,9 @@ static void controlReceiveThreadFunc(void* context) {
             else {
                 // No events ready - wait for readability or a local RTO timer to expire
                 enet_uint32 condition = ENET_SOCKET_WAIT_RECEIVE;
-                enet_socket_wait(client->socket, &condition, waitTimeMs);
+                uint64_t waitToken = LiBeginThreadWait();
+                enet_socket_wait(client->socket, &condition, getImpairedWaitTimeMs(client->socket, waitTimeMs));
+                LiEndThreadWait(waitToken);
                 continue;
             }
         }
@@ -1129,7 +1166,7 @@ static void controlReceiveThreadFunc(void* context) {
             int packetLength;
 
             if (event.packet->dataLength < sizeof(*ctlHdr)) {
-                Limelog("Discarding runt control packet: %d < %d\n", event.packet->dataLength, (int)sizeof(*ctlHdr));
+                Limelog("Discarding runt control packet: %d < %d\n", (int)event.packet->dataLength, (int)sizeof(*ctlHdr));
                 enet_packet_destroy(event.packet);
                 continue;
             }
@@ -1144,7 +1181,7 @@ static void controlReceiveThreadFunc(void* context) {
                     PNVCTL_ENCRYPTED_PACKET_HEADER encHdr;
 
                     if (event.packet->dataLength < sizeof(NVCTL_ENCRYPTED_PACKET_HEADER)) {
-                        Limelog("Discarding runt encrypted control packet: %d < %d\n", event.packet->dataLength, (int)sizeof(NVCTL_ENCRYPTED_PACKET_HEADER));
+                        Limelog("Discarding runt encrypted control packet: %d < %d\n", (int)event.packet->dataLength, (int)sizeof(NVCTL_ENCRYPTED_PACKET_HEADER));
                         enet_packet_destroy(event.packet);
                         continue;
                     }
@@ -1157,7 +1194,7 @@ static void controlReceiveThreadFunc(void* context) {
                     ctlHdr = NULL;
                     packetLength = (int)event.packet->dataLength;
                     if (!decryptControlMessageToV1(encHdr, packetLength, &ctlHdr, &packetLength)) {
-                        Limelog("Failed to decrypt control packet of size %d\n", event.packet->dataLength);
+                        Limelog("Failed to decrypt control packet of size %d\n", (int)event.packet->dataLength);
                         enet_packet_destroy(event.packet);
                         continue;
                     }
@@ -1306,105 +1343,79 @@ static void controlReceiveThreadFunc(void* context) {
     }
 }
 
-static void lossStatsThreadFunc(void* context) {
-    BYTE_BUFFER byteBuffer;
-
-    if (usePeriodicPing) {
-        char periodicPingPayload[8];
-
-        BbInitializeWrappedBuffer(&byteBuffer, periodicPingPayload, 0, sizeof(periodicPingPayload), BYTE_ORDER_LITTLE);
-        BbPut16(&byteBuffer, 4); // Length of payload
-        BbPut32(&byteBuffer, 0); // Timestamp?
-
-        while (!PltIsThreadInterrupted(&lossStatsThread)) {
-            // For Sunshine servers, send the more detailed per-frame FEC messages
-            if (IS_SUNSHINE()) {
-                PQUEUED_FRAME_FEC_STATUS queuedFrameStatus;
-
-                // Sunshine should always use ENet for control messages
-                LC_ASSERT(peer != NULL);
-
-                while (LbqPollQueueElement(&frameFecStatusQueue, (void**)&queuedFrameStatus) == LBQ_SUCCESS) {
-                    // Send as an unreliable packet, since it's not a critical message
-                    if (!sendMessageEnet(SS_FRAME_FEC_PTYPE,
-                                         sizeof(queuedFrameStatus->fecStatus),
-                                         &queuedFrameStatus->fecStatus,
-                                         CTRL_CHANNEL_GENERIC,
-                                         ENET_PACKET_FLAG_UNSEQUENCED,
-                                         LbqGetItemCount(&frameFecStatusQueue) > 0)) {
-                        Limelog("Loss Stats: Sending frame FEC status message failed: %d\n", (int)LastSocketError());
-                        ListenerCallbacks.connectionTerminated(LastSocketFail());
-                        free(queuedFrameStatus);
-                        return;
-                    }
-
-                    free(queuedFrameStatus);
-                }
-            }
-
-            // Send the message (and don't expect a response)
-            //
-            // NB: We send this periodic message as reliable to ensure the RTT is recomputed
-            // regularly. This only happens when an ACK is received to a reliable packet.
-            // Since the other traffic on this channel is unsequenced, it doesn't really
-            // cause any negative HOL blocking side-effects.
-            if (!sendMessageAndForget(0x0200,
-                                      sizeof(periodicPingPayload),
-                                      periodicPingPayload,
-                                      CTRL_CHANNEL_GENERIC,
-                                      ENET_PACKET_FLAG_RELIABLE,
-                                      false)) {
-                Limelog("Loss Stats: Transaction failed: %d\n", (int)LastSocketError());
+static void periodicPingTimerFunc(void* context) {
+    // For Sunshine servers, send the more detailed per-frame FEC messages
+    if (IS_SUNSHINE()) {
+        PQUEUED_FRAME_FEC_STATUS queuedFrameStatus;
+
+        // Sunshine should always use ENet for control messages
+        LC_ASSERT(peer != NULL);
+
+        while (LbqPollQueueElement(&frameFecStatusQueue, (void**)&queuedFrameStatus) == LBQ_SUCCESS) {
+            // Send as an unreliable packet, since it's not a critical message
+            if (!sendMessageEnet(SS_FRAME_FEC_PTYPE,
+                                 sizeof(queuedFrameStatus->fecStatus),
+                                 &queuedFrameStatus->fecStatus,
+                                 CTRL_CHANNEL_GENERIC,
+                                 ENET_PACKET_FLAG_UNSEQUENCED,
+                                 LbqGetItemCount(&frameFecStatusQueue) > 0)) {
+                Limelog("Loss Stats: Sending frame FEC status message failed: %d\n", (int)LastSocketError());
+                PltCancelTimer(&lossStatsTimer);
                 ListenerCallbacks.connectionTerminated(LastSocketFail());
+                free(queuedFrameStatus);
                 return;
             }
 
-            // Wait a bit
-            PltSleepMsInterruptible(&lossStatsThread, PERIODIC_PING_INTERVAL_MS);
+            free(queuedFrameStatus);
         }
     }
-    else {
-        char* lossStatsPayload;
 
-        // Sunshine should use the newer codepath above
-        LC_ASSERT(!IS_SUNSHINE());
-
-        lossStatsPayload = malloc(payloadLengths[IDX_LOSS_STATS]);
-        if (lossStatsPayload == NULL) {
-            Limelog("Loss Stats: malloc() failed\n");
-            ListenerCallbacks.connectionTerminated(-1);
-            return;
-        }
-
-        while (!PltIsThreadInterrupted(&lossStatsThread)) {
-            // Construct the payload
-            BbInitializeWrappedBuffer(&byteBuffer, lossStatsPayload, 0, payloadLengths[IDX_LOSS_STATS], BYTE_ORDER_LITTLE);
-            BbPut32(&byteBuffer, 0);
-            BbPut32(&byteBuffer, LOSS_REPORT_INTERVAL_MS);
-            BbPut32(&byteBuffer, 1000);
-            BbPut64(&byteBuffer, lastGoodFrame);
-            BbPut32(&byteBuffer, 0);
-            BbPut32(&byteBuffer, 0);
-            BbPut32(&byteBuffer, 0x14);
-
-            // Send the message (and don't expect a response)
-            if (!sendMessageAndForget(packetTypes[IDX_LOSS_STATS],
-                                      payloadLengths[IDX_LOSS_STATS],
-                                      lossStatsPayload,
-                                      CTRL_CHANNEL_GENERIC,
-                                      0,
-                                      false)) {
-                free(lossStatsPayload);
-                Limelog("Loss Stats: Transaction failed: %d\n", (int)LastSocketError());
-                ListenerCallbacks.connectionTerminated(LastSocketFail());
-                return;
-            }
+    // Send the message (and don't expect a response)
+    //
+    // NB: We send this periodic message as reliable to ensure the RTT is recomputed
+    // regularly. This only happens when an ACK is received to a reliable packet.
+    // Since the other traffic on this channel is unsequenced, it doesn't really
+    // cause any negative HOL blocking side-effects.
+    if (!sendMessageAndForget(0x0200,
+                              sizeof(periodicPingPayload),
+                              periodicPingPayload,
+                              CTRL_CHANNEL_GENERIC,
+                              ENET_PACKET_FLAG_RELIABLE,
+                              false)) {
+        Limelog("Loss Stats: Transaction failed: %d\n", (int)LastSocketError());
+        PltCancelTimer(&lossStatsTimer);
+        ListenerCallbacks.connectionTerminated(LastSocketFail());
+        return;
+    }
+}
 
-            // Wait a bit
-            PltSleepMsInterruptible(&lossStatsThread, LOSS_REPORT_INTERVAL_MS);
-        }
+static void lossStatsTimerFunc(void* context) {
+    BYTE_BUFFER byteBuffer;
 
-        free(lossStatsPayload);
+    // Sunshine should use the newer codepath above
+    LC_ASSERT(!IS_SUNSHINE());
+
+    // Construct the payload
+    BbInitializeWrappedBuffer(&byteBuffer, lossStatsPayload, 0, payloadLengths[IDX_LOSS_STATS], BYTE_ORDER_LITTLE);
+    BbPut32(&byteBuffer, 0);
+    BbPut32(&byteBuffer, LOSS_REPORT_INTERVAL_MS);
+    BbPut32(&byteBuffer, 1000);
+    BbPut64(&byteBuffer, lastGoodFrame);
+    BbPut32(&byteBuffer, 0);
+    BbPut32(&byteBuffer, 0);
+    BbPut32(&byteBuffer, 0x14);
+
+    // Send the message (and don't expect a response)
+    if (!sendMessageAndForget(packetTypes[IDX_LOSS_STATS],
+                              payloadLengths[IDX_LOSS_STATS],
+                              lossStatsPayload,
+                              CTRL_CHANNEL_GENERIC,
+                              0,
+                              false)) {
+        Limelog("Loss Stats: Transaction failed: %d\n", (int)LastSocketError());
+        PltCancelTimer(&lossStatsTimer);
+        ListenerCallbacks.connectionTerminated(LastSocketFail());
+        return;
     }
 }
 
@@ -1480,51 +1491,43 @@ static void requestInvalidateReferenceFrames(uint32_t startFrame, uint32_t endFr
     Limelog("Invalidate reference frame request sent (%d to %d)\n", startFrame, endFrame);
 }
 
-static void invalidateRefFramesFunc(void* context) {
+static void invalidateRefFramesTimerFunc(void* context) {
+    PQUEUED_FRAME_INVALIDATION_TUPLE qfit;
+    uint32_t startFrame;
+    uint32_t endFrame;
+
     LC_ASSERT(isReferenceFrameInvalidationEnabled());
 
-    while (!PltIsThreadInterrupted(&invalidateRefFramesThread)) {
-        PQUEUED_FRAME_INVALIDATION_TUPLE qfit;
-        uint32_t startFrame;
-        uint32_t endFrame;
+    // The tuples may have been flushed by an IDR frame request
+    if (stopping || LbqPollQueueElement(&invalidReferenceFrameTuples, (void**)&qfit) != LBQ_SUCCESS) {
+        return;
+    }
 
-        // Wait for a reference frame invalidation request or a request to shutdown
-        if (LbqWaitForQueueElement(&invalidReferenceFrameTuples, (void**)&qfit) != LBQ_SUCCESS) {
-            // Bail if we're stopping
-            return;
-        }
+    startFrame = qfit->startFrame;
+    endFrame = qfit->endFrame;
 
-        startFrame = qfit->startFrame;
+    // Aggregate all lost frames into one range
+    do {
+        LC_ASSERT(qfit->endFrame >= endFrame);
         endFrame = qfit->endFrame;
+        free(qfit);
+    } while (LbqPollQueueElement(&invalidReferenceFrameTuples, (void**)&qfit) == LBQ_SUCCESS);
 
-        // Aggregate all lost frames into one range
-        do {
-            LC_ASSERT(qfit->endFrame >= endFrame);
-            endFrame = qfit->endFrame;
-            free(qfit);
-        } while (LbqPollQueueElement(&invalidReferenceFrameTuples, (void**)&qfit) == LBQ_SUCCESS);
-
-        // Send the reference frame invalidation request
-        requestInvalidateReferenceFrames(startFrame, endFrame);
-    }
+    // Send the reference frame invalidation request
+    requestInvalidateReferenceFrames(startFrame, endFrame);
 }
 
-static void requestIdrFrameFunc(void* context) {
-    while (!PltIsThreadInterrupted(&requestIdrFrameThread)) {
-        PltWaitForEvent(&idrFrameRequiredEvent);
-        PltClearEvent(&idrFrameRequiredEvent);
-
-        if (stopping) {
-            // Bail if we're stopping
-            return;
-        }
+static void requestIdrFrameTimerFunc(void* context) {
+    if (stopping) {
+        // Bail if we're stopping
+        return;
+    }
 
-        // Any pending reference frame invalidation requests are now redundant
-        freeBasicLbqList(LbqFlushQueueItems(&invalidReferenceFrameTuples));
+    // Any pending reference frame invalidation requests are now redundant
+    freeBasicLbqList(LbqFlushQueueItems(&invalidReferenceFrameTuples));
 
-        // Request the IDR frame
-        requestIdrFrame();
-    }
+    // Request the IDR frame
+    requestIdrFrame();
 }
 
 // Stops the control stream
@@ -1533,7 +1536,6 @@ int stopControlStream(void) {
     LbqSignalQueueShutdown(&invalidReferenceFrameTuples);
     LbqSignalQueueShutdown(&frameFecStatusQueue);
     LbqSignalQueueDrain(&asyncCallbackQueue);
-    PltSetEvent(&idrFrameRequiredEvent);
 
     // This must be set to stop in a timely manner
     LC_ASSERT(ConnectionInterrupted);
@@ -1542,21 +1544,21 @@ int stopControlStream(void) {
         shutdownTcpSocket(ctlSock);
     }
 
-    PltInterruptThread(&lossStatsThread);
-    PltInterruptThread(&requestIdrFrameThread);
+    PltCancelTimer(&lossStatsTimer);
+    PltCancelTimer(&requestIdrFrameTimer);
+    PltCancelTimer(&invalidateRefFramesTimer);
     PltInterruptThread(&controlReceiveThread);
-    PltInterruptThread(&asyncCallbackThread);
 
-    PltJoinThread(&lossStatsThread);
-    PltJoinThread(&requestIdrFrameThread);
+    PltJoinTimer(&lossStatsTimer);
+    PltJoinTimer(&requestIdrFrameTimer);
+    PltJoinTimer(&invalidateRefFramesTimer);
     PltJoinThread(&controlReceiveThread);
-    PltJoinThread(&asyncCallbackThread);
 
-    // We will only have an RFI thread if RFI is enabled
-    if (isReferenceFrameInvalidationEnabled()) {
-        PltInterruptThread(&invalidateRefFramesThread);
-        PltJoinThread(&invalidateRefFramesThread);
-    }
+    // Callbacks queued before the receive thread stopped are still delivered
+    PltJoinTimer(&asyncCallbackTimer);
+
+    free(lossStatsPayload);
+    lossStatsPayload = NULL;
 
     if (peer != NULL) {
         // Gracefully disconnect to ensure the remote host receives all of our final
@@ -1636,6 +1638,11 @@ bool LiGetEstimatedRttInfo(uint32_t* estimatedRtt, uint32_t* estimatedRttVarianc
 int startControlStream(void) {
     int err;
 
+    PltInitializeTimer(&lossStatsTimer, usePeriodicPing ? periodicPingTimerFunc : lossStatsTimerFunc, NULL);
+    PltInitializeTimer(&invalidateRefFramesTimer, invalidateRefFramesTimerFunc, NULL);
+    PltInitializeTimer(&requestIdrFrameTimer, requestIdrFrameTimerFunc, NULL);
+    PltInitializeTimer(&asyncCallbackTimer, asyncCallbackTimerFunc, NULL);
+
     if (AppVersionQuad[0] >= 5) {
         ENetAddress remoteAddress, localAddress;
         ENetEvent event;
@@ -1663,6 +1670,7 @@ int startControlStream(void) {
         }
 
         client->intercept = ignoreDisconnectIntercept;
+        registerImpairedSocket(client->socket, IMPAIR_STREAM_CONTROL);
 
         // Enable high priority QoS marking on control stream traffic
         //
@@ -1736,7 +1744,7 @@ int startControlStream(void) {
         enableNoDelay(ctlSock);
     }
 
-    err = PltCreateThread("ControlRecv", controlReceiveThreadFunc, NULL, &controlReceiveThread);
+    err = PltCreateThread("ControlRecv", THREAD_CLASS_INTERACTIVE, controlReceiveThreadFunc, NULL, &controlReceiveThread);
     if (err != 0) {
         stopping = true;
         if (ctlSock != INVALID_SOCKET) {
@@ -1820,106 +1828,18 @@ int startControlStream(void) {
         return err;
     }
 
-    err = PltCreateThread("LossStats", lossStatsThreadFunc, NULL, &lossStatsThread);
-    if (err != 0) {
-        stopping = true;
-
-        if (ctlSock != INVALID_SOCKET) {
-            shutdownTcpSocket(ctlSock);
-        }
-        else {
-            ConnectionInterrupted = true;
-        }
-
-        PltInterruptThread(&controlReceiveThread);
-        PltJoinThread(&controlReceiveThread);
-
-        if (ctlSock != INVALID_SOCKET) {
-            closeSocket(ctlSock);
-            ctlSock = INVALID_SOCKET;
-        }
-        else {
-            enet_peer_disconnect_now(peer, 0);
-            peer = NULL;
-            enet_host_destroy(client);
-            client = NULL;
-        }
-        return err;
-    }
-
-    err = PltCreateThread("ReqIdrFrame", requestIdrFrameFunc, NULL, &requestIdrFrameThread);
-    if (err != 0) {
-        stopping = true;
-
-        if (ctlSock != INVALID_SOCKET) {
-            shutdownTcpSocket(ctlSock);
-        }
-        else {
-            ConnectionInterrupted = true;
-        }
-
-        PltInterruptThread(&lossStatsThread);
-        PltJoinThread(&lossStatsThread);
-
-        PltInterruptThread(&controlReceiveThread);
-        PltJoinThread(&controlReceiveThread);
-
-        if (ctlSock != INVALID_SOCKET) {
-            closeSocket(ctlSock);
-            ctlSock = INVALID_SOCKET;
-        }
-        else {
-            enet_peer_disconnect_now(peer, 0);
-            peer = NULL;
-            enet_host_destroy(client);
-            client = NULL;
-        }
-
-        return err;
-    }
-
-    err = PltCreateThread("CtrlAsyncCb", asyncCallbackThreadFunc, NULL, &asyncCallbackThread);
-    if (err != 0) {
-        stopping = true;
-        PltSetEvent(&idrFrameRequiredEvent);
-
-        if (ctlSock != INVALID_SOCKET) {
-            shutdownTcpSocket(ctlSock);
-        }
-        else {
-            ConnectionInterrupted = true;
-        }
-
-        PltInterruptThread(&lossStatsThread);
-        PltJoinThread(&lossStatsThread);
-
-        PltInterruptThread(&controlReceiveThread);
-        PltJoinThread(&controlReceiveThread);
-
-        PltInterruptThread(&requestIdrFrameThread);
-        PltJoinThread(&requestIdrFrameThread);
-
-        if (ctlSock != INVALID_SOCKET) {
-            closeSocket(ctlSock);
-            ctlSock = INVALID_SOCKET;
-        }
-        else {
-            enet_peer_disconnect_now(peer, 0);
-            peer = NULL;
-            enet_host_destroy(client);
-            client = NULL;
-        }
+    if (usePeriodicPing) {
+        BYTE_BUFFER byteBuffer;
 
-        return err;
+        BbInitializeWrappedBuffer(&byteBuffer, periodicPingPayload, 0, sizeof(periodicPingPayload), BYTE_ORDER_LITTLE);
+        BbPut16(&byteBuffer, 4); // Length of payload
+        BbPut32(&byteBuffer, 0); // Timestamp?
     }
-
-    // Only create the reference frame invalidation thread if RFI is enabled
-    if (isReferenceFrameInvalidationEnabled()) {
-        err = PltCreateThread("InvRefFrames", invalidateRefFramesFunc, NULL, &invalidateRefFramesThread);
-        if (err != 0) {
+    else {
+        lossStatsPayload = malloc(payloadLengths[IDX_LOSS_STATS]);
+        if (lossStatsPayload == NULL) {
+            Limelog("Loss Stats: malloc() failed\n");
             stopping = true;
-            PltSetEvent(&idrFrameRequiredEvent);
-            LbqSignalQueueShutdown(&asyncCallbackQueue);
 
             if (ctlSock != INVALID_SOCKET) {
                 shutdownTcpSocket(ctlSock);
@@ -1928,18 +1848,9 @@ int startControlStream(void) {
                 ConnectionInterrupted = true;
             }
 
-            PltInterruptThread(&lossStatsThread);
-            PltJoinThread(&lossStatsThread);
-
             PltInterruptThread(&controlReceiveThread);
             PltJoinThread(&controlReceiveThread);
 
-            PltInterruptThread(&requestIdrFrameThread);
-            PltJoinThread(&requestIdrFrameThread);
-
-            PltInterruptThread(&asyncCallbackThread);
-            PltJoinThread(&asyncCallbackThread);
-
             if (ctlSock != INVALID_SOCKET) {
                 closeSocket(ctlSock);
                 ctlSock = INVALID_SOCKET;
@@ -1950,11 +1861,13 @@ int startControlStream(void) {
                 enet_host_destroy(client);
                 client = NULL;
             }
-
-            return err;
+            return -1;
         }
     }
 
+    // Periodic reports and on-demand requests run on the platform executor
+    PltScheduleTimer(&lossStatsTimer, 0, usePeriodicPing ? PERIODIC_PING_INTERVAL_MS : LOSS_REPORT_INTERVAL_MS);
+
     return 0;
 }
 
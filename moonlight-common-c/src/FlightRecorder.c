@@ -0,0 +1,265 @@
+#include "Limelight-internal.h"
+
+// The flight recorder keeps the most recent stream events in a ring. Any thread
+// can record an event: it claims a slot by incrementing the write sequence, and
+// publishes the slot by storing its sequence number after the event. A dump copies
+// the slots backwards from the write sequence and stops at the first slot that was
+// overwritten while copying, so recording never waits for a dump.
+
+#if defined(_MSC_VER)
+#define ATOMIC_FETCH_ADD(ptr, value) ((uint32_t)InterlockedExchangeAdd((volatile LONG*)(ptr), (LONG)(value)))
+#define ATOMIC_EXCHANGE(ptr, value) ((uint32_t)InterlockedExchange((volatile LONG*)(ptr), (LONG)(value)))
+#define ATOMIC_STORE(ptr, value) InterlockedExchange((volatile LONG*)(ptr), (LONG)(value))
+#define ATOMIC_LOAD(ptr) ((uint32_t)InterlockedOr((volatile LONG*)(ptr), 0))
+#define ATOMIC_FENCE() MemoryBarrier()
+#elif defined(__GNUC__)
+#define ATOMIC_FETCH_ADD(ptr, value) __atomic_fetch_add((ptr), (value), __ATOMIC_RELAXED)
+#define ATOMIC_EXCHANGE(ptr, value) __atomic_exchange_n((ptr), (value), __ATOMIC_ACQ_REL)
+#define ATOMIC_STORE(ptr, value) __atomic_store_n((ptr), (value), __ATOMIC_RELEASE)
+#define ATOMIC_LOAD(ptr) __atomic_load_n((ptr), __ATOMIC_ACQUIRE)
+#define ATOMIC_FENCE() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+#else
+// Events recorded at the same time by two threads may overwrite each other
+#define ATOMIC_FETCH_ADD(ptr, value) ((*(ptr) += (value)) - (value))
+#define ATOMIC_EXCHANGE(ptr, value) exchangeValue((ptr), (value))
+#define ATOMIC_STORE(ptr, value) (*(volatile uint32_t*)(ptr) = (value))
+#define ATOMIC_LOAD(ptr) (*(volatile uint32_t*)(ptr))
+#define ATOMIC_FENCE()
+
+static uint32_t exchangeValue(uint32_t* ptr, uint32_t value) {
+    uint32_t oldValue = *ptr;
+    *ptr = value;
+    return oldValue;
+}
+#endif
+
+// Must be a power of 2. This covers about 8 seconds of a 40 Mbps stream.
+#define FLIGHT_RECORDER_CAPACITY 32768
+
+// A dump covers the events before its trigger, and the events until it runs
+#define FLIGHT_RECORDER_WINDOW_US 5000000
+#define FLIGHT_RECORDER_DUMP_DELAY_MS 1000
+
+// Stutters and poor connection reports are dumped at most this often
+#define FLIGHT_RECORDER_MIN_DUMP_INTERVAL_US 30000000
+
+typedef struct _FLIGHT_EVENT_SLOT {
+    // The write sequence of the event, or 0 while it is written
+    uint32_t sequence;
+    uint16_t type;
+    uint16_t reserved;
+    uint32_t a;
+    uint32_t b;
+    uint64_t timeUs;
+} FLIGHT_EVENT_SLOT, *PFLIGHT_EVENT_SLOT;
+
+static FlightRecorderDumpCallback dumpCallback;
+static PFLIGHT_EVENT_SLOT flightEvents;
+static uint32_t flightSequence;
+static bool flightRecorderActive;
+
+// Delayed dumps run on the executor
+static PLT_TIMER dumpTimer;
+static uint32_t dumpPending;
+static uint32_t dumpRunning;
+static const char* pendingReason;
+static uint64_t pendingTriggerUs;
+static uint64_t lastTriggerUs;
+
+static const char* eventNames[] = {
+    "",
+    "video-packet",
+    "fec-recovered",
+    "fec-failed",
+    "frame-queued",
+    "frame-dequeued",
+    "frame-completed",
+    "audio-packet",
+    "input-sent",
+    "connection-status",
+    "append-packet",
+    "audio-queue",
+    "congestion-state",
+};
+
+void LiSetFlightRecorderDumpCallback(FlightRecorderDumpCallback callback) {
+    dumpCallback = callback;
+}
+
+void LiRecordFlightEvent(int type, uint32_t a, uint32_t b) {
+    PFLIGHT_EVENT_SLOT slot;
+    uint32_t sequence;
+
+    if (!flightRecorderActive) {
+        return;
+    }
+
+    // Sequence 0 marks a slot that is being written
+    sequence = ATOMIC_FETCH_ADD(&flightSequence, 1) + 1;
+    slot = &flightEvents[sequence & (FLIGHT_RECORDER_CAPACITY - 1)];
+
+    ATOMIC_STORE(&slot->sequence, 0);
+    ATOMIC_FENCE();
+    slot->type = (uint16_t)type;
+    slot->a = a;
+    slot->b = b;
+    slot->timeUs = PltGetMicroseconds();
+    ATOMIC_STORE(&slot->sequence, sequence);
+}
+
+// Copies the events of the dump window, newest first, and returns their count
+static int copyFlightEvents(PFLIGHT_EVENT_SLOT copy, uint64_t triggerUs) {
+    uint32_t head = ATOMIC_LOAD(&flightSequence);
+    uint32_t sequence;
+    int count = 0;
+
+    for (sequence = head; sequence != 0 && head - sequence < FLIGHT_RECORDER_CAPACITY; sequence--) {
+        PFLIGHT_EVENT_SLOT slot = &flightEvents[sequence & (FLIGHT_RECORDER_CAPACITY - 1)];
+        FLIGHT_EVENT_SLOT event;
+
+        if (ATOMIC_LOAD(&slot->sequence) != sequence) {
+            // Still being written, or already reused for a newer event
+            if (count == 0) {
+                continue;
+            }
+            break;
+        }
+        event = *slot;
+        ATOMIC_FENCE();
+        if (ATOMIC_LOAD(&slot->sequence) != sequence) {
+            break;
+        }
+
+        if (event.timeUs + FLIGHT_RECORDER_WINDOW_US < triggerUs) {
+            break;
+        }
+
+        copy[count++] = event;
+    }
+
+    return count;
+}
+
+static void dumpFlightRecorder(const char* reason, uint64_t triggerUs) {
+    PFLIGHT_EVENT_SLOT copy;
+    char* text;
+    size_t size;
+    int length;
+    int count;
+    int i;
+
+    // A dump that starts while another runs is dropped
+    if (dumpCallback == NULL || flightEvents == NULL || ATOMIC_EXCHANGE(&dumpRunning, 1) != 0) {
+        return;
+    }
+
+    copy = malloc(FLIGHT_RECORDER_CAPACITY * sizeof(*copy));
+    if (copy == NULL) {
+        ATOMIC_STORE(&dumpRunning, 0);
+        return;
+    }
+
+    count = copyFlightEvents(copy, triggerUs);
+
+    // Each line fits in 64 characters
+    size = 128 + (size_t)count * 64;
+    text = malloc(size);
+    if (text == NULL) {
+        free(copy);
+        ATOMIC_STORE(&dumpRunning, 0);
+        return;
+    }
+
+    length = snprintf(text, size, "# reason=%s events=%d\ntime_ms,event,a,b\n", reason, count);
+    for (i = count - 1; i >= 0; i--) {
+        PFLIGHT_EVENT_SLOT event = &copy[i];
+        const char* name = event->type < sizeof(eventNames) / sizeof(eventNames[0]) ? eventNames[event->type] : "unknown";
+
+        // Times are relative to the trigger
+        length += snprintf(&text[length], size - length, "%.3f,%s,%u,%u\n",
+                           ((double)event->timeUs - (double)triggerUs) / 1000.0,
+                           name, event->a, event->b);
+    }
+
+    Limelog("Flight recorder dumped %d events (%s)\n", count, reason);
+    dumpCallback(reason, text, length);
+
+    free(text);
+    free(copy);
+    ATOMIC_STORE(&dumpRunning, 0);
+}
+
+static void dumpTimerCallback(void* context) {
+    (void)context;
+
+    dumpFlightRecorder(pendingReason, pendingTriggerUs);
+    ATOMIC_STORE(&dumpPending, 0);
+}
+
+void LiTriggerFlightRecorderDump(const char* reason) {
+    uint64_t nowUs;
+
+    if (!flightRecorderActive || ATOMIC_EXCHANGE(&dumpPending, 1) != 0) {
+        return;
+    }
+
+    nowUs = PltGetMicroseconds();
+    if (lastTriggerUs != 0 && nowUs - lastTriggerUs < FLIGHT_RECORDER_MIN_DUMP_INTERVAL_US) {
+        ATOMIC_STORE(&dumpPending, 0);
+        return;
+    }
+
+    pendingReason = reason;
+    pendingTriggerUs = nowUs;
+    lastTriggerUs = nowUs;
+
+    // Wait to capture how the stream recovers
+    PltScheduleTimer(&dumpTimer, FLIGHT_RECORDER_DUMP_DELAY_MS, 0);
+}
+
+void dumpFlightRecorderNow(const char* reason) {
+    if (flightRecorderActive) {
+        dumpFlightRecorder(reason, PltGetMicroseconds());
+    }
+}
+
+void initializeFlightRecorder(void) {
+    lastTriggerUs = 0;
+    dumpPending = 0;
+
+    if (dumpCallback == NULL) {
+        return;
+    }
+
+    // The ring is kept for later connections, and a dump on a detached termination
+    // thread may still read it after the connection is stopped
+    if (flightEvents == NULL) {
+        flightEvents = calloc(FLIGHT_RECORDER_CAPACITY, sizeof(*flightEvents));
+        if (flightEvents == NULL) {
+            return;
+        }
+    }
+    else {
+        memset(flightEvents, 0, FLIGHT_RECORDER_CAPACITY * sizeof(*flightEvents));
+    }
+    flightSequence = 0;
+
+    PltInitializeTimer(&dumpTimer, dumpTimerCallback, NULL);
+    flightRecorderActive = true;
+}
+
+void cleanupFlightRecorder(void) {
+    if (!flightRecorderActive) {
+        return;
+    }
+
+    flightRecorderActive = false;
+
+    // A dump that was waiting for its delay runs now
+    PltCancelTimer(&dumpTimer);
+    PltJoinTimer(&dumpTimer);
+    if (ATOMIC_LOAD(&dumpPending) != 0) {
+        dumpFlightRecorder(pendingReason, pendingTriggerUs);
+        dumpPending = 0;
+    }
+}
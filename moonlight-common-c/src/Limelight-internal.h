@@ -10,6 +10,10 @@
 #include "RtpAudioQueue.h"
 #include "RtpVideoQueue.h"
 #include "ByteBuffer.h"
+#include "Av1Parser.h"
+#include "NetworkImpairment.h"
+#include "PacketCapture.h"
+#include "Mp4Muxer.h"
 
 #include <enet/enet.h>
 
@@ -110,13 +114,16 @@ void* extendBuffer(void* ptr, size_t newSize);
 
 void fixupMissingCallbacks(PDECODER_RENDERER_CALLBACKS* drCallbacks, PAUDIO_RENDERER_CALLBACKS* arCallbacks,
     PCONNECTION_LISTENER_CALLBACKS* clCallbacks);
+bool isSessionRecordingEnabled(void);
 void setRecorderCallbacks(PDECODER_RENDERER_CALLBACKS drCallbacks, PAUDIO_RENDERER_CALLBACKS arCallbacks);
+bool recordVideoFrame(PDECODE_UNIT decodeUnit);
 
 char* getSdpPayloadForStreamConfig(int rtspClientVersion, int* length);
 
 int initializeControlStream(void);
 int startControlStream(void);
 int stopControlStream(void);
+void abandonControlStream(void);
 void destroyControlStream(void);
 void connectionDetectedFrameLoss(uint32_t startFrame, uint32_t endFrame);
 void connectionReceivedCompleteFrame(uint32_t frameIndex);
@@ -132,6 +139,7 @@ void initializeVideoDepacketizer(int pktSize);
 void destroyVideoDepacketizer(void);
 void queueRtpPacket(PRTPV_QUEUE_ENTRY queueEntry);
 void stopVideoDepacketizer(void);
+void freeDecodeUnitBuffers(PLENTRY bufferList);
 void requestDecoderRefresh(void);
 void notifyFrameLost(unsigned int frameNumber, bool speculative);
 
@@ -140,14 +148,52 @@ void destroyVideoStream(void);
 void notifyKeyFrameReceived(void);
 int startVideoStream(void* rendererContext, int drFlags);
 void stopVideoStream(void);
+int startVideoReplay(void* rendererContext, int drFlags);
+void stopVideoReplay(void);
+void replayVideoPacket(const char* data, int length);
 
 int initializeAudioStream(void);
+void getChosenOpusConfig(POPUS_MULTISTREAM_CONFIGURATION chosenConfig);
 int notifyAudioPortNegotiationComplete(void);
 void destroyAudioStream(void);
 int startAudioStream(void* audioContext, int arFlags);
 void stopAudioStream(void);
+int startAudioReplay(void* audioContext, int arFlags);
+void stopAudioReplay(void);
+void replayAudioPacket(const char* data, int length);
 
 int initializeInputStream(void);
 void destroyInputStream(void);
 int startInputStream(void);
 int stopInputStream(void);
+
+// Records stream events for LiSetFlightRecorderDumpCallback() between these calls
+void initializeFlightRecorder(void);
+void cleanupFlightRecorder(void);
+void dumpFlightRecorderNow(const char* reason);
+
+// Feeds the video packets to LiGetBandwidthEstimate() between these calls. Encrypted
+// packets that are dropped before decryption only count as received.
+void initializeBandwidthEstimator(void);
+void cleanupBandwidthEstimator(void);
+void addBandwidthEstimatorPacket(uint16_t sequenceNumber, uint32_t timestamp, int length, uint64_t arrivalUs);
+void addBandwidthEstimatorSkippedPacket(int length);
+
+// Heap allocations are counted per source file for LiGetAllocationStats()
+int initializeAllocationTracker(void);
+void cleanupAllocationTracker(void);
+void markAllocationSteadyState(void);
+void* trackedMalloc(size_t size, const char* file);
+void* trackedCalloc(size_t count, size_t size, const char* file);
+void* trackedRealloc(void* ptr, size_t size, const char* file);
+char* trackedStrdup(const char* str, const char* file);
+void trackedFree(void* ptr, const char* file);
+
+#ifndef LC_ALLOCATION_TRACKER
+#undef strdup
+#define malloc(size) trackedMalloc(size, __FILE__)
+#define calloc(count, size) trackedCalloc(count, size, __FILE__)
+#define realloc(ptr, size) trackedRealloc(ptr, size, __FILE__)
+#define strdup(str) trackedStrdup(str, __FILE__)
+#define free(ptr) trackedFree(ptr, __FILE__)
+#endif
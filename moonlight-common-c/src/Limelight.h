@@ -107,7 +107,9 @@ void LiInitializeStreamConfiguration(PSTREAM_CONFIGURATION streamConfig);
 
 // These identify codec configuration data in the buffer lists
 // of frames identified as IDR frames for H.264 and HEVC formats.
-// For other codecs, all data is marked as BUFFER_TYPE_PICDATA.
+// For AV1, a sequence header OBU is placed in its own buffer marked
+// as BUFFER_TYPE_SPS. For other codecs, all data is marked as
+// BUFFER_TYPE_PICDATA.
 #define BUFFER_TYPE_PICDATA  0x00
 #define BUFFER_TYPE_SPS      0x01
 #define BUFFER_TYPE_PPS      0x02
@@ -123,7 +125,7 @@ typedef struct _LENTRY {
     // Size of data in bytes (never <= 0)
     int length;
 
-    // Buffer type (listed above, only set for H.264 and HEVC formats)
+    // Buffer type (listed above, only set for H.264, HEVC, and AV1 formats)
     int bufferType;
 } LENTRY, *PLENTRY;
 
@@ -137,9 +139,22 @@ typedef struct _LENTRY {
 // as the first buffers in the list. The I-frame data follows immediately
 // after the codec configuration NALUs.
 //
+// For AV1, the sequence header OBU follows the temporal delimiter in a separate buffer.
+//
 // For other codecs, any configuration data is not split into separate buffers.
 #define FRAME_TYPE_IDR    0x01
 
+// These describe properties of a frame parsed from the bitstream. They are
+// currently only provided for AV1 and are zero for other codecs.
+//
+// The frame only shows a previously decoded frame (AV1 show_existing_frame)
+#define FRAME_FLAG_SHOW_EXISTING    0x01
+// No later frame depends on this frame, so it may be skipped without corrupting the picture
+#define FRAME_FLAG_NON_REFERENCE    0x02
+// The frame carries a sequence header that differs from the previous one, so the
+// decoder may need to be reconfigured before this frame is submitted
+#define FRAME_FLAG_SEQUENCE_CHANGED 0x04
+
 // A decode unit describes a buffer chain of video data from multiple packets
 typedef struct _DECODE_UNIT {
     // Frame number
@@ -148,6 +163,9 @@ typedef struct _DECODE_UNIT {
     // Frame type
     int frameType;
 
+    // Frame flags (see FRAME_FLAG_* above)
+    uint8_t frameFlags;
+
     // Optional host processing latency of the frame, in 1/10 ms units.
     // Zero when the host doesn't provide the latency data
     // or frame processing latency is not applicable to the current frame
@@ -848,6 +866,12 @@ int LiGetPendingAudioFrames(void);
 // negotiated audio frame duration.
 int LiGetPendingAudioDuration(void);
 
+// Returns the host timestamp in milliseconds of the audio frame currently being
+// passed to decodeAndPlaySample(). For frames synthesized for packet loss
+// concealment, this is the previous timestamp advanced by one packet duration.
+// Only meaningful when called from within the decodeAndPlaySample() callback.
+uint32_t LiGetCurrentAudioTimestamp(void);
+
 // Port index flags for use with LiGetPortFromPortFlagIndex() and LiGetProtocolFromPortFlagIndex()
 #define ML_PORT_INDEX_TCP_47984 0
 #define ML_PORT_INDEX_TCP_47989 1
@@ -952,11 +976,347 @@ bool LiGetHdrMetadata(PSS_HDR_METADATA metadata);
 // frame, just that an IDR frame will arrive soon.
 void LiRequestIdrFrame(void);
 
+// The properties of an AV1 sequence header needed to describe the stream to a decoder
+typedef struct _AV1_SEQUENCE_INFO {
+    uint8_t profile;
+    uint8_t level;
+    uint8_t tier;
+    uint8_t bitDepth;
+    bool monochrome;
+    uint8_t subsamplingX;
+    uint8_t subsamplingY;
+    uint8_t chromaSamplePosition;
+    uint8_t colorPrimaries;
+    uint8_t transferCharacteristics;
+    uint8_t matrixCoefficients;
+    bool fullRange;
+    uint32_t maxWidth;
+    uint32_t maxHeight;
+} AV1_SEQUENCE_INFO, *PAV1_SEQUENCE_INFO;
+
+// This function parses an AV1 sequence header OBU (such as the contents of a BUFFER_TYPE_SPS
+// buffer in an AV1 frame). The level and tier are those of the first operating point.
+bool LiParseAv1SequenceHeader(const char* data, int length, PAV1_SEQUENCE_INFO info);
+
 // This function returns any extended feature flags supported by the host.
 #define LI_FF_PEN_TOUCH_EVENTS        0x01 // LiSendTouchEvent()/LiSendPenEvent() supported
 #define LI_FF_CONTROLLER_TOUCH_EVENTS 0x02 // LiSendControllerTouchEvent() supported
 uint32_t LiGetHostFeatureFlags(void);
 
+// Streams and directions that a network impairment profile applies to
+#define IMPAIR_STREAM_VIDEO   0
+#define IMPAIR_STREAM_AUDIO   1
+#define IMPAIR_STREAM_CONTROL 2
+#define IMPAIR_STREAM_COUNT   3
+
+#define IMPAIR_DIR_RECV 0x1
+#define IMPAIR_DIR_SEND 0x2
+
+// Distributions for the delay jitter
+#define IMPAIR_JITTER_UNIFORM 0 // Uniform within +/- jitterMs
+#define IMPAIR_JITTER_NORMAL  1 // Normal with a standard deviation of jitterMs
+
+// Network impairment applied to the datagrams of a stream. Loss follows a
+// Gilbert-Elliott model: each packet is lost with the loss probability of the
+// current state, then the state changes with the transition probability. All
+// probabilities are percentages. A zeroed profile disables the impairment.
+typedef struct _NETWORK_IMPAIRMENT {
+    float goodToBadPercent;
+    float badToGoodPercent;
+    float goodLossPercent;
+    float badLossPercent;
+
+    // Packets are held for delayMs plus a jitter sample, which may reorder them
+    int delayMs;
+    int jitterMs;
+    int jitterDistribution;
+
+    // Reordered packets are held for an extra reorderDelayMs
+    float reorderPercent;
+    int reorderDelayMs;
+
+    float duplicatePercent;
+} NETWORK_IMPAIRMENT, *PNETWORK_IMPAIRMENT;
+
+// Events reported to the impairment trace callback
+#define IMPAIR_EVENT_DROP        0
+#define IMPAIR_EVENT_DUPLICATE   1
+#define IMPAIR_EVENT_REORDER     2
+#define IMPAIR_EVENT_BURST_START 3 // Loss model entered the bad state
+#define IMPAIR_EVENT_BURST_END   4 // Loss model returned to the good state
+
+typedef struct _NETWORK_IMPAIRMENT_EVENT {
+    uint64_t timeMs; // LiGetMillis() time of the event
+    int stream;
+    int direction;
+    int type;
+
+    // Index of the datagram within this stream and direction, counted from
+    // the start of the stream. Together with the seed, it fully determines
+    // which impairments are injected.
+    uint32_t packetIndex;
+    int length;
+} NETWORK_IMPAIRMENT_EVENT, *PNETWORK_IMPAIRMENT_EVENT;
+
+// The trace callback is invoked on the network threads while the impairment
+// state is locked, so it must not block for long.
+typedef void(*NetworkImpairmentTraceCallback)(const NETWORK_IMPAIRMENT_EVENT* event);
+
+// These functions configure a repeatable network impairment for testing the loss
+// recovery paths. They take effect when the next connection is started and must not
+// be called during a connection. The directions are a combination of IMPAIR_DIR_*
+// flags. The impairment is only available when the library is built with
+// LC_NET_IMPAIRMENT, otherwise LiSetNetworkImpairment() returns -1.
+int LiSetNetworkImpairment(int stream, int directions, const NETWORK_IMPAIRMENT* impairment);
+void LiSetNetworkImpairmentSeed(uint64_t seed);
+void LiSetNetworkImpairmentTraceCallback(NetworkImpairmentTraceCallback callback);
+
+// This function sets a file that the next connections will record their received packets
+// to. Video packets are stored after decryption and audio packets as they arrive, along
+// with the negotiated stream parameters. The encryption keys are not stored. Passing NULL
+// stops capturing. This must not be called during a connection.
+void LiSetPacketCaptureFile(const char* path);
+
+// This function replays a packet capture through the depacketizers and the provided
+// renderer callbacks without a host. The stream configuration is only used for the
+// keys to decrypt captured audio and may be NULL if audio encryption was not used.
+// The packets are paced at speedPercent of their original timing, or as fast as
+// possible if speedPercent is 0. This blocks until the capture has been replayed,
+// and must not be called during a connection.
+int LiReplayPacketCapture(const char* path, PSTREAM_CONFIGURATION streamConfig,
+                          PCONNECTION_LISTENER_CALLBACKS clCallbacks, PDECODER_RENDERER_CALLBACKS drCallbacks,
+                          PAUDIO_RENDERER_CALLBACKS arCallbacks, int speedPercent);
+
+// This function sets a file that the next connections will record the stream to as
+// fragmented MP4, starting at the first IDR frame. Frames are muxed and written on a
+// background thread. If storage can't keep up, frames are dropped from the recording
+// until the next IDR frame, which is requested from the host. Passing NULL stops
+// recording. This must not be called during a connection.
+void LiSetSessionRecordingFile(const char* path);
+
+// Scheduling classes of the library's threads. Realtime media threads receive and
+// decode the stream and send input, interactive threads handle the control stream
+// and its timers, and background threads write captures and recordings.
+#define THREAD_CLASS_BACKGROUND     0
+#define THREAD_CLASS_INTERACTIVE    1
+#define THREAD_CLASS_REALTIME_MEDIA 2
+#define THREAD_CLASS_COUNT          3
+
+// This function enables or disables raising the priority of threads by their class,
+// which is enabled by default. On Linux, realtime media threads use SCHED_FIFO if the
+// process is allowed to, or a negative nice value otherwise, and background threads
+// use a positive nice value. Windows uses thread priorities and macOS uses QoS classes.
+// It takes effect for threads created afterwards, so it should be called before
+// starting a connection.
+void LiSetThreadPrioritiesEnabled(bool enabled);
+
+// This function restricts the threads of a class to the CPUs set in cpuMask, where
+// bit N is CPU N. A mask of 0 (the default) allows any CPU. Affinity is only applied
+// on Linux and Windows. It takes effect for threads created afterwards.
+void LiSetThreadClassAffinity(int threadClass, uint64_t cpuMask);
+
+#define THREAD_STATS_NAME_LENGTH 16
+
+typedef struct _THREAD_STATS {
+    char name[THREAD_STATS_NAME_LENGTH];
+
+    // CPU time used since the thread was registered. If the platform has no
+    // per-thread CPU clock (Emscripten, for example), this is estimated as the
+    // time spent outside of blocking waits and cpuTimeEstimated is set.
+    uint64_t cpuTimeUs;
+    bool cpuTimeEstimated;
+
+    // Returns from blocking waits since the thread was registered
+    uint64_t wakeups;
+
+    // Context switches counted by the OS since the thread started, or 0 if the
+    // platform doesn't report them (only Linux does)
+    uint64_t voluntaryContextSwitches;
+    uint64_t involuntaryContextSwitches;
+
+    // Rates over the interval since the previous snapshot
+    float cpuPercent;
+    float wakeupsPerSecond;
+} THREAD_STATS, *PTHREAD_STATS;
+
+// This function copies a snapshot of the threads registered for accounting and returns
+// the number of entries. The library's threads are registered while they run. Snapshots
+// are taken at most every 500 ms; more frequent calls return the previous snapshot, so
+// several readers polling at their own pace see consistent rates. It returns 0 if no
+// connection is active or the platform has no thread-local storage (consoles).
+int LiGetThreadStats(PTHREAD_STATS stats, int maxThreads);
+
+// These functions add an application thread to LiGetThreadStats(). A thread may register
+// itself while a connection is active, and must unregister before it exits and before
+// LiStopConnection() returns. Blocking waits outside of the library should be bracketed
+// by LiBeginThreadWait() and LiEndThreadWait() so they are counted as wakeups and left
+// out of estimated CPU time. They do nothing on threads that aren't registered.
+void LiRegisterThreadStats(const char* name);
+void LiUnregisterThreadStats(void);
+uint64_t LiBeginThreadWait(void);
+void LiEndThreadWait(uint64_t waitToken);
+
+#define LOCK_STATS_NAME_LENGTH 32
+
+// Bucket 0 counts times under 1 us and bucket N counts times from 2^(N-1) us
+// up to 2^N us. The last bucket also counts anything longer.
+#define LOCK_HISTOGRAM_BUCKETS 24
+
+typedef struct _LOCK_STATS {
+    char name[LOCK_STATS_NAME_LENGTH];
+
+    // Mutexes that were created with this name
+    uint32_t instances;
+
+    uint64_t acquisitions;
+    uint64_t contendedAcquisitions;
+
+    // Time spent waiting to acquire the lock and holding it. Time spent
+    // waiting on a condition variable doesn't count as holding it. The
+    // percentiles are the upper bounds of their histogram buckets.
+    uint64_t totalWaitUs;
+    uint64_t maxWaitUs;
+    uint32_t p99WaitUs;
+    uint64_t totalHoldUs;
+    uint64_t maxHoldUs;
+    uint32_t p99HoldUs;
+
+    uint32_t waitHistogram[LOCK_HISTOGRAM_BUCKETS];
+    uint32_t holdHistogram[LOCK_HISTOGRAM_BUCKETS];
+} LOCK_STATS, *PLOCK_STATS;
+
+// This function enables profiling the wait and hold times of the library's mutexes,
+// which is disabled by default. Unprofiled mutexes only pay for a pointer check. It
+// takes effect when the next connection is started, and the profile covers that
+// connection until the next one is started.
+void LiSetLockProfilingEnabled(bool enabled);
+
+// This function copies the lock profile grouped by lock name, sorted by the total
+// wait time, and returns the number of entries. It may be called during a
+// connection or after it stops.
+int LiGetLockStats(PLOCK_STATS stats, int maxLocks);
+
+typedef struct _LOCK_PROFILE LOCK_PROFILE, *PLOCK_PROFILE;
+
+// Application locks can be added to the profile. Each lock creates its profile once,
+// before any threads use the lock, and the profile is never freed. Acquisitions and
+// releases are reported while holding the lock, and only need to be timed while
+// LiIsLockProfilingActive() returns true.
+PLOCK_PROFILE LiCreateLockProfile(const char* name);
+bool LiIsLockProfilingActive(void);
+void LiRecordLockAcquired(PLOCK_PROFILE profile, uint64_t waitUs, bool contended);
+void LiRecordLockReleased(PLOCK_PROFILE profile, uint64_t holdUs);
+
+#define ALLOCATION_STATS_NAME_LENGTH 32
+
+typedef struct _ALLOCATION_STATS {
+    // The source file that made the allocations, without its extension
+    char name[ALLOCATION_STATS_NAME_LENGTH];
+
+    // Calls to malloc(), calloc(), realloc() and strdup() since the connection
+    // was started, and the bytes they requested
+    uint64_t allocations;
+    uint64_t bytes;
+
+    // Calls to free() with a non-NULL pointer made by the same source file
+    uint64_t frees;
+
+    // Rates since the connection was established, which leaves out the
+    // allocations made while setting up the stream
+    float allocationsPerSecond;
+    float bytesPerSecond;
+} ALLOCATION_STATS, *PALLOCATION_STATS;
+
+// This function enables counting the library's heap allocations per source file,
+// which is disabled by default. Untracked allocations only pay for a flag check.
+// Like lock profiling, it takes effect when the next connection is started.
+void LiSetAllocationTrackingEnabled(bool enabled);
+
+// This function copies the allocation counts sorted by the steady-state allocation
+// rate and returns the number of entries. It may be called during a connection or
+// after it stops. A stream that doesn't allocate once it is established reports
+// rates of zero.
+int LiGetAllocationStats(PALLOCATION_STATS stats, int maxSubsystems);
+
+// Flight recorder event types and the meaning of their two values
+#define FLIGHT_EVENT_VIDEO_PACKET      1  // Stream packet index, frame number
+#define FLIGHT_EVENT_FEC_RECOVERED     2  // Frame number, recovered data shards
+#define FLIGHT_EVENT_FEC_FAILED        3  // Frame number, missing data shards or 0 for lost FEC blocks
+#define FLIGHT_EVENT_FRAME_QUEUED      4  // Frame number, frame length
+#define FLIGHT_EVENT_FRAME_DEQUEUED    5  // Frame number, time in the decode unit queue in ms
+#define FLIGHT_EVENT_FRAME_COMPLETED   6  // Frame number, DR_* status
+#define FLIGHT_EVENT_AUDIO_PACKET      7  // Sequence number, packet length
+#define FLIGHT_EVENT_INPUT_SENT        8  // Packet magic, packet length
+#define FLIGHT_EVENT_CONNECTION_STATUS 9  // CONN_STATUS_*, frame loss percentage
+#define FLIGHT_EVENT_CONGESTION_STATE  12 // CONGESTION_STATE_*, received video kbps
+// Events recorded by the client
+#define FLIGHT_EVENT_APPEND_PACKET     10 // Frame number, time to append the frame to the decoder in us
+#define FLIGHT_EVENT_AUDIO_QUEUE       11 // Queued audio packets, 0
+
+// The dump is CSV text with one event per line. Times are in ms relative to the
+// trigger of the dump. The callback runs on an internal thread and must copy the
+// text if it keeps it.
+typedef void(*FlightRecorderDumpCallback)(const char* reason, const char* data, int length);
+
+// This function sets the callback that receives the flight recorder dumps. The
+// recorder keeps the last few seconds of packet, frame, audio and input events of
+// a connection started while a callback is set. The events around a stutter, a
+// poor connection report or a connection termination are dumped automatically.
+void LiSetFlightRecorderDumpCallback(FlightRecorderDumpCallback callback);
+
+// Clients can add their own events to the recording from any thread. Recording an
+// event doesn't take a lock.
+void LiRecordFlightEvent(int type, uint32_t a, uint32_t b);
+
+// This function requests a dump of the events around now, like a stutter detected
+// by the client. The dump runs a second later to include the recovery, and dumps
+// requested within 30 seconds of the previous one are ignored. The reason must be
+// a string constant.
+void LiTriggerFlightRecorderDump(const char* reason);
+
+#define CONGESTION_STATE_NORMAL   0 // The queueing delay is stable
+#define CONGESTION_STATE_OVERUSE  1 // The queueing delay grows, so the stream exceeds the path
+#define CONGESTION_STATE_UNDERUSE 2 // The queueing delay shrinks as a queue drains
+
+typedef struct _BANDWIDTH_ESTIMATE {
+    // The rate the path delivered the packets of recent frames at (the median of
+    // their dispersion), or 0 until frames of several packets were received. If the
+    // host paces its packets, this is a lower bound of the path capacity.
+    uint32_t capacityKbps;
+
+    // The bitrate the stream can use without building a queue. This is the
+    // capacity, or 85% of the received bitrate while the queueing delay grows.
+    uint32_t availableKbps;
+
+    // The video bitrate received over the last second, with packet headers
+    uint32_t receivedKbps;
+
+    // The smoothed delay of the frames above the lowest delay of the last 5 to 10
+    // seconds, and its trend over the last 20 frames
+    float queueingDelayMs;
+    float delayGradientMsPerSecond;
+    int congestionState;
+
+    // Video packets since the connection was started. Each gap in the RTP sequence
+    // numbers is a loss burst.
+    uint64_t receivedPackets;
+    uint64_t lostPackets;
+    uint32_t lossBursts;
+    uint32_t maxLossBurstPackets;
+    float meanLossBurstPackets;
+
+    // The share of video packets lost over the last second
+    float lossPercent;
+} BANDWIDTH_ESTIMATE, *PBANDWIDTH_ESTIMATE;
+
+// This function copies the estimate of the available bandwidth and congestion of
+// the video path, which is updated with each received frame from the packet
+// arrival times. Unlike CONN_STATUS_POOR, which reports frames that were already
+// lost, a growing queueing delay shows congestion before packets are dropped. It
+// returns false until video was received. It may be called during a connection or
+// after it stops.
+bool LiGetBandwidthEstimate(PBANDWIDTH_ESTIMATE estimate);
+
 #ifdef __cplusplus
 }
 #endif
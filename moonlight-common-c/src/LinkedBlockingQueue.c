@@ -36,12 +36,12 @@ PLINKED_BLOCKING_QUEUE_ENTRY LbqFlushQueueItems(PLINKED_BLOCKING_QUEUE queueHead
 }
 
 // Linked blocking queue init
-int LbqInitializeLinkedBlockingQueue(PLINKED_BLOCKING_QUEUE queueHead, int sizeBound) {
+int LbqInitializeLinkedBlockingQueue(PLINKED_BLOCKING_QUEUE queueHead, int sizeBound, const char* name) {
     int err;
 
     memset(queueHead, 0, sizeof(*queueHead));
 
-    err = PltCreateMutex(&queueHead->mutex);
+    err = PltCreateMutex(&queueHead->mutex, name);
     if (err != 0) {
         return err;
     }
@@ -0,0 +1,263 @@
+#include "Limelight-internal.h"
+
+// Every profiled lock has its own profile, which is only updated by the thread
+// holding that lock, so recording a sample takes no extra lock. Mutex profiles
+// stay in the list after their mutex is deleted so the profile outlives the
+// connection, and they are grouped by name when the stats are read. Application
+// lock profiles live for the whole process and are reset for each connection.
+
+struct _LOCK_PROFILE {
+    LOCK_STATS stats;
+    struct _LOCK_PROFILE* next;
+};
+
+static bool lockProfilingEnabled;
+static bool lockProfilingActive;
+static PLT_MUTEX profilerLock;
+static PLOCK_PROFILE mutexProfiles;
+static PLOCK_PROFILE applicationProfiles;
+
+void LiSetLockProfilingEnabled(bool enabled) {
+    lockProfilingEnabled = enabled;
+}
+
+bool LiIsLockProfilingActive(void) {
+    return lockProfilingActive;
+}
+
+static PLOCK_PROFILE allocateLockProfile(const char* name) {
+    PLOCK_PROFILE profile;
+
+    profile = calloc(1, sizeof(*profile));
+    if (profile == NULL) {
+        return NULL;
+    }
+
+    strncpy(profile->stats.name, name, sizeof(profile->stats.name) - 1);
+    profile->stats.instances = 1;
+    return profile;
+}
+
+PLOCK_PROFILE createMutexLockProfile(const char* name) {
+    PLOCK_PROFILE profile;
+
+    if (!lockProfilingActive) {
+        return NULL;
+    }
+
+    profile = allocateLockProfile(name);
+    if (profile == NULL) {
+        return NULL;
+    }
+
+    PltLockMutex(&profilerLock);
+    profile->next = mutexProfiles;
+    mutexProfiles = profile;
+    PltUnlockMutex(&profilerLock);
+
+    return profile;
+}
+
+PLOCK_PROFILE LiCreateLockProfile(const char* name) {
+    PLOCK_PROFILE profile;
+
+    profile = allocateLockProfile(name);
+    if (profile == NULL) {
+        return NULL;
+    }
+
+    profile->next = applicationProfiles;
+    applicationProfiles = profile;
+    return profile;
+}
+
+static int getHistogramBucket(uint64_t us) {
+    int bucket = 0;
+
+    while (us > 0 && bucket < LOCK_HISTOGRAM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+
+    return bucket;
+}
+
+void LiRecordLockAcquired(PLOCK_PROFILE profile, uint64_t waitUs, bool contended) {
+    if (profile == NULL || !lockProfilingActive) {
+        return;
+    }
+
+    profile->stats.acquisitions++;
+    if (contended) {
+        profile->stats.contendedAcquisitions++;
+    }
+    profile->stats.totalWaitUs += waitUs;
+    if (waitUs > profile->stats.maxWaitUs) {
+        profile->stats.maxWaitUs = waitUs;
+    }
+    profile->stats.waitHistogram[getHistogramBucket(waitUs)]++;
+}
+
+void LiRecordLockReleased(PLOCK_PROFILE profile, uint64_t holdUs) {
+    if (profile == NULL || !lockProfilingActive) {
+        return;
+    }
+
+    profile->stats.totalHoldUs += holdUs;
+    if (holdUs > profile->stats.maxHoldUs) {
+        profile->stats.maxHoldUs = holdUs;
+    }
+    profile->stats.holdHistogram[getHistogramBucket(holdUs)]++;
+}
+
+// Merges a profile into the stats entry of the same name, or a new entry if there's room
+static void addLockStats(PLOCK_STATS stats, int* count, int maxLocks, const LOCK_STATS* profile) {
+    PLOCK_STATS entry = NULL;
+    int i;
+
+    if (profile->acquisitions == 0) {
+        return;
+    }
+
+    for (i = 0; i < *count; i++) {
+        if (strcmp(stats[i].name, profile->name) == 0) {
+            entry = &stats[i];
+            break;
+        }
+    }
+
+    if (entry == NULL) {
+        if (*count == maxLocks) {
+            return;
+        }
+
+        stats[(*count)++] = *profile;
+        return;
+    }
+
+    entry->instances += profile->instances;
+    entry->acquisitions += profile->acquisitions;
+    entry->contendedAcquisitions += profile->contendedAcquisitions;
+    entry->totalWaitUs += profile->totalWaitUs;
+    entry->totalHoldUs += profile->totalHoldUs;
+    if (profile->maxWaitUs > entry->maxWaitUs) {
+        entry->maxWaitUs = profile->maxWaitUs;
+    }
+    if (profile->maxHoldUs > entry->maxHoldUs) {
+        entry->maxHoldUs = profile->maxHoldUs;
+    }
+    for (i = 0; i < LOCK_HISTOGRAM_BUCKETS; i++) {
+        entry->waitHistogram[i] += profile->waitHistogram[i];
+        entry->holdHistogram[i] += profile->holdHistogram[i];
+    }
+}
+
+static uint32_t getHistogramPercentile(const uint32_t* histogram, double percentile) {
+    uint64_t total = 0;
+    uint64_t count = 0;
+    int i;
+
+    for (i = 0; i < LOCK_HISTOGRAM_BUCKETS; i++) {
+        total += histogram[i];
+    }
+
+    for (i = 0; i < LOCK_HISTOGRAM_BUCKETS; i++) {
+        count += histogram[i];
+        if (count > 0 && count >= total * percentile) {
+            break;
+        }
+    }
+
+    return i < LOCK_HISTOGRAM_BUCKETS ? 1U << i : 1U << (LOCK_HISTOGRAM_BUCKETS - 1);
+}
+
+static int compareLockStats(const void* a, const void* b) {
+    const LOCK_STATS* statsA = (const LOCK_STATS*)a;
+    const LOCK_STATS* statsB = (const LOCK_STATS*)b;
+
+    if (statsA->totalWaitUs != statsB->totalWaitUs) {
+        return statsA->totalWaitUs > statsB->totalWaitUs ? -1 : 1;
+    }
+
+    return strcmp(statsA->name, statsB->name);
+}
+
+int LiGetLockStats(PLOCK_STATS stats, int maxLocks) {
+    PLOCK_PROFILE profile;
+    bool active = lockProfilingActive;
+    int count = 0;
+    int i;
+
+    // The list only changes during a connection
+    if (active) {
+        PltLockMutex(&profilerLock);
+    }
+
+    for (profile = mutexProfiles; profile != NULL; profile = profile->next) {
+        addLockStats(stats, &count, maxLocks, &profile->stats);
+    }
+
+    if (active) {
+        PltUnlockMutex(&profilerLock);
+    }
+
+    for (profile = applicationProfiles; profile != NULL; profile = profile->next) {
+        addLockStats(stats, &count, maxLocks, &profile->stats);
+    }
+
+    // A bucket's upper bound can exceed the largest sample in it
+    for (i = 0; i < count; i++) {
+        stats[i].p99WaitUs = getHistogramPercentile(stats[i].waitHistogram, 0.99);
+        if (stats[i].p99WaitUs > stats[i].maxWaitUs) {
+            stats[i].p99WaitUs = (uint32_t)stats[i].maxWaitUs;
+        }
+        stats[i].p99HoldUs = getHistogramPercentile(stats[i].holdHistogram, 0.99);
+        if (stats[i].p99HoldUs > stats[i].maxHoldUs) {
+            stats[i].p99HoldUs = (uint32_t)stats[i].maxHoldUs;
+        }
+    }
+
+    qsort(stats, count, sizeof(*stats), compareLockStats);
+    return count;
+}
+
+int initializeLockProfiler(void) {
+    PLOCK_PROFILE profile;
+    int err;
+
+    // The profile of the previous connection is replaced
+    while (mutexProfiles != NULL) {
+        profile = mutexProfiles;
+        mutexProfiles = profile->next;
+        free(profile);
+    }
+    for (profile = applicationProfiles; profile != NULL; profile = profile->next) {
+        LOCK_STATS stats;
+
+        memset(&stats, 0, sizeof(stats));
+        memcpy(stats.name, profile->stats.name, sizeof(stats.name));
+        stats.instances = 1;
+        profile->stats = stats;
+    }
+
+    if (!lockProfilingEnabled) {
+        return 0;
+    }
+
+    err = PltCreateMutex(&profilerLock, NULL);
+    if (err != 0) {
+        return err;
+    }
+
+    lockProfilingActive = true;
+    return 0;
+}
+
+void cleanupLockProfiler(void) {
+    if (!lockProfilingActive) {
+        return;
+    }
+
+    lockProfilingActive = false;
+    PltDeleteMutex(&profilerLock);
+}
@@ -7,6 +7,7 @@
 // replacement for enet_host_service(). It also handles cancellation of the connection
 // attempt during the wait.
 static int serviceEnetHostInternal(ENetHost* client, ENetEvent* event, enet_uint32 timeoutMs, bool ignoreInterrupts) {
+    uint64_t waitToken;
     int ret;
 
     // Clear the last socket error to ensure the caller doesn't read a stale error upon a
@@ -25,7 +26,10 @@ static int serviceEnetHostInternal(ENetHost* client, ENetEvent* event, enet_uint
             break;
         }
 
+        // Polls without a timeout aren't counted as waits
+        waitToken = selectedTimeout != 0 ? LiBeginThreadWait() : 0;
         ret = enet_host_service(client, event, selectedTimeout);
+        LiEndThreadWait(waitToken);
         if (ret != 0 || timeoutMs == 0) {
             break;
         }
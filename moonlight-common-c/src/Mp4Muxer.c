@@ -0,0 +1,775 @@
+#include "Limelight-internal.h"
+
+#define VIDEO_TRACK_ID 1
+#define AUDIO_TRACK_ID 2
+
+#define VIDEO_TIMESCALE 90000
+#define AUDIO_TIMESCALE 48000
+
+// Cut a fragment after this much video, or at the next IDR frame
+#define FRAGMENT_DURATION (VIDEO_TIMESCALE * 1)
+
+// sample_flags values (ISO/IEC 14496-12 section 8.8.3.1)
+#define SAMPLE_FLAGS_SYNC     0x02000000 // Depends on no other sample
+#define SAMPLE_FLAGS_NON_SYNC 0x01010000 // Depends on others, not a sync sample
+
+// 'und' packed as ISO-639-2/T
+#define LANGUAGE_UNDETERMINED 0x55C4
+
+#define TRUN_DATA_OFFSET_PRESENT     0x000001
+#define TRUN_SAMPLE_DURATION_PRESENT 0x000100
+#define TRUN_SAMPLE_SIZE_PRESENT     0x000200
+#define TRUN_SAMPLE_FLAGS_PRESENT    0x000400
+#define TFHD_DEFAULT_BASE_IS_MOOF    0x020000
+
+static const uint32_t unityMatrix[9] = { 0x00010000, 0, 0, 0, 0x00010000, 0, 0, 0, 0x40000000 };
+
+void mp4InitializeBuffer(PMP4_BUFFER buffer) {
+    memset(buffer, 0, sizeof(*buffer));
+}
+
+void mp4FreeBuffer(PMP4_BUFFER buffer) {
+    free(buffer->data);
+    mp4InitializeBuffer(buffer);
+}
+
+static bool reserveBuffer(PMP4_BUFFER buffer, size_t length) {
+    size_t capacity;
+    char* data;
+
+    if (buffer->failed) {
+        return false;
+    }
+    else if (buffer->length + length <= buffer->capacity) {
+        return true;
+    }
+
+    capacity = buffer->capacity != 0 ? buffer->capacity : 4096;
+    while (capacity < buffer->length + length) {
+        capacity *= 2;
+    }
+
+    data = realloc(buffer->data, capacity);
+    if (data == NULL) {
+        buffer->failed = true;
+        return false;
+    }
+
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return true;
+}
+
+static void putBytes(PMP4_BUFFER buffer, const void* data, size_t length) {
+    if (reserveBuffer(buffer, length)) {
+        memcpy(&buffer->data[buffer->length], data, length);
+        buffer->length += length;
+    }
+}
+
+static void put8(PMP4_BUFFER buffer, uint8_t value) {
+    putBytes(buffer, &value, sizeof(value));
+}
+
+static void put16(PMP4_BUFFER buffer, uint16_t value) {
+    value = BE16(value);
+    putBytes(buffer, &value, sizeof(value));
+}
+
+static void put32(PMP4_BUFFER buffer, uint32_t value) {
+    value = BE32(value);
+    putBytes(buffer, &value, sizeof(value));
+}
+
+static void put64(PMP4_BUFFER buffer, uint64_t value) {
+    value = BE64(value);
+    putBytes(buffer, &value, sizeof(value));
+}
+
+static void putZeros(PMP4_BUFFER buffer, size_t length) {
+    if (reserveBuffer(buffer, length)) {
+        memset(&buffer->data[buffer->length], 0, length);
+        buffer->length += length;
+    }
+}
+
+static void patch32(PMP4_BUFFER buffer, size_t offset, uint32_t value) {
+    if (!buffer->failed) {
+        value = BE32(value);
+        memcpy(&buffer->data[offset], &value, sizeof(value));
+    }
+}
+
+// Starts a box and returns its offset for endBox() to fill in the size
+static size_t beginBox(PMP4_BUFFER buffer, const char* type) {
+    size_t offset = buffer->length;
+
+    put32(buffer, 0);
+    putBytes(buffer, type, 4);
+    return offset;
+}
+
+static size_t beginFullBox(PMP4_BUFFER buffer, const char* type, uint8_t version, uint32_t flags) {
+    size_t offset = beginBox(buffer, type);
+
+    put32(buffer, ((uint32_t)version << 24) | flags);
+    return offset;
+}
+
+static void endBox(PMP4_BUFFER buffer, size_t offset) {
+    patch32(buffer, offset, (uint32_t)(buffer->length - offset));
+}
+
+static void putMatrix(PMP4_BUFFER buffer) {
+    for (int i = 0; i < 9; i++) {
+        put32(buffer, unityMatrix[i]);
+    }
+}
+
+// Returns the NAL unit in a parameter set buffer without its start sequence
+static bool getParameterSet(PLENTRY entry, const uint8_t** nal, int* length) {
+    const uint8_t* data = (const uint8_t*)entry->data;
+    int i = 0;
+
+    while (i < entry->length && data[i] == 0) {
+        i++;
+    }
+    if (i < 2 || i >= entry->length || data[i] != 1) {
+        return false;
+    }
+
+    *nal = &data[i + 1];
+    *length = entry->length - (i + 1);
+    return *length > 0;
+}
+
+static PLENTRY findBuffer(PLENTRY entry, int bufferType) {
+    while (entry != NULL) {
+        if (entry->bufferType == bufferType) {
+            return entry;
+        }
+        entry = entry->next;
+    }
+
+    return NULL;
+}
+
+static void putParameterSet(PMP4_BUFFER buffer, const uint8_t* nal, int length) {
+    put16(buffer, (uint16_t)length);
+    putBytes(buffer, nal, length);
+}
+
+static bool putAvcConfiguration(PMP4_MUXER muxer, PMP4_BUFFER buffer, PLENTRY bufferList) {
+    const uint8_t *sps, *pps;
+    int spsLength, ppsLength;
+    PLENTRY entry;
+    size_t box;
+
+    entry = findBuffer(bufferList, BUFFER_TYPE_SPS);
+    if (entry == NULL || !getParameterSet(entry, &sps, &spsLength) || spsLength < 4) {
+        return false;
+    }
+    entry = findBuffer(bufferList, BUFFER_TYPE_PPS);
+    if (entry == NULL || !getParameterSet(entry, &pps, &ppsLength)) {
+        return false;
+    }
+
+    // AVCDecoderConfigurationRecord (ISO/IEC 14496-15 section 5.3.3.1)
+    box = beginBox(buffer, "avcC");
+    put8(buffer, 1);
+    put8(buffer, sps[1]); // profile_idc
+    put8(buffer, sps[2]); // constraint flags
+    put8(buffer, sps[3]); // level_idc
+    put8(buffer, 0xFC | 3); // 4 byte NAL unit lengths
+    put8(buffer, 0xE0 | 1);
+    putParameterSet(buffer, sps, spsLength);
+    put8(buffer, 1);
+    putParameterSet(buffer, pps, ppsLength);
+    if (sps[1] != 66 && sps[1] != 77 && sps[1] != 88) {
+        // The chroma format and bit depth come from the negotiated format
+        // rather than the SPS, since they're fixed for each format we support.
+        put8(buffer, 0xFC | ((muxer->videoFormat & VIDEO_FORMAT_MASK_YUV444) ? 3 : 1));
+        put8(buffer, 0xF8);
+        put8(buffer, 0xF8);
+        put8(buffer, 0);
+    }
+    endBox(buffer, box);
+    return true;
+}
+
+static bool putHevcConfiguration(PMP4_MUXER muxer, PMP4_BUFFER buffer, PLENTRY bufferList) {
+    static const int parameterSetTypes[] = { BUFFER_TYPE_VPS, BUFFER_TYPE_SPS, BUFFER_TYPE_PPS };
+    static const uint8_t nalTypes[] = { 32, 33, 34 };
+    const uint8_t* nals[3];
+    int lengths[3];
+    uint8_t ptl[15];
+    size_t box;
+
+    for (int i = 0; i < 3; i++) {
+        PLENTRY entry = findBuffer(bufferList, parameterSetTypes[i]);
+        if (entry == NULL || !getParameterSet(entry, &nals[i], &lengths[i])) {
+            return false;
+        }
+    }
+
+    // Remove emulation prevention from the start of the SPS, which is the NAL
+    // header, the sub-layer info and the general profile_tier_level() fields.
+    int zeros = 0, ptlLength = 0;
+    for (int i = 0; i < lengths[1] && ptlLength < (int)sizeof(ptl); i++) {
+        if (zeros >= 2 && nals[1][i] == 3) {
+            zeros = 0;
+            continue;
+        }
+        zeros = nals[1][i] == 0 ? zeros + 1 : 0;
+        ptl[ptlLength++] = nals[1][i];
+    }
+    if (ptlLength < (int)sizeof(ptl)) {
+        return false;
+    }
+
+    // HEVCDecoderConfigurationRecord (ISO/IEC 14496-15 section 8.3.3.1)
+    box = beginBox(buffer, "hvcC");
+    put8(buffer, 1);
+    putBytes(buffer, &ptl[3], 12); // general profile, compatibility, constraints and level
+    put16(buffer, 0xF000); // min_spatial_segmentation_idc
+    put8(buffer, 0xFC); // parallelismType
+    put8(buffer, 0xFC | ((muxer->videoFormat & VIDEO_FORMAT_MASK_YUV444) ? 3 : 1));
+    put8(buffer, 0xF8 | ((muxer->videoFormat & VIDEO_FORMAT_MASK_10BIT) ? 2 : 0));
+    put8(buffer, 0xF8 | ((muxer->videoFormat & VIDEO_FORMAT_MASK_10BIT) ? 2 : 0));
+    put16(buffer, 0); // avgFrameRate
+    put8(buffer, ((((ptl[2] >> 1) & 0x7) + 1) << 3) | ((ptl[2] & 0x1) << 2) | 3);
+    put8(buffer, 3);
+    for (int i = 0; i < 3; i++) {
+        put8(buffer, nalTypes[i]);
+        put16(buffer, 1);
+        putParameterSet(buffer, nals[i], lengths[i]);
+    }
+    endBox(buffer, box);
+    return true;
+}
+
+static bool putAv1Configuration(PMP4_BUFFER buffer, PLENTRY bufferList) {
+    AV1_SEQUENCE_INFO info;
+    PLENTRY entry;
+    size_t box;
+
+    entry = findBuffer(bufferList, BUFFER_TYPE_SPS);
+    if (entry == NULL || !LiParseAv1SequenceHeader(entry->data, entry->length, &info)) {
+        return false;
+    }
+
+    // AV1CodecConfigurationRecord (AV1 Codec ISO Media File Format Binding section 2.3.3)
+    box = beginBox(buffer, "av1C");
+    put8(buffer, 0x81);
+    put8(buffer, (info.profile << 5) | (info.level & 0x1F));
+    put8(buffer, (info.tier << 7) | ((info.bitDepth > 8) << 6) | ((info.bitDepth == 12) << 5) |
+                 (info.monochrome << 4) | (info.subsamplingX << 3) | (info.subsamplingY << 2) |
+                 (info.chromaSamplePosition & 0x3));
+    put8(buffer, 0);
+    putBytes(buffer, entry->data, entry->length);
+    endBox(buffer, box);
+    return true;
+}
+
+static bool putVideoSampleEntry(PMP4_MUXER muxer, PMP4_BUFFER buffer, PLENTRY bufferList) {
+    const char* type;
+    size_t box;
+    bool ret;
+
+    if (muxer->videoFormat & VIDEO_FORMAT_MASK_H264) {
+        type = "avc3";
+    }
+    else if (muxer->videoFormat & VIDEO_FORMAT_MASK_H265) {
+        type = "hev1";
+    }
+    else {
+        type = "av01";
+    }
+
+    // VisualSampleEntry (ISO/IEC 14496-12 section 12.1.3)
+    box = beginBox(buffer, type);
+    putZeros(buffer, 6);
+    put16(buffer, 1); // data_reference_index
+    putZeros(buffer, 16);
+    put16(buffer, (uint16_t)muxer->width);
+    put16(buffer, (uint16_t)muxer->height);
+    put32(buffer, 0x00480000); // 72 dpi
+    put32(buffer, 0x00480000);
+    put32(buffer, 0);
+    put16(buffer, 1); // frame_count
+    putZeros(buffer, 32); // compressorname
+    put16(buffer, 0x0018); // depth
+    put16(buffer, 0xFFFF);
+
+    if (muxer->videoFormat & VIDEO_FORMAT_MASK_H264) {
+        ret = putAvcConfiguration(muxer, buffer, bufferList);
+    }
+    else if (muxer->videoFormat & VIDEO_FORMAT_MASK_H265) {
+        ret = putHevcConfiguration(muxer, buffer, bufferList);
+    }
+    else {
+        ret = putAv1Configuration(buffer, bufferList);
+    }
+
+    endBox(buffer, box);
+    return ret;
+}
+
+static void putAudioSampleEntry(PMP4_MUXER muxer, PMP4_BUFFER buffer) {
+    // Vorbis channel order used by Opus channel mapping family 1, as indexes of
+    // the channel order of OPUS_MULTISTREAM_CONFIGURATION.mapping
+    static const uint8_t vorbisOrder51[] = { 0, 2, 1, 4, 5, 3 };
+    static const uint8_t vorbisOrder71[] = { 0, 2, 1, 6, 7, 4, 5, 3 };
+    POPUS_MULTISTREAM_CONFIGURATION opusConfig = &muxer->opusConfig;
+    size_t box, dops;
+
+    // AudioSampleEntry (ISO/IEC 14496-12 section 12.2.3)
+    box = beginBox(buffer, "Opus");
+    putZeros(buffer, 6);
+    put16(buffer, 1); // data_reference_index
+    putZeros(buffer, 8);
+    put16(buffer, (uint16_t)opusConfig->channelCount);
+    put16(buffer, 16); // samplesize
+    put32(buffer, 0);
+    put32(buffer, (uint32_t)AUDIO_TIMESCALE << 16);
+
+    // OpusSpecificBox (Encapsulation of Opus in ISO Base Media File Format section 4.3.2)
+    dops = beginBox(buffer, "dOps");
+    put8(buffer, 0);
+    put8(buffer, (uint8_t)opusConfig->channelCount);
+    put16(buffer, 0); // PreSkip
+    put32(buffer, (uint32_t)opusConfig->sampleRate);
+    put16(buffer, 0); // OutputGain
+    if (opusConfig->channelCount <= 2 && opusConfig->streams == 1) {
+        // Mapping family 0 implies the stream layout
+        put8(buffer, 0);
+    }
+    else {
+        put8(buffer, 1);
+        put8(buffer, (uint8_t)opusConfig->streams);
+        put8(buffer, (uint8_t)opusConfig->coupledStreams);
+        for (int i = 0; i < opusConfig->channelCount; i++) {
+            if (opusConfig->channelCount == 6) {
+                put8(buffer, opusConfig->mapping[vorbisOrder51[i]]);
+            }
+            else if (opusConfig->channelCount == 8) {
+                put8(buffer, opusConfig->mapping[vorbisOrder71[i]]);
+            }
+            else {
+                put8(buffer, opusConfig->mapping[i]);
+            }
+        }
+    }
+    endBox(buffer, dops);
+
+    endBox(buffer, box);
+}
+
+static bool putTrack(PMP4_MUXER muxer, PMP4_BUFFER buffer, int track, PLENTRY bufferList) {
+    bool video = track == MP4_TRACK_VIDEO;
+    size_t trak, box, mdia, minf, stbl, stsd;
+    bool ret = true;
+
+    trak = beginBox(buffer, "trak");
+
+    box = beginFullBox(buffer, "tkhd", 0, 0x3); // Enabled and in movie
+    put32(buffer, 0); // creation_time
+    put32(buffer, 0); // modification_time
+    put32(buffer, video ? VIDEO_TRACK_ID : AUDIO_TRACK_ID);
+    put32(buffer, 0);
+    put32(buffer, 0); // duration
+    putZeros(buffer, 8);
+    put16(buffer, 0); // layer
+    put16(buffer, 0); // alternate_group
+    put16(buffer, video ? 0 : 0x0100); // volume
+    put16(buffer, 0);
+    putMatrix(buffer);
+    put32(buffer, video ? (uint32_t)muxer->width << 16 : 0);
+    put32(buffer, video ? (uint32_t)muxer->height << 16 : 0);
+    endBox(buffer, box);
+
+    mdia = beginBox(buffer, "mdia");
+
+    box = beginFullBox(buffer, "mdhd", 0, 0);
+    put32(buffer, 0);
+    put32(buffer, 0);
+    put32(buffer, video ? VIDEO_TIMESCALE : AUDIO_TIMESCALE);
+    put32(buffer, 0);
+    put16(buffer, LANGUAGE_UNDETERMINED);
+    put16(buffer, 0);
+    endBox(buffer, box);
+
+    box = beginFullBox(buffer, "hdlr", 0, 0);
+    put32(buffer, 0);
+    putBytes(buffer, video ? "vide" : "soun", 4);
+    putZeros(buffer, 12);
+    putBytes(buffer, video ? "VideoHandler" : "SoundHandler", sizeof("VideoHandler"));
+    endBox(buffer, box);
+
+    minf = beginBox(buffer, "minf");
+
+    if (video) {
+        box = beginFullBox(buffer, "vmhd", 0, 1);
+        putZeros(buffer, 8);
+    }
+    else {
+        box = beginFullBox(buffer, "smhd", 0, 0);
+        putZeros(buffer, 4);
+    }
+    endBox(buffer, box);
+
+    box = beginBox(buffer, "dinf");
+    size_t dref = beginFullBox(buffer, "dref", 0, 0);
+    put32(buffer, 1);
+    endBox(buffer, beginFullBox(buffer, "url ", 0, 1)); // Media is in this file
+    endBox(buffer, dref);
+    endBox(buffer, box);
+
+    // The samples are described by the fragments, so the sample tables are empty
+    stbl = beginBox(buffer, "stbl");
+    stsd = beginFullBox(buffer, "stsd", 0, 0);
+    put32(buffer, 1);
+    if (video) {
+        ret = putVideoSampleEntry(muxer, buffer, bufferList);
+    }
+    else {
+        putAudioSampleEntry(muxer, buffer);
+    }
+    endBox(buffer, stsd);
+
+    box = beginFullBox(buffer, "stts", 0, 0);
+    put32(buffer, 0);
+    endBox(buffer, box);
+    box = beginFullBox(buffer, "stsc", 0, 0);
+    put32(buffer, 0);
+    endBox(buffer, box);
+    box = beginFullBox(buffer, "stsz", 0, 0);
+    put32(buffer, 0);
+    put32(buffer, 0);
+    endBox(buffer, box);
+    box = beginFullBox(buffer, "stco", 0, 0);
+    put32(buffer, 0);
+    endBox(buffer, box);
+    endBox(buffer, stbl);
+
+    endBox(buffer, minf);
+    endBox(buffer, mdia);
+    endBox(buffer, trak);
+    return ret;
+}
+
+void mp4InitializeMuxer(PMP4_MUXER muxer, int videoFormat, int width, int height, int fps,
+                        const OPUS_MULTISTREAM_CONFIGURATION* opusConfig) {
+    memset(muxer, 0, sizeof(*muxer));
+    muxer->videoFormat = videoFormat;
+    muxer->width = width;
+    muxer->height = height;
+    muxer->fps = fps > 0 ? fps : 60;
+    muxer->opusConfig = *opusConfig;
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        mp4InitializeBuffer(&muxer->fragments[i].mdat);
+    }
+}
+
+void mp4DestroyMuxer(PMP4_MUXER muxer) {
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        mp4FreeBuffer(&muxer->fragments[i].mdat);
+    }
+}
+
+bool mp4WriteInitSegment(PMP4_MUXER muxer, PMP4_BUFFER out, PLENTRY bufferList) {
+    size_t initStart = out->length;
+    size_t box, moov;
+
+    box = beginBox(out, "ftyp");
+    putBytes(out, "isom", 4);
+    put32(out, 0x200);
+    putBytes(out, "isomiso6mp41", 12);
+    if (muxer->videoFormat & VIDEO_FORMAT_MASK_AV1) {
+        putBytes(out, "av01", 4);
+    }
+    endBox(out, box);
+
+    moov = beginBox(out, "moov");
+
+    box = beginFullBox(out, "mvhd", 0, 0);
+    put32(out, 0);
+    put32(out, 0);
+    put32(out, 1000); // timescale
+    put32(out, 0); // duration
+    put32(out, 0x00010000); // rate
+    put16(out, 0x0100); // volume
+    putZeros(out, 10);
+    putMatrix(out);
+    putZeros(out, 24);
+    put32(out, AUDIO_TRACK_ID + 1); // next_track_ID
+    endBox(out, box);
+
+    if (!putTrack(muxer, out, MP4_TRACK_VIDEO, bufferList)) {
+        // Discard the partial init segment
+        out->length = initStart;
+        return false;
+    }
+    putTrack(muxer, out, MP4_TRACK_AUDIO, NULL);
+
+    size_t mvex = beginBox(out, "mvex");
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        box = beginFullBox(out, "trex", 0, 0);
+        put32(out, i == MP4_TRACK_VIDEO ? VIDEO_TRACK_ID : AUDIO_TRACK_ID);
+        put32(out, 1); // default_sample_description_index
+        put32(out, 0);
+        put32(out, 0);
+        put32(out, 0);
+        endBox(out, box);
+    }
+    endBox(out, mvex);
+
+    endBox(out, moov);
+    return !out->failed;
+}
+
+// Converts Annex B start sequences to 4 byte NAL unit lengths. Emulation prevention
+// guarantees that a start sequence can't appear inside of a NAL unit.
+static uint32_t putLengthPrefixedNals(PMP4_BUFFER buffer, PLENTRY entry, int fullLength) {
+    size_t startLength = buffer->length;
+    size_t lengthOffset = 0;
+    bool inNal = false;
+    int zeros = 0;
+
+    // A 3 byte start sequence becomes a 4 byte length
+    if (!reserveBuffer(buffer, (size_t)fullLength * 2 + 4)) {
+        return 0;
+    }
+
+    for (; entry != NULL; entry = entry->next) {
+        const uint8_t* data = (const uint8_t*)entry->data;
+
+        for (int i = 0; i < entry->length; i++) {
+            if (data[i] == 0) {
+                zeros++;
+                continue;
+            }
+            else if (data[i] == 1 && zeros >= 2) {
+                if (inNal) {
+                    patch32(buffer, lengthOffset, (uint32_t)(buffer->length - lengthOffset - 4));
+                }
+                lengthOffset = buffer->length;
+                buffer->length += 4;
+                inNal = true;
+                zeros = 0;
+                continue;
+            }
+
+            if (inNal) {
+                while (zeros > 0) {
+                    buffer->data[buffer->length++] = 0;
+                    zeros--;
+                }
+                buffer->data[buffer->length++] = (char)data[i];
+            }
+            zeros = 0;
+        }
+    }
+
+    // Trailing zeros belong to the next start sequence, so they are dropped
+    if (inNal) {
+        patch32(buffer, lengthOffset, (uint32_t)(buffer->length - lengthOffset - 4));
+    }
+
+    return (uint32_t)(buffer->length - startLength);
+}
+
+// Copies the OBUs of a temporal unit, except for the temporal delimiter which
+// must not be stored in samples
+static uint32_t putAv1Obus(PMP4_BUFFER buffer, PLENTRY entry) {
+    size_t startLength = buffer->length;
+    bool first = true;
+
+    for (; entry != NULL; entry = entry->next) {
+        const uint8_t* data = (const uint8_t*)entry->data;
+        int length = entry->length;
+
+        if (first && length >= 2 && ((data[0] >> 3) & 0xF) == AV1_OBU_TEMPORAL_DELIMITER && (data[0] & 0x2)) {
+            int headerLength = (data[0] & 0x4) ? 2 : 1;
+
+            if (length > headerLength && data[headerLength] == 0) {
+                data += headerLength + 1;
+                length -= headerLength + 1;
+            }
+        }
+        if (length > 0) {
+            first = false;
+        }
+
+        putBytes(buffer, data, length);
+    }
+
+    return (uint32_t)(buffer->length - startLength);
+}
+
+static void putTrackFragment(PMP4_MUXER muxer, PMP4_BUFFER out, int track, size_t* dataOffsetPosition) {
+    PMP4_TRACK_FRAGMENT fragment = &muxer->fragments[track];
+    size_t traf, box;
+
+    traf = beginBox(out, "traf");
+
+    box = beginFullBox(out, "tfhd", 0, TFHD_DEFAULT_BASE_IS_MOOF);
+    put32(out, track == MP4_TRACK_VIDEO ? VIDEO_TRACK_ID : AUDIO_TRACK_ID);
+    endBox(out, box);
+
+    box = beginFullBox(out, "tfdt", 1, 0);
+    put64(out, fragment->samples[0].decodeTime);
+    endBox(out, box);
+
+    box = beginFullBox(out, "trun", 0, TRUN_DATA_OFFSET_PRESENT | TRUN_SAMPLE_DURATION_PRESENT |
+                                      TRUN_SAMPLE_SIZE_PRESENT | TRUN_SAMPLE_FLAGS_PRESENT);
+    put32(out, (uint32_t)fragment->sampleCount);
+    *dataOffsetPosition = out->length;
+    put32(out, 0);
+    for (int i = 0; i < fragment->sampleCount; i++) {
+        put32(out, fragment->samples[i].duration);
+        put32(out, fragment->samples[i].size);
+        put32(out, fragment->samples[i].sync ? SAMPLE_FLAGS_SYNC : SAMPLE_FLAGS_NON_SYNC);
+    }
+    endBox(out, box);
+
+    endBox(out, traf);
+}
+
+void mp4FlushFragment(PMP4_MUXER muxer, PMP4_BUFFER out) {
+    PMP4_TRACK_FRAGMENT video = &muxer->fragments[MP4_TRACK_VIDEO];
+    size_t dataOffsetPositions[MP4_TRACK_COUNT];
+    size_t moof, box, mdatLength;
+    uint32_t dataOffset;
+
+    if (video->sampleCount == 0 && muxer->fragments[MP4_TRACK_AUDIO].sampleCount == 0) {
+        return;
+    }
+
+    // Frame durations are the time to the next frame. The last frame of the
+    // fragment gets the nominal frame duration.
+    for (int i = 0; i < video->sampleCount; i++) {
+        if (i + 1 < video->sampleCount) {
+            video->samples[i].duration = (uint32_t)(video->samples[i + 1].decodeTime - video->samples[i].decodeTime);
+        }
+        else {
+            video->samples[i].duration = VIDEO_TIMESCALE / muxer->fps;
+        }
+    }
+
+    moof = beginBox(out, "moof");
+    box = beginFullBox(out, "mfhd", 0, 0);
+    put32(out, ++muxer->sequenceNumber);
+    endBox(out, box);
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        if (muxer->fragments[i].sampleCount != 0) {
+            putTrackFragment(muxer, out, i, &dataOffsetPositions[i]);
+        }
+    }
+    endBox(out, moof);
+
+    // The sample data offsets are relative to the start of the moof box
+    mdatLength = 8;
+    dataOffset = (uint32_t)(out->length - moof) + 8;
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        if (muxer->fragments[i].sampleCount != 0) {
+            patch32(out, dataOffsetPositions[i], dataOffset);
+            dataOffset += (uint32_t)muxer->fragments[i].mdat.length;
+            mdatLength += muxer->fragments[i].mdat.length;
+        }
+    }
+
+    put32(out, (uint32_t)mdatLength);
+    putBytes(out, "mdat", 4);
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        PMP4_TRACK_FRAGMENT fragment = &muxer->fragments[i];
+
+        putBytes(out, fragment->mdat.data, fragment->mdat.length);
+        fragment->mdat.length = 0;
+        fragment->mdat.failed = false;
+        fragment->sampleCount = 0;
+    }
+}
+
+static bool isFragmentFull(PMP4_MUXER muxer) {
+    for (int i = 0; i < MP4_TRACK_COUNT; i++) {
+        if (muxer->fragments[i].sampleCount == MP4_MAX_FRAGMENT_SAMPLES ||
+                muxer->fragments[i].mdat.length >= MP4_MAX_FRAGMENT_BYTES) {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+void mp4AddVideoSample(PMP4_MUXER muxer, PMP4_BUFFER out, PLENTRY bufferList, uint64_t decodeTime, bool keyFrame) {
+    PMP4_TRACK_FRAGMENT fragment = &muxer->fragments[MP4_TRACK_VIDEO];
+    PMP4_SAMPLE sample;
+    int fullLength = 0;
+
+    for (PLENTRY entry = bufferList; entry != NULL; entry = entry->next) {
+        fullLength += entry->length;
+    }
+
+    if (fragment->sampleCount != 0) {
+        PMP4_SAMPLE lastSample = &fragment->samples[fragment->sampleCount - 1];
+
+        // Decode times must increase
+        if (decodeTime <= lastSample->decodeTime) {
+            decodeTime = lastSample->decodeTime + 1;
+        }
+
+        // Start fragments at IDR frames where possible so they can be seeked to
+        if (keyFrame || decodeTime - fragment->samples[0].decodeTime >= FRAGMENT_DURATION ||
+                fragment->mdat.length + fullLength >= MP4_MAX_FRAGMENT_BYTES) {
+            mp4FlushFragment(muxer, out);
+        }
+    }
+    if (isFragmentFull(muxer)) {
+        mp4FlushFragment(muxer, out);
+    }
+
+    sample = &fragment->samples[fragment->sampleCount];
+    sample->decodeTime = decodeTime;
+    sample->sync = keyFrame;
+    if (muxer->videoFormat & VIDEO_FORMAT_MASK_AV1) {
+        sample->size = putAv1Obus(&fragment->mdat, bufferList);
+    }
+    else {
+        sample->size = putLengthPrefixedNals(&fragment->mdat, bufferList, fullLength);
+    }
+
+    if (!fragment->mdat.failed && sample->size != 0) {
+        fragment->sampleCount++;
+    }
+}
+
+void mp4AddAudioSample(PMP4_MUXER muxer, PMP4_BUFFER out, const char* data, int length, uint32_t lostPackets) {
+    PMP4_TRACK_FRAGMENT fragment = &muxer->fragments[MP4_TRACK_AUDIO];
+    uint32_t frameDuration = (uint32_t)muxer->opusConfig.samplesPerFrame;
+    PMP4_SAMPLE sample;
+
+    if (lostPackets != 0) {
+        // Lost packets extend the previous packet, since samples must be contiguous
+        if (fragment->sampleCount != 0) {
+            fragment->samples[fragment->sampleCount - 1].duration += lostPackets * frameDuration;
+        }
+        muxer->nextAudioTime += (uint64_t)lostPackets * frameDuration;
+    }
+
+    if (isFragmentFull(muxer)) {
+        mp4FlushFragment(muxer, out);
+    }
+
+    sample = &fragment->samples[fragment->sampleCount];
+    sample->decodeTime = muxer->nextAudioTime;
+    sample->duration = frameDuration;
+    sample->size = (uint32_t)length;
+    sample->sync = true;
+    putBytes(&fragment->mdat, data, length);
+
+    if (!fragment->mdat.failed) {
+        fragment->sampleCount++;
+        muxer->nextAudioTime += frameDuration;
+    }
+}
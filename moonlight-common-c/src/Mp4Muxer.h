@@ -0,0 +1,71 @@
+#pragma once
+
+#include "Limelight.h"
+
+// Fragmented MP4 (ISO/IEC 14496-12) muxer for the session recorder. It writes an
+// init segment with the codec configuration from the first IDR frame, then one
+// moof/mdat fragment per second of video or per GOP. Video uses the avc3, hev1
+// and av01 sample entries which allow parameter sets to repeat in-band, so the
+// decode units can be stored as received. Audio is stored as Opus.
+
+#define MP4_TRACK_VIDEO 0
+#define MP4_TRACK_AUDIO 1
+#define MP4_TRACK_COUNT 2
+
+// Fragments are cut before reaching either limit
+#define MP4_MAX_FRAGMENT_SAMPLES 1024
+#define MP4_MAX_FRAGMENT_BYTES (8 * 1024 * 1024)
+
+// Growable output buffer. Allocation failures are sticky and reported by failed.
+typedef struct _MP4_BUFFER {
+    char* data;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} MP4_BUFFER, *PMP4_BUFFER;
+
+typedef struct _MP4_SAMPLE {
+    uint64_t decodeTime;
+    uint32_t duration;
+    uint32_t size;
+    bool sync;
+} MP4_SAMPLE, *PMP4_SAMPLE;
+
+typedef struct _MP4_TRACK_FRAGMENT {
+    MP4_SAMPLE samples[MP4_MAX_FRAGMENT_SAMPLES];
+    int sampleCount;
+    MP4_BUFFER mdat;
+} MP4_TRACK_FRAGMENT, *PMP4_TRACK_FRAGMENT;
+
+typedef struct _MP4_MUXER {
+    int videoFormat;
+    int width;
+    int height;
+    int fps;
+    OPUS_MULTISTREAM_CONFIGURATION opusConfig;
+
+    uint32_t sequenceNumber;
+    uint64_t nextAudioTime;
+    MP4_TRACK_FRAGMENT fragments[MP4_TRACK_COUNT];
+} MP4_MUXER, *PMP4_MUXER;
+
+void mp4InitializeBuffer(PMP4_BUFFER buffer);
+void mp4FreeBuffer(PMP4_BUFFER buffer);
+
+void mp4InitializeMuxer(PMP4_MUXER muxer, int videoFormat, int width, int height, int fps,
+                        const OPUS_MULTISTREAM_CONFIGURATION* opusConfig);
+void mp4DestroyMuxer(PMP4_MUXER muxer);
+
+// Appends the ftyp and moov boxes. The buffer list must be an IDR frame containing
+// the parameter sets (or the AV1 sequence header). Returns false if they are missing.
+bool mp4WriteInitSegment(PMP4_MUXER muxer, PMP4_BUFFER out, PLENTRY bufferList);
+
+// Adds a frame to the current fragment. The decode time is in 90 kHz units. The
+// pending fragment is appended to the output first if this frame starts a new one.
+void mp4AddVideoSample(PMP4_MUXER muxer, PMP4_BUFFER out, PLENTRY bufferList, uint64_t decodeTime, bool keyFrame);
+
+// Adds an Opus packet after skipping the given number of lost packets
+void mp4AddAudioSample(PMP4_MUXER muxer, PMP4_BUFFER out, const char* data, int length, uint32_t lostPackets);
+
+// Appends any pending samples as a fragment
+void mp4FlushFragment(PMP4_MUXER muxer, PMP4_BUFFER out);
@@ -0,0 +1,605 @@
+#include "Limelight-internal.h"
+
+// This injects repeatable loss, burst loss, delay, reordering and duplication
+// into the datagrams of the video, audio and control streams. Every impairment
+// decision is drawn from random streams seeded per stream and direction, so the
+// same seed yields the same decisions for the same packet indexes regardless of
+// packet timing. Loss, reordering/duplication and delay use separate random
+// streams, so changing the delay profile doesn't change the loss pattern.
+
+static NETWORK_IMPAIRMENT impairmentProfiles[IMPAIR_STREAM_COUNT][2];
+static uint64_t impairmentSeed;
+static NetworkImpairmentTraceCallback traceCallback;
+
+#ifdef LC_NET_IMPAIRMENT
+
+#define CHANNEL_RECV 0
+#define CHANNEL_SEND 1
+
+#define MAX_IMPAIRED_SOCKETS 4
+
+// Large enough for any ENet datagram or RTP packet
+#define MAX_IMPAIRED_PACKET_SIZE 4096
+
+typedef struct _IMPAIRED_PACKET {
+    struct _IMPAIRED_PACKET* next;
+    uint64_t releaseTimeMs;
+    ENetAddress peerAddress;
+    ENetAddress localAddress;
+    bool hasLocalAddress;
+    int length;
+    char data[];
+} IMPAIRED_PACKET, *PIMPAIRED_PACKET;
+
+typedef struct _IMPAIRMENT_CHANNEL {
+    NETWORK_IMPAIRMENT profile;
+    bool enabled;
+
+    uint64_t lossRandom;
+    uint64_t eventRandom;
+    uint64_t delayRandom;
+    bool badState;
+    uint32_t packetIndex;
+
+    // Sorted by release time
+    PIMPAIRED_PACKET heldPackets;
+
+    uint32_t droppedPackets;
+    uint32_t duplicatedPackets;
+    uint32_t reorderedPackets;
+} IMPAIRMENT_CHANNEL, *PIMPAIRMENT_CHANNEL;
+
+typedef struct _IMPAIRED_SOCKET {
+    SOCKET socket;
+    int stream;
+    IMPAIRMENT_CHANNEL channels[2];
+} IMPAIRED_SOCKET, *PIMPAIRED_SOCKET;
+
+static PLT_MUTEX impairmentLock;
+static IMPAIRED_SOCKET impairedSockets[MAX_IMPAIRED_SOCKETS];
+
+static const char* streamNames[IMPAIR_STREAM_COUNT] = { "video", "audio", "control" };
+
+// SplitMix64
+static uint64_t nextRandom(uint64_t* state) {
+    uint64_t z = (*state += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+// Returns a uniform value in [0, 1) with 24 bits of precision
+static float nextRandomFloat(uint64_t* state) {
+    return (float)(nextRandom(state) >> 40) / (float)(1 << 24);
+}
+
+static bool nextRandomChance(uint64_t* state, float percent) {
+    // Always draw to keep the random stream aligned with the packet index
+    float value = nextRandomFloat(state) * 100.0f;
+    return value < percent;
+}
+
+static int nextJitterMs(PIMPAIRMENT_CHANNEL channel) {
+    float sample;
+
+    if (channel->profile.jitterMs == 0) {
+        return 0;
+    }
+
+    if (channel->profile.jitterDistribution == IMPAIR_JITTER_NORMAL) {
+        // Irwin-Hall approximation of a standard normal distribution. It avoids
+        // libm, whose results could differ between platforms.
+        sample = -6.0f;
+        for (int i = 0; i < 12; i++) {
+            sample += nextRandomFloat(&channel->delayRandom);
+        }
+    }
+    else {
+        sample = nextRandomFloat(&channel->delayRandom) * 2.0f - 1.0f;
+    }
+
+    return (int)(sample * channel->profile.jitterMs);
+}
+
+static bool isProfileEnabled(const NETWORK_IMPAIRMENT* profile) {
+    static const NETWORK_IMPAIRMENT disabledProfile;
+    return memcmp(profile, &disabledProfile, sizeof(*profile)) != 0;
+}
+
+static void traceImpairment(PIMPAIRED_SOCKET sock, int channelIndex, int type, int length, uint64_t now) {
+    NETWORK_IMPAIRMENT_EVENT event;
+
+    if (traceCallback == NULL) {
+        return;
+    }
+
+    event.timeMs = now;
+    event.stream = sock->stream;
+    event.direction = channelIndex == CHANNEL_RECV ? IMPAIR_DIR_RECV : IMPAIR_DIR_SEND;
+    event.type = type;
+    event.packetIndex = sock->channels[channelIndex].packetIndex;
+    event.length = length;
+    traceCallback(&event);
+}
+
+static void holdPacket(PIMPAIRMENT_CHANNEL channel, const char* data, int length,
+                       const ENetAddress* peerAddress, const ENetAddress* localAddress,
+                       uint64_t releaseTimeMs) {
+    PIMPAIRED_PACKET packet;
+    PIMPAIRED_PACKET* link;
+
+    packet = malloc(sizeof(*packet) + length);
+    if (packet == NULL) {
+        return;
+    }
+
+    packet->releaseTimeMs = releaseTimeMs;
+    if (peerAddress != NULL) {
+        packet->peerAddress = *peerAddress;
+    }
+    else {
+        memset(&packet->peerAddress, 0, sizeof(packet->peerAddress));
+    }
+    packet->hasLocalAddress = localAddress != NULL;
+    if (localAddress != NULL) {
+        packet->localAddress = *localAddress;
+    }
+    packet->length = length;
+    memcpy(packet->data, data, length);
+
+    // Insert after any packets with the same release time to keep their order
+    link = &channel->heldPackets;
+    while (*link != NULL && (*link)->releaseTimeMs <= releaseTimeMs) {
+        link = &(*link)->next;
+    }
+    packet->next = *link;
+    *link = packet;
+}
+
+// Runs a datagram through the impairment model and holds the surviving copies
+// until their release time
+static void impairPacket(PIMPAIRED_SOCKET sock, int channelIndex, const char* data, int length,
+                         const ENetAddress* peerAddress, const ENetAddress* localAddress) {
+    PIMPAIRMENT_CHANNEL channel = &sock->channels[channelIndex];
+    uint64_t now = PltGetMillis();
+    bool lost, transition, duplicate, reorder;
+
+    if (!channel->enabled) {
+        holdPacket(channel, data, length, peerAddress, localAddress, now);
+        return;
+    }
+
+    // Gilbert-Elliott loss with the loss probability of the current state
+    lost = nextRandomChance(&channel->lossRandom,
+                            channel->badState ? channel->profile.badLossPercent : channel->profile.goodLossPercent);
+    transition = nextRandomChance(&channel->lossRandom,
+                                  channel->badState ? channel->profile.badToGoodPercent : channel->profile.goodToBadPercent);
+    duplicate = nextRandomChance(&channel->eventRandom, channel->profile.duplicatePercent);
+    reorder = nextRandomChance(&channel->eventRandom, channel->profile.reorderPercent);
+
+    if (lost) {
+        channel->droppedPackets++;
+        traceImpairment(sock, channelIndex, IMPAIR_EVENT_DROP, length, now);
+    }
+    else {
+        for (int i = 0; i < (duplicate ? 2 : 1); i++) {
+            int delayMs = channel->profile.delayMs + nextJitterMs(channel);
+
+            if (i == 0 && reorder) {
+                delayMs += channel->profile.reorderDelayMs;
+                channel->reorderedPackets++;
+                traceImpairment(sock, channelIndex, IMPAIR_EVENT_REORDER, length, now);
+            }
+            else if (i == 1) {
+                channel->duplicatedPackets++;
+                traceImpairment(sock, channelIndex, IMPAIR_EVENT_DUPLICATE, length, now);
+            }
+
+            holdPacket(channel, data, length, peerAddress, localAddress, now + (delayMs > 0 ? delayMs : 0));
+        }
+    }
+
+    if (transition) {
+        channel->badState = !channel->badState;
+        traceImpairment(sock, channelIndex,
+                        channel->badState ? IMPAIR_EVENT_BURST_START : IMPAIR_EVENT_BURST_END,
+                        length, now);
+    }
+
+    channel->packetIndex++;
+}
+
+// Pops the first packet if it is due, otherwise returns NULL
+static PIMPAIRED_PACKET releasePacket(PIMPAIRMENT_CHANNEL channel, uint64_t now) {
+    PIMPAIRED_PACKET packet = channel->heldPackets;
+
+    if (packet == NULL || packet->releaseTimeMs > now) {
+        return NULL;
+    }
+
+    channel->heldPackets = packet->next;
+    return packet;
+}
+
+static void flushHeldSends(PIMPAIRED_SOCKET sock) {
+    PIMPAIRED_PACKET packet;
+    uint64_t now = PltGetMillis();
+
+    while ((packet = releasePacket(&sock->channels[CHANNEL_SEND], now)) != NULL) {
+        if (sock->stream == IMPAIR_STREAM_CONTROL) {
+            ENetBuffer buffer;
+
+            buffer.data = packet->data;
+            buffer.dataLength = packet->length;
+            enet_socket_send_direct(sock->socket, &packet->peerAddress,
+                                    packet->hasLocalAddress ? &packet->localAddress : NULL,
+                                    &buffer, 1);
+        }
+        else {
+            sendto(sock->socket, packet->data, packet->length, 0,
+                   (struct sockaddr*)&packet->peerAddress.address, packet->peerAddress.addressLength);
+        }
+
+        free(packet);
+    }
+}
+
+static uint64_t getNextReleaseTime(PIMPAIRED_SOCKET sock) {
+    uint64_t nextReleaseTimeMs = UINT64_MAX;
+
+    for (int i = 0; i < 2; i++) {
+        PIMPAIRED_PACKET packet = sock->channels[i].heldPackets;
+        if (packet != NULL && packet->releaseTimeMs < nextReleaseTimeMs) {
+            nextReleaseTimeMs = packet->releaseTimeMs;
+        }
+    }
+
+    return nextReleaseTimeMs;
+}
+
+// Must be called with impairmentLock held
+static PIMPAIRED_SOCKET findImpairedSocket(SOCKET s) {
+    for (int i = 0; i < MAX_IMPAIRED_SOCKETS; i++) {
+        if (impairedSockets[i].socket == s) {
+            return &impairedSockets[i];
+        }
+    }
+
+    return NULL;
+}
+
+static void freeImpairedSocket(PIMPAIRED_SOCKET sock) {
+    static const char* channelNames[2] = { "receive", "send" };
+
+    for (int i = 0; i < 2; i++) {
+        PIMPAIRMENT_CHANNEL channel = &sock->channels[i];
+
+        if (channel->enabled) {
+            Limelog("Network impairment on %s %s: %u packets, %u dropped, %u duplicated, %u reordered\n",
+                    streamNames[sock->stream], channelNames[i], channel->packetIndex,
+                    channel->droppedPackets, channel->duplicatedPackets, channel->reorderedPackets);
+        }
+
+        while (channel->heldPackets != NULL) {
+            PIMPAIRED_PACKET next = channel->heldPackets->next;
+            free(channel->heldPackets);
+            channel->heldPackets = next;
+        }
+    }
+
+    memset(sock, 0, sizeof(*sock));
+    sock->socket = INVALID_SOCKET;
+}
+
+void registerImpairedSocket(SOCKET s, int stream) {
+    PIMPAIRED_SOCKET sock;
+
+    LC_ASSERT(stream >= 0 && stream < IMPAIR_STREAM_COUNT);
+
+    if (!isProfileEnabled(&impairmentProfiles[stream][CHANNEL_RECV]) &&
+            !isProfileEnabled(&impairmentProfiles[stream][CHANNEL_SEND])) {
+        return;
+    }
+
+    PltLockMutex(&impairmentLock);
+
+    // A reused socket handle replaces the stale registration
+    sock = findImpairedSocket(s);
+    if (sock == NULL) {
+        sock = findImpairedSocket(INVALID_SOCKET);
+    }
+    if (sock == NULL) {
+        PltUnlockMutex(&impairmentLock);
+        Limelog("No free network impairment slot for the %s stream\n", streamNames[stream]);
+        return;
+    }
+
+    freeImpairedSocket(sock);
+    sock->socket = s;
+    sock->stream = stream;
+
+    for (int i = 0; i < 2; i++) {
+        PIMPAIRMENT_CHANNEL channel = &sock->channels[i];
+        uint64_t streamSeed = impairmentSeed ^ ((uint64_t)(stream * 2 + i) << 56);
+
+        channel->profile = impairmentProfiles[stream][i];
+        channel->enabled = isProfileEnabled(&channel->profile);
+
+        channel->lossRandom = nextRandom(&streamSeed);
+        channel->eventRandom = nextRandom(&streamSeed);
+        channel->delayRandom = nextRandom(&streamSeed);
+    }
+
+    PltUnlockMutex(&impairmentLock);
+
+    Limelog("Network impairment enabled on the %s stream (seed %llu)\n",
+            streamNames[stream], (unsigned long long)impairmentSeed);
+}
+
+bool isSocketImpaired(SOCKET s) {
+    bool impaired;
+
+    PltLockMutex(&impairmentLock);
+    impaired = findImpairedSocket(s) != NULL;
+    PltUnlockMutex(&impairmentLock);
+
+    return impaired;
+}
+
+int recvImpairedUdpSocket(SOCKET s, char* buffer, int size) {
+    uint64_t deadline = PltGetMillis() + UDP_RECV_POLL_TIMEOUT_MS;
+
+    for (;;) {
+        PIMPAIRED_SOCKET sock;
+        PIMPAIRED_PACKET packet;
+        uint64_t now, waitUntil;
+        struct pollfd pfd;
+        int err;
+
+        PltLockMutex(&impairmentLock);
+        sock = findImpairedSocket(s);
+        if (sock == NULL) {
+            PltUnlockMutex(&impairmentLock);
+            return recvUdpSocketDirect(s, buffer, size, true);
+        }
+
+        flushHeldSends(sock);
+
+        now = PltGetMillis();
+        packet = releasePacket(&sock->channels[CHANNEL_RECV], now);
+        waitUntil = getNextReleaseTime(sock);
+        PltUnlockMutex(&impairmentLock);
+
+        if (packet != NULL) {
+            err = packet->length < size ? packet->length : size;
+            memcpy(buffer, packet->data, err);
+            free(packet);
+            return err;
+        }
+        else if (now >= deadline) {
+            // Timeout
+            return 0;
+        }
+
+        if (waitUntil > deadline) {
+            waitUntil = deadline;
+        }
+
+        pfd.fd = s;
+        pfd.events = POLLIN;
+        err = pollSockets(&pfd, 1, (int)(waitUntil - now));
+        if (err < 0) {
+            return err;
+        }
+        else if (err == 0) {
+            continue;
+        }
+
+        // This won't block since the socket is readable
+        err = recvUdpSocketDirect(s, buffer, size, false);
+        if (err <= 0) {
+            return err;
+        }
+
+        PltLockMutex(&impairmentLock);
+        sock = findImpairedSocket(s);
+        if (sock != NULL) {
+            impairPacket(sock, CHANNEL_RECV, buffer, err, NULL, NULL);
+        }
+        PltUnlockMutex(&impairmentLock);
+
+        if (sock == NULL) {
+            return err;
+        }
+    }
+}
+
+int sendImpairedUdpSocket(SOCKET s, const char* buffer, int size, struct sockaddr* dstaddr, SOCKADDR_LEN addrLen) {
+    PIMPAIRED_SOCKET sock;
+    ENetAddress peerAddress;
+
+    PltLockMutex(&impairmentLock);
+    sock = findImpairedSocket(s);
+    if (sock == NULL || size > MAX_IMPAIRED_PACKET_SIZE) {
+        PltUnlockMutex(&impairmentLock);
+        return (int)sendto(s, buffer, size, 0, dstaddr, addrLen);
+    }
+
+    memset(&peerAddress, 0, sizeof(peerAddress));
+    memcpy(&peerAddress.address, dstaddr, addrLen);
+    peerAddress.addressLength = addrLen;
+
+    impairPacket(sock, CHANNEL_SEND, buffer, size, &peerAddress, NULL);
+    flushHeldSends(sock);
+    PltUnlockMutex(&impairmentLock);
+
+    return size;
+}
+
+int getImpairedWaitTimeMs(SOCKET s, int timeoutMs) {
+    PIMPAIRED_SOCKET sock;
+
+    PltLockMutex(&impairmentLock);
+    sock = findImpairedSocket(s);
+    if (sock != NULL) {
+        uint64_t now = PltGetMillis();
+        uint64_t nextReleaseTimeMs = getNextReleaseTime(sock);
+
+        if (nextReleaseTimeMs <= now) {
+            timeoutMs = 0;
+        }
+        else if (nextReleaseTimeMs - now < (uint64_t)timeoutMs) {
+            timeoutMs = (int)(nextReleaseTimeMs - now);
+        }
+    }
+    PltUnlockMutex(&impairmentLock);
+
+    return timeoutMs;
+}
+
+static int ENET_CALLBACK sendImpairedEnetSocket(ENetSocket socket, const ENetAddress* peerAddress,
+                                                const ENetAddress* localAddress, const ENetBuffer* buffers,
+                                                size_t bufferCount) {
+    PIMPAIRED_SOCKET sock;
+    char data[MAX_IMPAIRED_PACKET_SIZE];
+    size_t length = 0;
+
+    PltLockMutex(&impairmentLock);
+    sock = findImpairedSocket(socket);
+    if (sock == NULL) {
+        PltUnlockMutex(&impairmentLock);
+        return enet_socket_send_direct(socket, peerAddress, localAddress, buffers, bufferCount);
+    }
+
+    for (size_t i = 0; i < bufferCount; i++) {
+        if (length + buffers[i].dataLength > sizeof(data)) {
+            PltUnlockMutex(&impairmentLock);
+            return enet_socket_send_direct(socket, peerAddress, localAddress, buffers, bufferCount);
+        }
+
+        memcpy(&data[length], buffers[i].data, buffers[i].dataLength);
+        length += buffers[i].dataLength;
+    }
+
+    impairPacket(sock, CHANNEL_SEND, data, (int)length, peerAddress, localAddress);
+    flushHeldSends(sock);
+    PltUnlockMutex(&impairmentLock);
+
+    return (int)length;
+}
+
+static int ENET_CALLBACK recvImpairedEnetSocket(ENetSocket socket, ENetAddress* peerAddress,
+                                                ENetAddress* localAddress, ENetBuffer* buffers,
+                                                size_t bufferCount) {
+    for (;;) {
+        PIMPAIRED_SOCKET sock;
+        PIMPAIRED_PACKET packet;
+        int err;
+
+        PltLockMutex(&impairmentLock);
+        sock = findImpairedSocket(socket);
+        if (sock == NULL) {
+            PltUnlockMutex(&impairmentLock);
+            return enet_socket_receive_direct(socket, peerAddress, localAddress, buffers, bufferCount);
+        }
+
+        flushHeldSends(sock);
+        packet = releasePacket(&sock->channels[CHANNEL_RECV], PltGetMillis());
+        PltUnlockMutex(&impairmentLock);
+
+        if (packet != NULL) {
+            // ENet always receives into a single buffer
+            err = packet->length < (int)buffers[0].dataLength ? packet->length : (int)buffers[0].dataLength;
+            memcpy(buffers[0].data, packet->data, err);
+            if (peerAddress != NULL) {
+                *peerAddress = packet->peerAddress;
+            }
+            if (localAddress != NULL && packet->hasLocalAddress) {
+                *localAddress = packet->localAddress;
+            }
+            free(packet);
+            return err;
+        }
+
+        // Any packets held past this call are delivered on a later call, which
+        // the control stream schedules using getImpairedWaitTimeMs()
+        err = enet_socket_receive_direct(socket, peerAddress, localAddress, buffers, bufferCount);
+        if (err <= 0) {
+            return err;
+        }
+
+        PltLockMutex(&impairmentLock);
+        sock = findImpairedSocket(socket);
+        if (sock != NULL) {
+            impairPacket(sock, CHANNEL_RECV, buffers[0].data, err, peerAddress, localAddress);
+        }
+        PltUnlockMutex(&impairmentLock);
+
+        if (sock == NULL) {
+            return err;
+        }
+    }
+}
+
+static const ENetSocketHooks impairedEnetSocketHooks = {
+    sendImpairedEnetSocket,
+    recvImpairedEnetSocket
+};
+
+int initializeNetworkImpairment(void) {
+    int err;
+
+    err = PltCreateMutex(&impairmentLock, "Impairment");
+    if (err != 0) {
+        return err;
+    }
+
+    for (int i = 0; i < MAX_IMPAIRED_SOCKETS; i++) {
+        impairedSockets[i].socket = INVALID_SOCKET;
+    }
+
+    enet_socket_set_hooks(&impairedEnetSocketHooks);
+    return 0;
+}
+
+void cleanupNetworkImpairment(void) {
+    enet_socket_set_hooks(NULL);
+
+    for (int i = 0; i < MAX_IMPAIRED_SOCKETS; i++) {
+        if (impairedSockets[i].socket != INVALID_SOCKET) {
+            freeImpairedSocket(&impairedSockets[i]);
+        }
+    }
+
+    PltDeleteMutex(&impairmentLock);
+}
+
+#endif
+
+int LiSetNetworkImpairment(int stream, int directions, const NETWORK_IMPAIRMENT* impairment) {
+#ifdef LC_NET_IMPAIRMENT
+    if (stream < 0 || stream >= IMPAIR_STREAM_COUNT) {
+        return -1;
+    }
+
+    if (directions & IMPAIR_DIR_RECV) {
+        impairmentProfiles[stream][CHANNEL_RECV] = *impairment;
+    }
+    if (directions & IMPAIR_DIR_SEND) {
+        impairmentProfiles[stream][CHANNEL_SEND] = *impairment;
+    }
+
+    return 0;
+#else
+    (void)impairmentProfiles;
+    return -1;
+#endif
+}
+
+void LiSetNetworkImpairmentSeed(uint64_t seed) {
+    impairmentSeed = seed;
+}
+
+void LiSetNetworkImpairmentTraceCallback(NetworkImpairmentTraceCallback callback) {
+    traceCallback = callback;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "Limelight.h"
+#include "PlatformSockets.h"
+
+// The network impairment shim sits below recvUdpSocket(), sendUdpSocket() and the
+// ENet socket layer. It is only compiled in with LC_NET_IMPAIRMENT, so regular
+// builds talk to the sockets directly.
+#ifdef LC_NET_IMPAIRMENT
+int initializeNetworkImpairment(void);
+void cleanupNetworkImpairment(void);
+
+// Sockets stay registered until the platform is cleaned up at the end of the connection
+void registerImpairedSocket(SOCKET s, int stream);
+bool isSocketImpaired(SOCKET s);
+
+int recvImpairedUdpSocket(SOCKET s, char* buffer, int size);
+int sendImpairedUdpSocket(SOCKET s, const char* buffer, int size, struct sockaddr* dstaddr, SOCKADDR_LEN addrLen);
+
+// Shortens a socket wait so held packets are released on time
+int getImpairedWaitTimeMs(SOCKET s, int timeoutMs);
+#else
+#define initializeNetworkImpairment() 0
+#define cleanupNetworkImpairment()
+#define registerImpairedSocket(s, stream)
+#define getImpairedWaitTimeMs(s, timeoutMs) (timeoutMs)
+#endif
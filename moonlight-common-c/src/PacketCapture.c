@@ -0,0 +1,540 @@
+#ifdef _WIN32
+// Don't warn for fopen() usage
+#define _CRT_SECURE_NO_WARNINGS 1
+#endif
+
+#include "Limelight-internal.h"
+
+#ifndef LC_WINDOWS
+#include <fcntl.h>
+#include <sys/mman.h>
+#endif
+
+// Packet captures record every datagram the client hands to the RTP queues (after
+// video decryption, with audio still encrypted as the FEC requires) and every raw
+// control stream datagram, so loss, reordering and FEC recovery can be analyzed and
+// replayed offline. The receive threads only copy each datagram into the capture
+// queue. A background thread appends them to a memory-mapped file.
+//
+// File layout (little endian):
+//   Header: "MLCAPTUR", version, header length, then the negotiated stream
+//           parameters that replay needs (see writeCaptureHeader())
+//   Record: 32-bit microseconds since the previous record, 16-bit length,
+//           8-bit CAPTURE_STREAM_* value, 8-bit reserved, then the datagram
+
+#define CAPTURE_MAGIC "MLCAPTUR"
+#define CAPTURE_VERSION 1
+#define CAPTURE_HEADER_SIZE 112
+#define CAPTURE_RECORD_HEADER_SIZE 8
+
+#define CAPTURE_FLAG_AUDIO_ENCRYPTED 0x1
+#define CAPTURE_FLAG_RFI_SUPPORTED   0x2
+
+// Packets waiting for the writer thread before new ones are discarded
+#define CAPTURE_QUEUE_BOUND 4096
+
+// Unpaced replays hold back while this many frames are waiting to be decoded
+#define REPLAY_MAX_PENDING_VIDEO_FRAMES 8
+#define REPLAY_MAX_PENDING_AUDIO_FRAMES 15
+
+// The file grows in chunks that are mapped one at a time
+#define CAPTURE_MAP_CHUNK_SIZE (8 * 1024 * 1024)
+
+typedef struct _CAPTURED_PACKET {
+    LINKED_BLOCKING_QUEUE_ENTRY entry;
+    uint64_t timeUs;
+    uint16_t length;
+    uint8_t stream;
+    char data[];
+} CAPTURED_PACKET, *PCAPTURED_PACKET;
+
+static char* capturePath;
+static bool captureRunning;
+static LINKED_BLOCKING_QUEUE captureQueue;
+static PLT_THREAD captureWriterThread;
+static uint64_t lastRecordTimeUs;
+static uint32_t capturedPackets;
+static uint32_t discardedPackets;
+
+#ifdef LC_WINDOWS
+static FILE* captureFile;
+#else
+static int captureFd = -1;
+static char* captureMapping;
+static uint64_t mappingOffset;
+static uint64_t mappingPosition;
+#endif
+
+static bool openCaptureFile(const char* path) {
+#ifdef LC_WINDOWS
+    captureFile = fopen(path, "wb");
+    return captureFile != NULL;
+#else
+    captureFd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (captureFd < 0) {
+        return false;
+    }
+
+    mappingOffset = 0;
+    mappingPosition = 0;
+    captureMapping = NULL;
+    return true;
+#endif
+}
+
+#ifndef LC_WINDOWS
+static bool mapNextChunk(void) {
+    if (captureMapping != NULL) {
+        munmap(captureMapping, CAPTURE_MAP_CHUNK_SIZE);
+        captureMapping = NULL;
+        mappingOffset += CAPTURE_MAP_CHUNK_SIZE;
+        mappingPosition = 0;
+    }
+
+    if (ftruncate(captureFd, (off_t)(mappingOffset + CAPTURE_MAP_CHUNK_SIZE)) < 0) {
+        return false;
+    }
+
+    captureMapping = mmap(NULL, CAPTURE_MAP_CHUNK_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED,
+                          captureFd, (off_t)mappingOffset);
+    if (captureMapping == MAP_FAILED) {
+        captureMapping = NULL;
+        return false;
+    }
+
+    return true;
+}
+#endif
+
+static bool appendToCaptureFile(const char* data, int length) {
+#ifdef LC_WINDOWS
+    return fwrite(data, 1, length, captureFile) == (size_t)length;
+#else
+    while (length > 0) {
+        int chunkLength;
+
+        if (captureMapping == NULL || mappingPosition == CAPTURE_MAP_CHUNK_SIZE) {
+            if (!mapNextChunk()) {
+                return false;
+            }
+        }
+
+        chunkLength = length;
+        if ((uint64_t)chunkLength > CAPTURE_MAP_CHUNK_SIZE - mappingPosition) {
+            chunkLength = (int)(CAPTURE_MAP_CHUNK_SIZE - mappingPosition);
+        }
+
+        memcpy(&captureMapping[mappingPosition], data, chunkLength);
+        mappingPosition += chunkLength;
+        data += chunkLength;
+        length -= chunkLength;
+    }
+
+    return true;
+#endif
+}
+
+static void closeCaptureFile(void) {
+#ifdef LC_WINDOWS
+    fclose(captureFile);
+    captureFile = NULL;
+#else
+    if (captureMapping != NULL) {
+        munmap(captureMapping, CAPTURE_MAP_CHUNK_SIZE);
+        captureMapping = NULL;
+    }
+
+    // Trim the unused part of the last chunk
+    if (ftruncate(captureFd, (off_t)(mappingOffset + mappingPosition)) < 0) {
+        Limelog("Failed to truncate packet capture: %d\n", errno);
+    }
+    close(captureFd);
+    captureFd = -1;
+#endif
+}
+
+static bool writeCaptureHeader(void) {
+    char header[CAPTURE_HEADER_SIZE];
+    BYTE_BUFFER bb;
+    POPUS_MULTISTREAM_CONFIGURATION opusConfig;
+    uint32_t flags = 0;
+
+    opusConfig = HighQualitySurroundEnabled ? &HighQualityOpusConfig : &NormalQualityOpusConfig;
+    if (AudioEncryptionEnabled) {
+        flags |= CAPTURE_FLAG_AUDIO_ENCRYPTED;
+    }
+    if (ReferenceFrameInvalidationSupported) {
+        flags |= CAPTURE_FLAG_RFI_SUPPORTED;
+    }
+
+    memset(header, 0, sizeof(header));
+    memcpy(header, CAPTURE_MAGIC, strlen(CAPTURE_MAGIC));
+    BbInitializeWrappedBuffer(&bb, header, 8, sizeof(header) - 8, BYTE_ORDER_LITTLE);
+    BbPut32(&bb, CAPTURE_VERSION);
+    BbPut32(&bb, CAPTURE_HEADER_SIZE);
+    BbPut32(&bb, NegotiatedVideoFormat);
+    BbPut32(&bb, StreamConfig.width);
+    BbPut32(&bb, StreamConfig.height);
+    BbPut32(&bb, StreamConfig.fps);
+    BbPut32(&bb, StreamConfig.packetSize);
+    BbPut32(&bb, StreamConfig.audioConfiguration);
+    BbPut32(&bb, AudioPacketDuration);
+    BbPut32(&bb, opusConfig->sampleRate);
+    BbPut32(&bb, opusConfig->channelCount);
+    BbPut32(&bb, opusConfig->streams);
+    BbPut32(&bb, opusConfig->coupledStreams);
+    for (int i = 0; i < AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT; i++) {
+        BbPut8(&bb, opusConfig->mapping[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        BbPut32(&bb, AppVersionQuad[i]);
+    }
+    BbPut32(&bb, SunshineFeatureFlags);
+    BbPut32(&bb, EncryptionFeaturesEnabled);
+    BbPut32(&bb, flags);
+    LC_ASSERT(bb.position <= sizeof(header));
+
+    return appendToCaptureFile(header, sizeof(header));
+}
+
+static bool writeCapturedPacket(PCAPTURED_PACKET packet) {
+    char recordHeader[CAPTURE_RECORD_HEADER_SIZE];
+    BYTE_BUFFER bb;
+    uint64_t deltaUs;
+
+    // Packets from different receive threads may be queued slightly out of time order
+    deltaUs = packet->timeUs > lastRecordTimeUs ? packet->timeUs - lastRecordTimeUs : 0;
+    if (deltaUs > UINT32_MAX) {
+        deltaUs = UINT32_MAX;
+    }
+    lastRecordTimeUs += deltaUs;
+
+    BbInitializeWrappedBuffer(&bb, recordHeader, 0, sizeof(recordHeader), BYTE_ORDER_LITTLE);
+    BbPut32(&bb, (uint32_t)deltaUs);
+    BbPut16(&bb, packet->length);
+    BbPut8(&bb, packet->stream);
+    BbPut8(&bb, 0);
+
+    return appendToCaptureFile(recordHeader, sizeof(recordHeader)) &&
+           appendToCaptureFile(packet->data, packet->length);
+}
+
+static void captureWriterThreadProc(void* context) {
+    PCAPTURED_PACKET packet;
+    bool failed = false;
+
+    // The queue is drained before this returns when the capture stops
+    while (LbqWaitForQueueElement(&captureQueue, (void**)&packet) == LBQ_SUCCESS) {
+        if (!failed && !writeCapturedPacket(packet)) {
+            Limelog("Packet capture write failed; capture stopped\n");
+            failed = true;
+        }
+
+        free(packet);
+    }
+}
+
+void LiSetPacketCaptureFile(const char* path) {
+    free(capturePath);
+    capturePath = path != NULL ? strdup(path) : NULL;
+}
+
+void startPacketCapture(void) {
+    int err;
+
+    if (capturePath == NULL) {
+        return;
+    }
+
+    // A failed capture is logged but doesn't fail the connection
+    if (!openCaptureFile(capturePath)) {
+        Limelog("Failed to open packet capture file: %s\n", capturePath);
+        return;
+    }
+
+    if (!writeCaptureHeader()) {
+        Limelog("Failed to write packet capture header\n");
+        closeCaptureFile();
+        return;
+    }
+
+    LbqInitializeLinkedBlockingQueue(&captureQueue, CAPTURE_QUEUE_BOUND, "CaptureQueue");
+    lastRecordTimeUs = PltGetMicroseconds();
+    capturedPackets = 0;
+    discardedPackets = 0;
+
+    err = PltCreateThread("PktCapture", THREAD_CLASS_BACKGROUND, captureWriterThreadProc, NULL, &captureWriterThread);
+    if (err != 0) {
+        LbqDestroyLinkedBlockingQueue(&captureQueue);
+        closeCaptureFile();
+        return;
+    }
+
+    captureRunning = true;
+    Limelog("Capturing packets to %s\n", capturePath);
+}
+
+void stopPacketCapture(void) {
+    if (!captureRunning) {
+        return;
+    }
+
+    captureRunning = false;
+
+    // Let the writer finish the queued packets
+    LbqSignalQueueDrain(&captureQueue);
+    PltJoinThread(&captureWriterThread);
+    LbqDestroyLinkedBlockingQueue(&captureQueue);
+
+    closeCaptureFile();
+
+    Limelog("Packet capture complete: %u packets, %u discarded\n", capturedPackets, discardedPackets);
+}
+
+void capturePacket(int stream, const char* data, int length) {
+    PCAPTURED_PACKET packet;
+
+    if (!captureRunning) {
+        return;
+    }
+
+    LC_ASSERT(length >= 0 && length <= UINT16_MAX);
+
+    packet = malloc(sizeof(*packet) + length);
+    if (packet == NULL) {
+        return;
+    }
+
+    packet->timeUs = PltGetMicroseconds();
+    packet->length = (uint16_t)length;
+    packet->stream = (uint8_t)stream;
+    memcpy(packet->data, data, length);
+
+    if (LbqOfferQueueItem(&captureQueue, packet, &packet->entry) != LBQ_SUCCESS) {
+        // The writer fell behind. Don't stall the receive threads for it.
+        free(packet);
+        discardedPackets++;
+        return;
+    }
+
+    capturedPackets++;
+}
+
+static bool readCaptureHeader(FILE* file, PSTREAM_CONFIGURATION streamConfig) {
+    char header[CAPTURE_HEADER_SIZE];
+    BYTE_BUFFER bb;
+    uint32_t version, headerLength, value, flags;
+
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) ||
+            memcmp(header, CAPTURE_MAGIC, strlen(CAPTURE_MAGIC)) != 0) {
+        return false;
+    }
+
+    BbInitializeWrappedBuffer(&bb, header, 8, sizeof(header) - 8, BYTE_ORDER_LITTLE);
+    BbGet32(&bb, &version);
+    BbGet32(&bb, &headerLength);
+    if (version != CAPTURE_VERSION || headerLength < CAPTURE_HEADER_SIZE) {
+        return false;
+    }
+
+    memset(&StreamConfig, 0, sizeof(StreamConfig));
+    if (streamConfig != NULL) {
+        // Only the keys are used, to decrypt captured audio
+        memcpy(StreamConfig.remoteInputAesKey, streamConfig->remoteInputAesKey, sizeof(StreamConfig.remoteInputAesKey));
+        memcpy(StreamConfig.remoteInputAesIv, streamConfig->remoteInputAesIv, sizeof(StreamConfig.remoteInputAesIv));
+    }
+
+    BbGet32(&bb, &value);
+    NegotiatedVideoFormat = (int)value;
+    BbGet32(&bb, &value);
+    StreamConfig.width = (int)value;
+    BbGet32(&bb, &value);
+    StreamConfig.height = (int)value;
+    BbGet32(&bb, &value);
+    StreamConfig.fps = (int)value;
+    BbGet32(&bb, &value);
+    StreamConfig.packetSize = (int)value;
+    BbGet32(&bb, &value);
+    StreamConfig.audioConfiguration = (int)value;
+    BbGet32(&bb, &value);
+    AudioPacketDuration = (int)value;
+    BbGet32(&bb, &value);
+    NormalQualityOpusConfig.sampleRate = (int)value;
+    BbGet32(&bb, &value);
+    NormalQualityOpusConfig.channelCount = (int)value;
+    BbGet32(&bb, &value);
+    NormalQualityOpusConfig.streams = (int)value;
+    BbGet32(&bb, &value);
+    NormalQualityOpusConfig.coupledStreams = (int)value;
+    for (int i = 0; i < AUDIO_CONFIGURATION_MAX_CHANNEL_COUNT; i++) {
+        BbGet8(&bb, &NormalQualityOpusConfig.mapping[i]);
+    }
+    for (int i = 0; i < 4; i++) {
+        BbGet32(&bb, &value);
+        AppVersionQuad[i] = (int)value;
+    }
+    BbGet32(&bb, &SunshineFeatureFlags);
+    BbGet32(&bb, &EncryptionFeaturesEnabled);
+    BbGet32(&bb, &flags);
+
+    HighQualitySurroundEnabled = false;
+    AudioEncryptionEnabled = !!(flags & CAPTURE_FLAG_AUDIO_ENCRYPTED);
+    ReferenceFrameInvalidationSupported = !!(flags & CAPTURE_FLAG_RFI_SUPPORTED);
+
+    // Skip header fields added by later versions
+    return fseek(file, (long)headerLength, SEEK_SET) == 0;
+}
+
+// Waits for the decoder threads to catch up, so unpaced replays don't overflow
+// the frame queues. Renderers that stopped pulling frames are given up on.
+static void waitForPendingFrames(int maxVideoFrames, int maxAudioFrames) {
+    uint64_t startTimeMs = PltGetMillis();
+
+    while ((LiGetPendingVideoFrames() > maxVideoFrames || LiGetPendingAudioFrames() > maxAudioFrames) &&
+           PltGetMillis() - startTimeMs < 1000) {
+        PltSleepMs(1);
+    }
+}
+
+int LiReplayPacketCapture(const char* path, PSTREAM_CONFIGURATION streamConfig,
+                          PCONNECTION_LISTENER_CALLBACKS clCallbacks, PDECODER_RENDERER_CALLBACKS drCallbacks,
+                          PAUDIO_RENDERER_CALLBACKS arCallbacks, int speedPercent) {
+    char recordHeader[CAPTURE_RECORD_HEADER_SIZE];
+    char* data;
+    uint64_t captureTimeUs, startTimeUs;
+    uint32_t replayedPackets;
+    FILE* file;
+    int err;
+
+    fixupMissingCallbacks(&drCallbacks, &arCallbacks, &clCallbacks);
+    memcpy(&ListenerCallbacks, clCallbacks, sizeof(ListenerCallbacks));
+    memcpy(&VideoCallbacks, drCallbacks, sizeof(VideoCallbacks));
+    memcpy(&AudioCallbacks, arCallbacks, sizeof(AudioCallbacks));
+
+    // This allows converting captures into session recordings
+    if (isSessionRecordingEnabled()) {
+        setRecorderCallbacks(&VideoCallbacks, &AudioCallbacks);
+    }
+
+    file = fopen(path, "rb");
+    if (file == NULL) {
+        Limelog("Failed to open packet capture: %s\n", path);
+        return -1;
+    }
+
+    if (!readCaptureHeader(file, streamConfig)) {
+        Limelog("Invalid packet capture: %s\n", path);
+        fclose(file);
+        return -1;
+    }
+
+    data = malloc(UINT16_MAX);
+    if (data == NULL) {
+        fclose(file);
+        return -1;
+    }
+
+    if (AudioEncryptionEnabled && streamConfig == NULL) {
+        Limelog("Replaying encrypted audio requires the stream configuration of the capture\n");
+    }
+
+    ConnectionInterrupted = false;
+    err = initializePlatform();
+    if (err != 0) {
+        free(data);
+        fclose(file);
+        return err;
+    }
+
+    // The control stream isn't started, but the depacketizer reports frame loss to it.
+    // Abandoning it up front makes it drop those reports instead of sending requests.
+    err = initializeControlStream();
+    if (err != 0) {
+        cleanupPlatform();
+        free(data);
+        fclose(file);
+        return err;
+    }
+    abandonControlStream();
+
+    initializeAudioStream();
+    initializeVideoStream();
+
+    err = startVideoReplay(NULL, 0);
+    if (err != 0) {
+        goto DestroyStreams;
+    }
+
+    err = startAudioReplay(NULL, 0);
+    if (err != 0) {
+        stopVideoReplay();
+        goto DestroyStreams;
+    }
+
+    markAllocationSteadyState();
+
+    captureTimeUs = 0;
+    replayedPackets = 0;
+    startTimeUs = PltGetMicroseconds();
+    while (fread(recordHeader, 1, sizeof(recordHeader), file) == sizeof(recordHeader)) {
+        BYTE_BUFFER bb;
+        uint32_t deltaUs;
+        uint16_t length;
+        uint8_t stream;
+
+        BbInitializeWrappedBuffer(&bb, recordHeader, 0, sizeof(recordHeader), BYTE_ORDER_LITTLE);
+        BbGet32(&bb, &deltaUs);
+        BbGet16(&bb, &length);
+        BbGet8(&bb, &stream);
+
+        if (fread(data, 1, length, file) != length) {
+            Limelog("Packet capture is truncated\n");
+            break;
+        }
+
+        // Pace the packets at the requested fraction of their original timing
+        captureTimeUs += deltaUs;
+        if (speedPercent > 0) {
+            uint64_t targetTimeUs = startTimeUs + captureTimeUs * 100 / speedPercent;
+            uint64_t now = PltGetMicroseconds();
+
+            if (targetTimeUs > now + 1000) {
+                PltSleepMs((int)((targetTimeUs - now) / 1000));
+            }
+        }
+        else {
+            waitForPendingFrames(REPLAY_MAX_PENDING_VIDEO_FRAMES, REPLAY_MAX_PENDING_AUDIO_FRAMES);
+        }
+
+        switch (stream) {
+        case CAPTURE_STREAM_VIDEO:
+            replayVideoPacket(data, length);
+            break;
+        case CAPTURE_STREAM_AUDIO:
+            replayAudioPacket(data, length);
+            break;
+        default:
+            // Control stream datagrams are ENet encrypted and can't be replayed
+            continue;
+        }
+
+        replayedPackets++;
+    }
+
+    waitForPendingFrames(0, 0);
+
+    Limelog("Replayed %u packets in %u ms\n", replayedPackets,
+            (uint32_t)((PltGetMicroseconds() - startTimeUs) / 1000));
+
+    stopAudioReplay();
+    stopVideoReplay();
+
+DestroyStreams:
+    destroyVideoStream();
+    destroyAudioStream();
+    destroyControlStream();
+    cleanupPlatform();
+    free(data);
+    fclose(file);
+    return err;
+}
@@ -0,0 +1,14 @@
+#pragma once
+
+#include "Limelight.h"
+
+#define CAPTURE_STREAM_VIDEO   0
+#define CAPTURE_STREAM_AUDIO   1
+#define CAPTURE_STREAM_CONTROL 2
+
+// Packet capture is only active when LiSetPacketCaptureFile() set a path
+void startPacketCapture(void);
+void stopPacketCapture(void);
+
+// Called from the receive threads. This is a no-op if no capture is running.
+void capturePacket(int stream, const char* data, int length);
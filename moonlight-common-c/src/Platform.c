@@ -1,14 +1,27 @@
 #define _GNU_SOURCE
 #include "Limelight-internal.h"
 
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
 // The maximum amount of time before observing an interrupt
 // in PltSleepMsInterruptible().
 #define INTERRUPT_PERIOD_MS 50
 
+// Nice values used when SCHED_FIFO isn't permitted and for the other classes.
+// Lowering the nice value may also be refused, which leaves the default.
+#define REALTIME_MEDIA_NICE -10
+#define INTERACTIVE_NICE -5
+#define BACKGROUND_NICE 10
+
 struct thread_context {
     ThreadEntry entry;
     void* context;
     const char* name;
+    int threadClass;
 #if defined(__vita__)
     PLT_THREAD* thread;
 #endif
@@ -19,6 +32,86 @@ static int activeMutexes = 0;
 static int activeEvents = 0;
 static int activeCondVars = 0;
 
+static bool threadPrioritiesEnabled = true;
+static uint64_t threadClassAffinity[THREAD_CLASS_COUNT];
+
+void LiSetThreadPrioritiesEnabled(bool enabled) {
+    threadPrioritiesEnabled = enabled;
+}
+
+void LiSetThreadClassAffinity(int threadClass, uint64_t cpuMask) {
+    LC_ASSERT(threadClass >= 0 && threadClass < THREAD_CLASS_COUNT);
+    threadClassAffinity[threadClass] = cpuMask;
+}
+
+// Applies the scheduling priority and CPU affinity of a thread class to the calling thread
+static void applyThreadClass(const char* name, int threadClass) {
+    uint64_t affinity = threadClassAffinity[threadClass];
+
+#if defined(LC_WINDOWS)
+    if (threadPrioritiesEnabled) {
+        static const int priorities[THREAD_CLASS_COUNT] = {
+            THREAD_PRIORITY_BELOW_NORMAL, THREAD_PRIORITY_ABOVE_NORMAL, THREAD_PRIORITY_HIGHEST
+        };
+        SetThreadPriority(GetCurrentThread(), priorities[threadClass]);
+    }
+#if defined(LC_WINDOWS_DESKTOP)
+    if (affinity != 0 && SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)affinity) == 0) {
+        Limelog("Unable to set CPU affinity of %s: %d\n", name, (int)GetLastError());
+    }
+#endif
+#elif defined(__linux__)
+    if (threadPrioritiesEnabled) {
+        static const int niceValues[THREAD_CLASS_COUNT] = {
+            BACKGROUND_NICE, INTERACTIVE_NICE, REALTIME_MEDIA_NICE
+        };
+        bool scheduled = false;
+
+        if (threadClass == THREAD_CLASS_REALTIME_MEDIA) {
+            struct sched_param param;
+
+            // The lowest realtime priorities are enough to preempt normal threads
+            // without competing with the system's own realtime threads
+            memset(&param, 0, sizeof(param));
+            param.sched_priority = sched_get_priority_min(SCHED_FIFO) + 1;
+            scheduled = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param) == 0;
+        }
+
+        // Linux applies the nice value of a thread ID to that thread only
+        if (!scheduled) {
+            setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), niceValues[threadClass]);
+        }
+    }
+
+    if (affinity != 0) {
+        cpu_set_t cpuSet;
+        int cpu;
+
+        CPU_ZERO(&cpuSet);
+        for (cpu = 0; cpu < 64 && cpu < CPU_SETSIZE; cpu++) {
+            if (affinity & (1ULL << cpu)) {
+                CPU_SET(cpu, &cpuSet);
+            }
+        }
+
+        if (pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0) {
+            Limelog("Unable to set CPU affinity of %s\n", name);
+        }
+    }
+#elif defined(LC_DARWIN)
+    if (threadPrioritiesEnabled) {
+        static const qos_class_t qosClasses[THREAD_CLASS_COUNT] = {
+            QOS_CLASS_UTILITY, QOS_CLASS_USER_INITIATED, QOS_CLASS_USER_INTERACTIVE
+        };
+        pthread_set_qos_class_self_np(qosClasses[threadClass], 0);
+    }
+    (void)affinity;
+#else
+    (void)affinity;
+#endif
+    (void)name;
+}
+
 #if defined(LC_WINDOWS)
 
 #pragma pack(push, 8)
@@ -86,8 +179,13 @@ void* ThreadProc(void* context) {
     pthread_setname_np(ctx->name);
 #endif
 
+    applyThreadClass(ctx->name, ctx->threadClass);
+    LiRegisterThreadStats(ctx->name);
+
     ctx->entry(ctx->context);
 
+    LiUnregisterThreadStats();
+
 #if defined(__vita__)
     if (ctx->thread->detached) {
         free(ctx);
@@ -108,6 +206,8 @@ void* ThreadProc(void* context) {
 }
 
 void PltSleepMs(int ms) {
+    uint64_t waitToken = LiBeginThreadWait();
+
 #if defined(LC_WINDOWS)
     SleepEx(ms, FALSE);
 #elif defined(__vita__)
@@ -119,6 +219,8 @@ void PltSleepMs(int ms) {
     useconds_t usecs = ms * 1000;
     usleep(usecs);
 #endif
+
+    LiEndThreadWait(waitToken);
 }
 
 void PltSleepMsInterruptible(PLT_THREAD* thread, int ms) {
@@ -129,24 +231,26 @@ void PltSleepMsInterruptible(PLT_THREAD* thread, int ms) {
     }
 }
 
-int PltCreateMutex(PLT_MUTEX* mutex) {
+int PltCreateMutex(PLT_MUTEX* mutex, const char* name) {
 #if defined(LC_WINDOWS)
-    InitializeSRWLock(mutex);
+    InitializeSRWLock(&mutex->native);
 #elif defined(__vita__)
-    *mutex = sceKernelCreateMutex("", 0, 0, NULL);
-    if (*mutex < 0) {
+    mutex->native = sceKernelCreateMutex("", 0, 0, NULL);
+    if (mutex->native < 0) {
         return -1;
     }
 #elif defined(__WIIU__)
-    OSFastMutex_Init(mutex, "");
+    OSFastMutex_Init(&mutex->native, "");
 #elif defined(__3DS__)
-    LightLock_Init(mutex);
+    LightLock_Init(&mutex->native);
 #else
-    int err = pthread_mutex_init(mutex, NULL);
+    int err = pthread_mutex_init(&mutex->native, NULL);
     if (err != 0) {
         return err;
     }
 #endif
+    mutex->profile = name != NULL ? createMutexLockProfile(name) : NULL;
+    mutex->lockedUs = 0;
     activeMutexes++;
     return 0;
 }
@@ -154,18 +258,33 @@ int PltCreateMutex(PLT_MUTEX* mutex) {
 void PltDeleteMutex(PLT_MUTEX* mutex) {
     LC_ASSERT(activeMutexes > 0);
     activeMutexes--;
+    mutex->profile = NULL;
 #if defined(LC_WINDOWS)
     // No-op to destroy a SRWLOCK
 #elif defined(__vita__)
-    sceKernelDeleteMutex(*mutex);
+    sceKernelDeleteMutex(mutex->native);
 #elif defined(__WIIU__) || defined(__3DS__)
 
 #else
-    pthread_mutex_destroy(mutex);
+    pthread_mutex_destroy(&mutex->native);
 #endif
 }
 
-void PltLockMutex(PLT_MUTEX* mutex) {
+static bool tryLockNativeMutex(PLT_NATIVE_MUTEX* mutex) {
+#if defined(LC_WINDOWS)
+    return TryAcquireSRWLockExclusive(mutex);
+#elif defined(__vita__)
+    return sceKernelTryLockMutex(*mutex, 1) == 0;
+#elif defined(__WIIU__)
+    return OSFastMutex_TryLock(mutex);
+#elif defined(__3DS__)
+    return LightLock_TryLock(mutex) == 0;
+#else
+    return pthread_mutex_trylock(mutex) == 0;
+#endif
+}
+
+static void lockNativeMutex(PLT_NATIVE_MUTEX* mutex) {
 #if defined(LC_WINDOWS)
     AcquireSRWLockExclusive(mutex);
 #elif defined(__vita__)
@@ -179,7 +298,7 @@ void PltLockMutex(PLT_MUTEX* mutex) {
 #endif
 }
 
-void PltUnlockMutex(PLT_MUTEX* mutex) {
+static void unlockNativeMutex(PLT_NATIVE_MUTEX* mutex) {
 #if defined(LC_WINDOWS)
     ReleaseSRWLockExclusive(mutex);
 #elif defined(__vita__)
@@ -193,6 +312,34 @@ void PltUnlockMutex(PLT_MUTEX* mutex) {
 #endif
 }
 
+void PltLockMutex(PLT_MUTEX* mutex) {
+    uint64_t startUs;
+    bool contended;
+
+    if (mutex->profile == NULL) {
+        lockNativeMutex(&mutex->native);
+        return;
+    }
+
+    // Only a failed try counts as contention
+    startUs = PltGetMicroseconds();
+    contended = !tryLockNativeMutex(&mutex->native);
+    if (contended) {
+        lockNativeMutex(&mutex->native);
+    }
+
+    mutex->lockedUs = PltGetMicroseconds();
+    LiRecordLockAcquired(mutex->profile, contended ? mutex->lockedUs - startUs : 0, contended);
+}
+
+void PltUnlockMutex(PLT_MUTEX* mutex) {
+    if (mutex->profile != NULL) {
+        LiRecordLockReleased(mutex->profile, PltGetMicroseconds() - mutex->lockedUs);
+    }
+
+    unlockNativeMutex(&mutex->native);
+}
+
 void PltJoinThread(PLT_THREAD* thread) {
     LC_ASSERT(activeThreads > 0);
     activeThreads--;
@@ -248,9 +395,11 @@ static void thread_deallocator(OSThread *thread, void *stack) {
 }
 #endif
 
-int PltCreateThread(const char* name, ThreadEntry entry, void* context, PLT_THREAD* thread) {
+int PltCreateThread(const char* name, int threadClass, ThreadEntry entry, void* context, PLT_THREAD* thread) {
     struct thread_context* ctx;
 
+    LC_ASSERT(threadClass >= 0 && threadClass < THREAD_CLASS_COUNT);
+
     ctx = (struct thread_context*)malloc(sizeof(*ctx));
     if (ctx == NULL) {
         return -1;
@@ -259,6 +408,7 @@ int PltCreateThread(const char* name, ThreadEntry entry, void* context, PLT_THRE
     ctx->entry = entry;
     ctx->context = context;
     ctx->name = name;
+    ctx->threadClass = threadClass;
 
     thread->cancelled = false;
 
@@ -346,7 +496,7 @@ int PltCreateEvent(PLT_EVENT* event) {
         return -1;
     }
 #else
-    if (PltCreateMutex(&event->mutex) < 0) {
+    if (PltCreateMutex(&event->mutex, "Event") < 0) {
         return -1;
     }
     if (PltCreateConditionVariable(&event->cond, &event->mutex) < 0) {
@@ -391,7 +541,9 @@ void PltClearEvent(PLT_EVENT* event) {
 
 void PltWaitForEvent(PLT_EVENT* event) {
 #if defined(LC_WINDOWS)
+    uint64_t waitToken = LiBeginThreadWait();
     WaitForSingleObjectEx(*event, INFINITE, FALSE);
+    LiEndThreadWait(waitToken);
 #else
     PltLockMutex(&event->mutex);
     while (!event->signalled) {
@@ -405,7 +557,7 @@ int PltCreateConditionVariable(PLT_COND* cond, PLT_MUTEX* mutex) {
 #if defined(LC_WINDOWS)
     InitializeConditionVariable(cond);
 #elif defined(__vita__)
-    *cond = sceKernelCreateCond("", 0, *mutex, NULL);
+    *cond = sceKernelCreateCond("", 0, mutex->native, NULL);
     if (*cond < 0) {
         return -1;
     }
@@ -450,18 +602,54 @@ void PltSignalConditionVariable(PLT_COND* cond) {
 #endif
 }
 
+void PltBroadcastConditionVariable(PLT_COND* cond) {
+#if defined(LC_WINDOWS)
+    WakeAllConditionVariable(cond);
+#elif defined(__vita__)
+    sceKernelSignalCondAll(*cond);
+#elif defined(__WIIU__)
+    // OSFastCond_Signal() wakes all waiting threads
+    OSFastCond_Signal(cond);
+#elif defined(__3DS__)
+    CondVar_Broadcast(cond);
+#else
+    pthread_cond_broadcast(cond);
+#endif
+}
+
+// The mutex isn't held while waiting, so that time isn't profiled as hold time
+static void suspendLockProfile(PLT_MUTEX* mutex) {
+    if (mutex->profile != NULL) {
+        LiRecordLockReleased(mutex->profile, PltGetMicroseconds() - mutex->lockedUs);
+    }
+}
+
+static void resumeLockProfile(PLT_MUTEX* mutex) {
+    if (mutex->profile != NULL) {
+        mutex->lockedUs = PltGetMicroseconds();
+    }
+}
+
 void PltWaitForConditionVariable(PLT_COND* cond, PLT_MUTEX* mutex) {
+    uint64_t waitToken = LiBeginThreadWait();
+
+    suspendLockProfile(mutex);
+
 #if defined(LC_WINDOWS)
-    SleepConditionVariableSRW(cond, mutex, INFINITE, 0);
+    SleepConditionVariableSRW(cond, &mutex->native, INFINITE, 0);
 #elif defined(__vita__)
     sceKernelWaitCond(*cond, NULL);
 #elif defined(__WIIU__)
-    OSFastCond_Wait(cond, mutex);
+    OSFastCond_Wait(cond, &mutex->native);
 #elif defined(__3DS__)
-    CondVar_Wait(cond, mutex);
+    CondVar_Wait(cond, &mutex->native);
 #else
-    pthread_cond_wait(cond, mutex);
+    pthread_cond_wait(cond, &mutex->native);
 #endif
+
+    resumeLockProfile(mutex);
+
+    LiEndThreadWait(waitToken);
 }
 
 uint64_t PltGetMillis(void) {
@@ -482,6 +670,30 @@ uint64_t PltGetMillis(void) {
 #endif
 }
 
+uint64_t PltGetMicroseconds(void) {
+#if defined(LC_WINDOWS)
+    LARGE_INTEGER counter, frequency;
+
+    QueryPerformanceCounter(&counter);
+    QueryPerformanceFrequency(&frequency);
+
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000 +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000 / frequency.QuadPart;
+#elif defined(CLOCK_MONOTONIC) && !defined(NO_CLOCK_GETTIME)
+    struct timespec tv;
+
+    clock_gettime(CLOCK_MONOTONIC, &tv);
+
+    return ((uint64_t)tv.tv_sec * 1000000) + (tv.tv_nsec / 1000);
+#else
+    struct timeval tv;
+
+    gettimeofday(&tv, NULL);
+
+    return ((uint64_t)tv.tv_sec * 1000000) + tv.tv_usec;
+#endif
+}
+
 bool PltSafeStrcpy(char* dest, size_t dest_size, const char* src) {
     LC_ASSERT(dest_size > 0);
 
@@ -516,19 +728,465 @@ bool PltSafeStrcpy(char* dest, size_t dest_size, const char* src) {
     return true;
 }
 
+// The executor runs timers from a hierarchical timing wheel with 1 ms ticks.
+// Each level has 64 slots, and each slot of a level spans a full turn of the
+// level below it. Timers due within 64 ms sit in the first level, and timers
+// further out are cascaded down a level each time the level below wraps. This
+// keeps scheduling and cancellation O(1) regardless of how many timers exist.
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1 << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+#define TIMER_WHEEL_LEVELS 4
+#define TIMER_WHEEL_MAX_DELTA ((1ULL << (TIMER_WHEEL_BITS * TIMER_WHEEL_LEVELS)) - 1)
+
+// A second thread keeps timers running while a callback blocks
+// (legacy TCP control streams wait for replies, for example).
+#define EXECUTOR_THREAD_COUNT 2
+
+static PLT_MUTEX executorMutex;
+static PLT_COND executorCond;
+static PLT_COND timerIdleCond;
+static PLT_THREAD executorThreads[EXECUTOR_THREAD_COUNT];
+static PLT_TIMER* timerWheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SIZE];
+static PLT_TIMER* readyTimers;
+static int wheelTimerCount;
+static uint64_t executorStartTimeMs;
+static uint64_t wheelTick;
+static bool executorStopping;
+
+static uint64_t getExecutorTick(void) {
+    return PltGetMillis() - executorStartTimeMs;
+}
+
+static void waitForConditionVariableTimeout(PLT_COND* cond, PLT_MUTEX* mutex, int ms) {
+    uint64_t waitToken;
+
+    if (ms < 0) {
+        PltWaitForConditionVariable(cond, mutex);
+        return;
+    }
+
+    waitToken = LiBeginThreadWait();
+    suspendLockProfile(mutex);
+
+#if defined(LC_WINDOWS)
+    SleepConditionVariableSRW(cond, &mutex->native, ms, 0);
+#elif defined(__vita__)
+    SceUInt timeout = ms * 1000;
+    sceKernelWaitCond(*cond, &timeout);
+#elif defined(__WIIU__)
+    // OSFastCondition has no timed wait, so poll instead
+    unlockNativeMutex(&mutex->native);
+    PltSleepMs(ms < 5 ? ms : 5);
+    lockNativeMutex(&mutex->native);
+#elif defined(__3DS__)
+    CondVar_WaitTimeout(cond, &mutex->native, (s64)ms * 1000000);
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += ms / 1000;
+    ts.tv_nsec += (ms % 1000) * 1000000;
+    if (ts.tv_nsec >= 1000000000) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000;
+    }
+    pthread_cond_timedwait(cond, &mutex->native, &ts);
+#endif
+
+    resumeLockProfile(mutex);
+    LiEndThreadWait(waitToken);
+}
+
+static void linkTimer(PLT_TIMER** head, PLT_TIMER* timer) {
+    LC_ASSERT(timer->pprev == NULL);
+
+    timer->next = *head;
+    if (timer->next != NULL) {
+        timer->next->pprev = &timer->next;
+    }
+    timer->pprev = head;
+    *head = timer;
+}
+
+static void unlinkTimer(PLT_TIMER* timer) {
+    if (timer->pprev == NULL) {
+        return;
+    }
+
+    if (timer->pprev != &readyTimers) {
+        wheelTimerCount--;
+    }
+
+    *timer->pprev = timer->next;
+    if (timer->next != NULL) {
+        timer->next->pprev = timer->pprev;
+    }
+    timer->next = NULL;
+    timer->pprev = NULL;
+}
+
+// Places the timer in the slot covering its expiry. The executor lock must be held.
+static void insertTimer(PLT_TIMER* timer) {
+    uint64_t expiry = timer->expiryTick;
+    uint64_t delta;
+    int level;
+
+    if (expiry < wheelTick) {
+        linkTimer(&readyTimers, timer);
+        return;
+    }
+
+    // Timers beyond the last level are parked in its furthest slot
+    // and find their real slot when they are cascaded down
+    delta = expiry - wheelTick;
+    if (delta > TIMER_WHEEL_MAX_DELTA) {
+        expiry = wheelTick + TIMER_WHEEL_MAX_DELTA;
+        delta = TIMER_WHEEL_MAX_DELTA;
+    }
+
+    for (level = 0; level < TIMER_WHEEL_LEVELS - 1; level++) {
+        if (delta < (1ULL << (TIMER_WHEEL_BITS * (level + 1)))) {
+            break;
+        }
+    }
+
+    linkTimer(&timerWheel[level][(expiry >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK], timer);
+    wheelTimerCount++;
+}
+
+static void cascadeTimers(int level, int slot) {
+    PLT_TIMER* timer = timerWheel[level][slot];
+
+    while (timer != NULL) {
+        PLT_TIMER* next = timer->next;
+
+        unlinkTimer(timer);
+        insertTimer(timer);
+        timer = next;
+    }
+}
+
+// Moves the timers due by the given tick to the ready list
+static void advanceTimerWheel(uint64_t nowTick) {
+    // Nothing can expire on an empty wheel
+    if (wheelTimerCount == 0) {
+        if (wheelTick <= nowTick) {
+            wheelTick = nowTick + 1;
+        }
+        return;
+    }
+
+    while (wheelTick <= nowTick) {
+        int slot = wheelTick & TIMER_WHEEL_MASK;
+        PLT_TIMER* timer;
+
+        // When a level wraps, the next slot of the level above is due for cascading
+        if (slot == 0) {
+            int level;
+
+            for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+                int upperSlot = (wheelTick >> (TIMER_WHEEL_BITS * level)) & TIMER_WHEEL_MASK;
+
+                cascadeTimers(level, upperSlot);
+                if (upperSlot != 0) {
+                    break;
+                }
+            }
+        }
+
+        timer = timerWheel[0][slot];
+        while (timer != NULL) {
+            PLT_TIMER* next = timer->next;
+
+            unlinkTimer(timer);
+            linkTimer(&readyTimers, timer);
+            timer = next;
+        }
+
+        wheelTick++;
+    }
+}
+
+// Returns how long the executor can sleep before the next expiry or cascade
+static int getExecutorWaitTime(uint64_t nowTick) {
+    uint64_t nextTick = UINT64_MAX;
+    int level;
+    int i;
+
+    if (readyTimers != NULL) {
+        return 0;
+    }
+    else if (wheelTimerCount == 0) {
+        return -1;
+    }
+
+    for (i = 0; i < TIMER_WHEEL_SIZE; i++) {
+        if (timerWheel[0][(wheelTick + i) & TIMER_WHEEL_MASK] != NULL) {
+            nextTick = wheelTick + i;
+            break;
+        }
+    }
+
+    for (level = 1; level < TIMER_WHEEL_LEVELS; level++) {
+        int shift = TIMER_WHEEL_BITS * level;
+        uint64_t index = wheelTick >> shift;
+
+        // A slot of this level is cascaded when the level below wraps into it
+        for (i = 1; i <= TIMER_WHEEL_SIZE; i++) {
+            if (timerWheel[level][(index + i) & TIMER_WHEEL_MASK] != NULL) {
+                if (((index + i) << shift) < nextTick) {
+                    nextTick = (index + i) << shift;
+                }
+                break;
+            }
+        }
+    }
+
+    if (nextTick <= nowTick) {
+        return 0;
+    }
+
+    return (int)(nextTick - nowTick);
+}
+
+static void executorThreadProc(void* context) {
+    PltLockMutex(&executorMutex);
+    while (!executorStopping) {
+        uint64_t nowTick = getExecutorTick();
+        PLT_TIMER* timer;
+
+        advanceTimerWheel(nowTick);
+
+        timer = readyTimers;
+        if (timer == NULL) {
+            waitForConditionVariableTimeout(&executorCond, &executorMutex, getExecutorWaitTime(nowTick));
+            continue;
+        }
+
+        unlinkTimer(timer);
+
+        // Let the other thread pick up any timers that are also due
+        if (readyTimers != NULL) {
+            PltSignalConditionVariable(&executorCond);
+        }
+
+        // Periodic timers keep their rate unless they fall a whole period behind
+        if (timer->periodMs > 0) {
+            timer->expiryTick += timer->periodMs;
+            if (timer->expiryTick <= nowTick) {
+                timer->expiryTick = nowTick + timer->periodMs;
+            }
+        }
+        else {
+            timer->armed = false;
+        }
+
+        timer->running = true;
+        PltUnlockMutex(&executorMutex);
+
+        timer->entry(timer->context);
+
+        PltLockMutex(&executorMutex);
+        timer->running = false;
+
+        // Timers that were armed while running are inserted now
+        if (timer->armed) {
+            insertTimer(timer);
+        }
+
+        PltBroadcastConditionVariable(&timerIdleCond);
+    }
+
+    // Wake the next executor thread to stop
+    PltSignalConditionVariable(&executorCond);
+    PltUnlockMutex(&executorMutex);
+}
+
+void PltInitializeTimer(PLT_TIMER* timer, TimerEntry entry, void* context) {
+    memset(timer, 0, sizeof(*timer));
+    timer->entry = entry;
+    timer->context = context;
+}
+
+void PltScheduleTimer(PLT_TIMER* timer, int delayMs, int periodMs) {
+    uint64_t nowTick;
+
+    LC_ASSERT(delayMs >= 0 && periodMs >= 0);
+
+    PltLockMutex(&executorMutex);
+
+    unlinkTimer(timer);
+
+    // An empty wheel can skip ahead instead of stepping through idle ticks
+    nowTick = getExecutorTick();
+    if (wheelTimerCount == 0 && wheelTick < nowTick) {
+        wheelTick = nowTick;
+    }
+
+    timer->expiryTick = nowTick + delayMs;
+    timer->periodMs = periodMs;
+    timer->armed = true;
+
+    // A running timer is inserted when its callback returns
+    if (!timer->running) {
+        insertTimer(timer);
+        PltSignalConditionVariable(&executorCond);
+    }
+
+    PltUnlockMutex(&executorMutex);
+}
+
+void PltCancelTimer(PLT_TIMER* timer) {
+    PltLockMutex(&executorMutex);
+    unlinkTimer(timer);
+    timer->periodMs = 0;
+    timer->armed = false;
+    PltUnlockMutex(&executorMutex);
+}
+
+void PltJoinTimer(PLT_TIMER* timer) {
+    PltLockMutex(&executorMutex);
+    while (timer->armed || timer->running) {
+        PltWaitForConditionVariable(&timerIdleCond, &executorMutex);
+    }
+    PltUnlockMutex(&executorMutex);
+}
+
+static int startExecutor(void) {
+    int err;
+    int i;
+
+    err = PltCreateMutex(&executorMutex, "Executor");
+    if (err != 0) {
+        return err;
+    }
+
+    PltCreateConditionVariable(&executorCond, &executorMutex);
+    PltCreateConditionVariable(&timerIdleCond, &executorMutex);
+
+    memset(timerWheel, 0, sizeof(timerWheel));
+    readyTimers = NULL;
+    wheelTimerCount = 0;
+    executorStartTimeMs = PltGetMillis();
+    wheelTick = 0;
+    executorStopping = false;
+
+    for (i = 0; i < EXECUTOR_THREAD_COUNT; i++) {
+        err = PltCreateThread("Executor", THREAD_CLASS_INTERACTIVE, executorThreadProc, NULL, &executorThreads[i]);
+        if (err != 0) {
+            break;
+        }
+    }
+
+    if (err != 0) {
+        PltLockMutex(&executorMutex);
+        executorStopping = true;
+        PltSignalConditionVariable(&executorCond);
+        PltUnlockMutex(&executorMutex);
+
+        while (i-- > 0) {
+            PltJoinThread(&executorThreads[i]);
+        }
+
+        PltDeleteConditionVariable(&timerIdleCond);
+        PltDeleteConditionVariable(&executorCond);
+        PltDeleteMutex(&executorMutex);
+        return err;
+    }
+
+    return 0;
+}
+
+static void stopExecutor(void) {
+    int level;
+    int i;
+
+    PltLockMutex(&executorMutex);
+    executorStopping = true;
+    PltSignalConditionVariable(&executorCond);
+    PltUnlockMutex(&executorMutex);
+
+    for (i = 0; i < EXECUTOR_THREAD_COUNT; i++) {
+        PltJoinThread(&executorThreads[i]);
+    }
+
+    // Timers left armed by their owners are dropped
+    while (readyTimers != NULL) {
+        readyTimers->armed = false;
+        unlinkTimer(readyTimers);
+    }
+    for (level = 0; level < TIMER_WHEEL_LEVELS; level++) {
+        for (i = 0; i < TIMER_WHEEL_SIZE; i++) {
+            while (timerWheel[level][i] != NULL) {
+                timerWheel[level][i]->armed = false;
+                unlinkTimer(timerWheel[level][i]);
+            }
+        }
+    }
+
+    PltDeleteConditionVariable(&timerIdleCond);
+    PltDeleteConditionVariable(&executorCond);
+    PltDeleteMutex(&executorMutex);
+}
+
 int initializePlatform(void) {
     int err;
 
+    err = initializeLockProfiler();
+    if (err != 0) {
+        return err;
+    }
+
+    err = initializeAllocationTracker();
+    if (err != 0) {
+        cleanupLockProfiler();
+        return err;
+    }
+
     err = initializePlatformSockets();
     if (err != 0) {
+        cleanupAllocationTracker();
+        cleanupLockProfiler();
         return err;
     }
 
     err = enet_initialize();
     if (err != 0) {
+        cleanupAllocationTracker();
+        cleanupLockProfiler();
+        return err;
+    }
+
+    err = initializeNetworkImpairment();
+    if (err != 0) {
+        cleanupAllocationTracker();
+        cleanupLockProfiler();
+        return err;
+    }
+
+    // The executor threads register for accounting
+    err = initializeThreadStats();
+    if (err != 0) {
+        cleanupNetworkImpairment();
+        cleanupAllocationTracker();
+        cleanupLockProfiler();
+        return err;
+    }
+
+    err = startExecutor();
+    if (err != 0) {
+        cleanupThreadStats();
+        cleanupNetworkImpairment();
+        cleanupAllocationTracker();
+        cleanupLockProfiler();
         return err;
     }
 
+    // Delayed dumps run on the executor
+    initializeFlightRecorder();
+
+    initializeBandwidthEstimator();
+
     enterLowLatencyMode();
 
     return 0;
@@ -537,10 +1195,24 @@ int initializePlatform(void) {
 void cleanupPlatform(void) {
     exitLowLatencyMode();
 
+    cleanupBandwidthEstimator();
+
+    cleanupFlightRecorder();
+
+    stopExecutor();
+
+    cleanupThreadStats();
+
+    cleanupNetworkImpairment();
+
     cleanupPlatformSockets();
 
     enet_deinitialize();
 
+    cleanupAllocationTracker();
+
+    cleanupLockProfiler();
+
     LC_ASSERT(activeThreads == 0);
     LC_ASSERT(activeMutexes == 0);
     LC_ASSERT(activeEvents == 0);
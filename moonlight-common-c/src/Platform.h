@@ -43,8 +43,10 @@
 #include <arpa/inet.h>
 #include <netinet/in.h>
 #include <fcntl.h>
+#ifdef __EMSCRIPTEN__
 #include <emscripten.h>
 #endif
+#endif
 
 #ifdef _WIN32
 # define LC_WINDOWS
@@ -71,7 +73,7 @@
 #include <stdio.h>
 #include "Limelight.h"
 
-#ifdef LC_LOG
+#if defined(LC_LOG) || !defined(__EMSCRIPTEN__)
 #define Limelog(format, ...) \
     do { \
         if (ListenerCallbacks.logMessage) { \
@@ -163,4 +165,5 @@ int initializePlatform(void);
 void cleanupPlatform(void);
 
 uint64_t PltGetMillis(void);
+uint64_t PltGetMicroseconds(void);
 bool PltSafeStrcpy(char* dest, size_t dest_size, const char* src);
@@ -92,7 +92,7 @@ int setNonFatalRecvTimeoutMs(SOCKET s, int timeoutMs) {
 #endif
 }
 
-int pollSockets(struct pollfd* pollFds, int pollFdsCount, int timeoutMs) {
+static int pollSocketsInternal(struct pollfd* pollFds, int pollFdsCount, int timeoutMs) {
 #if defined(LC_WINDOWS)
     // We could have used WSAPoll() but it has some nasty bugs
     // https://daniel.haxx.se/blog/2012/10/10/wsapoll-is-broken/
@@ -164,6 +164,22 @@ int pollSockets(struct pollfd* pollFds, int pollFdsCount, int timeoutMs) {
 #endif
 }
 
+int pollSockets(struct pollfd* pollFds, int pollFdsCount, int timeoutMs) {
+    uint64_t waitToken;
+    int err;
+
+    // Readiness checks don't block
+    if (timeoutMs == 0) {
+        return pollSocketsInternal(pollFds, pollFdsCount, 0);
+    }
+
+    waitToken = LiBeginThreadWait();
+    err = pollSocketsInternal(pollFds, pollFdsCount, timeoutMs);
+    LiEndThreadWait(waitToken);
+
+    return err;
+}
+
 bool isSocketReadable(SOCKET s) {
     struct pollfd pfd;
     int err;
@@ -178,7 +194,7 @@ bool isSocketReadable(SOCKET s) {
     return true;
 }
 
-int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect) {
+int recvUdpSocketDirect(SOCKET s, char* buffer, int size, bool useSelect) {
     int err;
 
     do {
@@ -201,7 +217,9 @@ int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect) {
             // The caller has already configured a timeout on this
             // socket via SO_RCVTIMEO, so we can avoid a syscall
             // for each packet.
+            uint64_t waitToken = LiBeginThreadWait();
             err = (int)recvfrom(s, buffer, size, 0, NULL, NULL);
+            LiEndThreadWait(waitToken);
             if (err < 0 &&
                     (LastSocketError() == EWOULDBLOCK ||
                      LastSocketError() == EINTR ||
@@ -238,6 +256,26 @@ int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect) {
     return err;
 }
 
+int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect) {
+#ifdef LC_NET_IMPAIRMENT
+    if (isSocketImpaired(s)) {
+        return recvImpairedUdpSocket(s, buffer, size);
+    }
+#endif
+
+    return recvUdpSocketDirect(s, buffer, size, useSelect);
+}
+
+int sendUdpSocket(SOCKET s, const char* buffer, int size, struct sockaddr* dstaddr, SOCKADDR_LEN addrLen) {
+#ifdef LC_NET_IMPAIRMENT
+    if (isSocketImpaired(s)) {
+        return sendImpairedUdpSocket(s, buffer, size, dstaddr, addrLen);
+    }
+#endif
+
+    return (int)sendto(s, buffer, size, 0, dstaddr, addrLen);
+}
+
 void closeSocket(SOCKET s) {
 #if defined(LC_WINDOWS)
     closesocket(s);
@@ -106,6 +106,9 @@ SOCKET bindUdpSocket(int addressFamily, struct sockaddr_storage* localAddr, SOCK
 int enableNoDelay(SOCKET s);
 int setSocketNonBlocking(SOCKET s, bool enabled);
 int recvUdpSocket(SOCKET s, char* buffer, int size, bool useSelect);
+int sendUdpSocket(SOCKET s, const char* buffer, int size, struct sockaddr* dstaddr, SOCKADDR_LEN addrLen);
+// Bypasses the network impairment shim
+int recvUdpSocketDirect(SOCKET s, char* buffer, int size, bool useSelect);
 void shutdownTcpSocket(SOCKET s);
 int setNonFatalRecvTimeoutMs(SOCKET s, int timeoutMs);
 void closeSocket(SOCKET s);
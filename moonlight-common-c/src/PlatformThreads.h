@@ -4,16 +4,17 @@
 #include "Platform.h"
 
 typedef void(*ThreadEntry)(void* context);
+typedef void(*TimerEntry)(void* context);
 
 #if defined(LC_WINDOWS)
-typedef SRWLOCK PLT_MUTEX;
+typedef SRWLOCK PLT_NATIVE_MUTEX;
 typedef CONDITION_VARIABLE PLT_COND;
 typedef struct _PLT_THREAD {
     HANDLE handle;
     bool cancelled;
 } PLT_THREAD;
 #elif defined(__vita__)
-typedef int PLT_MUTEX;
+typedef int PLT_NATIVE_MUTEX;
 typedef int PLT_COND;
 typedef struct _PLT_THREAD {
     int handle;
@@ -22,21 +23,21 @@ typedef struct _PLT_THREAD {
     bool detached;
 } PLT_THREAD;
 #elif defined(__WIIU__)
-typedef OSFastMutex PLT_MUTEX;
+typedef OSFastMutex PLT_NATIVE_MUTEX;
 typedef OSFastCondition PLT_COND;
 typedef struct _PLT_THREAD {
     OSThread thread;
     int cancelled;
 } PLT_THREAD;
 #elif defined(__3DS__)
-typedef LightLock PLT_MUTEX;
+typedef LightLock PLT_NATIVE_MUTEX;
 typedef CondVar PLT_COND;
 typedef struct _PLT_THREAD {
     Thread thread;
     bool cancelled;
 } PLT_THREAD;
 #elif defined (LC_POSIX)
-typedef pthread_mutex_t PLT_MUTEX;
+typedef pthread_mutex_t PLT_NATIVE_MUTEX;
 typedef pthread_cond_t PLT_COND;
 typedef struct _PLT_THREAD {
     pthread_t thread;
@@ -46,6 +47,14 @@ typedef struct _PLT_THREAD {
 #error Unsupported platform
 #endif
 
+// The profile is only set while lock profiling is enabled, and is
+// updated by the thread holding the mutex
+typedef struct _PLT_MUTEX {
+    PLT_NATIVE_MUTEX native;
+    PLOCK_PROFILE profile;
+    uint64_t lockedUs;
+} PLT_MUTEX;
+
 #ifdef LC_WINDOWS
 typedef HANDLE PLT_EVENT;
 #else
@@ -56,12 +65,27 @@ typedef struct _PLT_EVENT {
 } PLT_EVENT;
 #endif
 
-int PltCreateMutex(PLT_MUTEX* mutex);
+// Timers run on the executor threads started by initializePlatform(). A timer
+// never runs concurrently with itself. All fields are owned by the executor.
+typedef struct _PLT_TIMER {
+    TimerEntry entry;
+    void* context;
+    struct _PLT_TIMER* next;
+    struct _PLT_TIMER** pprev;
+    uint64_t expiryTick;
+    int periodMs;
+    bool armed;
+    bool running;
+} PLT_TIMER;
+
+// The name groups the mutex in the lock profile. Pass NULL to exclude it.
+int PltCreateMutex(PLT_MUTEX* mutex, const char* name);
 void PltDeleteMutex(PLT_MUTEX* mutex);
 void PltLockMutex(PLT_MUTEX* mutex);
 void PltUnlockMutex(PLT_MUTEX* mutex);
 
-int PltCreateThread(const char* name, ThreadEntry entry, void* context, PLT_THREAD* thread);
+// The thread class is one of THREAD_CLASS_*
+int PltCreateThread(const char* name, int threadClass, ThreadEntry entry, void* context, PLT_THREAD* thread);
 void PltInterruptThread(PLT_THREAD* thread);
 bool PltIsThreadInterrupted(PLT_THREAD* thread);
 void PltJoinThread(PLT_THREAD* thread);
@@ -76,7 +100,27 @@ void PltWaitForEvent(PLT_EVENT* event);
 int PltCreateConditionVariable(PLT_COND* cond, PLT_MUTEX* mutex);
 void PltDeleteConditionVariable(PLT_COND* cond);
 void PltSignalConditionVariable(PLT_COND* cond);
+void PltBroadcastConditionVariable(PLT_COND* cond);
 void PltWaitForConditionVariable(PLT_COND* cond, PLT_MUTEX* mutex);
 
 void PltSleepMs(int ms);
 void PltSleepMsInterruptible(PLT_THREAD* thread, int ms);
+
+void PltInitializeTimer(PLT_TIMER* timer, TimerEntry entry, void* context);
+// Runs the timer after delayMs, then every periodMs if it is non-zero. Scheduling
+// an armed timer moves it, so pending one-shot requests are coalesced.
+void PltScheduleTimer(PLT_TIMER* timer, int delayMs, int periodMs);
+// Disarms the timer without waiting. This may be called from its own callback.
+void PltCancelTimer(PLT_TIMER* timer);
+// Waits until the timer is neither armed nor running its callback
+void PltJoinTimer(PLT_TIMER* timer);
+
+// Accounting for LiGetThreadStats(), which is active between these calls
+int initializeThreadStats(void);
+void cleanupThreadStats(void);
+
+// Lock profiling for LiGetLockStats(). Mutexes only get a profile between these
+// calls. LiRecordLockAcquired() and LiRecordLockReleased() record their samples.
+int initializeLockProfiler(void);
+void cleanupLockProfiler(void);
+PLOCK_PROFILE createMutexLockProfile(const char* name);
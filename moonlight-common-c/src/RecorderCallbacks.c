@@ -5,84 +5,359 @@
 
 #include "Limelight-internal.h"
 
-static FILE* videoFile;
-static FILE* audioFile;
+// The session recorder muxes the stream into a fragmented MP4 file on a background
+// thread, so storage latency never stalls the renderers. Video decode units are
+// handed over without copying when the frame is completed (see LiCompleteVideoFrame()),
+// and audio packets are copied as they are passed to the audio renderer. If the writer
+// falls behind, frames are dropped until the next IDR frame.
+
+// Frames and packets waiting for the writer thread
+#define RECORDER_QUEUE_BOUND 1024
+#define RECORDER_MAX_QUEUED_BYTES (64 * 1024 * 1024)
+
+// The file is written in chunks of this size at offsets aligned to it
+#define RECORDER_WRITE_CHUNK_SIZE (1024 * 1024)
+
+#define RECORDED_VIDEO_FRAME  0
+#define RECORDED_AUDIO_PACKET 1
+
+typedef struct _RECORDED_ITEM {
+    LINKED_BLOCKING_QUEUE_ENTRY entry;
+    int type;
+    int length;
+    uint64_t receiveTimeMs;
+
+    // Video frames
+    PLENTRY bufferList;
+    unsigned int presentationTimeMs;
+    bool keyFrame;
+
+    // Audio packets
+    uint32_t lostPackets;
+    char data[];
+} RECORDED_ITEM, *PRECORDED_ITEM;
+
+static char* recordingPath;
 
 static DECODER_RENDERER_CALLBACKS realDrCallbacks;
 static AUDIO_RENDERER_CALLBACKS realArCallbacks;
 
-static int recDrSetup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags)
-{
-    const char* path = context;
-    
-    if (path != NULL) {
-        videoFile = fopen(path, "wb");
-        if (videoFile == NULL) {
-            return -1;
+static bool recording;
+static PLT_MUTEX recorderLock;
+static LINKED_BLOCKING_QUEUE recorderQueue;
+static PLT_THREAD writerThread;
+static size_t queuedBytes;
+static bool waitingForIdrFrame;
+static uint32_t pendingLostAudioPackets;
+static uint32_t droppedVideoFrames;
+static uint32_t droppedAudioPackets;
+
+// Only accessed by the writer thread while recording
+static FILE* recordingFile;
+static MP4_MUXER muxer;
+static MP4_BUFFER outputBuffer;
+static bool initSegmentWritten;
+static unsigned int firstPresentationTimeMs;
+static uint64_t firstVideoReceiveTimeMs;
+static bool audioStarted;
+static bool writeFailed;
+
+void LiSetSessionRecordingFile(const char* path) {
+    free(recordingPath);
+    recordingPath = path != NULL ? strdup(path) : NULL;
+}
+
+bool isSessionRecordingEnabled(void) {
+    return recordingPath != NULL;
+}
+
+static void freeRecordedItem(PRECORDED_ITEM item) {
+    if (item->type == RECORDED_VIDEO_FRAME) {
+        freeDecodeUnitBuffers(item->bufferList);
+    }
+    free(item);
+}
+
+static void freeRecordedItemList(PLINKED_BLOCKING_QUEUE_ENTRY entry) {
+    PLINKED_BLOCKING_QUEUE_ENTRY nextEntry;
+
+    while (entry != NULL) {
+        nextEntry = entry->flink;
+        freeRecordedItem(entry->data);
+        entry = nextEntry;
+    }
+}
+
+// Writes the whole chunks of the output buffer, or all of it at the end
+static void flushOutput(bool final) {
+    size_t length;
+
+    if (outputBuffer.failed && !writeFailed) {
+        Limelog("Session recording ran out of memory\n");
+        writeFailed = true;
+    }
+
+    length = final ? outputBuffer.length : outputBuffer.length - (outputBuffer.length % RECORDER_WRITE_CHUNK_SIZE);
+    if (length == 0) {
+        return;
+    }
+
+    if (!writeFailed && fwrite(outputBuffer.data, 1, length, recordingFile) != length) {
+        Limelog("Session recording write failed\n");
+        writeFailed = true;
+    }
+
+    memmove(outputBuffer.data, &outputBuffer.data[length], outputBuffer.length - length);
+    outputBuffer.length -= length;
+}
+
+static void muxRecordedItem(PRECORDED_ITEM item) {
+    if (item->type == RECORDED_VIDEO_FRAME) {
+        if (!initSegmentWritten) {
+            // The codec configuration comes from the first IDR frame
+            if (!item->keyFrame || !mp4WriteInitSegment(&muxer, &outputBuffer, item->bufferList)) {
+                return;
+            }
+
+            initSegmentWritten = true;
+            firstPresentationTimeMs = item->presentationTimeMs;
+            firstVideoReceiveTimeMs = item->receiveTimeMs;
         }
+
+        mp4AddVideoSample(&muxer, &outputBuffer, item->bufferList,
+                          (uint64_t)(item->presentationTimeMs - firstPresentationTimeMs) * 90,
+                          item->keyFrame);
     }
-    else {
-        Limelog("Video recording will not be enabled - file path not specified in drContext!\n");
+    else if (initSegmentWritten) {
+        uint32_t lostPackets = item->lostPackets;
+
+        // Audio that starts after the first video frame is delayed to match
+        if (!audioStarted) {
+            if (item->receiveTimeMs > firstVideoReceiveTimeMs) {
+                lostPackets = (uint32_t)((item->receiveTimeMs - firstVideoReceiveTimeMs) / AudioPacketDuration);
+            }
+            audioStarted = true;
+        }
+
+        mp4AddAudioSample(&muxer, &outputBuffer, item->data, item->length, lostPackets);
     }
+}
+
+static void RecorderWriterThreadProc(void* context) {
+    PRECORDED_ITEM item;
 
-    return realDrCallbacks.setup(videoFormat, width, height, redrawRate, NULL, drFlags);
+    // The queue is drained before this returns when the recording stops
+    while (LbqWaitForQueueElement(&recorderQueue, (void**)&item) == LBQ_SUCCESS) {
+        muxRecordedItem(item);
+        flushOutput(false);
+
+        PltLockMutex(&recorderLock);
+        queuedBytes -= item->length;
+        PltUnlockMutex(&recorderLock);
+
+        freeRecordedItem(item);
+    }
 }
 
-static void recDrCleanup(void)
-{
-    if (videoFile != NULL) {
-        fclose(videoFile);
-        videoFile = NULL;
+static void startRecording(int videoFormat, int width, int height, int fps) {
+    OPUS_MULTISTREAM_CONFIGURATION opusConfig;
+    int err;
+
+    recordingFile = fopen(recordingPath, "wb");
+    if (recordingFile == NULL) {
+        Limelog("Failed to open session recording file: %s\n", recordingPath);
+        return;
     }
 
-    realDrCallbacks.cleanup();
+    // Writes are already batched into large chunks
+    setvbuf(recordingFile, NULL, _IONBF, 0);
+
+    getChosenOpusConfig(&opusConfig);
+    mp4InitializeMuxer(&muxer, videoFormat, width, height, fps, &opusConfig);
+    mp4InitializeBuffer(&outputBuffer);
+    initSegmentWritten = false;
+    audioStarted = false;
+    writeFailed = false;
+
+    queuedBytes = 0;
+    waitingForIdrFrame = true;
+    pendingLostAudioPackets = 0;
+    droppedVideoFrames = 0;
+    droppedAudioPackets = 0;
+
+    err = PltCreateMutex(&recorderLock, "Recorder");
+    if (err != 0) {
+        mp4DestroyMuxer(&muxer);
+        fclose(recordingFile);
+        return;
+    }
+
+    LbqInitializeLinkedBlockingQueue(&recorderQueue, RECORDER_QUEUE_BOUND, "RecorderQueue");
+
+    err = PltCreateThread("Recorder", THREAD_CLASS_BACKGROUND, RecorderWriterThreadProc, NULL, &writerThread);
+    if (err != 0) {
+        LbqDestroyLinkedBlockingQueue(&recorderQueue);
+        PltDeleteMutex(&recorderLock);
+        mp4DestroyMuxer(&muxer);
+        fclose(recordingFile);
+        return;
+    }
+
+    recording = true;
+    Limelog("Recording session to %s\n", recordingPath);
 }
 
-static int recDrSubmitDecodeUnit(PDECODE_UNIT decodeUnit)
-{
-    if (videoFile != NULL) {
-        PLENTRY entry = decodeUnit->bufferList;
-        while (entry != NULL) {
-            fwrite(entry->data, 1, entry->length, videoFile);
-            entry = entry->next;
+static void stopRecording(void) {
+    if (!recording) {
+        return;
+    }
+
+    PltLockMutex(&recorderLock);
+    recording = false;
+    PltUnlockMutex(&recorderLock);
+
+    // Let the writer finish the queued frames
+    LbqSignalQueueDrain(&recorderQueue);
+    PltJoinThread(&writerThread);
+    freeRecordedItemList(LbqDestroyLinkedBlockingQueue(&recorderQueue));
+
+    mp4FlushFragment(&muxer, &outputBuffer);
+    flushOutput(true);
+
+    fclose(recordingFile);
+    recordingFile = NULL;
+    mp4DestroyMuxer(&muxer);
+    mp4FreeBuffer(&outputBuffer);
+    PltDeleteMutex(&recorderLock);
+
+    Limelog("Session recording complete: %u video frames and %u audio packets dropped\n",
+            droppedVideoFrames, droppedAudioPackets);
+}
+
+bool recordVideoFrame(PDECODE_UNIT decodeUnit) {
+    PRECORDED_ITEM item;
+    bool queued = false;
+    bool requestIdr = false;
+
+    if (!recording) {
+        return false;
+    }
+
+    item = malloc(sizeof(*item));
+    if (item == NULL) {
+        return false;
+    }
+
+    item->type = RECORDED_VIDEO_FRAME;
+    item->length = decodeUnit->fullLength;
+    item->bufferList = decodeUnit->bufferList;
+    item->receiveTimeMs = decodeUnit->receiveTimeMs;
+    item->presentationTimeMs = decodeUnit->presentationTimeMs;
+    item->keyFrame = decodeUnit->frameType == FRAME_TYPE_IDR;
+    item->lostPackets = 0;
+
+    PltLockMutex(&recorderLock);
+    if (!recording) {
+        // The recording was just stopped
+    }
+    else if (waitingForIdrFrame && !item->keyFrame) {
+        // Frames can't be decoded without the frames that were dropped before them
+        droppedVideoFrames++;
+    }
+    else if (queuedBytes + item->length > RECORDER_MAX_QUEUED_BYTES ||
+             LbqOfferQueueItem(&recorderQueue, item, &item->entry) != LBQ_SUCCESS) {
+        droppedVideoFrames++;
+        requestIdr = !waitingForIdrFrame;
+        waitingForIdrFrame = true;
+    }
+    else {
+        queuedBytes += item->length;
+        waitingForIdrFrame = false;
+        queued = true;
+    }
+    PltUnlockMutex(&recorderLock);
+
+    if (!queued) {
+        free(item);
+
+        if (requestIdr) {
+            // The recording would otherwise have to wait until the host
+            // happens to send another IDR frame
+            Limelog("Session recording fell behind; dropping frames until the next IDR frame\n");
+            LiRequestIdrFrame();
         }
     }
 
-    return realDrCallbacks.submitDecodeUnit(decodeUnit);
+    return queued;
 }
 
-static int recArInit(int audioConfiguration, POPUS_MULTISTREAM_CONFIGURATION opusConfig, void* context, int arFlags)
-{
-    const char* path = context;
+static void recordAudioPacket(const char* data, int length) {
+    PRECORDED_ITEM item;
+
+    if (!recording) {
+        return;
+    }
 
-    if (path != NULL) {
-        audioFile = fopen(path, "wb");
-        if (audioFile == NULL) {
-            return -1;
+    // Packets that were concealed by the renderer leave a gap in the recording
+    if (data == NULL || length <= 0) {
+        PltLockMutex(&recorderLock);
+        pendingLostAudioPackets++;
+        PltUnlockMutex(&recorderLock);
+        return;
+    }
+
+    item = malloc(sizeof(*item) + length);
+    if (item != NULL) {
+        item->type = RECORDED_AUDIO_PACKET;
+        item->length = length;
+        item->receiveTimeMs = PltGetMillis();
+        item->bufferList = NULL;
+        memcpy(item->data, data, length);
+    }
+
+    PltLockMutex(&recorderLock);
+    if (item != NULL && recording && queuedBytes + length <= RECORDER_MAX_QUEUED_BYTES) {
+        item->lostPackets = pendingLostAudioPackets;
+        if (LbqOfferQueueItem(&recorderQueue, item, &item->entry) == LBQ_SUCCESS) {
+            queuedBytes += length;
+            pendingLostAudioPackets = 0;
+            item = NULL;
         }
     }
-    else {
-        Limelog("Audio recording will not be enabled - file path not specified in arContext!\n");
+    if (item != NULL) {
+        pendingLostAudioPackets++;
+        droppedAudioPackets++;
     }
+    PltUnlockMutex(&recorderLock);
 
-    return realArCallbacks.init(audioConfiguration, opusConfig, NULL, arFlags);
+    free(item);
 }
 
-static void recArCleanup(void)
+static int recDrSetup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags)
 {
-    if (audioFile != NULL) {
-        fclose(audioFile);
-        audioFile = NULL;
+    int err;
+
+    err = realDrCallbacks.setup(videoFormat, width, height, redrawRate, context, drFlags);
+    if (err != 0) {
+        return err;
     }
 
-    realArCallbacks.cleanup();
+    // A failed recording is logged but doesn't fail the stream
+    startRecording(videoFormat, width, height, redrawRate);
+    return 0;
+}
+
+static void recDrCleanup(void)
+{
+    realDrCallbacks.cleanup();
+
+    // All frames have been completed by now
+    stopRecording();
 }
 
 static void recArDecodeAndPlaySample(char* sampleData, int sampleLength)
 {
-    if (audioFile != NULL) {
-        fwrite(sampleData, 1, sampleLength, audioFile);
-    }
+    recordAudioPacket(sampleData, sampleLength);
 
     realArCallbacks.decodeAndPlaySample(sampleData, sampleLength);
 }
@@ -94,9 +369,6 @@ void setRecorderCallbacks(PDECODER_RENDERER_CALLBACKS drCallbacks, PAUDIO_RENDER
 
     drCallbacks->setup = recDrSetup;
     drCallbacks->cleanup = recDrCleanup;
-    drCallbacks->submitDecodeUnit = recDrSubmitDecodeUnit;
 
-    arCallbacks->init = recArInit;
-    arCallbacks->cleanup = recArCleanup;
     arCallbacks->decodeAndPlaySample = recArDecodeAndPlaySample;
 }
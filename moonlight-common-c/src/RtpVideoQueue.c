@@ -35,13 +35,36 @@ static void purgeListEntries(PRTPV_QUEUE_LIST list) {
     list->count = 0;
 }
 
+#define FEC_BLOCK_WORD(index) ((index) / 32)
+#define FEC_BLOCK_BIT(index) (1U << ((index) % 32))
+
+static bool isFecBlockShardReceived(PRTP_VIDEO_QUEUE queue, unsigned int index) {
+    return (queue->pendingFecBlockReceived[FEC_BLOCK_WORD(index)] & FEC_BLOCK_BIT(index)) != 0;
+}
+
+// Frees every packet held by the pending FEC block. Shards are packed at the
+// front of the array, so this stops as soon as the last one is released.
+static void purgePendingFecBlock(PRTP_VIDEO_QUEUE queue) {
+    unsigned int index;
+
+    for (index = 0; queue->pendingFecBlockCount != 0; index++) {
+        LC_ASSERT(index < RTPV_MAX_FEC_BLOCK_SHARDS);
+
+        if (queue->pendingFecBlockEntries[index] != NULL) {
+            free(queue->pendingFecBlockEntries[index]->packet);
+            queue->pendingFecBlockEntries[index] = NULL;
+            queue->pendingFecBlockReceived[FEC_BLOCK_WORD(index)] &= ~FEC_BLOCK_BIT(index);
+            queue->pendingFecBlockCount--;
+        }
+    }
+}
+
 void RtpvCleanupQueue(PRTP_VIDEO_QUEUE queue) {
-    purgeListEntries(&queue->pendingFecBlockList);
+    purgePendingFecBlock(queue);
     purgeListEntries(&queue->completedFecBlockList);
 }
 
 static void insertEntryIntoList(PRTPV_QUEUE_LIST list, PRTPV_QUEUE_ENTRY entry) {
-    LC_ASSERT(entry->prev == NULL);
     LC_ASSERT(entry->next == NULL);
 
     if (list->head == NULL) {
@@ -51,42 +74,31 @@ static void insertEntryIntoList(PRTPV_QUEUE_LIST list, PRTPV_QUEUE_ENTRY entry)
     }
     else {
         LC_ASSERT(list->count != 0);
-        PRTPV_QUEUE_ENTRY oldTail = list->tail;
-        entry->prev = oldTail;
-        LC_ASSERT(oldTail->next == NULL);
-        oldTail->next = entry;
+        LC_ASSERT(list->tail->next == NULL);
+        list->tail->next = entry;
         list->tail = entry;
     }
 
     list->count++;
 }
 
-static void removeEntryFromList(PRTPV_QUEUE_LIST list, PRTPV_QUEUE_ENTRY entry) {
+static PRTPV_QUEUE_ENTRY removeHeadFromList(PRTPV_QUEUE_LIST list) {
+    PRTPV_QUEUE_ENTRY entry = list->head;
+
     LC_ASSERT(entry != NULL);
     LC_ASSERT(list->count != 0);
-    LC_ASSERT(list->head != NULL);
     LC_ASSERT(list->tail != NULL);
 
-    if (list->head == entry) {
-        list->head = entry->next;
-    }
+    list->head = entry->next;
     if (list->tail == entry) {
-        list->tail = entry->prev;
-    }
-
-    if (entry->prev != NULL) {
-        LC_ASSERT(entry->prev->next == entry);
-        entry->prev->next = entry->next;
-    }
-    if (entry->next != NULL) {
-        LC_ASSERT(entry->next->prev == entry);
-        entry->next->prev = entry->prev;
+        LC_ASSERT(list->head == NULL);
+        list->tail = NULL;
     }
 
     entry->next = NULL;
-    entry->prev = NULL;
 
     list->count--;
+    return entry;
 }
 
 static void reportFinalFrameFecStatus(PRTP_VIDEO_QUEUE queue) {
@@ -109,50 +121,30 @@ static void reportFinalFrameFecStatus(PRTP_VIDEO_QUEUE queue) {
 
 // newEntry is contained within the packet buffer so we free the whole entry by freeing entry->packet
 static bool queuePacket(PRTP_VIDEO_QUEUE queue, PRTPV_QUEUE_ENTRY newEntry, PRTP_PACKET packet, int length, bool isParity, bool isFecRecovery) {
-    PRTPV_QUEUE_ENTRY entry;
+    unsigned int index;
     bool outOfSequence;
     
     LC_ASSERT(!(isFecRecovery && isParity));
     LC_ASSERT(!isBefore16(packet->sequenceNumber, queue->nextContiguousSequenceNumber));
 
-    // If the packet is in order, we can take the fast path and avoid having
-    // to loop through the whole list. If we get an out of order or missing
-    // packet, the fast path will stop working and we'll use the loop instead.
-    //
-    // NB: It's not enough to just check next contiguous sequence number because
-    // it's possible that we hit the OOS path earlier which doesn't update the
-    // next contiguous sequence number. If that happens, we need to use the slow
-    // path for this entire frame to avoid possibly mishandling a duplicate packet.
-    if (queue->useFastQueuePath && packet->sequenceNumber == queue->nextContiguousSequenceNumber) {
-        queue->nextContiguousSequenceNumber = U16(packet->sequenceNumber + 1);
-        outOfSequence = false;
-    }
-    else {
-        outOfSequence = false;
-
-        // Check for duplicates
-        entry = queue->pendingFecBlockList.head;
-        while (entry != NULL) {
-            if (packet->sequenceNumber == entry->packet->sequenceNumber) {
-                return false;
-            }
-            else if (isBefore16(packet->sequenceNumber, entry->packet->sequenceNumber)) {
-                outOfSequence = true;
-            }
+    // RtpvAddPacket() has already rejected anything outside of this FEC block,
+    // so the offset from the lowest sequence number is a valid shard index.
+    index = U16(packet->sequenceNumber - queue->bufferLowestSequenceNumber);
+    LC_ASSERT(index < RTPV_MAX_FEC_BLOCK_SHARDS);
+    LC_ASSERT(!isBefore16(queue->bufferHighestSequenceNumber, packet->sequenceNumber));
 
-            entry = entry->next;
-        }
-
-        // If we make it here, we cannot use the fast queue path for this frame because
-        // we're about to queue a non-duplicate packet out of order. This will not update
-        // nextContiguousSequenceNumber which the fast path relies on.
-        queue->useFastQueuePath = false;
+    // Check for duplicates
+    if (isFecBlockShardReceived(queue, index)) {
+        return false;
     }
 
+    // This packet is out of sequence if we've already queued one with a higher sequence number
+    outOfSequence = queue->pendingFecBlockCount != 0 &&
+                    isBefore16(packet->sequenceNumber, queue->receivedHighestSequenceNumber);
+
     newEntry->packet = packet;
     newEntry->length = length;
     newEntry->isParity = isParity;
-    newEntry->prev = NULL;
     newEntry->next = NULL;
     newEntry->presentationTimeMs = packet->timestamp / PTS_DIVISOR;
 
@@ -175,7 +167,18 @@ static bool queuePacket(PRTP_VIDEO_QUEUE queue, PRTPV_QUEUE_ENTRY newEntry, PRTP
         }
     }
 
-    insertEntryIntoList(&queue->pendingFecBlockList, newEntry);
+    queue->pendingFecBlockEntries[index] = newEntry;
+    queue->pendingFecBlockReceived[FEC_BLOCK_WORD(index)] |= FEC_BLOCK_BIT(index);
+    queue->pendingFecBlockCount++;
+
+    // Advance past every shard we now hold contiguously. Each shard can only
+    // be stepped over once per FEC block, so this is amortized O(1).
+    if (packet->sequenceNumber == queue->nextContiguousSequenceNumber) {
+        do {
+            queue->nextContiguousSequenceNumber = U16(queue->nextContiguousSequenceNumber + 1);
+            index++;
+        } while (index < RTPV_MAX_FEC_BLOCK_SHARDS && isFecBlockShardReceived(queue, index));
+    }
 
     return true;
 }
@@ -205,7 +208,7 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
 
     LC_ASSERT(totalPackets - neededPackets <= queue->bufferParityPackets);
 
-    if (queue->pendingFecBlockList.count < neededPackets) {
+    if (queue->pendingFecBlockCount < neededPackets) {
         // If we've never received OOS data from this host, we can predict whether this frame will be recoverable
         // based on the packets we've received (or not) so far. If the number of missing shards exceeds the total
         // needed shards, there is no hope of recovering the data. The only way we could recover this frame is by
@@ -219,7 +222,7 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
             }
             else {
                 // Assert that there are enough remaining packets to possibly recover this frame.
-                LC_ASSERT(neededPackets - queue->pendingFecBlockList.count <= U16(queue->bufferHighestSequenceNumber - queue->receivedHighestSequenceNumber));
+                LC_ASSERT(neededPackets - queue->pendingFecBlockCount <= U16(queue->bufferHighestSequenceNumber - queue->receivedHighestSequenceNumber));
             }
         }
 
@@ -234,7 +237,7 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
     if (queue->reportedLostFrame && !queue->receivedOosData) {
         // If it turns out that we lied to the host, stop further speculative RFI requests for a while.
         queue->receivedOosData = true;
-        queue->lastOosFramePresentationTimestamp = queue->pendingFecBlockList.head->presentationTimeMs;
+        queue->lastOosFramePresentationTimestamp = queue->pendingFecBlockEntries[U16(queue->receivedHighestSequenceNumber - queue->bufferLowestSequenceNumber)]->presentationTimeMs;
         Limelog("Leaving speculative RFI mode due to incorrect loss prediction of frame %u\n", queue->currentFrameNumber);
     }
 
@@ -286,37 +289,40 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
     int droppedRtpPacketLength = 0;
 #endif
 
-    PRTPV_QUEUE_ENTRY entry = queue->pendingFecBlockList.head;
-    while (entry != NULL) {
-        unsigned int index = U16(entry->packet->sequenceNumber - queue->bufferLowestSequenceNumber);
+    // Any received packet can serve as the template for the RTP header fields of
+    // recovered packets, since they are identical within an FEC block.
+    PRTP_PACKET templateRtpPacket = NULL;
+
+    unsigned int i;
+    for (i = 0; i < totalPackets; i++) {
+        PRTPV_QUEUE_ENTRY entry = queue->pendingFecBlockEntries[i];
+
+        if (entry == NULL) {
+            continue;
+        }
+
+        templateRtpPacket = entry->packet;
 
 #ifdef FEC_VALIDATION_MODE
-        if (index == dropIndex) {
+        if (i == dropIndex) {
             // If this was the drop choice, remember the original contents
             // and "drop" it.
             droppedRtpPacket = entry->packet;
             droppedRtpPacketLength = entry->length;
-            entry = entry->next;
             continue;
         }
 #endif
 
-        // We should never have duplicate packets enqueued
-        LC_ASSERT(packets[index] == NULL);
-        LC_ASSERT(marks[index] != 0);
-
-        packets[index] = (unsigned char*) entry->packet;
-        marks[index] = 0;
+        packets[i] = (unsigned char*) entry->packet;
+        marks[i] = 0;
         
         //Set padding to zero
         if (entry->length < receiveSize) {
-            memset(&packets[index][entry->length], 0, receiveSize - entry->length);
+            memset(&packets[i][entry->length], 0, receiveSize - entry->length);
         }
-
-        entry = entry->next;
     }
+    LC_ASSERT(templateRtpPacket != NULL);
 
-    unsigned int i;
     for (i = 0; i < totalPackets; i++) {
         if (marks[i]) {
             packets[i] = malloc(packetBufferSize);
@@ -342,6 +348,8 @@ static int reconstructFrame(PRTP_VIDEO_QUEUE queue) {
         
         // Report the final FEC status if we needed to perform a recovery
         reportFinalFrameFecStatus(queue);
+        LiRecordFlightEvent(FLIGHT_EVENT_FEC_RECOVERED, queue->currentFrameNumber,
+                            queue->bufferDataPackets - queue->receivedDataPackets);
     }
 
 cleanup_packets:
@@ -352,9 +360,9 @@ cleanup_packets:
                 PRTPV_QUEUE_ENTRY queueEntry = (PRTPV_QUEUE_ENTRY)&packets[i][receiveSize];
                 PRTP_PACKET rtpPacket = (PRTP_PACKET) packets[i];
                 rtpPacket->sequenceNumber = U16(i + queue->bufferLowestSequenceNumber);
-                rtpPacket->header = queue->pendingFecBlockList.head->packet->header;
-                rtpPacket->timestamp = queue->pendingFecBlockList.head->packet->timestamp;
-                rtpPacket->ssrc = queue->pendingFecBlockList.head->packet->ssrc;
+                rtpPacket->header = templateRtpPacket->header;
+                rtpPacket->timestamp = templateRtpPacket->timestamp;
+                rtpPacket->ssrc = templateRtpPacket->ssrc;
                 
                 int dataOffset = sizeof(*rtpPacket);
                 if (rtpPacket->header & FLAG_EXTENSION) {
@@ -462,75 +470,49 @@ cleanup:
 }
 
 static void stageCompleteFecBlock(PRTP_VIDEO_QUEUE queue) {
-    unsigned int nextSeqNum = queue->bufferLowestSequenceNumber;
-
-    while (queue->pendingFecBlockList.count > 0) {
-        PRTPV_QUEUE_ENTRY entry = queue->pendingFecBlockList.head;
-
-        unsigned int lowestRtpSequenceNumber = entry->packet->sequenceNumber;
-
-        do {
-            // We should never encounter a packet that's lower than our next seq num
-            LC_ASSERT(!isBefore16(entry->packet->sequenceNumber, nextSeqNum));
-
-            // Never return parity packets
-            if (entry->isParity) {
-                PRTPV_QUEUE_ENTRY parityEntry = entry;
-
-                // Skip this entry
-                entry = parityEntry->next;
-
-                // Remove this entry
-                removeEntryFromList(&queue->pendingFecBlockList, parityEntry);
-
-                // Free the entry and packet
-                free(parityEntry->packet);
+    unsigned int totalPackets = U16(queue->bufferHighestSequenceNumber - queue->bufferLowestSequenceNumber) + 1;
+    unsigned int i;
 
-                continue;
-            }
+    // The shard array is already in sequence order, so we can simply walk it
+    for (i = 0; i < totalPackets && queue->pendingFecBlockCount != 0; i++) {
+        PRTPV_QUEUE_ENTRY entry = queue->pendingFecBlockEntries[i];
 
-            // Check for the next packet in sequence. This will be O(1) for non-reordered packet streams.
-            if (entry->packet->sequenceNumber == nextSeqNum) {
-                removeEntryFromList(&queue->pendingFecBlockList, entry);
+        if (entry == NULL) {
+            // Only parity shards may be missing once the block is complete
+            LC_ASSERT(i >= queue->bufferDataPackets);
+            continue;
+        }
 
-                // To avoid having to sample the system time for each packet, we cheat
-                // and use the first packet's receive time for all packets. This ends up
-                // actually being better for the measurements that the depacketizer does,
-                // since it properly handles out of order packets.
-                LC_ASSERT(queue->bufferFirstRecvTimeMs != 0);
-                entry->receiveTimeMs = queue->bufferFirstRecvTimeMs;
+        queue->pendingFecBlockEntries[i] = NULL;
+        queue->pendingFecBlockReceived[FEC_BLOCK_WORD(i)] &= ~FEC_BLOCK_BIT(i);
+        queue->pendingFecBlockCount--;
 
-                // Move this packet to the completed FEC block list
-                insertEntryIntoList(&queue->completedFecBlockList, entry);
-                break;
-            }
-            else if (isBefore16(entry->packet->sequenceNumber, lowestRtpSequenceNumber)) {
-                lowestRtpSequenceNumber = entry->packet->sequenceNumber;
-            }
+        // Never return parity packets
+        if (entry->isParity) {
+            free(entry->packet);
+            continue;
+        }
 
-            entry = entry->next;
-        } while (entry != NULL);
+        // To avoid having to sample the system time for each packet, we cheat
+        // and use the first packet's receive time for all packets. This ends up
+        // actually being better for the measurements that the depacketizer does,
+        // since it properly handles out of order packets.
+        LC_ASSERT(queue->bufferFirstRecvTimeMs != 0);
+        entry->receiveTimeMs = queue->bufferFirstRecvTimeMs;
 
-        if (entry == NULL) {
-            // Start at the lowest we found last enumeration
-            nextSeqNum = lowestRtpSequenceNumber;
-        }
-        else {
-            // We found this packet so move on to the next one in sequence
-            nextSeqNum = U16(nextSeqNum + 1);
-        }
+        // Move this packet to the completed FEC block list
+        insertEntryIntoList(&queue->completedFecBlockList, entry);
     }
 }
 
 static void submitCompletedFrame(PRTP_VIDEO_QUEUE queue) {
     while (queue->completedFecBlockList.count > 0) {
-        PRTPV_QUEUE_ENTRY entry = queue->completedFecBlockList.head;
+        // Submit this packet for decoding. It will own freeing the entry now.
+        PRTPV_QUEUE_ENTRY entry = removeHeadFromList(&queue->completedFecBlockList);
 
         // Parity packets should have been removed by stageCompleteFecBlock()
         LC_ASSERT(!entry->isParity);
 
-        // Submit this packet for decoding. It will own freeing the entry now.
-        removeEntryFromList(&queue->completedFecBlockList, entry);
         queueRtpPacket(entry);
     }
 }
@@ -564,6 +546,8 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
     nvPacket->frameIndex = LE32(nvPacket->frameIndex);
     nvPacket->fecInfo = LE32(nvPacket->fecInfo);
 
+    LiRecordFlightEvent(FLIGHT_EVENT_VIDEO_PACKET, nvPacket->streamPacketIndex, nvPacket->frameIndex);
+
     // For legacy servers, we'll fixup the reserved data so that it looks like
     // it's a single FEC frame from a multi-FEC capable server. This allows us
     // to make our parsing logic simpler.
@@ -589,11 +573,13 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
 
     // Reinitialize the queue if it's empty after a frame delivery or
     // if we can't finish a frame before receiving the next one.
-    if (queue->pendingFecBlockList.count == 0 || queue->currentFrameNumber != nvPacket->frameIndex ||
+    if (queue->pendingFecBlockCount == 0 || queue->currentFrameNumber != nvPacket->frameIndex ||
             queue->multiFecCurrentBlockNumber != fecCurrentBlockNumber) {
-        if (queue->pendingFecBlockList.count != 0) {
+        if (queue->pendingFecBlockCount != 0) {
             // Report the final status of the FEC queue before dropping this frame
             reportFinalFrameFecStatus(queue);
+            LiRecordFlightEvent(FLIGHT_EVENT_FEC_FAILED, queue->currentFrameNumber,
+                                queue->bufferDataPackets - queue->pendingFecBlockCount);
 
             if (queue->multiFecLastBlockNumber != 0) {
                 Limelog("Unrecoverable frame %d (block %d of %d): %d+%d=%d received < %d needed\n",
@@ -601,7 +587,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
                         queue->multiFecLastBlockNumber+1,
                         queue->receivedDataPackets,
                         queue->receivedParityPackets,
-                        queue->pendingFecBlockList.count,
+                        queue->pendingFecBlockCount,
                         queue->bufferDataPackets);
 
                 // If we just missed a block of this frame rather than the whole thing,
@@ -609,7 +595,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
                 // frame further is not possible.
                 if (queue->currentFrameNumber == nvPacket->frameIndex) {
                     // Discard any unsubmitted buffers from the previous frame
-                    purgeListEntries(&queue->pendingFecBlockList);
+                    purgePendingFecBlock(queue);
                     purgeListEntries(&queue->completedFecBlockList);
 
                     // Notify the host of the loss of this frame
@@ -627,7 +613,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
                 Limelog("Unrecoverable frame %d: %d+%d=%d received < %d needed\n",
                         queue->currentFrameNumber, queue->receivedDataPackets,
                         queue->receivedParityPackets,
-                        queue->pendingFecBlockList.count,
+                        queue->pendingFecBlockCount,
                         queue->bufferDataPackets);
             }
         }
@@ -638,6 +624,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
         if (fecCurrentBlockNumber != expectedFecBlockNumber) {
             // Report the final status of the FEC queue before dropping this frame
             reportFinalFrameFecStatus(queue);
+            LiRecordFlightEvent(FLIGHT_EVENT_FEC_FAILED, nvPacket->frameIndex, 0);
 
             Limelog("Unrecoverable frame %d: lost FEC blocks %d to %d\n",
                     nvPacket->frameIndex,
@@ -645,7 +632,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
                     fecCurrentBlockNumber);
 
             // Discard any unsubmitted buffers from the previous frame
-            purgeListEntries(&queue->pendingFecBlockList);
+            purgePendingFecBlock(queue);
             purgeListEntries(&queue->completedFecBlockList);
 
             // Notify the host of the loss of this frame
@@ -661,7 +648,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
         }
 
         // Discard any pending buffers from the previous FEC block
-        purgeListEntries(&queue->pendingFecBlockList);
+        purgePendingFecBlock(queue);
 
         // Discard any completed FEC blocks from the previous frame
         if (queue->currentFrameNumber != nvPacket->frameIndex) {
@@ -697,7 +684,6 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
         queue->receivedParityPackets = 0;
         queue->receivedHighestSequenceNumber = 0;
         queue->missingPackets = 0;
-        queue->useFastQueuePath = true;
         queue->reportedLostFrame = false;
         queue->bufferDataPackets = (nvPacket->fecInfo & 0xFFC00000) >> 22;
         queue->fecPercentage = (nvPacket->fecInfo & 0xFF0) >> 4;
@@ -731,7 +717,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
     }
     else {
         // Update total missing packet count
-        if (queue->pendingFecBlockList.count == 1) {
+        if (queue->pendingFecBlockCount == 1) {
             // Initialize counts and highest seqnum on the first packet
             LC_ASSERT(queue->missingPackets == 0);
             LC_ASSERT(queue->receivedHighestSequenceNumber == 0);
@@ -770,9 +756,7 @@ int RtpvAddPacket(PRTP_VIDEO_QUEUE queue, PRTP_PACKET packet, int length, PRTPV_
             stageCompleteFecBlock(queue);
             
             // stageCompleteFecBlock() should have consumed all pending FEC data
-            LC_ASSERT(queue->pendingFecBlockList.head == NULL);
-            LC_ASSERT(queue->pendingFecBlockList.tail == NULL);
-            LC_ASSERT(queue->pendingFecBlockList.count == 0);
+            LC_ASSERT(queue->pendingFecBlockCount == 0);
             
             // If we're not yet at the last FEC block for this frame, move on to the next block.
             // Otherwise, the frame is complete and we can move on to the next frame.
@@ -4,7 +4,6 @@
 
 typedef struct _RTPV_QUEUE_ENTRY {
     struct _RTPV_QUEUE_ENTRY* next;
-    struct _RTPV_QUEUE_ENTRY* prev;
     PRTP_PACKET packet;
     uint64_t receiveTimeMs;
     uint32_t presentationTimeMs;
@@ -18,8 +17,18 @@ typedef struct _RTPV_QUEUE_LIST {
     uint32_t count;
 } RTPV_QUEUE_LIST, *PRTPV_QUEUE_LIST;
 
+// The FEC block header carries a 10-bit data shard count and an 8-bit FEC
+// percentage, so a single block can never exceed 1023 + 2609 shards.
+#define RTPV_MAX_FEC_BLOCK_SHARDS 4096
+
 typedef struct _RTP_VIDEO_QUEUE {
-    RTPV_QUEUE_LIST pendingFecBlockList;
+    // Packets of the pending FEC block, indexed by their offset from
+    // bufferLowestSequenceNumber. A set bit in pendingFecBlockReceived
+    // means the matching slot in pendingFecBlockEntries is occupied.
+    PRTPV_QUEUE_ENTRY pendingFecBlockEntries[RTPV_MAX_FEC_BLOCK_SHARDS];
+    uint32_t pendingFecBlockReceived[RTPV_MAX_FEC_BLOCK_SHARDS / 32];
+    uint32_t pendingFecBlockCount;
+
     RTPV_QUEUE_LIST completedFecBlockList;
 
     uint64_t bufferFirstRecvTimeMs;
@@ -34,7 +43,6 @@ typedef struct _RTP_VIDEO_QUEUE {
     uint32_t fecPercentage;
     uint32_t nextContiguousSequenceNumber;
     uint32_t missingPackets; // # of holes behind receivedHighestSequenceNumber
-    bool useFastQueuePath;
     bool reportedLostFrame;
 
     uint32_t currentFrameNumber;
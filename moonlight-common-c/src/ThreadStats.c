@@ -0,0 +1,391 @@
+#define _GNU_SOURCE
+#include "Limelight-internal.h"
+
+#if defined(__linux__)
+#include <sys/syscall.h>
+#elif defined(LC_DARWIN)
+#include <mach/mach.h>
+#endif
+
+// Per-thread CPU time and wakeup accounting. Each thread registers itself into a
+// slot, and the platform's blocking waits count wakeups and blocked time into the
+// calling thread's slot through a thread-local pointer. The counters are only
+// written by their own thread, so the waits never take a lock. A torn read on a
+// 32-bit platform only skews one sample.
+
+#if defined(_MSC_VER)
+#define THREAD_LOCAL __declspec(thread)
+#elif defined(__GNUC__) && !defined(__vita__) && !defined(__WIIU__) && !defined(__3DS__)
+#define THREAD_LOCAL __thread
+#endif
+
+#define MAX_TRACKED_THREADS 32
+
+// Readers polling faster than this share the previous snapshot
+#define THREAD_STATS_MIN_INTERVAL_US 500000
+
+#ifdef THREAD_LOCAL
+
+typedef struct _TRACKED_THREAD {
+    bool active;
+    char name[THREAD_STATS_NAME_LENGTH];
+
+    // Written by the tracked thread
+    uint64_t wakeups;
+    uint64_t blockedUs;
+    uint64_t waitStartUs;
+
+#if defined(LC_WINDOWS)
+    HANDLE handle;
+#elif defined(LC_DARWIN)
+    mach_port_t machThread;
+#else
+    pthread_t thread;
+#if defined(__linux__)
+    pid_t tid;
+#endif
+#endif
+    uint64_t registeredUs;
+    uint64_t cpuBaseUs;
+
+    // Previous sample
+    uint64_t sampleUs;
+    uint64_t sampleCpuTimeUs;
+    uint64_t sampleWakeups;
+    THREAD_STATS stats;
+} TRACKED_THREAD, *PTRACKED_THREAD;
+
+static THREAD_LOCAL PTRACKED_THREAD currentThread;
+static THREAD_LOCAL uint32_t currentGeneration;
+
+static TRACKED_THREAD trackedThreads[MAX_TRACKED_THREADS];
+static PLT_MUTEX threadStatsLock;
+static bool threadStatsActive;
+static uint32_t threadStatsGeneration;
+static uint64_t lastSnapshotUs;
+
+// Returns the slot of the calling thread. Detached threads can outlive the
+// connection that registered them, so their slot is ignored afterwards.
+static PTRACKED_THREAD getCurrentThread(void) {
+    if (currentThread == NULL || currentGeneration != threadStatsGeneration || !threadStatsActive) {
+        return NULL;
+    }
+
+    return currentThread;
+}
+
+// Reads the CPU time of a tracked thread. Returns false if the platform has no
+// per-thread CPU clock.
+static bool getThreadCpuTime(PTRACKED_THREAD thread, uint64_t* cpuTimeUs) {
+#if defined(LC_WINDOWS)
+    FILETIME creationTime, exitTime, kernelTime, userTime;
+
+    if (!GetThreadTimes(thread->handle, &creationTime, &exitTime, &kernelTime, &userTime)) {
+        return false;
+    }
+
+    // FILETIMEs count 100 ns units
+    *cpuTimeUs = ((((uint64_t)kernelTime.dwHighDateTime << 32) | kernelTime.dwLowDateTime) +
+                  (((uint64_t)userTime.dwHighDateTime << 32) | userTime.dwLowDateTime)) / 10;
+    return true;
+#elif defined(LC_DARWIN)
+    thread_basic_info_data_t info;
+    mach_msg_type_number_t count = THREAD_BASIC_INFO_COUNT;
+
+    if (thread_info(thread->machThread, THREAD_BASIC_INFO, (thread_info_t)&info, &count) != KERN_SUCCESS) {
+        return false;
+    }
+
+    *cpuTimeUs = ((uint64_t)info.user_time.seconds + info.system_time.seconds) * 1000000 +
+                 info.user_time.microseconds + info.system_time.microseconds;
+    return true;
+#elif defined(_POSIX_THREAD_CPUTIME) && _POSIX_THREAD_CPUTIME >= 0
+    // Emscripten provides the clock IDs, but reading them fails
+    clockid_t clockId;
+    struct timespec ts;
+
+    if (pthread_getcpuclockid(thread->thread, &clockId) != 0 || clock_gettime(clockId, &ts) != 0) {
+        return false;
+    }
+
+    *cpuTimeUs = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    return true;
+#else
+    (void)thread;
+    (void)cpuTimeUs;
+    return false;
+#endif
+}
+
+// Reads the context switch counts of a tracked thread where the OS reports them
+static void getThreadContextSwitches(PTRACKED_THREAD thread, PTHREAD_STATS stats) {
+#if defined(__linux__)
+    char path[64];
+    char line[128];
+    FILE* f;
+
+    snprintf(path, sizeof(path), "/proc/self/task/%d/status", (int)thread->tid);
+    f = fopen(path, "r");
+    if (f == NULL) {
+        return;
+    }
+
+    while (fgets(line, sizeof(line), f) != NULL) {
+        unsigned long long value;
+
+        if (sscanf(line, "voluntary_ctxt_switches: %llu", &value) == 1) {
+            stats->voluntaryContextSwitches = value;
+        }
+        else if (sscanf(line, "nonvoluntary_ctxt_switches: %llu", &value) == 1) {
+            stats->involuntaryContextSwitches = value;
+        }
+    }
+
+    fclose(f);
+#else
+    (void)thread;
+    (void)stats;
+#endif
+}
+
+static void sampleThread(PTRACKED_THREAD thread, uint64_t nowUs) {
+    uint64_t cpuTimeUs;
+    uint64_t wakeups;
+    uint64_t intervalUs;
+
+    if (getThreadCpuTime(thread, &cpuTimeUs)) {
+        cpuTimeUs = cpuTimeUs > thread->cpuBaseUs ? cpuTimeUs - thread->cpuBaseUs : 0;
+        thread->stats.cpuTimeEstimated = false;
+    }
+    else {
+        uint64_t waitStartUs = thread->waitStartUs;
+        uint64_t blockedUs = thread->blockedUs;
+
+        // Count the wait the thread is blocked in right now
+        if (waitStartUs != 0 && nowUs > waitStartUs) {
+            blockedUs += nowUs - waitStartUs;
+        }
+
+        cpuTimeUs = nowUs - thread->registeredUs;
+        cpuTimeUs = cpuTimeUs > blockedUs ? cpuTimeUs - blockedUs : 0;
+        thread->stats.cpuTimeEstimated = true;
+    }
+
+    // The estimate can step back slightly when a wait ends between reads
+    if (cpuTimeUs < thread->sampleCpuTimeUs) {
+        cpuTimeUs = thread->sampleCpuTimeUs;
+    }
+
+    wakeups = thread->wakeups;
+    intervalUs = nowUs - thread->sampleUs;
+    if (intervalUs > 0) {
+        thread->stats.cpuPercent = (float)(cpuTimeUs - thread->sampleCpuTimeUs) * 100 / intervalUs;
+        thread->stats.wakeupsPerSecond = (float)(wakeups - thread->sampleWakeups) * 1000000 / intervalUs;
+    }
+
+    thread->stats.cpuTimeUs = cpuTimeUs;
+    thread->stats.wakeups = wakeups;
+    getThreadContextSwitches(thread, &thread->stats);
+
+    thread->sampleUs = nowUs;
+    thread->sampleCpuTimeUs = cpuTimeUs;
+    thread->sampleWakeups = wakeups;
+}
+
+void LiRegisterThreadStats(const char* name) {
+    PTRACKED_THREAD thread = NULL;
+    int i;
+
+    if (!threadStatsActive || getCurrentThread() != NULL) {
+        return;
+    }
+
+    PltLockMutex(&threadStatsLock);
+    for (i = 0; i < MAX_TRACKED_THREADS; i++) {
+        if (!trackedThreads[i].active) {
+            thread = &trackedThreads[i];
+            break;
+        }
+    }
+    if (thread == NULL) {
+        PltUnlockMutex(&threadStatsLock);
+        return;
+    }
+
+    memset(thread, 0, sizeof(*thread));
+    strncpy(thread->name, name, sizeof(thread->name) - 1);
+    memcpy(thread->stats.name, thread->name, sizeof(thread->stats.name));
+
+#if defined(LC_WINDOWS)
+    if (!DuplicateHandle(GetCurrentProcess(), GetCurrentThread(), GetCurrentProcess(), &thread->handle,
+                         THREAD_QUERY_LIMITED_INFORMATION, FALSE, 0)) {
+        thread->handle = NULL;
+    }
+#elif defined(LC_DARWIN)
+    thread->machThread = pthread_mach_thread_np(pthread_self());
+#else
+    thread->thread = pthread_self();
+#if defined(__linux__)
+    thread->tid = (pid_t)syscall(SYS_gettid);
+#endif
+#endif
+
+    // Application threads may have run for a while before registering
+    if (!getThreadCpuTime(thread, &thread->cpuBaseUs)) {
+        thread->cpuBaseUs = 0;
+    }
+    thread->registeredUs = PltGetMicroseconds();
+    thread->sampleUs = thread->registeredUs;
+    thread->active = true;
+    currentThread = thread;
+    currentGeneration = threadStatsGeneration;
+    PltUnlockMutex(&threadStatsLock);
+}
+
+static void releaseThread(PTRACKED_THREAD thread) {
+    thread->active = false;
+#if defined(LC_WINDOWS)
+    if (thread->handle != NULL) {
+        CloseHandle(thread->handle);
+        thread->handle = NULL;
+    }
+#endif
+}
+
+void LiUnregisterThreadStats(void) {
+    PTRACKED_THREAD thread = getCurrentThread();
+
+    currentThread = NULL;
+    if (thread == NULL) {
+        return;
+    }
+
+    PltLockMutex(&threadStatsLock);
+    releaseThread(thread);
+    PltUnlockMutex(&threadStatsLock);
+}
+
+uint64_t LiBeginThreadWait(void) {
+    PTRACKED_THREAD thread = getCurrentThread();
+
+    if (thread == NULL) {
+        return 0;
+    }
+
+    thread->waitStartUs = PltGetMicroseconds();
+    return thread->waitStartUs;
+}
+
+void LiEndThreadWait(uint64_t waitToken) {
+    PTRACKED_THREAD thread = getCurrentThread();
+    uint64_t nowUs;
+
+    if (thread == NULL || waitToken == 0) {
+        return;
+    }
+
+    nowUs = PltGetMicroseconds();
+    if (nowUs > waitToken) {
+        thread->blockedUs += nowUs - waitToken;
+    }
+    thread->waitStartUs = 0;
+    thread->wakeups++;
+}
+
+int LiGetThreadStats(PTHREAD_STATS stats, int maxThreads) {
+    uint64_t nowUs;
+    int count = 0;
+    int i;
+
+    if (!threadStatsActive) {
+        return 0;
+    }
+
+    PltLockMutex(&threadStatsLock);
+
+    nowUs = PltGetMicroseconds();
+    if (nowUs - lastSnapshotUs >= THREAD_STATS_MIN_INTERVAL_US) {
+        for (i = 0; i < MAX_TRACKED_THREADS; i++) {
+            if (trackedThreads[i].active) {
+                sampleThread(&trackedThreads[i], nowUs);
+            }
+        }
+        lastSnapshotUs = nowUs;
+    }
+
+    for (i = 0; i < MAX_TRACKED_THREADS && count < maxThreads; i++) {
+        if (trackedThreads[i].active) {
+            stats[count++] = trackedThreads[i].stats;
+        }
+    }
+
+    PltUnlockMutex(&threadStatsLock);
+
+    return count;
+}
+
+int initializeThreadStats(void) {
+    int err;
+
+    err = PltCreateMutex(&threadStatsLock, "ThreadStats");
+    if (err != 0) {
+        return err;
+    }
+
+    memset(trackedThreads, 0, sizeof(trackedThreads));
+    lastSnapshotUs = 0;
+    threadStatsGeneration++;
+    threadStatsActive = true;
+    return 0;
+}
+
+void cleanupThreadStats(void) {
+    int i;
+
+    PltLockMutex(&threadStatsLock);
+    threadStatsActive = false;
+
+    // Only detached threads may still be registered
+    for (i = 0; i < MAX_TRACKED_THREADS; i++) {
+        if (trackedThreads[i].active) {
+            releaseThread(&trackedThreads[i]);
+        }
+    }
+    PltUnlockMutex(&threadStatsLock);
+
+    PltDeleteMutex(&threadStatsLock);
+}
+
+#else
+
+// Without thread-local storage, waits can't find their thread's counters
+
+void LiRegisterThreadStats(const char* name) {
+    (void)name;
+}
+
+void LiUnregisterThreadStats(void) {
+}
+
+uint64_t LiBeginThreadWait(void) {
+    return 0;
+}
+
+void LiEndThreadWait(uint64_t waitToken) {
+    (void)waitToken;
+}
+
+int LiGetThreadStats(PTHREAD_STATS stats, int maxThreads) {
+    (void)stats;
+    (void)maxThreads;
+    return 0;
+}
+
+int initializeThreadStats(void) {
+    return 0;
+}
+
+void cleanupThreadStats(void) {
+}
+
+#endif
@@ -23,12 +23,19 @@ static uint64_t firstPacketReceiveTime;
 static unsigned int firstPacketPresentationTime;
 static bool dropStatePending;
 static bool idrFrameProcessed;
+static uint8_t frameFlags;
+static AV1_PARSER av1Parser;
 
 #define DR_CLEANUP -1000
 
 #define CONSECUTIVE_DROP_LIMIT 120
 static unsigned int consecutiveFrameDrops;
 
+// A gap this long between complete frames dumps the flight recorder
+#define STUTTER_MIN_GAP_MS 100
+#define STUTTER_FRAME_INTERVALS 6
+static uint64_t lastFrameQueuedTimeMs;
+
 static LINKED_BLOCKING_QUEUE decodeUnitQueue;
 
 typedef struct _BUFFER_DESC {
@@ -57,9 +64,44 @@ typedef struct _LENTRY_INTERNAL {
 #define HEVC_NAL_TYPE_FILLER 38
 #define HEVC_NAL_TYPE_SEI 39
 
+// Everything that depends on the negotiated codec is reached through this table,
+// which is selected once per session in initializeVideoDepacketizer(). This keeps
+// per-packet and per-NALU code free of NegotiatedVideoFormat checks, and lets
+// codecs without an Annex B bitstream bypass start sequence parsing entirely.
+typedef struct _VIDEO_CODEC_OPS {
+    // H.264 and HEVC are parsed at the NALU level. For AV1, we trust the frame
+    // header to identify IDR frames and use the exact payload length it carries
+    // to strip the FEC trailing zero padding.
+    bool annexB;
+
+    // Strips NALUs that may precede the picture data in the first packet of a frame
+    void (*skipFramePrefix)(PBUFFER_DESC currentPos);
+
+    // Queues the payload of a packet (after the frame header). Returns false if the
+    // frame was dropped and processing of this packet must stop.
+    bool (*queuePayload)(PBUFFER_DESC currentPos, bool firstPacket, bool lastPacket,
+                         uint32_t frameIndex, uint32_t frameHeaderSize,
+                         PLENTRY_INTERNAL* existingEntry);
+
+    int (*getBufferFlags)(char* data, int length);
+    void (*validateIdrFrame)(PDECODE_UNIT decodeUnit);
+
+    // NALU classification for Annex B codecs (NULL for AV1)
+    bool (*isSeqReferenceFrameStart)(PBUFFER_DESC buffer);
+    bool (*isAccessUnitDelimiter)(PBUFFER_DESC buffer);
+    bool (*isSeiNal)(PBUFFER_DESC buffer);
+    bool (*isFillerDataNal)(PBUFFER_DESC buffer);
+    bool (*isPictureParameterSetNal)(PBUFFER_DESC buffer);
+    bool (*isIdrFrameStart)(PBUFFER_DESC buffer);
+} VIDEO_CODEC_OPS, *PVIDEO_CODEC_OPS;
+
+static const VIDEO_CODEC_OPS* codecOps;
+
+static const VIDEO_CODEC_OPS* getVideoCodecOps(int videoFormat);
+
 // Init
 void initializeVideoDepacketizer(int pktSize) {
-    LbqInitializeLinkedBlockingQueue(&decodeUnitQueue, 15);
+    LbqInitializeLinkedBlockingQueue(&decodeUnitQueue, 15, "DecodeUnitQueue");
 
     nextFrameNumber = 1;
     startFrameNumber = 0;
@@ -76,6 +118,10 @@ void initializeVideoDepacketizer(int pktSize) {
     dropStatePending = false;
     idrFrameProcessed = false;
     strictIdrFrameWait = !isReferenceFrameInvalidationEnabled();
+    codecOps = getVideoCodecOps(NegotiatedVideoFormat);
+    frameFlags = 0;
+    lastFrameQueuedTimeMs = 0;
+    av1InitializeParser(&av1Parser);
 }
 
 // Free the NAL chain
@@ -155,7 +201,7 @@ void destroyVideoDepacketizer(void) {
 // NB: This function also ensures an additional byte for the NALU type exists after the start sequence
 static bool getAnnexBStartSequence(PBUFFER_DESC current, PBUFFER_DESC startSeq) {
     // We must not get called for other codecs
-    LC_ASSERT(NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265));
+    LC_ASSERT(codecOps->annexB);
 
     if (current->length <= 3) {
         return false;
@@ -188,6 +234,31 @@ static bool getAnnexBStartSequence(PBUFFER_DESC current, PBUFFER_DESC startSeq)
     return false;
 }
 
+static void h264ValidateIdrFrame(PDECODE_UNIT decodeUnit) {
+    // H.264 IDR frames should have an SPS, PPS, then picture data
+    LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_SPS);
+    LC_ASSERT_VT(decodeUnit->bufferList->next != NULL);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->bufferType == BUFFER_TYPE_PPS);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->next != NULL);
+}
+
+static void hevcValidateIdrFrame(PDECODE_UNIT decodeUnit) {
+    // HEVC IDR frames should have an VPS, SPS, PPS, then picture data
+    LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_VPS);
+    LC_ASSERT_VT(decodeUnit->bufferList->next != NULL);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->bufferType == BUFFER_TYPE_SPS);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->next != NULL);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->next->bufferType == BUFFER_TYPE_PPS);
+    LC_ASSERT_VT(decodeUnit->bufferList->next->next->next != NULL);
+}
+
+static void av1ValidateIdrFrame(PDECODE_UNIT decodeUnit) {
+    // AV1 IDR frames start with a temporal delimiter. The sequence header that follows
+    // is only split into its own buffer if it was entirely contained in the first packet.
+    LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_PICDATA);
+    (void)decodeUnit;
+}
+
 void validateDecodeUnitForPlayback(PDECODE_UNIT decodeUnit) {
     // Frames must always have at least one buffer
     LC_ASSERT(decodeUnit->bufferList != NULL);
@@ -196,29 +267,7 @@ void validateDecodeUnitForPlayback(PDECODE_UNIT decodeUnit) {
     // Validate the buffers in the frame
     if (decodeUnit->frameType == FRAME_TYPE_IDR) {
         // IDR frames always start with codec configuration data
-        if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-            // H.264 IDR frames should have an SPS, PPS, then picture data
-            LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_SPS);
-            LC_ASSERT_VT(decodeUnit->bufferList->next != NULL);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->bufferType == BUFFER_TYPE_PPS);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->next != NULL);
-        }
-        else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-            // HEVC IDR frames should have an VPS, SPS, PPS, then picture data
-            LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_VPS);
-            LC_ASSERT_VT(decodeUnit->bufferList->next != NULL);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->bufferType == BUFFER_TYPE_SPS);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->next != NULL);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->next->bufferType == BUFFER_TYPE_PPS);
-            LC_ASSERT_VT(decodeUnit->bufferList->next->next->next != NULL);
-        }
-        else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_AV1) {
-            // We don't parse the AV1 bitstream
-            LC_ASSERT_VT(decodeUnit->bufferList->bufferType == BUFFER_TYPE_PICDATA);
-        }
-        else {
-            LC_ASSERT(false);
-        }
+        codecOps->validateIdrFrame(decodeUnit);
     }
     else {
         LC_ASSERT(decodeUnit->frameType == FRAME_TYPE_PFRAME);
@@ -240,6 +289,8 @@ bool LiWaitForNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* deco
     }
 
     validateDecodeUnitForPlayback(&qdu->decodeUnit);
+    LiRecordFlightEvent(FLIGHT_EVENT_FRAME_DEQUEUED, qdu->decodeUnit.frameNumber,
+                        (uint32_t)(LiGetMillis() - qdu->decodeUnit.enqueueTimeMs));
 
     *frameHandle = qdu;
     *decodeUnit = &qdu->decodeUnit;
@@ -255,6 +306,8 @@ bool LiPollNextVideoFrame(VIDEO_FRAME_HANDLE* frameHandle, PDECODE_UNIT* decodeU
     }
 
     validateDecodeUnitForPlayback(&qdu->decodeUnit);
+    LiRecordFlightEvent(FLIGHT_EVENT_FRAME_DEQUEUED, qdu->decodeUnit.frameNumber,
+                        (uint32_t)(LiGetMillis() - qdu->decodeUnit.enqueueTimeMs));
 
     *frameHandle = qdu;
     *decodeUnit = &qdu->decodeUnit;
@@ -279,10 +332,24 @@ void LiWakeWaitForVideoFrame(void) {
     LbqSignalQueueUserWake(&decodeUnitQueue);
 }
 
+// Frees the buffer chain of a decode unit
+void freeDecodeUnitBuffers(PLENTRY bufferList) {
+    PLENTRY_INTERNAL lastEntry;
+
+    while (bufferList != NULL) {
+        lastEntry = (PLENTRY_INTERNAL)bufferList;
+        bufferList = lastEntry->entry.next;
+        free(lastEntry->allocPtr);
+    }
+}
+
 // Cleanup a decode unit by freeing the buffer chain and the holder
 void LiCompleteVideoFrame(VIDEO_FRAME_HANDLE handle, int drStatus) {
     PQUEUED_DECODE_UNIT qdu = handle;
-    PLENTRY_INTERNAL lastEntry;
+
+    if (drStatus != DR_CLEANUP) {
+        LiRecordFlightEvent(FLIGHT_EVENT_FRAME_COMPLETED, qdu->decodeUnit.frameNumber, (uint32_t)drStatus);
+    }
 
     if (drStatus == DR_NEED_IDR) {
         Limelog("Requesting IDR frame on behalf of DR\n");
@@ -294,123 +361,61 @@ void LiCompleteVideoFrame(VIDEO_FRAME_HANDLE handle, int drStatus) {
         idrFrameProcessed = true;
     }
 
-    while (qdu->decodeUnit.bufferList != NULL) {
-        lastEntry = (PLENTRY_INTERNAL)qdu->decodeUnit.bufferList;
-        qdu->decodeUnit.bufferList = lastEntry->entry.next;
-        free(lastEntry->allocPtr);
+    // The session recorder takes ownership of the buffers instead of copying them
+    if (drStatus != DR_CLEANUP && recordVideoFrame(&qdu->decodeUnit)) {
+        qdu->decodeUnit.bufferList = NULL;
     }
 
+    freeDecodeUnitBuffers(qdu->decodeUnit.bufferList);
+    qdu->decodeUnit.bufferList = NULL;
+
     // We will have stack-allocated entries iff we have a direct-submit decoder
     if ((VideoCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
         free(qdu);
     }
 }
 
-static bool isSeqReferenceFrameStart(PBUFFER_DESC buffer) {
-    BUFFER_DESC startSeq;
-
-    if (!getAnnexBStartSequence(buffer, &startSeq)) {
-        return false;
+// Generates a predicate that checks the type of the NALU at the start of the buffer
+#define DEFINE_NAL_TYPE_PREDICATE(name, nalTypeMacro, nalType) \
+    static bool name(PBUFFER_DESC buffer) { \
+        BUFFER_DESC startSeq; \
+        if (!getAnnexBStartSequence(buffer, &startSeq)) { \
+            return false; \
+        } \
+        return nalTypeMacro(startSeq.data[startSeq.offset + startSeq.length]) == (nalType); \
     }
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == 5;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        switch (HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length])) {
-            case 16:
-            case 17:
-            case 18:
-            case 19:
-            case 20:
-            case 21:
-                return true;
-
-            default:
-                return false;
-        }
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
-    }
-}
-
-static bool isAccessUnitDelimiter(PBUFFER_DESC buffer) {
-    BUFFER_DESC startSeq;
-
-    if (!getAnnexBStartSequence(buffer, &startSeq)) {
-        return false;
-    }
-
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == H264_NAL_TYPE_AUD;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        return HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == HEVC_NAL_TYPE_AUD;
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
-    }
-}
-
-static bool isSeiNal(PBUFFER_DESC buffer) {
-    BUFFER_DESC startSeq;
-
-    if (!getAnnexBStartSequence(buffer, &startSeq)) {
-        return false;
-    }
+DEFINE_NAL_TYPE_PREDICATE(h264IsSeqReferenceFrameStart, H264_NAL_TYPE, 5)
+DEFINE_NAL_TYPE_PREDICATE(h264IsAccessUnitDelimiter, H264_NAL_TYPE, H264_NAL_TYPE_AUD)
+DEFINE_NAL_TYPE_PREDICATE(h264IsSeiNal, H264_NAL_TYPE, H264_NAL_TYPE_SEI)
+DEFINE_NAL_TYPE_PREDICATE(h264IsFillerDataNal, H264_NAL_TYPE, H264_NAL_TYPE_FILLER)
+DEFINE_NAL_TYPE_PREDICATE(h264IsPictureParameterSetNal, H264_NAL_TYPE, H264_NAL_TYPE_PPS)
+DEFINE_NAL_TYPE_PREDICATE(h264IsIdrFrameStart, H264_NAL_TYPE, H264_NAL_TYPE_SPS)
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == H264_NAL_TYPE_SEI;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        return HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == HEVC_NAL_TYPE_SEI;
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
-    }
-}
+DEFINE_NAL_TYPE_PREDICATE(hevcIsAccessUnitDelimiter, HEVC_NAL_TYPE, HEVC_NAL_TYPE_AUD)
+DEFINE_NAL_TYPE_PREDICATE(hevcIsSeiNal, HEVC_NAL_TYPE, HEVC_NAL_TYPE_SEI)
+DEFINE_NAL_TYPE_PREDICATE(hevcIsFillerDataNal, HEVC_NAL_TYPE, HEVC_NAL_TYPE_FILLER)
+DEFINE_NAL_TYPE_PREDICATE(hevcIsPictureParameterSetNal, HEVC_NAL_TYPE, HEVC_NAL_TYPE_PPS)
+DEFINE_NAL_TYPE_PREDICATE(hevcIsIdrFrameStart, HEVC_NAL_TYPE, HEVC_NAL_TYPE_VPS)
 
-#ifdef LC_DEBUG
-static bool isFillerDataNal(PBUFFER_DESC buffer) {
+static bool hevcIsSeqReferenceFrameStart(PBUFFER_DESC buffer) {
     BUFFER_DESC startSeq;
 
     if (!getAnnexBStartSequence(buffer, &startSeq)) {
         return false;
     }
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == H264_NAL_TYPE_FILLER;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        return HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == HEVC_NAL_TYPE_FILLER;
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
-    }
-}
-#endif
-
-static bool isPictureParameterSetNal(PBUFFER_DESC buffer) {
-    BUFFER_DESC startSeq;
-
-    if (!getAnnexBStartSequence(buffer, &startSeq)) {
-        return false;
-    }
+    switch (HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length])) {
+        case 16:
+        case 17:
+        case 18:
+        case 19:
+        case 20:
+        case 21:
+            return true;
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == H264_NAL_TYPE_PPS;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        return HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == HEVC_NAL_TYPE_PPS;
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
+        default:
+            return false;
     }
 }
 
@@ -444,23 +449,18 @@ static void skipToNextNal(PBUFFER_DESC buffer) {
     LC_ASSERT(buffer->length > 0);
 }
 
-static bool isIdrFrameStart(PBUFFER_DESC buffer) {
-    BUFFER_DESC startSeq;
+// Dumps the flight recorder when the stream stalls
+static void checkFrameGap(uint64_t nowMs) {
+    int stutterGapMs = STUTTER_MIN_GAP_MS;
 
-    if (!getAnnexBStartSequence(buffer, &startSeq)) {
-        return false;
+    if (StreamConfig.fps > 0 && STUTTER_FRAME_INTERVALS * 1000 / StreamConfig.fps > stutterGapMs) {
+        stutterGapMs = STUTTER_FRAME_INTERVALS * 1000 / StreamConfig.fps;
     }
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        return H264_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == H264_NAL_TYPE_SPS;
-    }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        return HEVC_NAL_TYPE(startSeq.data[startSeq.offset + startSeq.length]) == HEVC_NAL_TYPE_VPS;
-    }
-    else {
-        LC_ASSERT(false);
-        return false;
+    if (lastFrameQueuedTimeMs != 0 && nowMs - lastFrameQueuedTimeMs >= (uint64_t)stutterGapMs) {
+        LiTriggerFlightRecorderDump("frame-gap");
     }
+    lastFrameQueuedTimeMs = nowMs;
 }
 
 // Reassemble the frame with the given frame number
@@ -481,6 +481,7 @@ static void reassembleFrame(int frameNumber) {
             qdu->decodeUnit.bufferList = nalChainHead;
             qdu->decodeUnit.fullLength = nalChainDataLength;
             qdu->decodeUnit.frameType = frameType;
+            qdu->decodeUnit.frameFlags = frameFlags;
             qdu->decodeUnit.frameNumber = frameNumber;
             qdu->decodeUnit.frameHostProcessingLatency = frameHostProcessingLatency;
             qdu->decodeUnit.receiveTimeMs = firstPacketReceiveTime;
@@ -502,6 +503,9 @@ static void reassembleFrame(int frameNumber) {
             nalChainHead = nalChainTail = NULL;
             nalChainDataLength = 0;
 
+            LiRecordFlightEvent(FLIGHT_EVENT_FRAME_QUEUED, frameNumber, qdu->decodeUnit.fullLength);
+            checkFrameGap(qdu->decodeUnit.enqueueTimeMs);
+
             if ((VideoCallbacks.capabilities & CAPABILITY_DIRECT_SUBMIT) == 0) {
                 if (LbqOfferQueueItem(&decodeUnitQueue, qdu, &qdu->entry) == LBQ_BOUND_EXCEEDED) {
                     Limelog("Video decode unit queue overflow\n");
@@ -543,15 +547,10 @@ static void reassembleFrame(int frameNumber) {
     }
 }
 
-static int getBufferFlags(char* data, int length) {
+static int h264GetBufferFlags(char* data, int length) {
     BUFFER_DESC buffer;
     BUFFER_DESC candidate;
 
-    // We only parse H.264 and HEVC bitstreams
-    if (!(NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265))) {
-        return BUFFER_TYPE_PICDATA;
-    }
-
     buffer.data = data;
     buffer.length = (unsigned int)length;
     buffer.offset = 0;
@@ -560,8 +559,7 @@ static int getBufferFlags(char* data, int length) {
         return BUFFER_TYPE_PICDATA;
     }
 
-    if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H264) {
-        switch (H264_NAL_TYPE(candidate.data[candidate.offset + candidate.length])) {
+    switch (H264_NAL_TYPE(candidate.data[candidate.offset + candidate.length])) {
         case H264_NAL_TYPE_SPS:
             return BUFFER_TYPE_SPS;
 
@@ -570,27 +568,41 @@ static int getBufferFlags(char* data, int length) {
 
         default:
             return BUFFER_TYPE_PICDATA;
-        }
     }
-    else if (NegotiatedVideoFormat & VIDEO_FORMAT_MASK_H265) {
-        switch (HEVC_NAL_TYPE(candidate.data[candidate.offset + candidate.length])) {
-            case HEVC_NAL_TYPE_SPS:
-                return BUFFER_TYPE_SPS;
+}
 
-            case HEVC_NAL_TYPE_PPS:
-                return BUFFER_TYPE_PPS;
+static int hevcGetBufferFlags(char* data, int length) {
+    BUFFER_DESC buffer;
+    BUFFER_DESC candidate;
 
-            case HEVC_NAL_TYPE_VPS:
-                return BUFFER_TYPE_VPS;
+    buffer.data = data;
+    buffer.length = (unsigned int)length;
+    buffer.offset = 0;
 
-            default:
-                return BUFFER_TYPE_PICDATA;
-        }
-    }
-    else {
-        LC_ASSERT(false);
+    if (!getAnnexBStartSequence(&buffer, &candidate)) {
         return BUFFER_TYPE_PICDATA;
     }
+
+    switch (HEVC_NAL_TYPE(candidate.data[candidate.offset + candidate.length])) {
+        case HEVC_NAL_TYPE_SPS:
+            return BUFFER_TYPE_SPS;
+
+        case HEVC_NAL_TYPE_PPS:
+            return BUFFER_TYPE_PPS;
+
+        case HEVC_NAL_TYPE_VPS:
+            return BUFFER_TYPE_VPS;
+
+        default:
+            return BUFFER_TYPE_PICDATA;
+    }
+}
+
+// Sequence headers are tagged by queueAv1Payload() as they are split out
+static int av1GetBufferFlags(char* data, int length) {
+    (void)data;
+    (void)length;
+    return BUFFER_TYPE_PICDATA;
 }
 
 // As an optimization, we can cast the existing packet buffer to a PLENTRY and avoid
@@ -627,7 +639,7 @@ static void queueFragment(PLENTRY_INTERNAL* existingEntry, char* data, int offse
             *existingEntry = NULL;
         }
 
-        entry->entry.bufferType = getBufferFlags(entry->entry.data, entry->entry.length);
+        entry->entry.bufferType = codecOps->getBufferFlags(entry->entry.data, entry->entry.length);
 
         nalChainDataLength += entry->entry.length;
 
@@ -658,7 +670,7 @@ static void processAvcHevcRtpPayloadSlow(PBUFFER_DESC currentPos, PLENTRY_INTERN
         // Skip any prepended AUD or SEI NALUs. We may have padding between
         // these on IDR frames, so the check in processRtpPayload() is not
         // completely sufficient to handle that case.
-        while (isAccessUnitDelimiter(currentPos) || isSeiNal(currentPos)) {
+        while (codecOps->isAccessUnitDelimiter(currentPos) || codecOps->isSeiNal(currentPos)) {
             skipToNextNal(currentPos);
         }
 
@@ -669,7 +681,7 @@ static void processAvcHevcRtpPayloadSlow(PBUFFER_DESC currentPos, PLENTRY_INTERN
         start++;
 #endif
 
-        if (isSeqReferenceFrameStart(currentPos)) {
+        if (codecOps->isSeqReferenceFrameStart(currentPos)) {
             // No longer waiting for an IDR frame
             waitingForIdrFrame = false;
             waitingForRefInvalFrame = false;
@@ -693,7 +705,7 @@ static void processAvcHevcRtpPayloadSlow(PBUFFER_DESC currentPos, PLENTRY_INTERN
             while (currentPos->length != 0) {
                 // Any NALUs we encounter on the way to the end of the packet must be
                 // reference frame slices or filler data.
-                LC_ASSERT_VT(isSeqReferenceFrameStart(currentPos) || isFillerDataNal(currentPos));
+                LC_ASSERT_VT(codecOps->isSeqReferenceFrameStart(currentPos) || codecOps->isFillerDataNal(currentPos));
                 skipToNextNalOrEnd(currentPos);
             }
         }
@@ -733,6 +745,203 @@ static bool isFirstPacket(uint8_t flags, uint8_t fecBlockNumber) {
     return (flags == (FLAG_SOF | FLAG_EOF) || flags == FLAG_SOF) && fecBlockNumber == 0;
 }
 
+// Strip the Annex B NALUs that may precede the picture data in the first packet
+static void skipAnnexBFramePrefix(PBUFFER_DESC currentPos) {
+    // The Annex B NALU start prefix must be next
+    if (!getAnnexBStartSequence(currentPos, NULL)) {
+        // If we aren't starting on a start prefix, something went wrong.
+        LC_ASSERT_VT(false);
+
+        // For release builds, we will try to recover by searching for one.
+        // This mimics the way most decoders handle this situation.
+        skipToNextNal(currentPos);
+    }
+
+    // If an AUD NAL is prepended to this frame data, remove it.
+    // Other parts of this code are not prepared to deal with a
+    // NAL of that type, so stripping it is the easiest option.
+    if (codecOps->isAccessUnitDelimiter(currentPos)) {
+        skipToNextNal(currentPos);
+    }
+
+    // There may be one or more SEI NAL units prepended to the
+    // frame data *after* the (optional) AUD.
+    while (codecOps->isSeiNal(currentPos)) {
+        skipToNextNal(currentPos);
+    }
+}
+
+static void skipNoFramePrefix(PBUFFER_DESC currentPos) {
+    (void)currentPos;
+}
+
+static bool queueAnnexBPayload(PBUFFER_DESC currentPos, bool firstPacket, bool lastPacket,
+                               uint32_t frameIndex, uint32_t frameHeaderSize,
+                               PLENTRY_INTERNAL* existingEntry) {
+    (void)lastPacket;
+    (void)frameIndex;
+    (void)frameHeaderSize;
+
+    if (firstPacket && codecOps->isIdrFrameStart(currentPos)) {
+        // SPS and PPS prefix is padded between NALs, so we must decode it with the slow path
+        processAvcHevcRtpPayloadSlow(currentPos, existingEntry);
+    }
+    else {
+        // Intel's H.264 Media Foundation encoder prepends a PPS to each P-frame.
+        // Skip it to avoid confusing clients.
+        if (firstPacket && codecOps->isPictureParameterSetNal(currentPos)) {
+            skipToNextNal(currentPos);
+        }
+
+#ifdef FORCE_3_BYTE_START_SEQUENCES
+        if (firstPacket) {
+            currentPos->offset++;
+            currentPos->length--;
+        }
+#endif
+
+        queueFragment(existingEntry, currentPos->data, currentPos->offset, currentPos->length);
+    }
+
+    return true;
+}
+
+static bool queueAv1Payload(PBUFFER_DESC currentPos, bool firstPacket, bool lastPacket,
+                            uint32_t frameIndex, uint32_t frameHeaderSize,
+                            PLENTRY_INTERNAL* existingEntry) {
+    int seqHdrOffset, seqHdrLength;
+
+    // We fixup the length of the last packet for other codecs since they may not be tolerant
+    // of trailing zero padding like H.264/HEVC Annex B bitstream parsers are.
+    if (lastPacket) {
+        // The payload length includes the frame header, so it cannot be smaller than that
+        LC_ASSERT_VT(lastPacketPayloadLength > frameHeaderSize);
+
+        // The payload length cannot be smaller than the actual received payload
+        // NB: currentPos->length is already adjusted to exclude the frameHeaderSize
+        LC_ASSERT_VT(lastPacketPayloadLength - frameHeaderSize <= currentPos->length);
+
+        // If the payload length is valid, truncate the packet. If not, discard this frame.
+        if (lastPacketPayloadLength > frameHeaderSize && lastPacketPayloadLength - frameHeaderSize <= currentPos->length) {
+            currentPos->length = lastPacketPayloadLength - frameHeaderSize;
+        }
+        else {
+            if (lastPacketPayloadLength <= frameHeaderSize) {
+                Limelog("Invalid last payload length for header on frame %u: %u <= %u",
+                        frameIndex, lastPacketPayloadLength, frameHeaderSize);
+            }
+            else {
+                Limelog("Invalid last payload length for packet size on frame %u: %u > %u",
+                        frameIndex, lastPacketPayloadLength - frameHeaderSize, currentPos->length);
+            }
+
+            // Skip to the next frame and tell the host we lost this one
+            decodingFrame = false;
+            nextFrameNumber = frameIndex + 1;
+            dropFrameState();
+            if (waitingForIdrFrame) {
+                LiRequestIdrFrame();
+            }
+            else {
+                connectionDetectedFrameLoss(startFrameNumber, frameIndex);
+            }
+
+            return false;
+        }
+    }
+
+    if (firstPacket) {
+        av1BeginTemporalUnit(&av1Parser);
+    }
+
+    av1ScanTemporalUnit(&av1Parser, &currentPos->data[currentPos->offset], (int)currentPos->length,
+                        &seqHdrOffset, &seqHdrLength);
+
+    // A sequence header is split into its own buffer, so the decoder can find it
+    // without parsing the OBUs itself. It only ever appears at the start of a frame.
+    if (seqHdrOffset >= 0) {
+        PLENTRY prevTail = nalChainTail;
+
+        if (seqHdrOffset > 0) {
+            queueFragment(NULL, currentPos->data, currentPos->offset, seqHdrOffset);
+            prevTail = nalChainTail;
+        }
+
+        queueFragment(NULL, currentPos->data, currentPos->offset + seqHdrOffset, seqHdrLength);
+        if (nalChainTail != prevTail) {
+            nalChainTail->bufferType = BUFFER_TYPE_SPS;
+        }
+
+        currentPos->offset += seqHdrOffset + seqHdrLength;
+        currentPos->length -= seqHdrOffset + seqHdrLength;
+    }
+
+    if (currentPos->length > 0) {
+        queueFragment(existingEntry, currentPos->data, currentPos->offset, currentPos->length);
+    }
+
+    if (lastPacket) {
+        frameFlags = av1EndTemporalUnit(&av1Parser);
+    }
+
+    return true;
+}
+
+static const VIDEO_CODEC_OPS h264CodecOps = {
+    true,
+    skipAnnexBFramePrefix,
+    queueAnnexBPayload,
+    h264GetBufferFlags,
+    h264ValidateIdrFrame,
+    h264IsSeqReferenceFrameStart,
+    h264IsAccessUnitDelimiter,
+    h264IsSeiNal,
+    h264IsFillerDataNal,
+    h264IsPictureParameterSetNal,
+    h264IsIdrFrameStart,
+};
+
+static const VIDEO_CODEC_OPS hevcCodecOps = {
+    true,
+    skipAnnexBFramePrefix,
+    queueAnnexBPayload,
+    hevcGetBufferFlags,
+    hevcValidateIdrFrame,
+    hevcIsSeqReferenceFrameStart,
+    hevcIsAccessUnitDelimiter,
+    hevcIsSeiNal,
+    hevcIsFillerDataNal,
+    hevcIsPictureParameterSetNal,
+    hevcIsIdrFrameStart,
+};
+
+static const VIDEO_CODEC_OPS av1CodecOps = {
+    false,
+    skipNoFramePrefix,
+    queueAv1Payload,
+    av1GetBufferFlags,
+    av1ValidateIdrFrame,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+    NULL,
+};
+
+static const VIDEO_CODEC_OPS* getVideoCodecOps(int videoFormat) {
+    if (videoFormat & VIDEO_FORMAT_MASK_H264) {
+        return &h264CodecOps;
+    }
+    else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
+        return &hevcCodecOps;
+    }
+    else {
+        LC_ASSERT(videoFormat & VIDEO_FORMAT_MASK_AV1);
+        return &av1CodecOps;
+    }
+}
+
 // Process an RTP Payload
 // The caller will free *existingEntry unless we NULL it
 static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
@@ -819,6 +1028,7 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
         // We're now decoding a frame
         decodingFrame = true;
         frameType = FRAME_TYPE_PFRAME;
+        frameFlags = 0;
         firstPacketReceiveTime = receiveTimeMs;
         
         // Some versions of Sunshine don't send a valid PTS, so we will
@@ -850,7 +1060,7 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
             case 2: // IDR frame
                 // For other codecs, we trust the frame header rather than parsing the bitstream
                 // to determine if a given frame is an IDR frame.
-                if (!(NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265))) {
+                if (!codecOps->annexB) {
                     waitingForIdrFrame = false;
                     waitingForNextSuccessfulFrame = false;
                     frameType = FRAME_TYPE_IDR;
@@ -894,7 +1104,7 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
         // Codecs like H.264 and HEVC handle the FEC trailing zero padding just fine, but other
         // codecs need the exact length encoded separately.
         LC_ASSERT_VT(currentPos.length >= 6);
-        if (!(NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) && currentPos.length >= 6) {
+        if (!codecOps->annexB && currentPos.length >= 6) {
             BYTE_BUFFER bb;
             BbInitializeWrappedBuffer(&bb, currentPos.data, currentPos.offset + 4, 2, BYTE_ORDER_LITTLE);
             BbGet16(&bb, &lastPacketPayloadLength);
@@ -960,101 +1170,16 @@ static void processRtpPayload(PNV_VIDEO_PACKET videoPacket, int length,
             currentPos.length -= frameHeaderSize;
         }
 
-        // We only parse H.264 and HEVC at the NALU level
-        if (NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) {
-            // The Annex B NALU start prefix must be next
-            if (!getAnnexBStartSequence(&currentPos, NULL)) {
-                // If we aren't starting on a start prefix, something went wrong.
-                LC_ASSERT_VT(false);
-
-                // For release builds, we will try to recover by searching for one.
-                // This mimics the way most decoders handle this situation.
-                skipToNextNal(&currentPos);
-            }
-
-            // If an AUD NAL is prepended to this frame data, remove it.
-            // Other parts of this code are not prepared to deal with a
-            // NAL of that type, so stripping it is the easiest option.
-            if (isAccessUnitDelimiter(&currentPos)) {
-                skipToNextNal(&currentPos);
-            }
-
-            // There may be one or more SEI NAL units prepended to the
-            // frame data *after* the (optional) AUD.
-            while (isSeiNal(&currentPos)) {
-                skipToNextNal(&currentPos);
-            }
-        }
+        // Strip anything preceding the picture data
+        codecOps->skipFramePrefix(&currentPos);
     }
     else {
         // There is no frame header on later packets
         frameHeaderSize = 0;
     }
 
-    if (NegotiatedVideoFormat & (VIDEO_FORMAT_MASK_H264 | VIDEO_FORMAT_MASK_H265)) {
-        if (firstPacket && isIdrFrameStart(&currentPos)) {
-            // SPS and PPS prefix is padded between NALs, so we must decode it with the slow path
-            processAvcHevcRtpPayloadSlow(&currentPos, existingEntry);
-        }
-        else {
-            // Intel's H.264 Media Foundation encoder prepends a PPS to each P-frame.
-            // Skip it to avoid confusing clients.
-            if (firstPacket && isPictureParameterSetNal(&currentPos)) {
-                skipToNextNal(&currentPos);
-            }
-
-#ifdef FORCE_3_BYTE_START_SEQUENCES
-            if (firstPacket) {
-                currentPos.offset++;
-                currentPos.length--;
-            }
-#endif
-
-            queueFragment(existingEntry, currentPos.data, currentPos.offset, currentPos.length);
-        }
-    }
-    else {
-        // We fixup the length of the last packet for other codecs since they may not be tolerant
-        // of trailing zero padding like H.264/HEVC Annex B bitstream parsers are.
-        if (lastPacket) {
-            // The payload length includes the frame header, so it cannot be smaller than that
-            LC_ASSERT_VT(lastPacketPayloadLength > frameHeaderSize);
-
-            // The payload length cannot be smaller than the actual received payload
-            // NB: currentPos.length is already adjusted to exclude the frameHeaderSize from above
-            LC_ASSERT_VT(lastPacketPayloadLength - frameHeaderSize <= currentPos.length);
-
-            // If the payload length is valid, truncate the packet. If not, discard this frame.
-            if (lastPacketPayloadLength > frameHeaderSize && lastPacketPayloadLength - frameHeaderSize <= currentPos.length) {
-                currentPos.length = lastPacketPayloadLength - frameHeaderSize;
-            }
-            else {
-                if (lastPacketPayloadLength <= frameHeaderSize) {
-                    Limelog("Invalid last payload length for header on frame %u: %u <= %u",
-                            frameIndex, lastPacketPayloadLength, frameHeaderSize);
-                }
-                else {
-                    Limelog("Invalid last payload length for packet size on frame %u: %u > %u",
-                            frameIndex, lastPacketPayloadLength - frameHeaderSize, currentPos.length);
-                }
-
-                // Skip to the next frame and tell the host we lost this one
-                decodingFrame = false;
-                nextFrameNumber = frameIndex + 1;
-                dropFrameState();
-                if (waitingForIdrFrame) {
-                    LiRequestIdrFrame();
-                }
-                else {
-                    connectionDetectedFrameLoss(startFrameNumber, frameIndex);
-                }
-
-                return;
-            }
-        }
-
-        // Other codecs are just passed through as is.
-        queueFragment(existingEntry, currentPos.data, currentPos.offset, currentPos.length);
+    if (!codecOps->queuePayload(&currentPos, firstPacket, lastPacket, frameIndex, frameHeaderSize, existingEntry)) {
+        return;
     }
 
     if (lastPacket) {
@@ -12,7 +12,9 @@ static SOCKET firstFrameSocket = INVALID_SOCKET;
 
 static PPLT_CRYPTO_CONTEXT decryptionCtx;
 
-static PLT_THREAD udpPingThread;
+static PLT_TIMER udpPingTimer;
+static LC_SOCKADDR udpPingAddr;
+static int udpPingCount;
 static PLT_THREAD receiveThread;
 static PLT_THREAD decoderThread;
 
@@ -25,6 +27,8 @@ static bool receivedFullFrame;
 // the RTP queue will wait for missing/reordered packets.
 #define RTP_QUEUE_DELAY 10
 
+#define UDP_PING_INTERVAL_MS 500
+
 // This is the desired number of video packets that can be
 // stored in the socket's receive buffer. 2048 is chosen
 // because it should be large enough for all reasonable
@@ -51,46 +55,65 @@ void destroyVideoStream(void) {
     RtpvCleanupQueue(&rtpQueue);
 }
 
-// UDP Ping proc
-static void VideoPingThreadProc(void* context) {
+// UDP ping timer
+static void VideoPingTimerFunc(void* context) {
     char legacyPingData[] = { 0x50, 0x49, 0x4E, 0x47 };
-    LC_SOCKADDR saddr;
-
-    LC_ASSERT(VideoPortNumber != 0);
-
-    memcpy(&saddr, &RemoteAddr, sizeof(saddr));
-    SET_PORT(&saddr, VideoPortNumber);
 
     // We do not check for errors here. Socket errors will be handled
     // on the read-side in ReceiveThreadProc(). This avoids potential
     // issues related to receiving ICMP port unreachable messages due
     // to sending a packet prior to the host PC binding to that port.
-    int pingCount = 0;
-    while (!PltIsThreadInterrupted(&udpPingThread)) {
-        if (VideoPingPayload.payload[0] != 0) {
-            pingCount++;
-            VideoPingPayload.sequenceNumber = BE32(pingCount);
-
-            sendto(rtpSocket, (char*)&VideoPingPayload, sizeof(VideoPingPayload), 0, (struct sockaddr*)&saddr, AddrLen);
-        }
-        else {
-            sendto(rtpSocket, legacyPingData, sizeof(legacyPingData), 0, (struct sockaddr*)&saddr, AddrLen);
-        }
+    if (VideoPingPayload.payload[0] != 0) {
+        udpPingCount++;
+        VideoPingPayload.sequenceNumber = BE32(udpPingCount);
 
-        PltSleepMsInterruptible(&udpPingThread, 500);
+        sendUdpSocket(rtpSocket, (char*)&VideoPingPayload, sizeof(VideoPingPayload), (struct sockaddr*)&udpPingAddr, AddrLen);
+    }
+    else {
+        sendUdpSocket(rtpSocket, legacyPingData, sizeof(legacyPingData), (struct sockaddr*)&udpPingAddr, AddrLen);
     }
 }
 
+static void startUdpPing(void) {
+    LC_ASSERT(VideoPortNumber != 0);
+
+    memcpy(&udpPingAddr, &RemoteAddr, sizeof(udpPingAddr));
+    SET_PORT(&udpPingAddr, VideoPortNumber);
+    udpPingCount = 0;
+
+    PltInitializeTimer(&udpPingTimer, VideoPingTimerFunc, NULL);
+    PltScheduleTimer(&udpPingTimer, 0, UDP_PING_INTERVAL_MS);
+}
+
+static void stopUdpPing(void) {
+    PltCancelTimer(&udpPingTimer);
+    PltJoinTimer(&udpPingTimer);
+}
+
 // Receive thread proc
+// Hands a decrypted packet to the RTP queue. The buffer must have room for the
+// queue entry after decryptedSize bytes. Returns true if the queue now owns it.
+static bool queueVideoPacket(char* buffer, int length, int decryptedSize) {
+    PRTP_PACKET packet;
+
+    // Convert fields to host byte-order
+    packet = (PRTP_PACKET)&buffer[0];
+    packet->sequenceNumber = BE16(packet->sequenceNumber);
+    packet->timestamp = BE32(packet->timestamp);
+    packet->ssrc = BE32(packet->ssrc);
+
+    return RtpvAddPacket(&rtpQueue, packet, length, (PRTPV_QUEUE_ENTRY)&buffer[decryptedSize]) == RTPF_RET_QUEUED;
+}
+
 static void VideoReceiveThreadProc(void* context) {
     int err;
     int bufferSize, receiveSize, decryptedSize, minSize;
     char* buffer;
     char* encryptedBuffer;
-    int queueStatus;
     bool useSelect;
     int waitingForVideoMs;
     bool encrypted;
+    uint64_t arrivalUs;
 
     encrypted = !!(EncryptionFeaturesEnabled & SS_ENC_VIDEO);
     decryptedSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
@@ -123,8 +146,6 @@ static void VideoReceiveThreadProc(void* context) {
 
     waitingForVideoMs = 0;
     while (!PltIsThreadInterrupted(&receiveThread)) {
-        PRTP_PACKET packet;
-
         if (buffer == NULL) {
             buffer = (char*)malloc(bufferSize);
             if (buffer == NULL) {
@@ -159,6 +180,8 @@ static void VideoReceiveThreadProc(void* context) {
             continue;
         }
 
+        arrivalUs = PltGetMicroseconds();
+
         if (!receivedDataFromPeer) {
             receivedDataFromPeer = true;
             Limelog("Received first video packet after %d ms\n", waitingForVideoMs);
@@ -209,6 +232,7 @@ static void VideoReceiveThreadProc(void* context) {
             // traffic away (as mentioned in the paragraph above) and continue accepting
             // legitmate video traffic.
             if (encHeader->frameNumber && LE32(encHeader->frameNumber) < RtpvGetCurrentFrameNumber(&rtpQueue)) {
+                addBandwidthEstimatorSkippedPacket(err);
                 continue;
             }
 
@@ -223,15 +247,14 @@ static void VideoReceiveThreadProc(void* context) {
             }
         }
 
-        // Convert fields to host byte-order
-        packet = (PRTP_PACKET)&buffer[0];
-        packet->sequenceNumber = BE16(packet->sequenceNumber);
-        packet->timestamp = BE32(packet->timestamp);
-        packet->ssrc = BE32(packet->ssrc);
+        capturePacket(CAPTURE_STREAM_VIDEO, buffer, err);
 
-        queueStatus = RtpvAddPacket(&rtpQueue, packet, err, (PRTPV_QUEUE_ENTRY)&buffer[decryptedSize]);
+        // The RTP header is still in network byte order
+        addBandwidthEstimatorPacket(BE16(((PRTP_PACKET)buffer)->sequenceNumber),
+                                    BE32(((PRTP_PACKET)buffer)->timestamp),
+                                    err, arrivalUs);
 
-        if (queueStatus == RTPF_RET_QUEUED) {
+        if (queueVideoPacket(buffer, err, decryptedSize)) {
             // The queue owns the buffer
             buffer = NULL;
         }
@@ -287,7 +310,7 @@ void stopVideoStream(void) {
     // Wake up client code that may be waiting on the decode unit queue
     stopVideoDepacketizer();
     
-    PltInterruptThread(&udpPingThread);
+    stopUdpPing();
     PltInterruptThread(&receiveThread);
     if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
         PltInterruptThread(&decoderThread);
@@ -297,7 +320,6 @@ void stopVideoStream(void) {
         shutdownTcpSocket(firstFrameSocket);
     }
 
-    PltJoinThread(&udpPingThread);
     PltJoinThread(&receiveThread);
     if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
         PltJoinThread(&decoderThread);
@@ -337,10 +359,11 @@ int startVideoStream(void* rendererContext, int drFlags) {
         VideoCallbacks.cleanup();
         return LastSocketError();
     }
+    registerImpairedSocket(rtpSocket, IMPAIR_STREAM_VIDEO);
 
     VideoCallbacks.start();
 
-    err = PltCreateThread("VideoRecv", VideoReceiveThreadProc, NULL, &receiveThread);
+    err = PltCreateThread("VideoRecv", THREAD_CLASS_REALTIME_MEDIA, VideoReceiveThreadProc, NULL, &receiveThread);
     if (err != 0) {
         VideoCallbacks.stop();
         closeSocket(rtpSocket);
@@ -349,7 +372,7 @@ int startVideoStream(void* rendererContext, int drFlags) {
     }
 
     if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
-        err = PltCreateThread("VideoDec", VideoDecoderThreadProc, NULL, &decoderThread);
+        err = PltCreateThread("VideoDec", THREAD_CLASS_REALTIME_MEDIA, VideoDecoderThreadProc, NULL, &decoderThread);
         if (err != 0) {
             VideoCallbacks.stop();
             PltInterruptThread(&receiveThread);
@@ -383,26 +406,7 @@ int startVideoStream(void* rendererContext, int drFlags) {
 
     // Start pinging before reading the first frame so GFE knows where
     // to send UDP data
-    err = PltCreateThread("VideoPing", VideoPingThreadProc, NULL, &udpPingThread);
-    if (err != 0) {
-        VideoCallbacks.stop();
-        stopVideoDepacketizer();
-        PltInterruptThread(&receiveThread);
-        if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
-            PltInterruptThread(&decoderThread);
-        }
-        PltJoinThread(&receiveThread);
-        if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
-            PltJoinThread(&decoderThread);
-        }
-        closeSocket(rtpSocket);
-        if (firstFrameSocket != INVALID_SOCKET) {
-            closeSocket(firstFrameSocket);
-            firstFrameSocket = INVALID_SOCKET;
-        }
-        VideoCallbacks.cleanup();
-        return err;
-    }
+    startUdpPing();
 
     if (AppVersionQuad[0] == 3) {
         // Read the first frame to start the flow of video
@@ -415,3 +419,62 @@ int startVideoStream(void* rendererContext, int drFlags) {
 
     return 0;
 }
+
+// Start the video stream without sockets to replay a packet capture
+int startVideoReplay(void* rendererContext, int drFlags) {
+    int err;
+
+    LC_ASSERT(NegotiatedVideoFormat != 0);
+    err = VideoCallbacks.setup(NegotiatedVideoFormat, StreamConfig.width,
+        StreamConfig.height, StreamConfig.fps, rendererContext, drFlags);
+    if (err != 0) {
+        return err;
+    }
+
+    VideoCallbacks.start();
+
+    if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
+        err = PltCreateThread("VideoDec", THREAD_CLASS_REALTIME_MEDIA, VideoDecoderThreadProc, NULL, &decoderThread);
+        if (err != 0) {
+            VideoCallbacks.stop();
+            VideoCallbacks.cleanup();
+            return err;
+        }
+    }
+
+    return 0;
+}
+
+void stopVideoReplay(void) {
+    VideoCallbacks.stop();
+
+    // Wake up client code that may be waiting on the decode unit queue
+    stopVideoDepacketizer();
+
+    if ((VideoCallbacks.capabilities & (CAPABILITY_DIRECT_SUBMIT | CAPABILITY_PULL_RENDERER)) == 0) {
+        PltInterruptThread(&decoderThread);
+        PltJoinThread(&decoderThread);
+    }
+
+    VideoCallbacks.cleanup();
+}
+
+// Feeds a captured video packet to the depacketizer as the receive thread would
+void replayVideoPacket(const char* data, int length) {
+    int decryptedSize = StreamConfig.packetSize + MAX_RTP_HEADER_SIZE;
+    char* buffer;
+
+    if (length < (int)sizeof(RTP_PACKET) || length > decryptedSize) {
+        return;
+    }
+
+    buffer = (char*)malloc(decryptedSize + sizeof(RTPV_QUEUE_ENTRY));
+    if (buffer == NULL) {
+        return;
+    }
+
+    memcpy(buffer, data, length);
+    if (!queueVideoPacket(buffer, length, decryptedSize)) {
+        free(buffer);
+    }
+}
@@ -0,0 +1,458 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Audio RTP sender. Opus packets come from an Ogg Opus file or are TOC-only
+// packets that decode as silence. Every 4 data packets are followed by 2
+// Reed-Solomon parity packets, matching RtpAudioQueue.
+
+#include "hostsim.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <rs.h>
+
+#define RTP_HEADER_LENGTH 12
+#define FEC_HEADER_LENGTH 12
+
+#define RTP_PAYLOAD_TYPE_AUDIO 97
+#define RTP_PAYLOAD_TYPE_FEC 127
+
+#define AUDIO_DATA_SHARDS 4
+#define AUDIO_FEC_SHARDS 2
+
+#define MAX_OPUS_PACKET_SIZE 1400
+
+typedef struct _OPUS_PACKET {
+    int offset;
+    int length;
+} OPUS_PACKET, *POPUS_PACKET;
+
+static uint8_t* opusData;
+static int opusDataLength;
+static POPUS_PACKET opusPackets;
+static int opusPacketCount;
+
+// Packet duration in units of 100 us, so 2.5 ms CELT frames are exact
+static int opusPacketDuration;
+
+// ─── Ogg Opus reader ─────────────────────────────────────────────────────────
+
+static bool appendPacketData(const uint8_t* data, int length, int* capacity) {
+    if (opusDataLength + length > *capacity) {
+        *capacity = (*capacity + length) * 2;
+        uint8_t* newData = realloc(opusData, *capacity);
+        if (newData == NULL) {
+            return false;
+        }
+        opusData = newData;
+    }
+
+    memcpy(&opusData[opusDataLength], data, length);
+    opusDataLength += length;
+    return true;
+}
+
+static bool addPacket(int offset, int length) {
+    static int capacity;
+
+    if (opusPacketCount == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        POPUS_PACKET newPackets = realloc(opusPackets, capacity * sizeof(*opusPackets));
+        if (newPackets == NULL) {
+            return false;
+        }
+        opusPackets = newPackets;
+    }
+
+    opusPackets[opusPacketCount].offset = offset;
+    opusPackets[opusPacketCount].length = length;
+    opusPacketCount++;
+    return true;
+}
+
+// Returns the duration of an Opus packet in units of 100 us or -1 if invalid
+static int getOpusPacketDuration(const uint8_t* packet, int length) {
+    static const int silkDurations[] = { 100, 200, 400, 600 };
+    static const int hybridDurations[] = { 100, 200 };
+    static const int celtDurations[] = { 25, 50, 100, 200 };
+    int config = packet[0] >> 3;
+    int frameDuration, frames;
+
+    if (config < 12) {
+        frameDuration = silkDurations[config & 3];
+    }
+    else if (config < 16) {
+        frameDuration = hybridDurations[config & 1];
+    }
+    else {
+        frameDuration = celtDurations[config & 3];
+    }
+
+    switch (packet[0] & 3) {
+    case 0:
+        frames = 1;
+        break;
+    case 1:
+    case 2:
+        frames = 2;
+        break;
+    default:
+        if (length < 2) {
+            return -1;
+        }
+        frames = packet[1] & 0x3F;
+        break;
+    }
+
+    return frameDuration * frames;
+}
+
+static bool readOggOpus(const char* path) {
+    FILE* f = fopen(path, "rb");
+    uint8_t header[27];
+    uint8_t lacing[255];
+    uint8_t* page = NULL;
+    int pageCapacity = 0;
+    int dataCapacity = 0;
+    int packetStart = 0;
+    int headerPackets = 0;
+    bool ret = false;
+
+    if (f == NULL) {
+        hsLog("Unable to open %s\n", path);
+        return false;
+    }
+
+    while (fread(header, 1, sizeof(header), f) == sizeof(header)) {
+        int segments = header[26];
+        int pageLength = 0;
+        int pageOffset = 0;
+
+        if (memcmp(header, "OggS", 4) != 0) {
+            hsLog("%s is not an Ogg file\n", path);
+            goto cleanup;
+        }
+        if (fread(lacing, 1, segments, f) != (size_t)segments) {
+            break;
+        }
+        for (int i = 0; i < segments; i++) {
+            pageLength += lacing[i];
+        }
+
+        if (pageLength > pageCapacity) {
+            free(page);
+            pageCapacity = pageLength;
+            page = malloc(pageCapacity);
+            if (page == NULL) {
+                goto cleanup;
+            }
+        }
+        if (fread(page, 1, pageLength, f) != (size_t)pageLength) {
+            break;
+        }
+
+        // Packets are split into 255 byte segments and may continue onto
+        // the next page. A segment shorter than 255 bytes ends the packet.
+        for (int i = 0; i < segments; i++) {
+            if (!appendPacketData(&page[pageOffset], lacing[i], &dataCapacity)) {
+                goto cleanup;
+            }
+            pageOffset += lacing[i];
+
+            if (lacing[i] == 255) {
+                continue;
+            }
+
+            int packetLength = opusDataLength - packetStart;
+            const uint8_t* packet = &opusData[packetStart];
+
+            if (headerPackets == 0) {
+                if (packetLength < 19 || memcmp(packet, "OpusHead", 8) != 0) {
+                    hsLog("%s is not an Ogg Opus file\n", path);
+                    goto cleanup;
+                }
+                if (packet[9] != 2) {
+                    hsLog("%s has %d channels, but only stereo is supported\n", path, packet[9]);
+                    goto cleanup;
+                }
+                headerPackets++;
+                opusDataLength = packetStart;
+            }
+            else if (headerPackets == 1) {
+                // OpusTags
+                headerPackets++;
+                opusDataLength = packetStart;
+            }
+            else if (packetLength > 0) {
+                int duration = getOpusPacketDuration(packet, packetLength);
+
+                if (packetLength > MAX_OPUS_PACKET_SIZE) {
+                    hsLog("%s has an oversized %d byte packet\n", path, packetLength);
+                    goto cleanup;
+                }
+
+                // The client requires equally sized packets within each FEC
+                // block, like the CBR audio real hosts send
+                if (opusPacketCount > 0 && packetLength != opusPackets[0].length) {
+                    hsLog("%s isn't constant bitrate (encode it with opusenc --hard-cbr)\n", path);
+                    goto cleanup;
+                }
+                if (opusPacketDuration == 0) {
+                    opusPacketDuration = duration;
+                }
+                else if (duration != opusPacketDuration) {
+                    hsLog("%s has variable packet durations, which can't be streamed\n", path);
+                    goto cleanup;
+                }
+                if (!addPacket(packetStart, packetLength)) {
+                    goto cleanup;
+                }
+            }
+
+            packetStart = opusDataLength;
+        }
+    }
+
+    if (opusPacketCount == 0) {
+        hsLog("%s doesn't contain any audio packets\n", path);
+        goto cleanup;
+    }
+
+    hsLog("Loaded %s: %d packets of %d.%d ms\n", path, opusPacketCount,
+          opusPacketDuration / 10, opusPacketDuration % 10);
+    ret = true;
+
+cleanup:
+    free(page);
+    fclose(f);
+    return ret;
+}
+
+bool audioOpenSource(const char* path) {
+    if (path == NULL) {
+        return true;
+    }
+
+    return readOggOpus(path);
+}
+
+// ─── RTP sender ──────────────────────────────────────────────────────────────
+
+typedef struct _AUDIO_STATE {
+    int sock;
+    uint32_t generation;
+    bool useFile;
+    int nextPacket;
+    uint16_t sequenceNumber;
+    uint32_t timestamp;
+    reed_solomon* rs;
+
+    // Payloads of the current FEC block, which are all the same length
+    uint8_t shardData[AUDIO_DATA_SHARDS + AUDIO_FEC_SHARDS][MAX_OPUS_PACKET_SIZE];
+    int shardLength;
+} AUDIO_STATE, *PAUDIO_STATE;
+
+static void writeRtpHeader(uint8_t* packet, uint8_t packetType, uint16_t sequenceNumber, uint32_t timestamp) {
+    packet[0] = 0x80;
+    packet[1] = packetType;
+    packet[2] = (uint8_t)(sequenceNumber >> 8);
+    packet[3] = (uint8_t)sequenceNumber;
+    packet[4] = (uint8_t)(timestamp >> 24);
+    packet[5] = (uint8_t)(timestamp >> 16);
+    packet[6] = (uint8_t)(timestamp >> 8);
+    packet[7] = (uint8_t)timestamp;
+    memset(&packet[8], 0, 4); // SSRC
+}
+
+static void sendFecPackets(PAUDIO_STATE state, const struct sockaddr_in* addr, int durationMs) {
+    uint16_t baseSequenceNumber = (uint16_t)(state->sequenceNumber - AUDIO_DATA_SHARDS);
+    uint32_t baseTimestamp = state->timestamp - AUDIO_DATA_SHARDS * durationMs;
+    int blockSize = state->shardLength;
+    uint8_t* shards[AUDIO_DATA_SHARDS + AUDIO_FEC_SHARDS];
+
+    for (int i = 0; i < AUDIO_DATA_SHARDS + AUDIO_FEC_SHARDS; i++) {
+        shards[i] = state->shardData[i];
+    }
+    reed_solomon_encode(state->rs, shards, AUDIO_DATA_SHARDS + AUDIO_FEC_SHARDS, blockSize);
+
+    for (int i = 0; i < AUDIO_FEC_SHARDS; i++) {
+        uint8_t packet[RTP_HEADER_LENGTH + FEC_HEADER_LENGTH + MAX_OPUS_PACKET_SIZE];
+        uint8_t* fecHeader = &packet[RTP_HEADER_LENGTH];
+
+        writeRtpHeader(packet, RTP_PAYLOAD_TYPE_FEC, (uint16_t)(baseSequenceNumber + AUDIO_DATA_SHARDS + i), 0);
+        fecHeader[0] = (uint8_t)i;
+        fecHeader[1] = RTP_PAYLOAD_TYPE_AUDIO;
+        fecHeader[2] = (uint8_t)(baseSequenceNumber >> 8);
+        fecHeader[3] = (uint8_t)baseSequenceNumber;
+        fecHeader[4] = (uint8_t)(baseTimestamp >> 24);
+        fecHeader[5] = (uint8_t)(baseTimestamp >> 16);
+        fecHeader[6] = (uint8_t)(baseTimestamp >> 8);
+        fecHeader[7] = (uint8_t)baseTimestamp;
+        memset(&fecHeader[8], 0, 4); // SSRC
+        memcpy(&fecHeader[FEC_HEADER_LENGTH], shards[AUDIO_DATA_SHARDS + i], blockSize);
+
+        sendto(state->sock, packet, RTP_HEADER_LENGTH + FEC_HEADER_LENGTH + blockSize, 0,
+               (const struct sockaddr*)addr, sizeof(*addr));
+    }
+}
+
+static void sendAudioPacket(PAUDIO_STATE state, const struct sockaddr_in* addr, int durationMs) {
+    uint8_t packet[RTP_HEADER_LENGTH + MAX_OPUS_PACKET_SIZE];
+    int shardIndex = state->sequenceNumber % AUDIO_DATA_SHARDS;
+    const uint8_t* payload;
+    int payloadLength;
+    uint8_t silence;
+
+    if (state->useFile) {
+        payload = &opusData[opusPackets[state->nextPacket].offset];
+        payloadLength = opusPackets[state->nextPacket].length;
+        state->nextPacket = (state->nextPacket + 1) % opusPacketCount;
+    }
+    else {
+        // A TOC byte for a stereo CELT fullband frame with no frame data,
+        // which the decoder treats as silence
+        silence = durationMs == 10 ? 0xF4 : 0xEC;
+        payload = &silence;
+        payloadLength = 1;
+    }
+
+    writeRtpHeader(packet, RTP_PAYLOAD_TYPE_AUDIO, state->sequenceNumber, state->timestamp);
+    memcpy(&packet[RTP_HEADER_LENGTH], payload, payloadLength);
+    if (sendto(state->sock, packet, RTP_HEADER_LENGTH + payloadLength, 0,
+               (const struct sockaddr*)addr, sizeof(*addr)) < 0 &&
+            errno != EAGAIN && errno != ENOBUFS) {
+        hsLog("Audio: sendto() failed: %s\n", strerror(errno));
+    }
+
+    memcpy(state->shardData[shardIndex], payload, payloadLength);
+    state->shardLength = payloadLength;
+
+    state->sequenceNumber++;
+    state->timestamp += durationMs;
+
+    if (shardIndex == AUDIO_DATA_SHARDS - 1) {
+        sendFecPackets(state, addr, durationMs);
+    }
+}
+
+static void receivePings(PAUDIO_STATE state, int timeoutMs) {
+    struct pollfd pfd = { .fd = state->sock, .events = POLLIN };
+    uint8_t buffer[64];
+
+    while (poll(&pfd, 1, timeoutMs) > 0) {
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+
+        if (recvfrom(state->sock, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength) < 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&SessionLock);
+        if (Session.launched && !Session.hasAudioAddr) {
+            Session.audioAddr = from;
+            Session.hasAudioAddr = true;
+        }
+        pthread_mutex_unlock(&SessionLock);
+
+        timeoutMs = 0;
+    }
+}
+
+static void* audioStreamThread(void* context) {
+    PAUDIO_STATE state = context;
+    uint64_t nextPacketUs = 0;
+
+    while (!Quitting) {
+        HS_SESSION session;
+        uint64_t nowUs = hsGetMicros();
+        int waitMs = nextPacketUs > nowUs ? (int)((nextPacketUs - nowUs + 999) / 1000) : 0;
+
+        receivePings(state, waitMs);
+
+        pthread_mutex_lock(&SessionLock);
+        session = Session;
+        pthread_mutex_unlock(&SessionLock);
+
+        if (!session.playing || !session.hasAudioAddr) {
+            nextPacketUs = hsGetMicros() + 10000;
+            continue;
+        }
+
+        if (session.generation != state->generation) {
+            state->generation = session.generation;
+            state->sequenceNumber = 0;
+            state->timestamp = 0;
+            state->nextPacket = 0;
+
+            // Fall back to silence if the file doesn't match what the client asked for
+            state->useFile = opusPacketCount > 0 && opusPacketDuration == session.audioPacketDurationMs * 10;
+            if (opusPacketCount > 0 && !state->useFile) {
+                hsLog("Audio: client requested %d ms packets, sending silence\n", session.audioPacketDurationMs);
+            }
+            nextPacketUs = hsGetMicros();
+        }
+
+        if (hsGetMicros() < nextPacketUs) {
+            continue;
+        }
+
+        sendAudioPacket(state, &session.audioAddr, session.audioPacketDurationMs);
+
+        nextPacketUs += session.audioPacketDurationMs * 1000;
+        if (nextPacketUs + 100000 < hsGetMicros()) {
+            nextPacketUs = hsGetMicros();
+        }
+    }
+
+    close(state->sock);
+    reed_solomon_release(state->rs);
+    free(state);
+    return NULL;
+}
+
+bool startAudioStream(void) {
+    PAUDIO_STATE state = calloc(1, sizeof(*state));
+    static const uint8_t parity[] = { 0x77, 0x40, 0x38, 0x0e, 0xc7, 0xa7, 0x0d, 0x6c };
+
+    if (state == NULL) {
+        return false;
+    }
+
+    // Same parity matrix override as RtpAudioQueue, which matches the host's
+    state->rs = reed_solomon_new(AUDIO_DATA_SHARDS, AUDIO_FEC_SHARDS);
+    if (state->rs == NULL) {
+        free(state);
+        return false;
+    }
+    memcpy(&state->rs->m[16], parity, sizeof(parity));
+    memcpy(state->rs->parity, parity, sizeof(parity));
+
+    state->sock = hsCreateSocket(SOCK_DGRAM, HS_AUDIO_PORT);
+    if (state->sock < 0) {
+        reed_solomon_release(state->rs);
+        free(state);
+        return false;
+    }
+
+    return hsStartThread(audioStreamThread, state);
+}
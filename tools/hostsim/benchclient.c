@@ -0,0 +1,907 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Headless client for the host simulator. It drives moonlight-common-c
+// natively with null renderers and reports what arrives at the decoder
+// boundary, so protocol and queueing changes can be measured without a TV.
+
+#include <Limelight.h>
+
+#include <getopt.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <openssl/rand.h>
+
+#define HTTP_PORT 47989
+#define LATENCY_BUCKETS 1000
+
+// Referenced by the SDP generator; 0 keeps the library's default
+int g_AudioPacketDurationOverride;
+
+typedef struct _BENCH_STATS {
+    uint64_t startMs;
+    uint32_t frames;
+    uint32_t idrFrames;
+    uint32_t droppedFrames;
+    uint64_t videoBytes;
+    int lastFrameNumber;
+
+    // Host send time to the complete frame leaving the depacketizer, in ms
+    uint32_t latencyHistogram[LATENCY_BUCKETS + 1];
+    uint64_t latencySum;
+    uint32_t latencyMax;
+
+    // Host send time to the first packet of the frame being read by the receive
+    // thread, in ms. On loopback this is the receive thread's scheduling latency.
+    uint32_t recvLatencyHistogram[LATENCY_BUCKETS + 1];
+    uint64_t recvLatencySum;
+    uint32_t recvLatencyMax;
+
+    // Time spent waiting in the decode unit queue and reassembly
+    uint64_t queueDelaySum;
+
+    uint32_t audioPackets;
+    uint32_t audioLost;
+} BENCH_STATS, *PBENCH_STATS;
+
+static BENCH_STATS stats;
+static pthread_mutex_t statsLock = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool terminated;
+static volatile int terminationError;
+static bool verbose;
+static FILE* traceFile;
+static FILE* flightRecorderFile;
+static uint32_t impairmentCounts[IMPAIR_EVENT_BURST_END + 1];
+static volatile bool contentionStopping;
+
+static uint64_t getMillis(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000) + (ts.tv_nsec / 1000000);
+}
+
+static int submitDecodeUnit(PDECODE_UNIT decodeUnit) {
+    uint64_t now = getMillis();
+
+    // The host stamps RTP timestamps from the same monotonic clock in 90 KHz
+    // units and the client divides them back down. Compare in the truncated
+    // 32-bit domain so wraparound doesn't matter.
+    uint32_t latency = ((uint32_t)(now * 90) - decodeUnit->presentationTimeMs * 90U) / 90;
+    uint32_t recvLatency = ((uint32_t)(decodeUnit->receiveTimeMs * 90) - decodeUnit->presentationTimeMs * 90U) / 90;
+
+    pthread_mutex_lock(&statsLock);
+    if (stats.lastFrameNumber != 0 && decodeUnit->frameNumber > stats.lastFrameNumber + 1) {
+        stats.droppedFrames += decodeUnit->frameNumber - stats.lastFrameNumber - 1;
+    }
+    stats.lastFrameNumber = decodeUnit->frameNumber;
+    stats.frames++;
+    stats.videoBytes += decodeUnit->fullLength;
+    if (decodeUnit->frameType == FRAME_TYPE_IDR) {
+        stats.idrFrames++;
+    }
+    stats.latencyHistogram[latency < LATENCY_BUCKETS ? latency : LATENCY_BUCKETS]++;
+    stats.latencySum += latency;
+    if (latency > stats.latencyMax) {
+        stats.latencyMax = latency;
+    }
+    stats.recvLatencyHistogram[recvLatency < LATENCY_BUCKETS ? recvLatency : LATENCY_BUCKETS]++;
+    stats.recvLatencySum += recvLatency;
+    if (recvLatency > stats.recvLatencyMax) {
+        stats.recvLatencyMax = recvLatency;
+    }
+    stats.queueDelaySum += now - decodeUnit->receiveTimeMs;
+    pthread_mutex_unlock(&statsLock);
+
+    return DR_OK;
+}
+
+static void decodeAndPlaySample(char* sampleData, int sampleLength) {
+    (void)sampleData;
+
+    pthread_mutex_lock(&statsLock);
+    stats.audioPackets++;
+    if (sampleLength == 0) {
+        // Called with no data for packet loss concealment
+        stats.audioLost++;
+    }
+    pthread_mutex_unlock(&statsLock);
+}
+
+static void connectionTerminated(int errorCode) {
+    terminationError = errorCode;
+    terminated = true;
+}
+
+static void logMessage(const char* format, ...) {
+    va_list va;
+
+    if (!verbose) {
+        return;
+    }
+
+    va_start(va, format);
+    vfprintf(stderr, format, va);
+    va_end(va);
+}
+
+static void saveFlightRecorderDump(const char* reason, const char* data, int length) {
+    fprintf(stderr, "Flight recorder dump: %s\n", reason);
+    fwrite(data, 1, length, flightRecorderFile);
+    fflush(flightRecorderFile);
+}
+
+static void traceImpairment(const NETWORK_IMPAIRMENT_EVENT* event) {
+    static const char* streamNames[] = { "video", "audio", "control" };
+    static const char* eventNames[] = { "drop", "duplicate", "reorder", "burst-start", "burst-end" };
+
+    // Called with the library's impairment lock held, which serializes the events
+    impairmentCounts[event->type]++;
+    if (traceFile != NULL) {
+        fprintf(traceFile, "%llu,%s,%s,%s,%u,%d\n",
+                (unsigned long long)event->timeMs, streamNames[event->stream],
+                event->direction == IMPAIR_DIR_RECV ? "recv" : "send",
+                eventNames[event->type], event->packetIndex, event->length);
+    }
+}
+
+// Parses <stream>[:recv|:send]:<key>=<value>,... into an impairment profile
+static bool parseImpairment(char* spec) {
+    NETWORK_IMPAIRMENT impairment;
+    int stream, directions;
+    char* params;
+    char* param;
+
+    params = strrchr(spec, ':');
+    if (params == NULL) {
+        return false;
+    }
+    *params++ = 0;
+
+    directions = IMPAIR_DIR_RECV | IMPAIR_DIR_SEND;
+    char* direction = strchr(spec, ':');
+    if (direction != NULL) {
+        *direction++ = 0;
+        if (!strcmp(direction, "recv")) {
+            directions = IMPAIR_DIR_RECV;
+        }
+        else if (!strcmp(direction, "send")) {
+            directions = IMPAIR_DIR_SEND;
+        }
+        else {
+            return false;
+        }
+    }
+
+    if (!strcmp(spec, "video")) {
+        stream = IMPAIR_STREAM_VIDEO;
+    }
+    else if (!strcmp(spec, "audio")) {
+        stream = IMPAIR_STREAM_AUDIO;
+    }
+    else if (!strcmp(spec, "control")) {
+        stream = IMPAIR_STREAM_CONTROL;
+    }
+    else {
+        return false;
+    }
+
+    memset(&impairment, 0, sizeof(impairment));
+    for (param = strtok(params, ","); param != NULL; param = strtok(NULL, ",")) {
+        char* value = strchr(param, '=');
+        if (value == NULL) {
+            return false;
+        }
+        *value++ = 0;
+
+        if (!strcmp(param, "loss")) {
+            impairment.goodLossPercent = strtof(value, NULL);
+        }
+        else if (!strcmp(param, "burst")) {
+            if (sscanf(value, "%f/%f/%f", &impairment.goodToBadPercent,
+                       &impairment.badToGoodPercent, &impairment.badLossPercent) != 3) {
+                return false;
+            }
+        }
+        else if (!strcmp(param, "delay")) {
+            impairment.delayMs = atoi(value);
+        }
+        else if (!strcmp(param, "jitter")) {
+            impairment.jitterMs = atoi(value);
+            if (value[strlen(value) - 1] == 'n') {
+                impairment.jitterDistribution = IMPAIR_JITTER_NORMAL;
+            }
+        }
+        else if (!strcmp(param, "reorder")) {
+            if (sscanf(value, "%f/%d", &impairment.reorderPercent, &impairment.reorderDelayMs) != 2) {
+                return false;
+            }
+        }
+        else if (!strcmp(param, "dup")) {
+            impairment.duplicatePercent = strtof(value, NULL);
+        }
+        else {
+            return false;
+        }
+    }
+
+    if (LiSetNetworkImpairment(stream, directions, &impairment) != 0) {
+        fprintf(stderr, "moonlight-common-c was built without NET_IMPAIRMENT\n");
+        exit(1);
+    }
+
+    return true;
+}
+
+// Parses <class>=<mask> for --affinity
+static bool parseAffinity(const char* spec) {
+    static const char* classNames[THREAD_CLASS_COUNT] = { "background", "interactive", "media" };
+    const char* mask = strchr(spec, '=');
+
+    if (mask == NULL) {
+        return false;
+    }
+
+    for (int i = 0; i < THREAD_CLASS_COUNT; i++) {
+        if (strlen(classNames[i]) == (size_t)(mask - spec) && !strncmp(spec, classNames[i], mask - spec)) {
+            LiSetThreadClassAffinity(i, strtoull(mask + 1, NULL, 0));
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static uint32_t getLatencyPercentile(PBENCH_STATS s, const uint32_t* histogram, double percentile) {
+    uint32_t target = (uint32_t)(s->frames * percentile);
+    uint32_t count = 0;
+
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+        count += histogram[i];
+        if (count > target) {
+            return i;
+        }
+    }
+    return LATENCY_BUCKETS;
+}
+
+static void printStats(const char* label, PBENCH_STATS s) {
+    double elapsedSec = (getMillis() - s->startMs) / 1000.0;
+
+    if (s->frames == 0 || elapsedSec <= 0) {
+        printf("%s: no frames received\n", label);
+        return;
+    }
+
+    printf("%s: %.1f FPS, %.2f Mbps, %u IDR, %u dropped, "
+           "latency avg %.1f / p50 %u / p99 %u / max %u ms, "
+           "recv avg %.1f / p99 %u / max %u ms, queue %.1f ms, "
+           "audio %u packets (%u concealed)\n",
+           label,
+           s->frames / elapsedSec,
+           s->videoBytes * 8 / elapsedSec / 1000000.0,
+           s->idrFrames, s->droppedFrames,
+           (double)s->latencySum / s->frames,
+           getLatencyPercentile(s, s->latencyHistogram, 0.5),
+           getLatencyPercentile(s, s->latencyHistogram, 0.99), s->latencyMax,
+           (double)s->recvLatencySum / s->frames,
+           getLatencyPercentile(s, s->recvLatencyHistogram, 0.99), s->recvLatencyMax,
+           (double)s->queueDelaySum / s->frames,
+           s->audioPackets, s->audioLost);
+    fflush(stdout);
+}
+
+// Returns the stats for the interval that just ended and starts a new one
+static void takeIntervalStats(PBENCH_STATS s) {
+    pthread_mutex_lock(&statsLock);
+    *s = stats;
+    memset(&stats, 0, sizeof(stats));
+    stats.startMs = getMillis();
+    stats.lastFrameNumber = s->lastFrameNumber;
+    pthread_mutex_unlock(&statsLock);
+}
+
+static void addStats(PBENCH_STATS totals, const BENCH_STATS* s) {
+    totals->frames += s->frames;
+    totals->idrFrames += s->idrFrames;
+    totals->droppedFrames += s->droppedFrames;
+    totals->videoBytes += s->videoBytes;
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+        totals->latencyHistogram[i] += s->latencyHistogram[i];
+    }
+    totals->latencySum += s->latencySum;
+    if (s->latencyMax > totals->latencyMax) {
+        totals->latencyMax = s->latencyMax;
+    }
+    for (int i = 0; i <= LATENCY_BUCKETS; i++) {
+        totals->recvLatencyHistogram[i] += s->recvLatencyHistogram[i];
+    }
+    totals->recvLatencySum += s->recvLatencySum;
+    if (s->recvLatencyMax > totals->recvLatencyMax) {
+        totals->recvLatencyMax = s->recvLatencyMax;
+    }
+    totals->queueDelaySum += s->queueDelaySum;
+    totals->audioPackets += s->audioPackets;
+    totals->audioLost += s->audioLost;
+}
+
+static void printThreadStats(void) {
+    THREAD_STATS threads[32];
+    int count;
+
+    count = LiGetThreadStats(threads, 32);
+    for (int i = 0; i < count; i++) {
+        printf("  %-12s %5.1f%% CPU%s, %6.0f wakeups/s, %llu voluntary / %llu involuntary switches\n",
+               threads[i].name, threads[i].cpuPercent, threads[i].cpuTimeEstimated ? " (est)" : "",
+               threads[i].wakeupsPerSecond,
+               (unsigned long long)threads[i].voluntaryContextSwitches,
+               (unsigned long long)threads[i].involuntaryContextSwitches);
+    }
+    fflush(stdout);
+}
+
+static void printBandwidthEstimate(void) {
+    static const char* states[] = { "normal", "overuse", "underuse" };
+    BANDWIDTH_ESTIMATE estimate;
+
+    if (!LiGetBandwidthEstimate(&estimate)) {
+        return;
+    }
+
+    printf("  bandwidth: %.2f Mbps available (%.2f capacity, %.2f received), "
+           "queue %.1f ms (%+.1f ms/s, %s), loss %.2f%% (%llu lost in %u bursts, max %u)\n",
+           estimate.availableKbps / 1000.0, estimate.capacityKbps / 1000.0, estimate.receivedKbps / 1000.0,
+           estimate.queueingDelayMs, estimate.delayGradientMsPerSecond, states[estimate.congestionState],
+           estimate.lossPercent, (unsigned long long)estimate.lostPackets,
+           estimate.lossBursts, estimate.maxLossBurstPackets);
+    fflush(stdout);
+}
+
+static void printLockStats(void) {
+    LOCK_STATS locks[32];
+    int count;
+
+    count = LiGetLockStats(locks, 32);
+    printf("%-20s %5s %10s %7s %10s %8s %8s %10s %8s %8s\n",
+           "lock", "count", "acquired", "contend", "wait ms", "wait p99", "wait max",
+           "hold ms", "hold p99", "hold max");
+    for (int i = 0; i < count; i++) {
+        printf("%-20s %5u %10llu %6.2f%% %10.1f %8u %8llu %10.1f %8u %8llu\n",
+               locks[i].name, locks[i].instances,
+               (unsigned long long)locks[i].acquisitions,
+               (double)locks[i].contendedAcquisitions * 100 / locks[i].acquisitions,
+               locks[i].totalWaitUs / 1000.0, locks[i].p99WaitUs,
+               (unsigned long long)locks[i].maxWaitUs,
+               locks[i].totalHoldUs / 1000.0, locks[i].p99HoldUs,
+               (unsigned long long)locks[i].maxHoldUs);
+    }
+    fflush(stdout);
+}
+
+static void printAllocationStats(void) {
+    ALLOCATION_STATS subsystems[48];
+    float totalRate = 0;
+    int count;
+
+    count = LiGetAllocationStats(subsystems, 48);
+    printf("%-20s %10s %12s %10s %10s %12s\n",
+           "allocator", "allocs", "bytes", "frees", "allocs/s", "bytes/s");
+    for (int i = 0; i < count; i++) {
+        printf("%-20s %10llu %12llu %10llu %10.1f %12.0f\n",
+               subsystems[i].name,
+               (unsigned long long)subsystems[i].allocations,
+               (unsigned long long)subsystems[i].bytes,
+               (unsigned long long)subsystems[i].frees,
+               subsystems[i].allocationsPerSecond, subsystems[i].bytesPerSecond);
+        totalRate += subsystems[i].allocationsPerSecond;
+    }
+    printf("steady-state allocation rate: %.1f/s\n", totalRate);
+    fflush(stdout);
+}
+
+// Busy threads at normal priority that compete with the client for the CPUs
+static void* contentionThreadProc(void* context) {
+    volatile uint64_t counter = 0;
+
+    (void)context;
+    while (!contentionStopping) {
+        counter++;
+    }
+    return NULL;
+}
+
+// Performs a plain HTTP GET against the host and returns the response body,
+// which the caller must free
+static char* httpGet(const char* host, const char* path) {
+    struct addrinfo hints, *res;
+    char port[8];
+    char request[512];
+    char* response = NULL;
+    int length = 0;
+    int capacity = 0;
+    int sock;
+
+    memset(&hints, 0, sizeof(hints));
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    snprintf(port, sizeof(port), "%d", HTTP_PORT);
+    if (getaddrinfo(host, port, &hints, &res) != 0) {
+        fprintf(stderr, "Unable to resolve %s\n", host);
+        return NULL;
+    }
+
+    sock = socket(res->ai_family, res->ai_socktype, res->ai_protocol);
+    if (sock < 0 || connect(sock, res->ai_addr, res->ai_addrlen) < 0) {
+        fprintf(stderr, "Unable to connect to %s:%d\n", host, HTTP_PORT);
+        if (sock >= 0) {
+            close(sock);
+        }
+        freeaddrinfo(res);
+        return NULL;
+    }
+    freeaddrinfo(res);
+
+    snprintf(request, sizeof(request),
+             "GET %s HTTP/1.1\r\nHost: %s\r\nConnection: close\r\n\r\n", path, host);
+    send(sock, request, strlen(request), 0);
+
+    for (;;) {
+        if (capacity - length < 4096) {
+            capacity += 16384;
+            char* newResponse = realloc(response, capacity);
+            if (newResponse == NULL) {
+                break;
+            }
+            response = newResponse;
+        }
+
+        int ret = (int)recv(sock, &response[length], capacity - length - 1, 0);
+        if (ret <= 0) {
+            break;
+        }
+        length += ret;
+    }
+    close(sock);
+
+    if (response == NULL) {
+        return NULL;
+    }
+    response[length] = 0;
+
+    char* body = strstr(response, "\r\n\r\n");
+    if (body == NULL) {
+        free(response);
+        return NULL;
+    }
+    memmove(response, body + 4, strlen(body + 4) + 1);
+    return response;
+}
+
+static bool getXmlValue(const char* xml, const char* tag, char* value, size_t valueSize) {
+    char openTag[64];
+    const char* start;
+    const char* end;
+
+    snprintf(openTag, sizeof(openTag), "<%s>", tag);
+    start = strstr(xml, openTag);
+    if (start == NULL) {
+        return false;
+    }
+    start += strlen(openTag);
+
+    end = strchr(start, '<');
+    if (end == NULL || (size_t)(end - start) >= valueSize) {
+        return false;
+    }
+
+    memcpy(value, start, end - start);
+    value[end - start] = 0;
+    return true;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options] [host]\n"
+            "\n"
+            "  --width <px>         Stream width (default: 1920)\n"
+            "  --height <px>        Stream height (default: 1080)\n"
+            "  --fps <n>            Frame rate (default: 60)\n"
+            "  --bitrate <kbps>     Bitrate (default: 20000)\n"
+            "  --packet-size <n>    Video packet size (default: 1392)\n"
+            "  --codec <c>          h264, hevc or av1 (default: h264)\n"
+            "  --audio-ms <n>       Audio packet duration, 5 or 10 (default: library choice)\n"
+            "  --duration <sec>     Benchmark length (default: 30)\n"
+            "  --interval <sec>     Reporting interval (default: 5)\n"
+            "  --impair <spec>      Impair a stream, may be repeated. The spec is\n"
+            "                       <video|audio|control>[:recv|:send]:<params> with\n"
+            "                       comma separated parameters:\n"
+            "                         loss=<%%>            random loss\n"
+            "                         burst=<p%%>/<r%%>/<%%> Gilbert-Elliott transition to\n"
+            "                                             and from bursts, and burst loss\n"
+            "                         delay=<ms>          fixed delay\n"
+            "                         jitter=<ms>[n]      uniform (or normal) jitter\n"
+            "                         reorder=<%%>/<ms>    hold packets back\n"
+            "                         dup=<%%>             duplication\n"
+            "  --seed <n>           Impairment seed (default: 0)\n"
+            "  --trace <file>       Write injected impairments as CSV\n"
+            "  --capture <file>     Record the received packets\n"
+            "  --record <file>      Record the stream as fragmented MP4\n"
+            "  --flight-recorder <file>\n"
+            "                       Append flight recorder dumps to a file\n"
+            "  --replay <file>      Replay a packet capture instead of connecting\n"
+            "  --speed <%%>          Replay speed, 0 for unpaced (default: 100)\n"
+            "  --contention <n>     Run n busy threads alongside the client\n"
+            "  --no-thread-priorities\n"
+            "                       Create the library's threads at default priority\n"
+            "  --affinity <class>=<mask>\n"
+            "                       Pin a thread class (media, interactive or\n"
+            "                       background) to a CPU mask, may be repeated\n"
+            "  --thread-stats       Print CPU use and wakeups of each thread per interval\n"
+            "  --bandwidth-stats    Print the bandwidth and congestion estimate per interval\n"
+            "  --lock-profile       Print lock wait and hold times (in us) at the end\n"
+            "  --alloc-stats        Print heap allocations per source file at the end\n"
+            "  --verbose            Print moonlight-common-c log messages\n",
+            name);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option longOptions[] = {
+        { "width", required_argument, NULL, 'w' },
+        { "height", required_argument, NULL, 'H' },
+        { "fps", required_argument, NULL, 'f' },
+        { "bitrate", required_argument, NULL, 'b' },
+        { "packet-size", required_argument, NULL, 'p' },
+        { "codec", required_argument, NULL, 'c' },
+        { "audio-ms", required_argument, NULL, 'a' },
+        { "duration", required_argument, NULL, 'd' },
+        { "interval", required_argument, NULL, 'i' },
+        { "impair", required_argument, NULL, 'I' },
+        { "seed", required_argument, NULL, 's' },
+        { "trace", required_argument, NULL, 't' },
+        { "capture", required_argument, NULL, 'C' },
+        { "record", required_argument, NULL, 'r' },
+        { "flight-recorder", required_argument, NULL, 'F' },
+        { "replay", required_argument, NULL, 'R' },
+        { "speed", required_argument, NULL, 'S' },
+        { "contention", required_argument, NULL, 'x' },
+        { "no-thread-priorities", no_argument, NULL, 'P' },
+        { "affinity", required_argument, NULL, 'A' },
+        { "thread-stats", no_argument, NULL, 'T' },
+        { "bandwidth-stats", no_argument, NULL, 'B' },
+        { "lock-profile", no_argument, NULL, 'L' },
+        { "alloc-stats", no_argument, NULL, 'M' },
+        { "verbose", no_argument, NULL, 'v' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    STREAM_CONFIGURATION streamConfig;
+    SERVER_INFORMATION serverInfo;
+    CONNECTION_LISTENER_CALLBACKS clCallbacks;
+    DECODER_RENDERER_CALLBACKS drCallbacks;
+    AUDIO_RENDERER_CALLBACKS arCallbacks;
+    const char* host = "127.0.0.1";
+    const char* replayPath = NULL;
+    int replaySpeed = 100;
+    int contentionThreads = 0;
+    bool threadStats = false;
+    bool bandwidthStats = false;
+    bool lockProfile = false;
+    bool allocationStats = false;
+    pthread_t* contention = NULL;
+    int duration = 30;
+    int interval = 5;
+    char appVersion[32], gfeVersion[32], codecSupport[16], sessionUrl[128];
+    char path[256];
+    char riKeyHex[33];
+    uint32_t riKeyId;
+    char* response;
+    int opt;
+
+    LiInitializeStreamConfiguration(&streamConfig);
+    streamConfig.width = 1920;
+    streamConfig.height = 1080;
+    streamConfig.fps = 60;
+    streamConfig.bitrate = 20000;
+    streamConfig.packetSize = 1392;
+    streamConfig.streamingRemotely = STREAM_CFG_LOCAL;
+    streamConfig.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
+    streamConfig.supportedVideoFormats = VIDEO_FORMAT_H264;
+    streamConfig.encryptionFlags = ENCFLG_NONE;
+
+    while ((opt = getopt_long(argc, argv, "h", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'w':
+            streamConfig.width = atoi(optarg);
+            break;
+        case 'H':
+            streamConfig.height = atoi(optarg);
+            break;
+        case 'f':
+            streamConfig.fps = atoi(optarg);
+            break;
+        case 'b':
+            streamConfig.bitrate = atoi(optarg);
+            break;
+        case 'p':
+            streamConfig.packetSize = atoi(optarg);
+            break;
+        case 'c':
+            if (!strcmp(optarg, "h264")) {
+                streamConfig.supportedVideoFormats = VIDEO_FORMAT_H264;
+            }
+            else if (!strcmp(optarg, "hevc") || !strcmp(optarg, "h265")) {
+                streamConfig.supportedVideoFormats = VIDEO_FORMAT_H265;
+            }
+            else if (!strcmp(optarg, "av1")) {
+                streamConfig.supportedVideoFormats = VIDEO_FORMAT_AV1_MAIN8;
+            }
+            else {
+                fprintf(stderr, "Unknown codec: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'a':
+            g_AudioPacketDurationOverride = atoi(optarg);
+            break;
+        case 'd':
+            duration = atoi(optarg);
+            break;
+        case 'i':
+            interval = atoi(optarg);
+            break;
+        case 'I':
+            if (!parseImpairment(optarg)) {
+                fprintf(stderr, "Invalid impairment: %s\n", optarg);
+                return 1;
+            }
+            LiSetNetworkImpairmentTraceCallback(traceImpairment);
+            break;
+        case 's':
+            LiSetNetworkImpairmentSeed(strtoull(optarg, NULL, 0));
+            break;
+        case 't':
+            traceFile = fopen(optarg, "w");
+            if (traceFile == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            fprintf(traceFile, "time_ms,stream,direction,event,packet,length\n");
+            break;
+        case 'C':
+            LiSetPacketCaptureFile(optarg);
+            break;
+        case 'r':
+            LiSetSessionRecordingFile(optarg);
+            break;
+        case 'F':
+            flightRecorderFile = fopen(optarg, "a");
+            if (flightRecorderFile == NULL) {
+                perror(optarg);
+                return 1;
+            }
+            LiSetFlightRecorderDumpCallback(saveFlightRecorderDump);
+            break;
+        case 'R':
+            replayPath = optarg;
+            break;
+        case 'S':
+            replaySpeed = atoi(optarg);
+            break;
+        case 'x':
+            contentionThreads = atoi(optarg);
+            break;
+        case 'P':
+            LiSetThreadPrioritiesEnabled(false);
+            break;
+        case 'A':
+            if (!parseAffinity(optarg)) {
+                fprintf(stderr, "Invalid affinity: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'T':
+            threadStats = true;
+            break;
+        case 'B':
+            bandwidthStats = true;
+            break;
+        case 'L':
+            LiSetLockProfilingEnabled(true);
+            lockProfile = true;
+            break;
+        case 'M':
+            LiSetAllocationTrackingEnabled(true);
+            allocationStats = true;
+            break;
+        case 'v':
+            verbose = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+    if (optind < argc) {
+        host = argv[optind];
+    }
+    if (interval <= 0) {
+        interval = duration;
+    }
+
+    if (contentionThreads > 0) {
+        contention = calloc(contentionThreads, sizeof(*contention));
+        for (int i = 0; i < contentionThreads; i++) {
+            pthread_create(&contention[i], NULL, contentionThreadProc, NULL);
+        }
+    }
+
+    LiInitializeConnectionCallbacks(&clCallbacks);
+    clCallbacks.connectionTerminated = connectionTerminated;
+    clCallbacks.logMessage = logMessage;
+
+    LiInitializeVideoCallbacks(&drCallbacks);
+    drCallbacks.submitDecodeUnit = submitDecodeUnit;
+
+    LiInitializeAudioCallbacks(&arCallbacks);
+    arCallbacks.decodeAndPlaySample = decodeAndPlaySample;
+
+    if (replayPath != NULL) {
+        BENCH_STATS totals;
+        int err;
+
+        pthread_mutex_lock(&statsLock);
+        stats.startMs = getMillis();
+        pthread_mutex_unlock(&statsLock);
+
+        // The host simulator doesn't encrypt audio, so no keys are needed
+        err = LiReplayPacketCapture(replayPath, NULL, &clCallbacks, &drCallbacks, &arCallbacks, replaySpeed);
+        if (err != 0) {
+            fprintf(stderr, "Failed to replay %s: %d\n", replayPath, err);
+            return 1;
+        }
+
+        takeIntervalStats(&totals);
+        printStats("replay", &totals);
+        if (lockProfile) {
+            printLockStats();
+        }
+        if (allocationStats) {
+            printAllocationStats();
+        }
+        return 0;
+    }
+
+    response = httpGet(host, "/serverinfo?uniqueid=0123456789ABCDEF");
+    if (response == NULL ||
+            !getXmlValue(response, "appversion", appVersion, sizeof(appVersion)) ||
+            !getXmlValue(response, "GfeVersion", gfeVersion, sizeof(gfeVersion))) {
+        fprintf(stderr, "Invalid /serverinfo response from %s\n", host);
+        free(response);
+        return 1;
+    }
+    if (!getXmlValue(response, "ServerCodecModeSupport", codecSupport, sizeof(codecSupport))) {
+        strcpy(codecSupport, "0");
+    }
+    free(response);
+
+    // The remote input key doubles as the control stream key
+    if (RAND_bytes((unsigned char*)streamConfig.remoteInputAesKey, sizeof(streamConfig.remoteInputAesKey)) != 1 ||
+            RAND_bytes((unsigned char*)&riKeyId, sizeof(riKeyId)) != 1) {
+        return 1;
+    }
+    riKeyId &= 0x7FFFFFFF;
+    for (int i = 0; i < 16; i++) {
+        sprintf(&riKeyHex[i * 2], "%02x", (unsigned char)streamConfig.remoteInputAesKey[i]);
+    }
+    uint32_t riKeyIdBe = htonl(riKeyId);
+    memcpy(streamConfig.remoteInputAesIv, &riKeyIdBe, sizeof(riKeyIdBe));
+
+    snprintf(path, sizeof(path),
+             "/launch?uniqueid=0123456789ABCDEF&appid=1&mode=%dx%dx%d&rikey=%s&rikeyid=%u&localAudioPlayMode=0",
+             streamConfig.width, streamConfig.height, streamConfig.fps, riKeyHex, riKeyId);
+    response = httpGet(host, path);
+    if (response == NULL || !getXmlValue(response, "sessionUrl0", sessionUrl, sizeof(sessionUrl))) {
+        fprintf(stderr, "Launch failed\n");
+        free(response);
+        return 1;
+    }
+    free(response);
+
+    LiInitializeServerInformation(&serverInfo);
+    serverInfo.address = host;
+    serverInfo.serverInfoAppVersion = appVersion;
+    serverInfo.serverInfoGfeVersion = gfeVersion;
+    serverInfo.rtspSessionUrl = sessionUrl;
+    serverInfo.serverCodecModeSupport = atoi(codecSupport);
+
+    if (LiStartConnection(&serverInfo, &streamConfig, &clCallbacks, &drCallbacks, &arCallbacks,
+                          NULL, 0, NULL, 0) != 0) {
+        fprintf(stderr, "Failed to start the connection\n");
+        return 1;
+    }
+
+    BENCH_STATS totals, intervalStats;
+    uint64_t benchStartMs = getMillis();
+
+    pthread_mutex_lock(&statsLock);
+    stats.startMs = benchStartMs;
+    pthread_mutex_unlock(&statsLock);
+    memset(&totals, 0, sizeof(totals));
+
+    while (!terminated && getMillis() - benchStartMs < (uint64_t)duration * 1000) {
+        uint64_t intervalEndMs = getMillis() + (uint64_t)interval * 1000;
+
+        while (!terminated && getMillis() < intervalEndMs &&
+               getMillis() - benchStartMs < (uint64_t)duration * 1000) {
+            usleep(50000);
+        }
+
+        takeIntervalStats(&intervalStats);
+        addStats(&totals, &intervalStats);
+        printStats("interval", &intervalStats);
+        if (threadStats) {
+            printThreadStats();
+        }
+        if (bandwidthStats) {
+            printBandwidthEstimate();
+        }
+    }
+
+    LiStopConnection();
+
+    if (terminated) {
+        fprintf(stderr, "Connection terminated: %d\n", terminationError);
+    }
+
+    totals.startMs = benchStartMs;
+    printStats("total", &totals);
+    if (lockProfile) {
+        printLockStats();
+    }
+    if (allocationStats) {
+        printAllocationStats();
+    }
+
+    if (impairmentCounts[IMPAIR_EVENT_DROP] + impairmentCounts[IMPAIR_EVENT_DUPLICATE] +
+            impairmentCounts[IMPAIR_EVENT_REORDER] != 0) {
+        printf("impaired: %u dropped, %u duplicated, %u reordered, %u bursts\n",
+               impairmentCounts[IMPAIR_EVENT_DROP], impairmentCounts[IMPAIR_EVENT_DUPLICATE],
+               impairmentCounts[IMPAIR_EVENT_REORDER], impairmentCounts[IMPAIR_EVENT_BURST_START]);
+    }
+    if (traceFile != NULL) {
+        fclose(traceFile);
+    }
+    if (flightRecorderFile != NULL) {
+        fclose(flightRecorderFile);
+    }
+
+    contentionStopping = true;
+    for (int i = 0; i < contentionThreads; i++) {
+        pthread_join(contention[i], NULL);
+    }
+    free(contention);
+
+    return terminated && terminationError != ML_ERROR_GRACEFUL_TERMINATION ? 1 : 0;
+}
@@ -0,0 +1,233 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// ENet control stream peer. With our advertised version the client always
+// encrypts control messages with AES-GCM using the /launch rikey and a
+// 16 byte IV whose first byte is the sender's sequence number.
+
+#include "hostsim.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <arpa/inet.h>
+
+#include <enet/enet.h>
+
+#define GCM_TAG_LENGTH 16
+
+// Encrypted header type, length and sequence number precede the GCM tag
+#define ENC_HEADER_LENGTH 8
+
+#define CTRL_TYPE_INVALIDATE_REF_FRAMES 0x0301
+#define CTRL_TYPE_REQUEST_IDR_FRAME     0x0302
+#define CTRL_TYPE_TERMINATION           0x0109
+
+// NVST_DISCONN_SERVER_TERMINATED_CLOSED, treated as a graceful exit by the client
+#define TERMINATION_REASON_CLOSED 0x80030023
+
+static uint32_t hostSequenceNumber;
+
+static bool aesGcm(bool encrypt, const uint8_t* key, uint32_t seq, uint8_t* tag,
+                   const uint8_t* in, int length, uint8_t* out) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    uint8_t iv[16] = { 0 };
+    int outLength;
+    bool ret;
+
+    // Truncating, like the client and GFE
+    iv[0] = (uint8_t)seq;
+
+    ret = ctx != NULL &&
+          EVP_CipherInit_ex(ctx, EVP_aes_128_gcm(), NULL, NULL, NULL, encrypt ? 1 : 0) == 1 &&
+          EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, sizeof(iv), NULL) == 1 &&
+          EVP_CipherInit_ex(ctx, NULL, NULL, key, iv, -1) == 1 &&
+          (encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, GCM_TAG_LENGTH, tag) == 1) &&
+          EVP_CipherUpdate(ctx, out, &outLength, in, length) == 1 &&
+          EVP_CipherFinal_ex(ctx, out + outLength, &outLength) == 1 &&
+          (!encrypt || EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, GCM_TAG_LENGTH, tag) == 1);
+
+    EVP_CIPHER_CTX_free(ctx);
+    return ret;
+}
+
+static void sendControlMessage(ENetPeer* peer, const uint8_t* key, uint16_t type,
+                               const void* payload, uint16_t payloadLength) {
+    uint8_t plain[4 + 256];
+    ENetPacket* packet;
+    uint8_t* data;
+    int plainLength = 4 + payloadLength;
+
+    if (payloadLength > sizeof(plain) - 4) {
+        return;
+    }
+
+    plain[0] = (uint8_t)type;
+    plain[1] = (uint8_t)(type >> 8);
+    plain[2] = (uint8_t)payloadLength;
+    plain[3] = (uint8_t)(payloadLength >> 8);
+    memcpy(&plain[4], payload, payloadLength);
+
+    packet = enet_packet_create(NULL, ENC_HEADER_LENGTH + GCM_TAG_LENGTH + plainLength, ENET_PACKET_FLAG_RELIABLE);
+    if (packet == NULL) {
+        return;
+    }
+
+    data = packet->data;
+    uint16_t length = (uint16_t)(4 + GCM_TAG_LENGTH + plainLength);
+    data[0] = 0x01;
+    data[1] = 0x00;
+    data[2] = (uint8_t)length;
+    data[3] = (uint8_t)(length >> 8);
+    data[4] = (uint8_t)hostSequenceNumber;
+    data[5] = (uint8_t)(hostSequenceNumber >> 8);
+    data[6] = (uint8_t)(hostSequenceNumber >> 16);
+    data[7] = (uint8_t)(hostSequenceNumber >> 24);
+
+    if (!aesGcm(true, key, hostSequenceNumber, &data[ENC_HEADER_LENGTH],
+                plain, plainLength, &data[ENC_HEADER_LENGTH + GCM_TAG_LENGTH])) {
+        enet_packet_destroy(packet);
+        return;
+    }
+    hostSequenceNumber++;
+
+    if (enet_peer_send(peer, 0, packet) < 0) {
+        enet_packet_destroy(packet);
+    }
+}
+
+static void handleControlMessage(const uint8_t* key, const uint8_t* data, size_t length) {
+    uint8_t plain[2048];
+    uint32_t seq;
+    int plainLength;
+    uint16_t type;
+
+    if (length < ENC_HEADER_LENGTH + GCM_TAG_LENGTH + 4 || data[0] != 0x01 || data[1] != 0x00) {
+        hsLog("Control: discarding malformed packet (%d bytes)\n", (int)length);
+        return;
+    }
+
+    plainLength = (int)length - ENC_HEADER_LENGTH - GCM_TAG_LENGTH;
+    if (plainLength > (int)sizeof(plain)) {
+        return;
+    }
+
+    seq = data[4] | (data[5] << 8) | (data[6] << 16) | ((uint32_t)data[7] << 24);
+    if (!aesGcm(false, key, seq, (uint8_t*)&data[ENC_HEADER_LENGTH],
+                &data[ENC_HEADER_LENGTH + GCM_TAG_LENGTH], plainLength, plain)) {
+        hsLog("Control: failed to decrypt message %u\n", seq);
+        return;
+    }
+
+    type = plain[0] | (plain[1] << 8);
+    // Reference frame invalidation isn't advertised, so both mean IDR. Other
+    // messages (loss stats, input, FEC status) are accepted and ignored.
+    if (type == CTRL_TYPE_REQUEST_IDR_FRAME || type == CTRL_TYPE_INVALIDATE_REF_FRAMES) {
+        hsLog("Control: IDR frame requested\n");
+        sessionSignalIdr();
+    }
+}
+
+static void* controlServerThread(void* context) {
+    ENetHost* host = context;
+    ENetPeer* peer = NULL;
+    uint32_t peerGeneration = 0;
+    uint8_t key[16];
+    uint8_t peerKey[16];
+
+    while (!Quitting) {
+        ENetEvent event;
+        bool launched;
+        uint32_t generation;
+
+        pthread_mutex_lock(&SessionLock);
+        launched = Session.launched;
+        generation = Session.generation;
+        memcpy(key, Session.riKey, sizeof(key));
+        pthread_mutex_unlock(&SessionLock);
+
+        // Tell the client when its session was cancelled or replaced
+        if (peer != NULL && (!launched || generation != peerGeneration)) {
+            uint32_t reason = htonl(TERMINATION_REASON_CLOSED);
+            sendControlMessage(peer, peerKey, CTRL_TYPE_TERMINATION, &reason, sizeof(reason));
+            enet_peer_disconnect_later(peer, 0);
+            peer = NULL;
+        }
+
+        if (enet_host_service(host, &event, 10) <= 0) {
+            continue;
+        }
+
+        switch (event.type) {
+        case ENET_EVENT_TYPE_CONNECT:
+            // The session may have been launched while we were waiting
+            pthread_mutex_lock(&SessionLock);
+            launched = Session.launched;
+            peerGeneration = Session.generation;
+            memcpy(peerKey, Session.riKey, sizeof(peerKey));
+            pthread_mutex_unlock(&SessionLock);
+
+            if (!launched) {
+                enet_peer_disconnect_now(event.peer, 0);
+                break;
+            }
+            hsLog("Control: client connected\n");
+            peer = event.peer;
+            hostSequenceNumber = 0;
+            break;
+
+        case ENET_EVENT_TYPE_RECEIVE:
+            if (event.peer == peer) {
+                handleControlMessage(peerKey, event.packet->data, event.packet->dataLength);
+            }
+            enet_packet_destroy(event.packet);
+            break;
+
+        case ENET_EVENT_TYPE_DISCONNECT:
+            if (event.peer == peer) {
+                peer = NULL;
+                sessionEnd("control stream disconnected");
+            }
+            break;
+
+        default:
+            break;
+        }
+    }
+
+    enet_host_destroy(host);
+    return NULL;
+}
+
+bool startControlServer(void) {
+    ENetAddress address;
+    struct sockaddr_in sin;
+    ENetHost* host;
+
+    memset(&sin, 0, sizeof(sin));
+    sin.sin_family = AF_INET;
+    sin.sin_addr.s_addr = htonl(INADDR_ANY);
+    enet_address_set_address(&address, (struct sockaddr*)&sin, sizeof(sin));
+    enet_address_set_port(&address, HS_CONTROL_PORT);
+
+    // Leave room for a new session to connect while the last one disconnects
+    host = enet_host_create(AF_INET, &address, 2, 0, 0, 0);
+    if (host == NULL) {
+        hsLog("Failed to create the ENet control host\n");
+        return false;
+    }
+
+    return hsStartThread(controlServerThread, host);
+}
@@ -0,0 +1,146 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <pthread.h>
+#include <netinet/in.h>
+
+#include <openssl/evp.h>
+#include <openssl/x509.h>
+
+// Well-known GameStream ports. The simulator always uses the defaults so
+// clients don't need any port configuration.
+#define HS_HTTP_PORT    47989
+#define HS_HTTPS_PORT   47984
+#define HS_RTSP_PORT    48010
+#define HS_VIDEO_PORT   47998
+#define HS_CONTROL_PORT 47999
+#define HS_AUDIO_PORT   48000
+
+// Sunshine-style version (negative last component). This selects the
+// encrypted ENet control stream, the single-PLAY RTSP handshake, multi-block
+// video FEC and the 8 byte video frame header on the client.
+#define HS_APP_VERSION "7.1.431.-1"
+#define HS_GFE_VERSION "3.23.0.74"
+
+#define HS_APP_ID 1
+
+// Values match x-nv-vqos[0].bitStreamFormat in the client's ANNOUNCE
+#define HS_CODEC_H264 0
+#define HS_CODEC_HEVC 1
+#define HS_CODEC_AV1  2
+
+typedef struct _HS_CONFIG {
+    const char* hostname;
+    const char* uniqueId;
+
+    // NULL selects synthetic video frames and silent audio
+    const char* videoPath;
+    const char* audioPath;
+
+    int codec;
+    int fps;               // 0 follows the client's requested frame rate
+    int fecPercentage;
+    int gopFrames;         // IDR interval for synthetic video
+    int syntheticKbps;     // 0 follows the client's requested bitrate
+    const char* pin;       // NULL prompts on stdin
+} HS_CONFIG, *PHS_CONFIG;
+
+typedef struct _HS_SESSION {
+    // Set by /launch, cleared when the session ends
+    bool launched;
+    uint32_t generation;
+    uint8_t riKey[16];
+    uint32_t riKeyId;
+
+    // Negotiated in the RTSP ANNOUNCE
+    bool announced;
+    int width;
+    int height;
+    int fps;
+    int packetSize;
+    int bitrateKbps;
+    int audioPacketDurationMs;
+    int minRequiredFecPackets;
+
+    // Set by the RTSP PLAY
+    bool playing;
+
+    // Learned from the client's UDP pings
+    bool hasVideoAddr;
+    struct sockaddr_in videoAddr;
+    bool hasAudioAddr;
+    struct sockaddr_in audioAddr;
+} HS_SESSION, *PHS_SESSION;
+
+extern HS_CONFIG Config;
+extern HS_SESSION Session;
+extern pthread_mutex_t SessionLock;
+extern volatile bool Quitting;
+
+// main.c
+void hsLog(const char* fmt, ...) __attribute__((format(printf, 1, 2)));
+uint64_t hsGetMillis(void);
+uint64_t hsGetMicros(void);
+void hsBytesToHex(const uint8_t* in, int length, char* out);
+int hsHexToBytes(const char* in, uint8_t* out, int maxLength);
+const char* hsGetQueryParam(const char* query, const char* name, char* value, size_t valueSize);
+bool hsStartThread(void* (*func)(void*), void* context);
+int hsCreateSocket(int type, uint16_t port);
+void sessionLaunch(const uint8_t* riKey, uint32_t riKeyId);
+void sessionEnd(const char* reason);
+bool sessionRequestIdr(void);
+void sessionSignalIdr(void);
+
+// pairing.c
+extern X509* ServerCert;
+extern EVP_PKEY* ServerKey;
+bool pairingInit(void);
+bool pairingIsClientPaired(X509* clientCert);
+int pairingHandleRequest(const char* query, char* response, size_t responseSize);
+void pairingUnpairAll(void);
+
+// http.c
+bool startHttpServers(void);
+
+// rtsp.c
+bool startRtspServer(void);
+
+// control.c
+bool startControlServer(void);
+
+// media.c
+typedef struct _HS_VIDEO_FRAME {
+    const uint8_t* data;
+    int length;
+    bool keyframe;
+} HS_VIDEO_FRAME, *PHS_VIDEO_FRAME;
+
+bool mediaOpenVideo(const char* path, int* codec);
+void mediaRewindVideo(void);
+bool mediaNextVideoFrame(PHS_VIDEO_FRAME frame, bool keyframeRequired,
+                         int width, int height, int bitrateKbps, int fps);
+
+// video.c
+bool startVideoStream(void);
+
+// audio.c
+bool audioOpenSource(const char* path);
+bool startAudioStream(void);
@@ -0,0 +1,339 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// NvHTTP endpoints on the HTTP (47989) and HTTPS (47984) ports. Requests are
+// served one at a time and every connection is closed after its response.
+
+#include "hostsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <openssl/ssl.h>
+
+#include <Limelight.h>
+
+#define MAX_REQUEST_SIZE  16384
+#define MAX_RESPONSE_SIZE 16384
+
+typedef struct _HTTP_CONNECTION {
+    int sock;
+    SSL* ssl;
+    char localAddr[INET_ADDRSTRLEN];
+} HTTP_CONNECTION, *PHTTP_CONNECTION;
+
+// 1x1 transparent PNG for /appasset
+static const unsigned char boxArt[] = {
+    0x89, 0x50, 0x4e, 0x47, 0x0d, 0x0a, 0x1a, 0x0a, 0x00, 0x00, 0x00, 0x0d, 0x49, 0x48, 0x44, 0x52,
+    0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x01, 0x08, 0x06, 0x00, 0x00, 0x00, 0x1f, 0x15, 0xc4,
+    0x89, 0x00, 0x00, 0x00, 0x0b, 0x49, 0x44, 0x41, 0x54, 0x78, 0x9c, 0x63, 0x60, 0x00, 0x02, 0x00,
+    0x00, 0x05, 0x00, 0x01, 0x7a, 0x5e, 0xab, 0x3f, 0x00, 0x00, 0x00, 0x00, 0x49, 0x45, 0x4e, 0x44,
+    0xae, 0x42, 0x60, 0x82
+};
+
+static SSL_CTX* sslContext;
+static int httpSock = -1;
+static int httpsSock = -1;
+
+static int connRead(PHTTP_CONNECTION conn, char* buffer, int length) {
+    return conn->ssl ? SSL_read(conn->ssl, buffer, length) : (int)recv(conn->sock, buffer, length, 0);
+}
+
+static void connWrite(PHTTP_CONNECTION conn, const void* buffer, int length) {
+    if (conn->ssl) {
+        SSL_write(conn->ssl, buffer, length);
+    }
+    else {
+        send(conn->sock, buffer, length, 0);
+    }
+}
+
+static void sendResponse(PHTTP_CONNECTION conn, int status, const char* contentType, const void* body, int bodyLength) {
+    char header[256];
+    int headerLength;
+
+    headerLength = snprintf(header, sizeof(header),
+                            "HTTP/1.1 %d %s\r\n"
+                            "Content-Type: %s\r\n"
+                            "Content-Length: %d\r\n"
+                            "Connection: close\r\n"
+                            "\r\n",
+                            status, status == 200 ? "OK" : "Not Found",
+                            contentType, bodyLength);
+    connWrite(conn, header, headerLength);
+    connWrite(conn, body, bodyLength);
+}
+
+static void sendXml(PHTTP_CONNECTION conn, int status, const char* body) {
+    char xml[MAX_RESPONSE_SIZE];
+    int length;
+
+    length = snprintf(xml, sizeof(xml),
+                      "<?xml version=\"1.0\" encoding=\"utf-8\"?>"
+                      "<root status_code=\"%d\">%s</root>",
+                      status, body);
+    if (length >= (int)sizeof(xml)) {
+        length = (int)sizeof(xml) - 1;
+    }
+    sendResponse(conn, 200, "application/xml", xml, length);
+}
+
+static int serverCodecModeSupport(void) {
+    switch (Config.codec) {
+    case HS_CODEC_AV1:
+        return SCM_H264 | SCM_AV1_MAIN8;
+    case HS_CODEC_HEVC:
+        return SCM_H264 | SCM_HEVC;
+    default:
+        return SCM_H264;
+    }
+}
+
+static void handleServerInfo(PHTTP_CONNECTION conn) {
+    char body[2048];
+    bool paired = false;
+    bool launched;
+    int width, height, fps;
+
+    if (conn->ssl) {
+        X509* peerCert = SSL_get1_peer_certificate(conn->ssl);
+        paired = pairingIsClientPaired(peerCert);
+        X509_free(peerCert);
+    }
+
+    pthread_mutex_lock(&SessionLock);
+    launched = Session.launched;
+    width = Session.announced ? Session.width : 1920;
+    height = Session.announced ? Session.height : 1080;
+    fps = Session.announced ? Session.fps : 60;
+    pthread_mutex_unlock(&SessionLock);
+
+    snprintf(body, sizeof(body),
+             "<hostname>%s</hostname>"
+             "<appversion>" HS_APP_VERSION "</appversion>"
+             "<GfeVersion>" HS_GFE_VERSION "</GfeVersion>"
+             "<uniqueid>%s</uniqueid>"
+             "<HttpsPort>%d</HttpsPort>"
+             "<ExternalPort>%d</ExternalPort>"
+             "<mac>00:00:00:00:00:00</mac>"
+             "<LocalIP>%s</LocalIP>"
+             "<ServerCodecModeSupport>%d</ServerCodecModeSupport>"
+             "<MaxLumaPixelsHEVC>%d</MaxLumaPixelsHEVC>"
+             "<gputype>Host Simulator</gputype>"
+             "<numofapps>1</numofapps>"
+             "<SupportedDisplayMode><DisplayMode>"
+             "<Width>%d</Width><Height>%d</Height><RefreshRate>%d</RefreshRate>"
+             "</DisplayMode></SupportedDisplayMode>"
+             "<PairStatus>%d</PairStatus>"
+             "<currentgame>%d</currentgame>"
+             "<state>%s</state>",
+             Config.hostname, Config.uniqueId,
+             HS_HTTPS_PORT, HS_HTTP_PORT,
+             conn->localAddr,
+             serverCodecModeSupport(),
+             Config.codec == HS_CODEC_H264 ? 0 : 8912896,
+             width, height, fps,
+             paired ? 1 : 0,
+             launched ? HS_APP_ID : 0,
+             launched ? "SUNSHINE_SERVER_BUSY" : "SUNSHINE_SERVER_FREE");
+    sendXml(conn, 200, body);
+}
+
+static void handleAppList(PHTTP_CONNECTION conn) {
+    char body[512];
+    const char* title = "Host Simulator";
+
+    if (Config.videoPath != NULL) {
+        const char* slash = strrchr(Config.videoPath, '/');
+        title = slash ? slash + 1 : Config.videoPath;
+    }
+
+    snprintf(body, sizeof(body),
+             "<App><IsHdrSupported>0</IsHdrSupported><AppTitle>%s</AppTitle><ID>%d</ID></App>",
+             title, HS_APP_ID);
+    sendXml(conn, 200, body);
+}
+
+static void handleLaunch(PHTTP_CONNECTION conn, const char* query, bool resume) {
+    char value[64];
+    uint8_t riKey[16];
+    uint32_t riKeyId;
+    char body[256];
+
+    if (!resume && (hsGetQueryParam(query, "appid", value, sizeof(value)) == NULL || atoi(value) != HS_APP_ID)) {
+        sendXml(conn, 404, "");
+        return;
+    }
+
+    if (hsGetQueryParam(query, "rikey", value, sizeof(value)) == NULL ||
+            hsHexToBytes(value, riKey, sizeof(riKey)) != sizeof(riKey) ||
+            hsGetQueryParam(query, "rikeyid", value, sizeof(value)) == NULL) {
+        sendXml(conn, 400, "");
+        return;
+    }
+    riKeyId = (uint32_t)strtol(value, NULL, 10);
+
+    sessionLaunch(riKey, riKeyId);
+
+    snprintf(body, sizeof(body), "<%s>1</%s><sessionUrl0>rtsp://%s:%d</sessionUrl0>",
+             resume ? "resume" : "gamesession", resume ? "resume" : "gamesession",
+             conn->localAddr, HS_RTSP_PORT);
+    sendXml(conn, 200, body);
+}
+
+static void handlePair(PHTTP_CONNECTION conn, const char* query) {
+    char* body = malloc(MAX_RESPONSE_SIZE);
+
+    pairingHandleRequest(query, body, MAX_RESPONSE_SIZE);
+    sendXml(conn, 200, body);
+    free(body);
+}
+
+static void handleRequest(PHTTP_CONNECTION conn) {
+    char request[MAX_REQUEST_SIZE];
+    int length = 0;
+    char* path;
+    char* query;
+
+    // Only GET requests are used, so everything we need is in the header
+    while (length < (int)sizeof(request) - 1) {
+        int ret = connRead(conn, &request[length], (int)sizeof(request) - 1 - length);
+        if (ret <= 0) {
+            return;
+        }
+        length += ret;
+        request[length] = 0;
+        if (strstr(request, "\r\n\r\n") != NULL) {
+            break;
+        }
+    }
+
+    if (strncmp(request, "GET ", 4) != 0) {
+        return;
+    }
+    path = &request[4];
+    path[strcspn(path, " \r\n")] = 0;
+
+    query = strchr(path, '?');
+    if (query != NULL) {
+        *query++ = 0;
+    }
+    else {
+        query = "";
+    }
+
+    if (!strcmp(path, "/serverinfo")) {
+        handleServerInfo(conn);
+    }
+    else if (!strcmp(path, "/applist")) {
+        handleAppList(conn);
+    }
+    else if (!strcmp(path, "/appasset")) {
+        sendResponse(conn, 200, "image/png", boxArt, sizeof(boxArt));
+    }
+    else if (!strcmp(path, "/launch")) {
+        handleLaunch(conn, query, false);
+    }
+    else if (!strcmp(path, "/resume")) {
+        handleLaunch(conn, query, true);
+    }
+    else if (!strcmp(path, "/cancel")) {
+        sessionEnd("cancelled by the client");
+        sendXml(conn, 200, "<cancel>1</cancel>");
+    }
+    else if (!strcmp(path, "/pair")) {
+        handlePair(conn, query);
+    }
+    else if (!strcmp(path, "/unpair")) {
+        pairingUnpairAll();
+        sendXml(conn, 200, "");
+    }
+    else {
+        hsLog("HTTP: unsupported request %s\n", path);
+        sendResponse(conn, 404, "text/plain", "", 0);
+    }
+}
+
+// Clients present their pairing certificate, which we only look at for
+// PairStatus. Any certificate (or none) is accepted.
+static int acceptAnyCertificate(int preverifyOk, X509_STORE_CTX* ctx) {
+    (void)preverifyOk;
+    (void)ctx;
+    return 1;
+}
+
+static void* httpServerThread(void* context) {
+    bool secure = context != NULL;
+    int listenSock = secure ? httpsSock : httpSock;
+
+    while (!Quitting) {
+        HTTP_CONNECTION conn;
+        struct sockaddr_in addr;
+        socklen_t addrLen = sizeof(addr);
+        struct timeval timeout = { 5, 0 };
+
+        memset(&conn, 0, sizeof(conn));
+        conn.sock = accept(listenSock, NULL, NULL);
+        if (conn.sock < 0) {
+            continue;
+        }
+
+        setsockopt(conn.sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        getsockname(conn.sock, (struct sockaddr*)&addr, &addrLen);
+        inet_ntop(AF_INET, &addr.sin_addr, conn.localAddr, sizeof(conn.localAddr));
+
+        if (secure) {
+            conn.ssl = SSL_new(sslContext);
+            SSL_set_fd(conn.ssl, conn.sock);
+            if (SSL_accept(conn.ssl) <= 0) {
+                SSL_free(conn.ssl);
+                close(conn.sock);
+                continue;
+            }
+        }
+
+        handleRequest(&conn);
+
+        if (conn.ssl) {
+            SSL_shutdown(conn.ssl);
+            SSL_free(conn.ssl);
+        }
+        close(conn.sock);
+    }
+
+    close(listenSock);
+    return NULL;
+}
+
+bool startHttpServers(void) {
+    httpSock = hsCreateSocket(SOCK_STREAM, HS_HTTP_PORT);
+    httpsSock = hsCreateSocket(SOCK_STREAM, HS_HTTPS_PORT);
+    if (httpSock < 0 || httpsSock < 0) {
+        return false;
+    }
+
+    sslContext = SSL_CTX_new(TLS_server_method());
+    SSL_CTX_use_certificate(sslContext, ServerCert);
+    SSL_CTX_use_PrivateKey(sslContext, ServerKey);
+    SSL_CTX_set_verify(sslContext, SSL_VERIFY_PEER, acceptAnyCertificate);
+
+    return hsStartThread(httpServerThread, NULL) &&
+           hsStartThread(httpServerThread, sslContext);
+}
@@ -0,0 +1,344 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "hostsim.h"
+
+#include <errno.h>
+#include <getopt.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <enet/enet.h>
+
+HS_CONFIG Config = {
+    .hostname = "hostsim",
+    .uniqueId = "0123456789ABCDEF",
+    .codec = -1,
+    .fecPercentage = 20,
+    .gopFrames = 0,
+};
+HS_SESSION Session;
+pthread_mutex_t SessionLock = PTHREAD_MUTEX_INITIALIZER;
+volatile bool Quitting;
+
+static bool idrPending;
+static pthread_mutex_t logLock = PTHREAD_MUTEX_INITIALIZER;
+
+void hsLog(const char* fmt, ...) {
+    va_list va;
+    uint64_t now = hsGetMillis();
+
+    pthread_mutex_lock(&logLock);
+    fprintf(stderr, "[%6llu.%03llu] ", (unsigned long long)(now / 1000), (unsigned long long)(now % 1000));
+    va_start(va, fmt);
+    vfprintf(stderr, fmt, va);
+    va_end(va);
+    pthread_mutex_unlock(&logLock);
+}
+
+// Same clock as PltGetMillis() in moonlight-common-c, so a client on the same
+// machine can compare RTP timestamps against its own receive times.
+uint64_t hsGetMillis(void) {
+    return hsGetMicros() / 1000;
+}
+
+uint64_t hsGetMicros(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000) + (ts.tv_nsec / 1000);
+}
+
+void hsBytesToHex(const uint8_t* in, int length, char* out) {
+    static const char hex[] = "0123456789ABCDEF";
+
+    for (int i = 0; i < length; i++) {
+        out[i * 2] = hex[in[i] >> 4];
+        out[i * 2 + 1] = hex[in[i] & 0xF];
+    }
+    out[length * 2] = 0;
+}
+
+// Returns the number of bytes decoded or -1 if the string is malformed
+int hsHexToBytes(const char* in, uint8_t* out, int maxLength) {
+    int length = (int)strlen(in);
+
+    if (length % 2 != 0 || length / 2 > maxLength) {
+        return -1;
+    }
+
+    for (int i = 0; i < length / 2; i++) {
+        unsigned int byte;
+        if (sscanf(&in[i * 2], "%2x", &byte) != 1) {
+            return -1;
+        }
+        out[i] = (uint8_t)byte;
+    }
+
+    return length / 2;
+}
+
+// Copies the value of a query string parameter. Returns NULL if the
+// parameter is missing or its value doesn't fit.
+const char* hsGetQueryParam(const char* query, const char* name, char* value, size_t valueSize) {
+    size_t nameLength = strlen(name);
+    const char* p = query;
+
+    while (p != NULL && *p) {
+        if (!strncmp(p, name, nameLength) && p[nameLength] == '=') {
+            const char* start = p + nameLength + 1;
+            size_t length = strcspn(start, "&");
+            if (length >= valueSize) {
+                return NULL;
+            }
+            memcpy(value, start, length);
+            value[length] = 0;
+            return value;
+        }
+
+        p = strchr(p, '&');
+        if (p != NULL) {
+            p++;
+        }
+    }
+
+    return NULL;
+}
+
+bool hsStartThread(void* (*func)(void*), void* context) {
+    pthread_t thread;
+
+    if (pthread_create(&thread, NULL, func, context) != 0) {
+        return false;
+    }
+
+    pthread_detach(thread);
+    return true;
+}
+
+int hsCreateSocket(int type, uint16_t port) {
+    struct sockaddr_in addr;
+    int val = 1;
+    int s;
+
+    s = socket(AF_INET, type, 0);
+    if (s < 0) {
+        return -1;
+    }
+
+    setsockopt(s, SOL_SOCKET, SO_REUSEADDR, &val, sizeof(val));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(s, (struct sockaddr*)&addr, sizeof(addr)) < 0) {
+        hsLog("Failed to bind port %u: %s\n", port, strerror(errno));
+        close(s);
+        return -1;
+    }
+
+    if (type == SOCK_STREAM && listen(s, 8) < 0) {
+        close(s);
+        return -1;
+    }
+
+    return s;
+}
+
+void sessionLaunch(const uint8_t* riKey, uint32_t riKeyId) {
+    pthread_mutex_lock(&SessionLock);
+    uint32_t generation = Session.generation + 1;
+    memset(&Session, 0, sizeof(Session));
+    Session.generation = generation;
+    Session.launched = true;
+    memcpy(Session.riKey, riKey, sizeof(Session.riKey));
+    Session.riKeyId = riKeyId;
+    idrPending = true;
+    pthread_mutex_unlock(&SessionLock);
+
+    hsLog("Session %u launched\n", generation);
+}
+
+void sessionEnd(const char* reason) {
+    pthread_mutex_lock(&SessionLock);
+    if (Session.launched) {
+        hsLog("Session %u ended: %s\n", Session.generation, reason);
+    }
+    Session.launched = false;
+    Session.announced = false;
+    Session.playing = false;
+    Session.hasVideoAddr = false;
+    Session.hasAudioAddr = false;
+    pthread_mutex_unlock(&SessionLock);
+}
+
+// Returns true once for each IDR frame request from the client
+bool sessionRequestIdr(void) {
+    bool ret;
+
+    pthread_mutex_lock(&SessionLock);
+    ret = idrPending;
+    idrPending = false;
+    pthread_mutex_unlock(&SessionLock);
+
+    return ret;
+}
+
+void sessionSignalIdr(void) {
+    pthread_mutex_lock(&SessionLock);
+    idrPending = true;
+    pthread_mutex_unlock(&SessionLock);
+}
+
+static void onSignal(int sig) {
+    (void)sig;
+    Quitting = true;
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "  --video <file>     H.264/HEVC Annex B or AV1 OBU elementary stream\n"
+            "                     (synthetic H.264 frames if omitted)\n"
+            "  --audio <file>     Ogg Opus stereo stream with 5 or 10 ms frames\n"
+            "                     (silence if omitted)\n"
+            "  --codec <c>        h264, hevc or av1 (default: detect from --video)\n"
+            "  --fps <n>          Frame rate (default: the client's requested rate)\n"
+            "  --fec <pct>        Video FEC percentage (default: 20)\n"
+            "  --gop <frames>     Synthetic IDR interval (default: IDR on request only)\n"
+            "  --bitrate <kbps>   Synthetic bitrate (default: the client's requested rate)\n"
+            "  --pin <pin>        Pairing PIN (default: prompt when pairing starts)\n"
+            "  --name <hostname>  Hostname reported to clients\n",
+            name);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option longOptions[] = {
+        { "video", required_argument, NULL, 'v' },
+        { "audio", required_argument, NULL, 'a' },
+        { "codec", required_argument, NULL, 'c' },
+        { "fps", required_argument, NULL, 'f' },
+        { "fec", required_argument, NULL, 'e' },
+        { "gop", required_argument, NULL, 'g' },
+        { "bitrate", required_argument, NULL, 'b' },
+        { "pin", required_argument, NULL, 'p' },
+        { "name", required_argument, NULL, 'n' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'v':
+            Config.videoPath = optarg;
+            break;
+        case 'a':
+            Config.audioPath = optarg;
+            break;
+        case 'c':
+            if (!strcmp(optarg, "h264")) {
+                Config.codec = HS_CODEC_H264;
+            }
+            else if (!strcmp(optarg, "hevc") || !strcmp(optarg, "h265")) {
+                Config.codec = HS_CODEC_HEVC;
+            }
+            else if (!strcmp(optarg, "av1")) {
+                Config.codec = HS_CODEC_AV1;
+            }
+            else {
+                fprintf(stderr, "Unknown codec: %s\n", optarg);
+                return 1;
+            }
+            break;
+        case 'f':
+            Config.fps = atoi(optarg);
+            break;
+        case 'e':
+            Config.fecPercentage = atoi(optarg);
+            break;
+        case 'g':
+            Config.gopFrames = atoi(optarg);
+            break;
+        case 'b':
+            Config.syntheticKbps = atoi(optarg);
+            break;
+        case 'p':
+            Config.pin = optarg;
+            break;
+        case 'n':
+            Config.hostname = optarg;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    if (Config.fecPercentage < 0 || Config.fecPercentage > 255) {
+        fprintf(stderr, "FEC percentage must be between 0 and 255\n");
+        return 1;
+    }
+    if (Config.pin != NULL && strlen(Config.pin) != 4) {
+        fprintf(stderr, "PIN must be 4 digits\n");
+        return 1;
+    }
+
+    if (!mediaOpenVideo(Config.videoPath, &Config.codec) ||
+            !audioOpenSource(Config.audioPath) ||
+            !pairingInit()) {
+        return 1;
+    }
+
+    if (enet_initialize() != 0) {
+        hsLog("Failed to initialize ENet\n");
+        return 1;
+    }
+
+    signal(SIGPIPE, SIG_IGN);
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+
+    // The video stream initializes the RS tables the audio stream also uses
+    if (!startHttpServers() ||
+            !startRtspServer() ||
+            !startControlServer() ||
+            !startVideoStream() ||
+            !startAudioStream()) {
+        return 1;
+    }
+
+    hsLog("Host simulator '%s' ready (%s video, %s audio)\n",
+          Config.hostname,
+          Config.codec == HS_CODEC_AV1 ? "AV1" : (Config.codec == HS_CODEC_HEVC ? "HEVC" : "H.264"),
+          Config.audioPath ? "Opus" : "silent");
+
+    while (!Quitting) {
+        pause();
+    }
+
+    hsLog("Shutting down\n");
+    return 0;
+}
@@ -0,0 +1,445 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Video frame sources. Elementary stream files are loaded into memory and
+// split into access units (H.264/HEVC) or temporal units (AV1) up front.
+// Without a file, synthetic H.264 frames are generated with valid parameter
+// sets and filler slice data, which exercises the transport but not decoding.
+
+#include "hostsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct _FRAME_ENTRY {
+    int offset;
+    int length;
+    bool keyframe;
+} FRAME_ENTRY, *PFRAME_ENTRY;
+
+static uint8_t* fileData;
+static PFRAME_ENTRY frames;
+static int frameCount;
+static int firstKeyframe;
+static int nextFrame;
+
+static uint8_t* syntheticBuffer;
+static int syntheticBufferSize;
+static int syntheticFrameNumber;
+static uint32_t syntheticSeed = 0x12345678;
+
+// ─── Elementary stream parsing ──────────────────────────────────────────────
+
+static bool addFrame(int offset, int length, bool keyframe) {
+    static int capacity;
+
+    if (length <= 0) {
+        return true;
+    }
+
+    if (frameCount == capacity) {
+        capacity = capacity ? capacity * 2 : 1024;
+        PFRAME_ENTRY newFrames = realloc(frames, capacity * sizeof(*frames));
+        if (newFrames == NULL) {
+            return false;
+        }
+        frames = newFrames;
+    }
+
+    frames[frameCount].offset = offset;
+    frames[frameCount].length = length;
+    frames[frameCount].keyframe = keyframe;
+    frameCount++;
+    return true;
+}
+
+// Returns the offset of the next start code at or after offset, or length
+static int findStartCode(const uint8_t* data, int length, int offset) {
+    for (int i = offset; i + 3 <= length; i++) {
+        if (data[i] == 0 && data[i + 1] == 0 && data[i + 2] == 1) {
+            // Include the leading zero of a 4 byte start code
+            return (i > offset && data[i - 1] == 0) ? i - 1 : i;
+        }
+    }
+    return length;
+}
+
+static bool splitAnnexB(const uint8_t* data, int length, int codec) {
+    int auStart = -1;
+    bool auHasVcl = false;
+    bool auKeyframe = false;
+    int offset = findStartCode(data, length, 0);
+
+    while (offset < length) {
+        int header = offset + (data[offset + 2] == 1 ? 3 : 4);
+        int next = findStartCode(data, length, header);
+        bool startsAu, isVcl, isKeyframe;
+
+        if (header + 2 >= next) {
+            offset = next;
+            continue;
+        }
+
+        if (codec == HS_CODEC_HEVC) {
+            int type = (data[header] >> 1) & 0x3F;
+            bool firstSlice = (data[header + 2] & 0x80) != 0;
+            isVcl = type < 32;
+            isKeyframe = type >= 16 && type <= 21;
+            startsAu = type == 35 ||
+                       (auHasVcl && isVcl && firstSlice) ||
+                       (auHasVcl && (type == 32 || type == 33 || type == 34 || type == 39));
+        }
+        else {
+            int type = data[header] & 0x1F;
+            bool firstSlice = (data[header + 1] & 0x80) != 0;
+            isVcl = type == 1 || type == 5;
+            isKeyframe = type == 5;
+            startsAu = type == 9 ||
+                       (auHasVcl && isVcl && firstSlice) ||
+                       (auHasVcl && (type == 6 || type == 7 || type == 8));
+        }
+
+        if (startsAu || auStart < 0) {
+            if (auStart >= 0 && !addFrame(auStart, offset - auStart, auKeyframe)) {
+                return false;
+            }
+            auStart = offset;
+            auHasVcl = false;
+            auKeyframe = false;
+        }
+
+        auHasVcl |= isVcl;
+        auKeyframe |= isKeyframe;
+        offset = next;
+    }
+
+    return auStart < 0 || addFrame(auStart, length - auStart, auKeyframe);
+}
+
+static bool splitAv1(const uint8_t* data, int length) {
+    int tuStart = -1;
+    bool tuKeyframe = false;
+    int offset = 0;
+
+    while (offset < length) {
+        int type = (data[offset] >> 3) & 0xF;
+        bool hasExtension = (data[offset] & 0x4) != 0;
+        bool hasSize = (data[offset] & 0x2) != 0;
+        int pos = offset + 1 + (hasExtension ? 1 : 0);
+        uint64_t size = 0;
+
+        if (!hasSize) {
+            hsLog("AV1 OBUs must use the low overhead bitstream format (obu_has_size_field)\n");
+            return false;
+        }
+
+        for (int i = 0; i < 8 && pos < length; i++) {
+            size |= (uint64_t)(data[pos] & 0x7F) << (i * 7);
+            if (!(data[pos++] & 0x80)) {
+                break;
+            }
+        }
+        if (pos + size > (uint64_t)length) {
+            break;
+        }
+
+        // Temporal delimiters start each temporal unit. Encoders emit a
+        // sequence header with every key frame.
+        if (type == 2 || tuStart < 0) {
+            if (tuStart >= 0 && !addFrame(tuStart, offset - tuStart, tuKeyframe)) {
+                return false;
+            }
+            tuStart = offset;
+            tuKeyframe = false;
+        }
+        tuKeyframe |= type == 1;
+
+        offset = pos + (int)size;
+    }
+
+    return tuStart < 0 || addFrame(tuStart, offset - tuStart, tuKeyframe);
+}
+
+static int detectCodec(const char* path, const uint8_t* data, int length) {
+    const char* ext = strrchr(path, '.');
+
+    if (ext != NULL) {
+        if (!strcmp(ext, ".h265") || !strcmp(ext, ".265") || !strcmp(ext, ".hevc")) {
+            return HS_CODEC_HEVC;
+        }
+        else if (!strcmp(ext, ".obu") || !strcmp(ext, ".av1")) {
+            return HS_CODEC_AV1;
+        }
+        else if (!strcmp(ext, ".h264") || !strcmp(ext, ".264") || !strcmp(ext, ".avc")) {
+            return HS_CODEC_H264;
+        }
+    }
+
+    // AV1 streams begin with a temporal delimiter OBU
+    if (length >= 2 && data[0] == 0x12 && data[1] == 0x00) {
+        return HS_CODEC_AV1;
+    }
+
+    // HEVC NAL headers have a nonzero temporal ID in their second byte
+    int start = findStartCode(data, length, 0);
+    int header = start + (start + 2 < length && data[start + 2] == 1 ? 3 : 4);
+    if (header + 1 < length && data[header + 1] == 0x01 &&
+            (data[header] == 0x40 || data[header] == 0x42 || data[header] == 0x44 ||
+             data[header] == 0x46 || data[header] == 0x4e)) {
+        return HS_CODEC_HEVC;
+    }
+
+    return HS_CODEC_H264;
+}
+
+bool mediaOpenVideo(const char* path, int* codec) {
+    FILE* f;
+    long length;
+
+    if (path == NULL) {
+        if (*codec > HS_CODEC_H264) {
+            hsLog("Synthetic video is only available as H.264\n");
+            return false;
+        }
+        *codec = HS_CODEC_H264;
+        return true;
+    }
+
+    f = fopen(path, "rb");
+    if (f == NULL) {
+        hsLog("Unable to open %s\n", path);
+        return false;
+    }
+
+    fseek(f, 0, SEEK_END);
+    length = ftell(f);
+    fseek(f, 0, SEEK_SET);
+
+    fileData = malloc(length);
+    if (fileData == NULL || fread(fileData, 1, length, f) != (size_t)length) {
+        hsLog("Unable to read %s\n", path);
+        fclose(f);
+        return false;
+    }
+    fclose(f);
+
+    if (*codec < 0) {
+        *codec = detectCodec(path, fileData, (int)length);
+    }
+
+    if (!(*codec == HS_CODEC_AV1 ? splitAv1(fileData, (int)length) : splitAnnexB(fileData, (int)length, *codec))) {
+        return false;
+    }
+
+    firstKeyframe = -1;
+    int keyframes = 0;
+    for (int i = 0; i < frameCount; i++) {
+        if (frames[i].keyframe) {
+            if (firstKeyframe < 0) {
+                firstKeyframe = i;
+            }
+            keyframes++;
+        }
+    }
+    if (firstKeyframe < 0) {
+        hsLog("%s doesn't contain a keyframe\n", path);
+        return false;
+    }
+
+    hsLog("Loaded %s: %d frames, %d keyframes\n", path, frameCount, keyframes);
+    mediaRewindVideo();
+    return true;
+}
+
+void mediaRewindVideo(void) {
+    nextFrame = firstKeyframe;
+    syntheticFrameNumber = 0;
+}
+
+// ─── Synthetic H.264 ─────────────────────────────────────────────────────────
+
+typedef struct _BIT_WRITER {
+    uint8_t* data;
+    int bitOffset;
+} BIT_WRITER, *PBIT_WRITER;
+
+static void putBits(PBIT_WRITER bw, uint32_t value, int bits) {
+    while (bits-- > 0) {
+        if (value & (1U << bits)) {
+            bw->data[bw->bitOffset / 8] |= 0x80 >> (bw->bitOffset % 8);
+        }
+        bw->bitOffset++;
+    }
+}
+
+static void putUe(PBIT_WRITER bw, uint32_t value) {
+    int bits = 0;
+
+    while ((value + 1) >> (bits + 1)) {
+        bits++;
+    }
+    putBits(bw, 0, bits);
+    putBits(bw, value + 1, bits + 1);
+}
+
+// Appends an RBSP as a NAL unit with a start code and emulation prevention.
+// Returns the number of bytes written.
+static int putNal(uint8_t* out, uint8_t header, PBIT_WRITER rbsp) {
+    int length = 0;
+    int zeros = 0;
+
+    // RBSP stop bit
+    putBits(rbsp, 1, 1);
+
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = 0;
+    out[length++] = 1;
+    out[length++] = header;
+    for (int i = 0; i < (rbsp->bitOffset + 7) / 8; i++) {
+        if (zeros == 2 && rbsp->data[i] <= 3) {
+            out[length++] = 3;
+            zeros = 0;
+        }
+        out[length++] = rbsp->data[i];
+        zeros = rbsp->data[i] == 0 ? zeros + 1 : 0;
+    }
+
+    return length;
+}
+
+// Main profile SPS and PPS for the requested resolution
+static int writeParameterSets(uint8_t* out, int width, int height) {
+    uint8_t rbsp[64];
+    BIT_WRITER bw;
+    int mbWidth = (width + 15) / 16;
+    int mbHeight = (height + 15) / 16;
+    bool cropping = mbWidth * 16 != width || mbHeight * 16 != height;
+    int length;
+
+    memset(rbsp, 0, sizeof(rbsp));
+    bw.data = rbsp;
+    bw.bitOffset = 0;
+    putBits(&bw, 77, 8);          // profile_idc
+    putBits(&bw, 0, 8);           // constraint flags
+    putBits(&bw, 51, 8);          // level_idc
+    putUe(&bw, 0);                // seq_parameter_set_id
+    putUe(&bw, 4);                // log2_max_frame_num_minus4
+    putUe(&bw, 2);                // pic_order_cnt_type
+    putUe(&bw, 1);                // max_num_ref_frames
+    putBits(&bw, 0, 1);           // gaps_in_frame_num_value_allowed_flag
+    putUe(&bw, mbWidth - 1);
+    putUe(&bw, mbHeight - 1);
+    putBits(&bw, 1, 1);           // frame_mbs_only_flag
+    putBits(&bw, 1, 1);           // direct_8x8_inference_flag
+    putBits(&bw, cropping, 1);
+    if (cropping) {
+        putUe(&bw, 0);
+        putUe(&bw, (mbWidth * 16 - width) / 2);
+        putUe(&bw, 0);
+        putUe(&bw, (mbHeight * 16 - height) / 2);
+    }
+    putBits(&bw, 0, 1);           // vui_parameters_present_flag
+    length = putNal(out, 0x67, &bw);
+
+    memset(rbsp, 0, sizeof(rbsp));
+    bw.bitOffset = 0;
+    putUe(&bw, 0);                // pic_parameter_set_id
+    putUe(&bw, 0);                // seq_parameter_set_id
+    putBits(&bw, 0, 2);           // entropy_coding_mode_flag, bottom_field_pic_order_in_frame_present_flag
+    putUe(&bw, 0);                // num_slice_groups_minus1
+    putUe(&bw, 0);                // num_ref_idx_l0_default_active_minus1
+    putUe(&bw, 0);                // num_ref_idx_l1_default_active_minus1
+    putBits(&bw, 0, 3);           // weighted_pred_flag, weighted_bipred_idc
+    putUe(&bw, 0);                // pic_init_qp_minus26 (se 0)
+    putUe(&bw, 0);                // pic_init_qs_minus26 (se 0)
+    putUe(&bw, 0);                // chroma_qp_index_offset (se 0)
+    putBits(&bw, 1, 1);           // deblocking_filter_control_present_flag
+    putBits(&bw, 0, 2);           // constrained_intra_pred_flag, redundant_pic_cnt_present_flag
+    length += putNal(&out[length], 0x68, &bw);
+
+    return length;
+}
+
+static int writeSyntheticFrame(int width, int height, int frameSize, bool keyframe) {
+    int length = 0;
+
+    if (syntheticBufferSize < frameSize + 256) {
+        free(syntheticBuffer);
+        syntheticBufferSize = frameSize + 256;
+        syntheticBuffer = malloc(syntheticBufferSize);
+        if (syntheticBuffer == NULL) {
+            syntheticBufferSize = 0;
+            return 0;
+        }
+    }
+
+    if (keyframe) {
+        length = writeParameterSets(syntheticBuffer, width, height);
+    }
+
+    // A single slice whose first_mb_in_slice is 0, followed by filler that
+    // never contains a zero byte and so can't emulate a start code
+    syntheticBuffer[length++] = 0;
+    syntheticBuffer[length++] = 0;
+    syntheticBuffer[length++] = 0;
+    syntheticBuffer[length++] = 1;
+    syntheticBuffer[length++] = keyframe ? 0x65 : 0x41;
+    syntheticBuffer[length++] = 0x88;
+    while (length < frameSize) {
+        syntheticSeed ^= syntheticSeed << 13;
+        syntheticSeed ^= syntheticSeed >> 17;
+        syntheticSeed ^= syntheticSeed << 5;
+        syntheticBuffer[length++] = (uint8_t)(syntheticSeed % 255) + 1;
+    }
+
+    return length;
+}
+
+// ─── Frame source ────────────────────────────────────────────────────────────
+
+bool mediaNextVideoFrame(PHS_VIDEO_FRAME frame, bool keyframeRequired,
+                         int width, int height, int bitrateKbps, int fps) {
+    if (fileData == NULL) {
+        int frameSize = (int)((int64_t)bitrateKbps * 1000 / 8 / (fps > 0 ? fps : 60));
+
+        frame->keyframe = keyframeRequired || syntheticFrameNumber == 0 ||
+                          (Config.gopFrames > 0 && syntheticFrameNumber % Config.gopFrames == 0);
+        frame->length = writeSyntheticFrame(width, height, frameSize, frame->keyframe);
+        frame->data = syntheticBuffer;
+        syntheticFrameNumber++;
+        return frame->length > 0;
+    }
+
+    // Serve IDR requests by skipping ahead to the next keyframe
+    if (keyframeRequired) {
+        while (!frames[nextFrame].keyframe) {
+            nextFrame = (nextFrame + 1) % frameCount;
+        }
+    }
+
+    frame->data = &fileData[frames[nextFrame].offset];
+    frame->length = frames[nextFrame].length;
+    frame->keyframe = frames[nextFrame].keyframe;
+
+    // Loop back to the first keyframe at the end of the file
+    nextFrame++;
+    if (nextFrame == frameCount) {
+        nextFrame = firstKeyframe;
+    }
+
+    return true;
+}
@@ -0,0 +1,862 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Microbenchmarks of moonlight-common-c's per-packet primitives. Each case runs
+// on synthetic input shaped like a 1080p60 stream, and prints one JSON object per
+// line so results can be compared between builds.
+
+#include "Limelight-internal.h"
+#include "Rtsp.h"
+#include "rs.h"
+
+#include <opus_multistream.h>
+
+#include <getopt.h>
+#include <math.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEFAULT_MIN_TIME_MS 500
+
+// A 1392 byte video packet, as sent by the host
+#define VIDEO_PACKET_SIZE 1392
+#define RTP_HEADER_LENGTH 16 // Fixed header and the 4 byte extension
+#define SHARD_SIZE (VIDEO_PACKET_SIZE + RTP_HEADER_LENGTH)
+
+// Referenced by the SDP generator; 0 keeps the library's default
+int g_AudioPacketDurationOverride;
+
+typedef void (*BenchFunction)(void* context, uint64_t iterations);
+
+static const char* filter;
+static uint64_t minTimeNs = DEFAULT_MIN_TIME_MS * 1000000ULL;
+static bool listOnly;
+
+static uint64_t getNanoseconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ((uint64_t)ts.tv_sec * 1000000000) + ts.tv_nsec;
+}
+
+static uint64_t timeIterations(BenchFunction function, void* context, uint64_t iterations) {
+    uint64_t startNs = getNanoseconds();
+
+    function(context, iterations);
+    return getNanoseconds() - startNs;
+}
+
+// Runs a case in batches for at least the minimum time and prints its result.
+// bytesPerOp is the payload processed per iteration, or 0 if it has none.
+static void runBenchmark(const char* name, const char* params, BenchFunction function, void* context,
+                         size_t bytesPerOp) {
+    char fullName[128];
+    uint64_t iterations = 1;
+    uint64_t totalNs = 0;
+    uint64_t totalOps = 0;
+    double bestNsPerOp = 0;
+    int batches = 0;
+
+    snprintf(fullName, sizeof(fullName), "%s/%s", name, params);
+    if (filter != NULL && strstr(fullName, filter) == NULL) {
+        return;
+    }
+    if (listOnly) {
+        printf("%s\n", fullName);
+        return;
+    }
+
+    // Grow the batch until it takes a tenth of the minimum time, which also warms up
+    // the caches and allocator
+    for (;;) {
+        uint64_t elapsedNs = timeIterations(function, context, iterations);
+
+        if (elapsedNs >= minTimeNs / 10) {
+            break;
+        }
+        iterations *= elapsedNs < minTimeNs / 1000 ? 10 : 2;
+    }
+
+    while (totalNs < minTimeNs || batches < 3) {
+        uint64_t elapsedNs = timeIterations(function, context, iterations);
+        double nsPerOp = (double)elapsedNs / iterations;
+
+        if (batches == 0 || nsPerOp < bestNsPerOp) {
+            bestNsPerOp = nsPerOp;
+        }
+        totalNs += elapsedNs;
+        totalOps += iterations;
+        batches++;
+    }
+
+    printf("{\"benchmark\":\"%s\",\"params\":\"%s\",\"iterations\":%llu,"
+           "\"ns_per_op\":%.1f,\"min_ns_per_op\":%.1f,\"ops_per_sec\":%.0f",
+           name, params, (unsigned long long)totalOps,
+           (double)totalNs / totalOps, bestNsPerOp, totalOps * 1e9 / totalNs);
+    if (bytesPerOp != 0) {
+        printf(",\"mb_per_sec\":%.1f", (double)bytesPerOp * totalOps * 1000.0 / totalNs);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+// Input without zero bytes, so it never contains an Annex B start sequence
+static void fillRandom(unsigned char* data, size_t length) {
+    for (size_t i = 0; i < length; i++) {
+        data[i] = (unsigned char)(1 + rand() % 255);
+    }
+}
+
+// ─── Reed-Solomon ────────────────────────────────────────────────────────────
+
+typedef struct _RS_CONTEXT {
+    reed_solomon* rs;
+    int dataShards;
+    int parityShards;
+    int lostShards;
+    unsigned char* buffer;
+    unsigned char* shards[DATA_SHARDS_MAX];
+    unsigned char marks[DATA_SHARDS_MAX];
+} RS_CONTEXT, *PRS_CONTEXT;
+
+static void benchReedSolomonReconstruct(void* context, uint64_t iterations) {
+    PRS_CONTEXT rs = context;
+    int totalShards = rs->dataShards + rs->parityShards;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        // Lose data shards spread across the block, as burst loss is spread over FEC blocks
+        memset(rs->marks, 0, totalShards);
+        for (int j = 0; j < rs->lostShards; j++) {
+            rs->marks[j * rs->dataShards / rs->lostShards] = 1;
+        }
+
+        reed_solomon_reconstruct(rs->rs, rs->shards, rs->marks, totalShards, SHARD_SIZE);
+    }
+}
+
+static void benchReedSolomonNew(void* context, uint64_t iterations) {
+    PRS_CONTEXT rs = context;
+
+    // The video queue creates a codec for each frame it recovers
+    for (uint64_t i = 0; i < iterations; i++) {
+        reed_solomon_release(reed_solomon_new(rs->dataShards, rs->parityShards));
+    }
+}
+
+static void runReedSolomonBenchmarks(void) {
+    static const int shapes[][2] = { { 4, 1 }, { 16, 4 }, { 32, 8 }, { 100, 20 }, { 200, 50 } };
+    RS_CONTEXT rs;
+    char params[64];
+
+    reed_solomon_init();
+
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) {
+        int losses[3];
+        int totalShards;
+
+        memset(&rs, 0, sizeof(rs));
+        rs.dataShards = shapes[i][0];
+        rs.parityShards = shapes[i][1];
+        totalShards = rs.dataShards + rs.parityShards;
+
+        rs.rs = reed_solomon_new(rs.dataShards, rs.parityShards);
+        rs.buffer = malloc((size_t)totalShards * SHARD_SIZE);
+        if (rs.rs == NULL || rs.buffer == NULL) {
+            fprintf(stderr, "Failed to set up Reed-Solomon with %d+%d shards\n", rs.dataShards, rs.parityShards);
+            exit(1);
+        }
+        for (int j = 0; j < totalShards; j++) {
+            rs.shards[j] = &rs.buffer[j * SHARD_SIZE];
+        }
+        fillRandom(rs.buffer, (size_t)rs.dataShards * SHARD_SIZE);
+        reed_solomon_encode(rs.rs, rs.shards, totalShards, SHARD_SIZE);
+
+        losses[0] = 1;
+        losses[1] = rs.parityShards / 2 > 1 ? rs.parityShards / 2 : 0;
+        losses[2] = rs.parityShards > 1 ? rs.parityShards : 0;
+        for (int j = 0; j < 3; j++) {
+            if (losses[j] == 0) {
+                continue;
+            }
+            rs.lostShards = losses[j];
+            snprintf(params, sizeof(params), "data=%d,parity=%d,lost=%d", rs.dataShards, rs.parityShards, rs.lostShards);
+            runBenchmark("rs_reconstruct", params, benchReedSolomonReconstruct, &rs,
+                         (size_t)rs.dataShards * SHARD_SIZE);
+        }
+
+        snprintf(params, sizeof(params), "data=%d,parity=%d", rs.dataShards, rs.parityShards);
+        runBenchmark("rs_new", params, benchReedSolomonNew, &rs, 0);
+
+        reed_solomon_release(rs.rs);
+        free(rs.buffer);
+    }
+}
+
+// ─── Linked blocking queue ───────────────────────────────────────────────────
+
+#define LBQ_BOUND 30
+#define LBQ_MAX_PRODUCERS 8
+
+typedef struct _LBQ_CONTEXT {
+    LINKED_BLOCKING_QUEUE queue;
+    LINKED_BLOCKING_QUEUE_ENTRY* entries;
+    int producers;
+    uint64_t itemsPerProducer;
+} LBQ_CONTEXT, *PLBQ_CONTEXT;
+
+typedef struct _LBQ_PRODUCER {
+    PLBQ_CONTEXT lbq;
+    int index;
+} LBQ_PRODUCER, *PLBQ_PRODUCER;
+
+static void benchLbqUncontended(void* context, uint64_t iterations) {
+    PLBQ_CONTEXT lbq = context;
+    void* data;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        LbqOfferQueueItem(&lbq->queue, lbq, &lbq->entries[0]);
+        LbqPollQueueElement(&lbq->queue, &data);
+    }
+}
+
+static void* lbqProducerThreadProc(void* context) {
+    PLBQ_PRODUCER producer = context;
+    PLBQ_CONTEXT lbq = producer->lbq;
+
+    for (uint64_t i = 0; i < lbq->itemsPerProducer; i++) {
+        // Each producer cycles through its own entries, which the consumer has
+        // released by the time the bounded queue accepts them again
+        PLINKED_BLOCKING_QUEUE_ENTRY entry = &lbq->entries[producer->index * (LBQ_BOUND + 1) + i % (LBQ_BOUND + 1)];
+
+        while (LbqOfferQueueItem(&lbq->queue, lbq, entry) == LBQ_BOUND_EXCEEDED) {
+            sched_yield();
+        }
+    }
+
+    return NULL;
+}
+
+static void benchLbqContended(void* context, uint64_t iterations) {
+    PLBQ_CONTEXT lbq = context;
+    pthread_t threads[LBQ_MAX_PRODUCERS];
+    LBQ_PRODUCER producers[LBQ_MAX_PRODUCERS];
+    void* data;
+
+    lbq->itemsPerProducer = (iterations + lbq->producers - 1) / lbq->producers;
+    for (int i = 0; i < lbq->producers; i++) {
+        producers[i].lbq = lbq;
+        producers[i].index = i;
+        pthread_create(&threads[i], NULL, lbqProducerThreadProc, &producers[i]);
+    }
+
+    // The calling thread is the consumer, like a decoder thread
+    for (uint64_t i = 0; i < lbq->itemsPerProducer * lbq->producers; i++) {
+        LbqWaitForQueueElement(&lbq->queue, &data);
+    }
+
+    for (int i = 0; i < lbq->producers; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
+static void runLbqBenchmarks(void) {
+    static const int producerCounts[] = { 1, 2, 4, 8 };
+    LBQ_CONTEXT lbq;
+    char params[64];
+
+    memset(&lbq, 0, sizeof(lbq));
+    lbq.entries = calloc(LBQ_MAX_PRODUCERS * (LBQ_BOUND + 1), sizeof(*lbq.entries));
+    if (lbq.entries == NULL || LbqInitializeLinkedBlockingQueue(&lbq.queue, LBQ_BOUND, NULL) != LBQ_SUCCESS) {
+        fprintf(stderr, "Failed to set up the queue\n");
+        exit(1);
+    }
+
+    runBenchmark("lbq_offer_poll", "threads=1", benchLbqUncontended, &lbq, 0);
+
+    for (size_t i = 0; i < sizeof(producerCounts) / sizeof(producerCounts[0]); i++) {
+        lbq.producers = producerCounts[i];
+        snprintf(params, sizeof(params), "producers=%d,consumers=1", lbq.producers);
+        runBenchmark("lbq_offer_wait", params, benchLbqContended, &lbq, 0);
+    }
+
+    LbqSignalQueueShutdown(&lbq.queue);
+    LbqDestroyLinkedBlockingQueue(&lbq.queue);
+    free(lbq.entries);
+}
+
+// ─── Byte buffer ─────────────────────────────────────────────────────────────
+
+typedef struct _BB_CONTEXT {
+    char buffer[64];
+    int byteOrder;
+    uint64_t checksum;
+} BB_CONTEXT, *PBB_CONTEXT;
+
+static void benchByteBuffer(void* context, uint64_t iterations) {
+    PBB_CONTEXT bb = context;
+    BYTE_BUFFER buffer;
+
+    // Writes and reads back a record shaped like a control stream message
+    for (uint64_t i = 0; i < iterations; i++) {
+        uint8_t value8;
+        uint16_t value16;
+        uint32_t value32;
+        uint64_t value64;
+
+        BbInitializeWrappedBuffer(&buffer, bb->buffer, 0, sizeof(bb->buffer), bb->byteOrder);
+        BbPut16(&buffer, 0x0302);
+        BbPut16(&buffer, 36);
+        BbPut8(&buffer, (uint8_t)i);
+        BbPut32(&buffer, (uint32_t)i);
+        BbPut32(&buffer, (uint32_t)(i * 3));
+        BbPut64(&buffer, i * 7);
+        BbPut64(&buffer, i * 11);
+        BbPut32(&buffer, 0);
+
+        BbInitializeWrappedBuffer(&buffer, bb->buffer, 0, sizeof(bb->buffer), bb->byteOrder);
+        BbGet16(&buffer, &value16);
+        bb->checksum += value16;
+        BbGet16(&buffer, &value16);
+        bb->checksum += value16;
+        BbGet8(&buffer, &value8);
+        bb->checksum += value8;
+        BbGet32(&buffer, &value32);
+        bb->checksum += value32;
+        BbGet32(&buffer, &value32);
+        bb->checksum += value32;
+        BbGet64(&buffer, &value64);
+        bb->checksum += value64;
+        BbGet64(&buffer, &value64);
+        bb->checksum += value64;
+        BbGet32(&buffer, &value32);
+        bb->checksum += value32;
+    }
+}
+
+static void runByteBufferBenchmarks(void) {
+    BB_CONTEXT bb;
+
+    memset(&bb, 0, sizeof(bb));
+    bb.byteOrder = BYTE_ORDER_LITTLE;
+    runBenchmark("bytebuffer_put_get", "order=little,fields=8", benchByteBuffer, &bb, 0);
+    bb.byteOrder = BYTE_ORDER_BIG;
+    runBenchmark("bytebuffer_put_get", "order=big,fields=8", benchByteBuffer, &bb, 0);
+}
+
+// ─── Decryption ──────────────────────────────────────────────────────────────
+
+typedef struct _CRYPTO_CONTEXT {
+    PPLT_CRYPTO_CONTEXT ctx;
+    int algorithm;
+    int flags;
+    unsigned char key[16];
+    unsigned char iv[16];
+    int ivLength;
+    unsigned char tag[16];
+    unsigned char plaintext[VIDEO_PACKET_SIZE + 16];
+    unsigned char ciphertext[VIDEO_PACKET_SIZE + 32];
+    int ciphertextLength;
+    unsigned char output[VIDEO_PACKET_SIZE + 32];
+} CRYPTO_CONTEXT, *PCRYPTO_CONTEXT;
+
+static bool decryptPacket(PCRYPTO_CONTEXT crypto) {
+    int outputLength = sizeof(crypto->output);
+
+    return PltDecryptMessage(crypto->ctx, crypto->algorithm, crypto->flags,
+                             crypto->key, sizeof(crypto->key),
+                             crypto->iv, crypto->ivLength,
+                             crypto->algorithm == ALGORITHM_AES_GCM ? crypto->tag : NULL,
+                             crypto->algorithm == ALGORITHM_AES_GCM ? sizeof(crypto->tag) : 0,
+                             crypto->ciphertext, crypto->ciphertextLength,
+                             crypto->output, &outputLength);
+}
+
+static void benchDecrypt(void* context, uint64_t iterations) {
+    PCRYPTO_CONTEXT crypto = context;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        decryptPacket(crypto);
+    }
+}
+
+// Encrypts a packet the way the host does, and checks that it decrypts
+static void setUpCrypto(PCRYPTO_CONTEXT crypto, int algorithm, int plaintextLength) {
+    PPLT_CRYPTO_CONTEXT encryptionCtx = PltCreateCryptoContext();
+
+    memset(crypto, 0, sizeof(*crypto));
+    crypto->ctx = PltCreateCryptoContext();
+    crypto->algorithm = algorithm;
+    PltGenerateRandomData(crypto->key, sizeof(crypto->key));
+    PltGenerateRandomData(crypto->iv, sizeof(crypto->iv));
+    fillRandom(crypto->plaintext, plaintextLength);
+
+    crypto->ciphertextLength = sizeof(crypto->ciphertext);
+    if (algorithm == ALGORITHM_AES_GCM) {
+        // Video packets
+        crypto->ivLength = 12;
+        crypto->flags = 0;
+        if (!PltEncryptMessage(encryptionCtx, algorithm, 0, crypto->key, sizeof(crypto->key),
+                               crypto->iv, crypto->ivLength, crypto->tag, sizeof(crypto->tag),
+                               crypto->plaintext, plaintextLength,
+                               crypto->ciphertext, &crypto->ciphertextLength)) {
+            crypto->ciphertextLength = 0;
+        }
+    }
+    else {
+        // Audio packets
+        crypto->ivLength = 16;
+        crypto->flags = CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH;
+        if (!PltEncryptMessage(encryptionCtx, algorithm, CIPHER_FLAG_RESET_IV | CIPHER_FLAG_FINISH | CIPHER_FLAG_PAD_TO_BLOCK_SIZE,
+                               crypto->key, sizeof(crypto->key), crypto->iv, crypto->ivLength, NULL, 0,
+                               crypto->plaintext, plaintextLength,
+                               crypto->ciphertext, &crypto->ciphertextLength)) {
+            crypto->ciphertextLength = 0;
+        }
+    }
+
+    PltDestroyCryptoContext(encryptionCtx);
+
+    if (crypto->ciphertextLength == 0 || !decryptPacket(crypto) ||
+            memcmp(crypto->output, crypto->plaintext, plaintextLength) != 0) {
+        fprintf(stderr, "Failed to set up %s decryption\n", algorithm == ALGORITHM_AES_GCM ? "GCM" : "CBC");
+        exit(1);
+    }
+}
+
+static void runCryptoBenchmarks(void) {
+    static const int audioLengths[] = { 128, 480 };
+    CRYPTO_CONTEXT crypto;
+    char params[64];
+
+    setUpCrypto(&crypto, ALGORITHM_AES_GCM, VIDEO_PACKET_SIZE);
+    snprintf(params, sizeof(params), "aes128_gcm,bytes=%d", VIDEO_PACKET_SIZE);
+    runBenchmark("decrypt", params, benchDecrypt, &crypto, VIDEO_PACKET_SIZE);
+    PltDestroyCryptoContext(crypto.ctx);
+
+    for (size_t i = 0; i < sizeof(audioLengths) / sizeof(audioLengths[0]); i++) {
+        setUpCrypto(&crypto, ALGORITHM_AES_CBC, audioLengths[i]);
+        snprintf(params, sizeof(params), "aes128_cbc,bytes=%d", audioLengths[i]);
+        runBenchmark("decrypt", params, benchDecrypt, &crypto, audioLengths[i]);
+        PltDestroyCryptoContext(crypto.ctx);
+    }
+}
+
+// ─── RTSP and SDP ────────────────────────────────────────────────────────────
+
+static const char rtspDescribeResponse[] =
+    "RTSP/1.0 200 OK\r\n"
+    "CSeq: 3\r\n"
+    "Content-Type: application/sdp\r\n"
+    "Session: DEADBEEFCAFE;timeout = 90\r\n"
+    "Content-Length: 312\r\n"
+    "\r\n"
+    "v=0\r\n"
+    "o=android 2054093440 1 IN IPv4 192.168.1.10\r\n"
+    "s=NVIDIA Streaming Client\r\n"
+    "a=sprop-parameter-sets=AAAAAWdkAB+s2UBQBbsBEAAAAwAQAAADA8DxgxmgAAAAAWjr48siwA==\r\n"
+    "a=rtpmap:98 H264/90000\r\n"
+    "a=fmtp:97 surround-params=21101\r\n"
+    "a=fmtp:97 surround-params=642012453\r\n"
+    "a=fmtp:97 surround-params=85301245367\r\n"
+    "a=x-ss-general.featureFlags:3\r\n"
+    "a=x-ss-general.encryptionSupported:7\r\n"
+    "a=x-ss-general.encryptionRequested:0\r\n";
+
+static void benchParseRtsp(void* context, uint64_t iterations) {
+    RTSP_MESSAGE message;
+
+    (void)context;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        if (parseRtspMessage(&message, (char*)rtspDescribeResponse, sizeof(rtspDescribeResponse) - 1) == RTSP_ERROR_SUCCESS) {
+            freeMessage(&message);
+        }
+    }
+}
+
+static void benchSdpPayload(void* context, uint64_t iterations) {
+    int length;
+
+    (void)context;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        free(getSdpPayloadForStreamConfig(14, &length));
+    }
+}
+
+static void setUpStreamConfig(void) {
+    struct sockaddr_in* addr = (struct sockaddr_in*)&RemoteAddr;
+
+    LiInitializeStreamConfiguration(&StreamConfig);
+    StreamConfig.width = 1920;
+    StreamConfig.height = 1080;
+    StreamConfig.fps = 60;
+    StreamConfig.bitrate = 20000;
+    StreamConfig.packetSize = VIDEO_PACKET_SIZE;
+    StreamConfig.streamingRemotely = STREAM_CFG_LOCAL;
+    StreamConfig.audioConfiguration = AUDIO_CONFIGURATION_STEREO;
+    StreamConfig.supportedVideoFormats = VIDEO_FORMAT_H264;
+    StreamConfig.encryptionFlags = ENCFLG_NONE;
+    NegotiatedVideoFormat = VIDEO_FORMAT_H264;
+
+    // A Sunshine host
+    AppVersionQuad[0] = 7;
+    AppVersionQuad[1] = 1;
+    AppVersionQuad[2] = 431;
+    AppVersionQuad[3] = -1;
+
+    memset(&RemoteAddr, 0, sizeof(RemoteAddr));
+    addr->sin_family = AF_INET;
+    addr->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    AddrLen = sizeof(*addr);
+
+    // The default ports, as negotiated with the host over RTSP
+    RtspPortNumber = 48010;
+    ControlPortNumber = 47999;
+    AudioPortNumber = 48000;
+    VideoPortNumber = 47998;
+}
+
+static void runRtspBenchmarks(void) {
+    char params[64];
+    int length;
+    char* sdp;
+
+    snprintf(params, sizeof(params), "describe_response,bytes=%d", (int)sizeof(rtspDescribeResponse) - 1);
+    runBenchmark("rtsp_parse", params, benchParseRtsp, NULL, sizeof(rtspDescribeResponse) - 1);
+
+    sdp = getSdpPayloadForStreamConfig(14, &length);
+    if (sdp == NULL) {
+        fprintf(stderr, "Failed to generate the SDP payload\n");
+        exit(1);
+    }
+    free(sdp);
+    snprintf(params, sizeof(params), "1080p60_h264,bytes=%d", length);
+    runBenchmark("sdp_generate", params, benchSdpPayload, NULL, 0);
+}
+
+// ─── Video depacketizer ──────────────────────────────────────────────────────
+
+#define FRAME_HEADER_LENGTH 8
+
+typedef struct _DEPACKETIZER_CONTEXT {
+    int packetsPerFrame;
+    int packetLength;
+    unsigned char idrPacket[RTP_HEADER_LENGTH + VIDEO_PACKET_SIZE];
+    unsigned char packet[RTP_HEADER_LENGTH + VIDEO_PACKET_SIZE];
+    uint32_t frameIndex;
+    uint32_t streamPacketIndex;
+    int packetInFrame;
+    uint64_t frames;
+} DEPACKETIZER_CONTEXT, *PDEPACKETIZER_CONTEXT;
+
+static uint64_t submittedFrames;
+
+static int submitDecodeUnit(PDECODE_UNIT decodeUnit) {
+    (void)decodeUnit;
+
+    submittedFrames++;
+    return DR_OK;
+}
+
+// Copies a template packet into a fresh buffer as the receive thread does, and
+// hands it to the depacketizer
+static void queueVideoPacket(PDEPACKETIZER_CONTEXT depacketizer, const unsigned char* template) {
+    char* buffer = malloc(depacketizer->packetLength + sizeof(RTPV_QUEUE_ENTRY));
+    PRTPV_QUEUE_ENTRY entry;
+    PNV_VIDEO_PACKET nvPacket;
+    uint8_t flags = FLAG_CONTAINS_PIC_DATA;
+
+    if (buffer == NULL) {
+        return;
+    }
+    memcpy(buffer, template, depacketizer->packetLength);
+
+    if (depacketizer->packetInFrame == 0) {
+        flags |= FLAG_SOF;
+    }
+    if (depacketizer->packetInFrame == depacketizer->packetsPerFrame - 1) {
+        flags |= FLAG_EOF;
+    }
+
+    nvPacket = (PNV_VIDEO_PACKET)&buffer[RTP_HEADER_LENGTH];
+    nvPacket->streamPacketIndex = depacketizer->streamPacketIndex++ << 8;
+    nvPacket->frameIndex = depacketizer->frameIndex;
+    nvPacket->flags = flags;
+
+    entry = (PRTPV_QUEUE_ENTRY)&buffer[depacketizer->packetLength];
+    memset(entry, 0, sizeof(*entry));
+    entry->packet = (PRTP_PACKET)buffer;
+    entry->length = depacketizer->packetLength;
+    entry->receiveTimeMs = PltGetMillis();
+    entry->presentationTimeMs = depacketizer->frameIndex * 1000 / 60;
+
+    queueRtpPacket(entry);
+
+    if (++depacketizer->packetInFrame == depacketizer->packetsPerFrame) {
+        depacketizer->packetInFrame = 0;
+        depacketizer->frameIndex++;
+        depacketizer->frames++;
+    }
+}
+
+static void benchDepacketizer(void* context, uint64_t iterations) {
+    PDEPACKETIZER_CONTEXT depacketizer = context;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        queueVideoPacket(depacketizer, depacketizer->packetInFrame == 0 ? depacketizer->idrPacket : depacketizer->packet);
+    }
+}
+
+// Writes the RTP and NV_VIDEO_PACKET headers of a single-block frame packet
+static void writeVideoHeaders(unsigned char* packet) {
+    PNV_VIDEO_PACKET nvPacket = (PNV_VIDEO_PACKET)&packet[RTP_HEADER_LENGTH];
+
+    memset(packet, 0, RTP_HEADER_LENGTH + sizeof(*nvPacket));
+    packet[0] = 0x90; // RTP with the extension bit set
+    nvPacket->multiFecFlags = 0x10;
+    nvPacket->multiFecBlocks = 0;
+}
+
+static void runDepacketizerBenchmarks(void) {
+    static const unsigned char sps[] = { 0, 0, 0, 1, 0x67, 0x64, 0x00, 0x2a, 0xac, 0x2c, 0x6a, 0x81, 0xe0, 0x08, 0x9f, 0x96 };
+    static const unsigned char pps[] = { 0, 0, 0, 1, 0x68, 0xee, 0x3c, 0xb0 };
+    static const unsigned char idrSlice[] = { 0, 0, 0, 1, 0x65, 0x88, 0x84 };
+    static const unsigned char pSlice[] = { 0, 0, 0, 1, 0x41, 0x9a, 0x02 };
+    static const int frameSizes[] = { 10, 30, 100 };
+    DECODER_RENDERER_CALLBACKS callbacks;
+    DEPACKETIZER_CONTEXT depacketizer;
+    unsigned char* payload;
+    int offset;
+    char params[64];
+
+    LiInitializeVideoCallbacks(&callbacks);
+    callbacks.capabilities = CAPABILITY_DIRECT_SUBMIT;
+    callbacks.submitDecodeUnit = submitDecodeUnit;
+    VideoCallbacks = callbacks;
+    ReferenceFrameInvalidationSupported = false;
+
+    for (size_t i = 0; i < sizeof(frameSizes) / sizeof(frameSizes[0]); i++) {
+        memset(&depacketizer, 0, sizeof(depacketizer));
+        depacketizer.packetsPerFrame = frameSizes[i];
+        depacketizer.packetLength = RTP_HEADER_LENGTH + VIDEO_PACKET_SIZE;
+        depacketizer.frameIndex = 1;
+
+        // The first packet of each frame starts with the frame header and a slice
+        writeVideoHeaders(depacketizer.idrPacket);
+        payload = &depacketizer.idrPacket[RTP_HEADER_LENGTH + sizeof(NV_VIDEO_PACKET)];
+        fillRandom(payload, VIDEO_PACKET_SIZE - sizeof(NV_VIDEO_PACKET));
+        payload[0] = 0x01;
+        payload[1] = 0;
+        payload[2] = 0;
+        payload[3] = 2; // IDR frame
+        payload[4] = (VIDEO_PACKET_SIZE - sizeof(NV_VIDEO_PACKET)) & 0xFF;
+        payload[5] = (VIDEO_PACKET_SIZE - sizeof(NV_VIDEO_PACKET)) >> 8;
+        payload[6] = 0;
+        payload[7] = 0;
+        offset = FRAME_HEADER_LENGTH;
+        memcpy(&payload[offset], sps, sizeof(sps));
+        offset += sizeof(sps);
+        memcpy(&payload[offset], pps, sizeof(pps));
+        offset += sizeof(pps);
+        memcpy(&payload[offset], idrSlice, sizeof(idrSlice));
+
+        writeVideoHeaders(depacketizer.packet);
+        fillRandom(&depacketizer.packet[RTP_HEADER_LENGTH + sizeof(NV_VIDEO_PACKET)],
+                   VIDEO_PACKET_SIZE - sizeof(NV_VIDEO_PACKET));
+
+        initializeVideoDepacketizer(VIDEO_PACKET_SIZE);
+
+        // Start the stream with an IDR frame, then send P-frames
+        for (int j = 0; j < depacketizer.packetsPerFrame; j++) {
+            queueVideoPacket(&depacketizer, depacketizer.idrPacket);
+        }
+        payload = &depacketizer.idrPacket[RTP_HEADER_LENGTH + sizeof(NV_VIDEO_PACKET)];
+        payload[3] = 1; // P-frame
+        memcpy(&payload[FRAME_HEADER_LENGTH], pSlice, sizeof(pSlice));
+        memset(&payload[FRAME_HEADER_LENGTH + sizeof(pSlice)], 0x5a, sizeof(sps) + sizeof(pps) + sizeof(idrSlice) - sizeof(pSlice));
+
+        submittedFrames = 0;
+        snprintf(params, sizeof(params), "h264,packets_per_frame=%d", depacketizer.packetsPerFrame);
+        runBenchmark("depacketize_packet", params, benchDepacketizer, &depacketizer, VIDEO_PACKET_SIZE);
+
+        // Every frame must have reached the decoder
+        if (!listOnly && submittedFrames + 1 < depacketizer.frames) {
+            fprintf(stderr, "Depacketizer dropped frames: %llu of %llu submitted\n",
+                    (unsigned long long)submittedFrames, (unsigned long long)depacketizer.frames);
+            exit(1);
+        }
+
+        destroyVideoDepacketizer();
+    }
+}
+
+// ─── Opus ────────────────────────────────────────────────────────────────────
+
+#define OPUS_BENCH_PACKETS 100
+#define OPUS_SAMPLE_RATE 48000
+
+typedef struct _OPUS_LAYOUT {
+    const char* name;
+    int channels;
+    int streams;
+    int coupledStreams;
+    unsigned char mapping[8];
+    int bitrate;
+} OPUS_LAYOUT;
+
+typedef struct _OPUS_CONTEXT {
+    OpusMSDecoder* decoder;
+    int channels;
+    int samplesPerFrame;
+    unsigned char packets[OPUS_BENCH_PACKETS][1400];
+    int packetLengths[OPUS_BENCH_PACKETS];
+    opus_int16 pcm[OPUS_SAMPLE_RATE / 100 * 8];
+    int nextPacket;
+    uint64_t decodedSamples;
+} OPUS_CONTEXT, *POPUS_CONTEXT;
+
+static void benchOpusDecode(void* context, uint64_t iterations) {
+    POPUS_CONTEXT opus = context;
+
+    for (uint64_t i = 0; i < iterations; i++) {
+        opus->decodedSamples += opus_multistream_decode(opus->decoder, opus->packets[opus->nextPacket],
+                                                        opus->packetLengths[opus->nextPacket],
+                                                        opus->pcm, opus->samplesPerFrame, 0);
+        opus->nextPacket = (opus->nextPacket + 1) % OPUS_BENCH_PACKETS;
+    }
+}
+
+static void runOpusBenchmarks(void) {
+    // The layouts and bitrates of the host's normal quality audio
+    static const OPUS_LAYOUT layouts[] = {
+        { "stereo", 2, 1, 1, { 0, 1 }, 96000 },
+        { "5.1", 6, 4, 2, { 0, 4, 1, 5, 2, 3 }, 256000 },
+        { "7.1", 8, 5, 3, { 0, 6, 1, 7, 2, 3, 4, 5 }, 450000 },
+    };
+    static const int durationsMs[] = { 5, 10 };
+    POPUS_CONTEXT opus = malloc(sizeof(*opus));
+    char params[64];
+    int err;
+
+    if (opus == NULL) {
+        exit(1);
+    }
+
+    for (size_t i = 0; i < sizeof(layouts) / sizeof(layouts[0]); i++) {
+        for (size_t j = 0; j < sizeof(durationsMs) / sizeof(durationsMs[0]); j++) {
+            const OPUS_LAYOUT* layout = &layouts[i];
+            OpusMSEncoder* encoder;
+
+            memset(opus, 0, sizeof(*opus));
+            opus->channels = layout->channels;
+            opus->samplesPerFrame = OPUS_SAMPLE_RATE * durationsMs[j] / 1000;
+
+            encoder = opus_multistream_encoder_create(OPUS_SAMPLE_RATE, layout->channels, layout->streams,
+                                                      layout->coupledStreams, layout->mapping,
+                                                      OPUS_APPLICATION_RESTRICTED_LOWDELAY, &err);
+            opus->decoder = opus_multistream_decoder_create(OPUS_SAMPLE_RATE, layout->channels, layout->streams,
+                                                            layout->coupledStreams, layout->mapping, &err);
+            if (encoder == NULL || opus->decoder == NULL) {
+                fprintf(stderr, "Failed to create the Opus %s codec: %d\n", layout->name, err);
+                exit(1);
+            }
+            opus_multistream_encoder_ctl(encoder, OPUS_SET_BITRATE(layout->bitrate));
+
+            // A different tone on each channel over noise
+            for (int packet = 0; packet < OPUS_BENCH_PACKETS; packet++) {
+                for (int sample = 0; sample < opus->samplesPerFrame; sample++) {
+                    int t = packet * opus->samplesPerFrame + sample;
+
+                    for (int channel = 0; channel < layout->channels; channel++) {
+                        opus->pcm[sample * layout->channels + channel] =
+                            (opus_int16)(8000 * sin(2 * M_PI * 220 * (channel + 1) * t / OPUS_SAMPLE_RATE) +
+                                         rand() % 1000 - 500);
+                    }
+                }
+
+                opus->packetLengths[packet] = opus_multistream_encode(encoder, opus->pcm, opus->samplesPerFrame,
+                                                                      opus->packets[packet], sizeof(opus->packets[packet]));
+                if (opus->packetLengths[packet] < 0) {
+                    fprintf(stderr, "Failed to encode Opus %s audio: %d\n", layout->name, opus->packetLengths[packet]);
+                    exit(1);
+                }
+            }
+            opus_multistream_encoder_destroy(encoder);
+
+            snprintf(params, sizeof(params), "%s,frame_ms=%d", layout->name, durationsMs[j]);
+            runBenchmark("opus_decode", params, benchOpusDecode, opus, 0);
+
+            opus_multistream_decoder_destroy(opus->decoder);
+        }
+    }
+
+    free(opus);
+}
+
+static void usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "\n"
+            "  --filter <text>      Only run the cases whose name contains the text\n"
+            "  --min-time <ms>      Minimum run time of each case (default: %d)\n"
+            "  --list               List the cases without running them\n",
+            name, DEFAULT_MIN_TIME_MS);
+}
+
+int main(int argc, char* argv[]) {
+    static const struct option longOptions[] = {
+        { "filter", required_argument, NULL, 'f' },
+        { "min-time", required_argument, NULL, 't' },
+        { "list", no_argument, NULL, 'l' },
+        { "help", no_argument, NULL, 'h' },
+        { NULL, 0, NULL, 0 }
+    };
+    int opt;
+
+    while ((opt = getopt_long(argc, argv, "h", longOptions, NULL)) != -1) {
+        switch (opt) {
+        case 'f':
+            filter = optarg;
+            break;
+        case 't':
+            minTimeNs = strtoull(optarg, NULL, 10) * 1000000;
+            break;
+        case 'l':
+            listOnly = true;
+            break;
+        default:
+            usage(argv[0]);
+            return opt == 'h' ? 0 : 1;
+        }
+    }
+
+    srand(1);
+    setUpStreamConfig();
+
+    runReedSolomonBenchmarks();
+    runLbqBenchmarks();
+    runByteBufferBenchmarks();
+    runCryptoBenchmarks();
+    runRtspBenchmarks();
+    runDepacketizerBenchmarks();
+    runOpusBenchmarks();
+
+    return 0;
+}
@@ -0,0 +1,372 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Host side of the GameStream pairing handshake (see libgamestream/pairing.c
+// for the client side). Pairings only live as long as the process.
+
+#include "hostsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <openssl/pem.h>
+#include <openssl/rand.h>
+#include <openssl/rsa.h>
+#include <openssl/sha.h>
+
+#define MAX_PAIRED_CLIENTS 16
+
+X509* ServerCert;
+EVP_PKEY* ServerKey;
+
+static pthread_mutex_t pairingLock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned char pairedFingerprints[MAX_PAIRED_CLIENTS][SHA256_DIGEST_LENGTH];
+static int pairedCount;
+
+// State of the pairing attempt in progress
+static X509* clientCert;
+static unsigned char aesKey[16];
+static unsigned char serverSecret[16];
+static unsigned char serverChallenge[16];
+static unsigned char clientHash[32];
+static int pairingPhase;
+
+static pthread_mutex_t stateLock = PTHREAD_MUTEX_INITIALIZER;
+
+// GameStream encrypts the handshake with AES-128 in ECB mode, 16 bytes at a time
+static bool aesEcb(bool encrypt, const unsigned char* in, unsigned char* out, int length) {
+    EVP_CIPHER_CTX* ctx = EVP_CIPHER_CTX_new();
+    int outLength;
+    bool ret = ctx != NULL &&
+               EVP_CipherInit_ex(ctx, EVP_aes_128_ecb(), NULL, aesKey, NULL, encrypt ? 1 : 0) == 1 &&
+               EVP_CIPHER_CTX_set_padding(ctx, 0) == 1 &&
+               EVP_CipherUpdate(ctx, out, &outLength, in, length) == 1 &&
+               outLength == length;
+
+    EVP_CIPHER_CTX_free(ctx);
+    return ret;
+}
+
+static bool generateCertificate(void) {
+    EVP_PKEY_CTX* ctx;
+    X509_NAME* name;
+
+    ctx = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, NULL);
+    if (ctx == NULL ||
+            EVP_PKEY_keygen_init(ctx) <= 0 ||
+            EVP_PKEY_CTX_set_rsa_keygen_bits(ctx, 2048) <= 0 ||
+            EVP_PKEY_keygen(ctx, &ServerKey) <= 0) {
+        EVP_PKEY_CTX_free(ctx);
+        return false;
+    }
+    EVP_PKEY_CTX_free(ctx);
+
+    ServerCert = X509_new();
+    X509_set_version(ServerCert, 2);
+    ASN1_INTEGER_set(X509_get_serialNumber(ServerCert), 0);
+    X509_gmtime_adj(X509_getm_notBefore(ServerCert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(ServerCert), 60 * 60 * 24 * 365 * 10L);
+    X509_set_pubkey(ServerCert, ServerKey);
+
+    name = X509_get_subject_name(ServerCert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, (const unsigned char*)"NVIDIA GameStream Server", -1, -1, 0);
+    X509_set_issuer_name(ServerCert, name);
+
+    // The pairing handshake hashes the 256 byte signature of a 2048-bit key
+    return X509_sign(ServerCert, ServerKey, EVP_sha256()) > 0;
+}
+
+bool pairingInit(void) {
+    if (!generateCertificate()) {
+        hsLog("Failed to generate the server certificate\n");
+        return false;
+    }
+
+    return true;
+}
+
+static void fingerprint(X509* cert, unsigned char* out) {
+    unsigned int length = SHA256_DIGEST_LENGTH;
+    X509_digest(cert, EVP_sha256(), out, &length);
+}
+
+bool pairingIsClientPaired(X509* cert) {
+    unsigned char digest[SHA256_DIGEST_LENGTH];
+    bool ret = false;
+
+    if (cert == NULL) {
+        return false;
+    }
+
+    fingerprint(cert, digest);
+
+    pthread_mutex_lock(&pairingLock);
+    for (int i = 0; i < pairedCount; i++) {
+        if (!memcmp(pairedFingerprints[i], digest, sizeof(digest))) {
+            ret = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&pairingLock);
+
+    return ret;
+}
+
+void pairingUnpairAll(void) {
+    pthread_mutex_lock(&pairingLock);
+    pairedCount = 0;
+    pthread_mutex_unlock(&pairingLock);
+}
+
+static bool readPin(char* pin) {
+    if (Config.pin != NULL) {
+        memcpy(pin, Config.pin, 4);
+        return true;
+    }
+
+    hsLog("Pairing requested. Enter the PIN shown by the client: ");
+    char line[32];
+    if (fgets(line, sizeof(line), stdin) == NULL || strlen(line) < 4) {
+        return false;
+    }
+    memcpy(pin, line, 4);
+    return true;
+}
+
+static bool verifySignature(const unsigned char* data, int dataLength,
+                            const unsigned char* signature, int signatureLength, X509* cert) {
+    EVP_PKEY* pubKey = X509_get_pubkey(cert);
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    int result = -1;
+
+    if (pubKey != NULL && ctx != NULL &&
+            EVP_DigestVerifyInit(ctx, NULL, EVP_sha256(), NULL, pubKey) == 1 &&
+            EVP_DigestVerifyUpdate(ctx, data, dataLength) == 1) {
+        result = EVP_DigestVerifyFinal(ctx, signature, signatureLength);
+    }
+
+    EVP_MD_CTX_free(ctx);
+    EVP_PKEY_free(pubKey);
+    return result == 1;
+}
+
+static bool sign(const unsigned char* data, int dataLength, unsigned char* signature, size_t* signatureLength) {
+    EVP_MD_CTX* ctx = EVP_MD_CTX_new();
+    bool ret = ctx != NULL &&
+               EVP_DigestSignInit(ctx, NULL, EVP_sha256(), NULL, ServerKey) == 1 &&
+               EVP_DigestSignUpdate(ctx, data, dataLength) == 1 &&
+               EVP_DigestSignFinal(ctx, signature, signatureLength) == 1;
+
+    EVP_MD_CTX_free(ctx);
+    return ret;
+}
+
+static int failPairing(char* response, size_t responseSize, const char* reason) {
+    hsLog("Pairing failed: %s\n", reason);
+
+    X509_free(clientCert);
+    clientCert = NULL;
+    pairingPhase = 0;
+
+    return snprintf(response, responseSize, "<paired>0</paired>");
+}
+
+// Phase 1: exchange certificates and derive the AES key from the salted PIN
+static int handleGetServerCert(const char* query, char* response, size_t responseSize) {
+    char saltHex[33], certHex[8192];
+    unsigned char salt[16], saltPin[20], keyHash[32];
+    unsigned char certPem[4096];
+    int certLength;
+
+    if (hsGetQueryParam(query, "salt", saltHex, sizeof(saltHex)) == NULL ||
+            hsGetQueryParam(query, "clientcert", certHex, sizeof(certHex)) == NULL ||
+            hsHexToBytes(saltHex, salt, sizeof(salt)) != sizeof(salt) ||
+            (certLength = hsHexToBytes(certHex, certPem, sizeof(certPem))) <= 0) {
+        return failPairing(response, responseSize, "malformed getservercert");
+    }
+
+    BIO* bio = BIO_new_mem_buf(certPem, certLength);
+    X509_free(clientCert);
+    clientCert = PEM_read_bio_X509(bio, NULL, NULL, NULL);
+    BIO_free(bio);
+    if (clientCert == NULL) {
+        return failPairing(response, responseSize, "unreadable client certificate");
+    }
+
+    memcpy(saltPin, salt, sizeof(salt));
+    if (!readPin((char*)&saltPin[16])) {
+        return failPairing(response, responseSize, "no PIN entered");
+    }
+    SHA256(saltPin, sizeof(saltPin), keyHash);
+    memcpy(aesKey, keyHash, sizeof(aesKey));
+
+    // Send our certificate as hex-encoded PEM
+    BIO* mem = BIO_new(BIO_s_mem());
+    BUF_MEM* pem;
+    PEM_write_bio_X509(mem, ServerCert);
+    BIO_get_mem_ptr(mem, &pem);
+
+    char* pemHex = malloc(pem->length * 2 + 1);
+    hsBytesToHex((unsigned char*)pem->data, (int)pem->length, pemHex);
+    int ret = snprintf(response, responseSize, "<paired>1</paired><plaincert>%s</plaincert>", pemHex);
+    free(pemHex);
+    BIO_free(mem);
+
+    pairingPhase = 1;
+    return ret;
+}
+
+// Phase 2: prove knowledge of the PIN and send our own challenge
+static int handleClientChallenge(const char* query, char* response, size_t responseSize) {
+    char challengeHex[33];
+    unsigned char challengeEnc[16], challenge[16];
+    unsigned char hashInput[16 + 256 + 16];
+    unsigned char plain[48], encrypted[48];
+    char encryptedHex[97];
+    const ASN1_BIT_STRING* signature;
+
+    if (pairingPhase != 1 ||
+            hsGetQueryParam(query, "clientchallenge", challengeHex, sizeof(challengeHex)) == NULL ||
+            hsHexToBytes(challengeHex, challengeEnc, sizeof(challengeEnc)) != sizeof(challengeEnc)) {
+        return failPairing(response, responseSize, "unexpected clientchallenge");
+    }
+
+    if (!aesEcb(false, challengeEnc, challenge, sizeof(challenge))) {
+        return failPairing(response, responseSize, "decryption failed");
+    }
+
+    RAND_bytes(serverSecret, sizeof(serverSecret));
+    RAND_bytes(serverChallenge, sizeof(serverChallenge));
+
+    X509_get0_signature(&signature, NULL, ServerCert);
+    memcpy(hashInput, challenge, 16);
+    memcpy(hashInput + 16, signature->data, 256);
+    memcpy(hashInput + 16 + 256, serverSecret, 16);
+    SHA256(hashInput, sizeof(hashInput), plain);
+    memcpy(plain + 32, serverChallenge, 16);
+
+    if (!aesEcb(true, plain, encrypted, sizeof(plain))) {
+        return failPairing(response, responseSize, "encryption failed");
+    }
+    hsBytesToHex(encrypted, sizeof(encrypted), encryptedHex);
+
+    pairingPhase = 2;
+    return snprintf(response, responseSize, "<paired>1</paired><challengeresponse>%s</challengeresponse>", encryptedHex);
+}
+
+// Phase 3: store the client's hash and send our signed secret
+static int handleServerChallengeResp(const char* query, char* response, size_t responseSize) {
+    char hashHex[65];
+    unsigned char hashEnc[32];
+    unsigned char secret[16 + 256];
+    char secretHex[sizeof(secret) * 2 + 1];
+    size_t signatureLength = 256;
+
+    if (pairingPhase != 2 ||
+            hsGetQueryParam(query, "serverchallengeresp", hashHex, sizeof(hashHex)) == NULL ||
+            hsHexToBytes(hashHex, hashEnc, sizeof(hashEnc)) != sizeof(hashEnc)) {
+        return failPairing(response, responseSize, "unexpected serverchallengeresp");
+    }
+
+    if (!aesEcb(false, hashEnc, clientHash, sizeof(hashEnc))) {
+        return failPairing(response, responseSize, "decryption failed");
+    }
+
+    memcpy(secret, serverSecret, 16);
+    if (!sign(serverSecret, 16, secret + 16, &signatureLength) || signatureLength != 256) {
+        return failPairing(response, responseSize, "signing failed");
+    }
+    hsBytesToHex(secret, sizeof(secret), secretHex);
+
+    pairingPhase = 3;
+    return snprintf(response, responseSize, "<paired>1</paired><pairingsecret>%s</pairingsecret>", secretHex);
+}
+
+// Phase 4: verify the client's secret against its earlier hash
+static int handleClientPairingSecret(const char* query, char* response, size_t responseSize) {
+    char secretHex[(16 + 256) * 2 + 1];
+    unsigned char secret[16 + 256];
+    unsigned char hashInput[16 + 256 + 16];
+    unsigned char expectedHash[32];
+    const ASN1_BIT_STRING* signature;
+
+    if (pairingPhase != 3 ||
+            hsGetQueryParam(query, "clientpairingsecret", secretHex, sizeof(secretHex)) == NULL ||
+            hsHexToBytes(secretHex, secret, sizeof(secret)) != sizeof(secret)) {
+        return failPairing(response, responseSize, "unexpected clientpairingsecret");
+    }
+
+    if (!verifySignature(secret, 16, secret + 16, 256, clientCert)) {
+        return failPairing(response, responseSize, "bad client signature");
+    }
+
+    X509_get0_signature(&signature, NULL, clientCert);
+    memcpy(hashInput, serverChallenge, 16);
+    memcpy(hashInput + 16, signature->data, 256);
+    memcpy(hashInput + 16 + 256, secret, 16);
+    SHA256(hashInput, sizeof(hashInput), expectedHash);
+    if (memcmp(expectedHash, clientHash, sizeof(expectedHash))) {
+        return failPairing(response, responseSize, "wrong PIN");
+    }
+
+    pthread_mutex_lock(&pairingLock);
+    if (pairedCount < MAX_PAIRED_CLIENTS) {
+        fingerprint(clientCert, pairedFingerprints[pairedCount++]);
+    }
+    pthread_mutex_unlock(&pairingLock);
+
+    hsLog("Client paired\n");
+
+    X509_free(clientCert);
+    clientCert = NULL;
+    pairingPhase = 0;
+    return snprintf(response, responseSize, "<paired>1</paired>");
+}
+
+// Builds the body of a /pair response (without the <root> element)
+int pairingHandleRequest(const char* query, char* response, size_t responseSize) {
+    char phrase[32];
+    int ret;
+
+    pthread_mutex_lock(&stateLock);
+    if (hsGetQueryParam(query, "phrase", phrase, sizeof(phrase)) != NULL) {
+        if (!strcmp(phrase, "getservercert")) {
+            ret = handleGetServerCert(query, response, responseSize);
+        }
+        else if (!strcmp(phrase, "pairchallenge")) {
+            ret = snprintf(response, responseSize, "<paired>1</paired>");
+        }
+        else {
+            ret = failPairing(response, responseSize, "unknown pairing phrase");
+        }
+    }
+    else if (strstr(query, "clientchallenge=") != NULL) {
+        ret = handleClientChallenge(query, response, responseSize);
+    }
+    else if (strstr(query, "serverchallengeresp=") != NULL) {
+        ret = handleServerChallengeResp(query, response, responseSize);
+    }
+    else if (strstr(query, "clientpairingsecret=") != NULL) {
+        ret = handleClientPairingSecret(query, response, responseSize);
+    }
+    else {
+        ret = failPairing(response, responseSize, "unknown pairing phase");
+    }
+    pthread_mutex_unlock(&stateLock);
+
+    return ret;
+}
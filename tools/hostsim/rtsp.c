@@ -0,0 +1,265 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// RTSP handshake over TCP. The client opens a new connection for every
+// request and reads the response until we close it.
+
+#include "hostsim.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+#define MAX_RTSP_MESSAGE_SIZE 32768
+
+static void sendRtspResponse(int sock, int status, const char* reason, int cseq,
+                             const char* extraHeaders, const char* payload) {
+    char response[4096];
+    int length;
+    int payloadLength = payload ? (int)strlen(payload) : 0;
+
+    length = snprintf(response, sizeof(response),
+                      "RTSP/1.0 %d %s\r\n"
+                      "CSeq: %d\r\n"
+                      "%s"
+                      "Content-Length: %d\r\n"
+                      "\r\n"
+                      "%s",
+                      status, reason, cseq,
+                      extraHeaders ? extraHeaders : "",
+                      payloadLength,
+                      payload ? payload : "");
+    if (length >= (int)sizeof(response)) {
+        length = (int)sizeof(response) - 1;
+    }
+
+    send(sock, response, length, 0);
+}
+
+// Looks up a header value (case-insensitive name). Returns NULL if absent.
+static const char* getHeader(const char* message, const char* name, char* value, size_t valueSize) {
+    size_t nameLength = strlen(name);
+    const char* line = strstr(message, "\r\n");
+
+    while (line != NULL && line[2] != '\r') {
+        line += 2;
+        if (!strncasecmp(line, name, nameLength) && line[nameLength] == ':') {
+            const char* start = line + nameLength + 1;
+            size_t length;
+
+            while (*start == ' ') {
+                start++;
+            }
+            length = strcspn(start, "\r\n");
+            if (length >= valueSize) {
+                length = valueSize - 1;
+            }
+            memcpy(value, start, length);
+            value[length] = 0;
+            return value;
+        }
+        line = strstr(line, "\r\n");
+    }
+
+    return NULL;
+}
+
+static int getSdpAttribute(const char* sdp, const char* name, int defaultValue) {
+    char search[128];
+    const char* attribute;
+
+    snprintf(search, sizeof(search), "a=%s:", name);
+    attribute = strstr(sdp, search);
+    if (attribute == NULL) {
+        return defaultValue;
+    }
+
+    return atoi(attribute + strlen(search));
+}
+
+static void handleDescribe(int sock, int cseq) {
+    char sdp[512];
+
+    snprintf(sdp, sizeof(sdp),
+             "v=0\r\n"
+             "o=- 0 0 IN IPv4 0.0.0.0\r\n"
+             "s=Host Simulator\r\n"
+             "%s"
+             "a=x-ss-general.featureFlags:0\r\n"
+             "a=x-ss-general.encryptionSupported:0\r\n"
+             "a=x-ss-general.encryptionRequested:0\r\n",
+             // The client detects HEVC by the VPS prefix and AV1 by its rtpmap
+             Config.codec == HS_CODEC_HEVC ? "a=sprop-parameter-sets=AAAAAU\r\n" :
+             Config.codec == HS_CODEC_AV1 ? "a=rtpmap:98 AV1/90000\r\n" : "");
+
+    sendRtspResponse(sock, 200, "OK", cseq, "Content-Type: application/sdp\r\n", sdp);
+}
+
+static void handleSetup(int sock, int cseq, const char* target) {
+    char headers[256];
+    int port;
+
+    if (strstr(target, "streamid=audio") != NULL) {
+        port = HS_AUDIO_PORT;
+    }
+    else if (strstr(target, "streamid=video") != NULL) {
+        port = HS_VIDEO_PORT;
+    }
+    else if (strstr(target, "streamid=control") != NULL) {
+        port = HS_CONTROL_PORT;
+    }
+    else {
+        sendRtspResponse(sock, 404, "Not Found", cseq, NULL, NULL);
+        return;
+    }
+
+    snprintf(headers, sizeof(headers),
+             "Session: DEADBEEFCAFE;timeout = 90\r\n"
+             "Transport: server_port=%d\r\n",
+             port);
+    sendRtspResponse(sock, 200, "OK", cseq, headers, NULL);
+}
+
+static void handleAnnounce(int sock, int cseq, const char* sdp) {
+    int format = getSdpAttribute(sdp, "x-nv-vqos[0].bitStreamFormat", HS_CODEC_H264);
+    int channels = getSdpAttribute(sdp, "x-nv-audio.surround.numChannels", 2);
+
+    if (format != Config.codec) {
+        hsLog("RTSP: client requested bitstream format %d, but the stream is %d\n", format, Config.codec);
+        sendRtspResponse(sock, 400, "Bad Request", cseq, NULL, NULL);
+        return;
+    }
+    if (channels != 2) {
+        hsLog("RTSP: only stereo audio is supported (client requested %d channels)\n", channels);
+        sendRtspResponse(sock, 400, "Bad Request", cseq, NULL, NULL);
+        return;
+    }
+
+    pthread_mutex_lock(&SessionLock);
+    Session.width = getSdpAttribute(sdp, "x-nv-video[0].clientViewportWd", 1280);
+    Session.height = getSdpAttribute(sdp, "x-nv-video[0].clientViewportHt", 720);
+    Session.fps = Config.fps ? Config.fps : getSdpAttribute(sdp, "x-nv-video[0].maxFPS", 60);
+    Session.packetSize = getSdpAttribute(sdp, "x-nv-video[0].packetSize", 1024);
+    Session.bitrateKbps = Config.syntheticKbps ? Config.syntheticKbps :
+                          getSdpAttribute(sdp, "x-nv-vqos[0].bw.maximumBitrateKbps", 10000);
+    Session.audioPacketDurationMs = getSdpAttribute(sdp, "x-nv-aqos.packetDuration", 5);
+    Session.minRequiredFecPackets = getSdpAttribute(sdp, "x-nv-vqos[0].fec.minRequiredFecPackets", 0);
+    Session.announced = true;
+    hsLog("RTSP: %dx%d %d FPS, %d Kbps, %d byte packets, %d ms audio\n",
+          Session.width, Session.height, Session.fps, Session.bitrateKbps,
+          Session.packetSize, Session.audioPacketDurationMs);
+    pthread_mutex_unlock(&SessionLock);
+
+    sendRtspResponse(sock, 200, "OK", cseq, NULL, NULL);
+}
+
+static void handleRtspConnection(int sock) {
+    char* message = malloc(MAX_RTSP_MESSAGE_SIZE);
+    char method[16], target[256], value[32];
+    char* body;
+    int length = 0;
+    int contentLength = 0;
+    int cseq;
+    bool launched;
+
+    // Read the header, then the payload if there is one
+    for (;;) {
+        int ret = (int)recv(sock, &message[length], MAX_RTSP_MESSAGE_SIZE - 1 - length, 0);
+        if (ret <= 0) {
+            free(message);
+            return;
+        }
+        length += ret;
+        message[length] = 0;
+
+        body = strstr(message, "\r\n\r\n");
+        if (body != NULL) {
+            body += 4;
+            if (getHeader(message, "Content-length", value, sizeof(value)) != NULL) {
+                contentLength = atoi(value);
+            }
+            if (length - (int)(body - message) >= contentLength || length == MAX_RTSP_MESSAGE_SIZE - 1) {
+                break;
+            }
+        }
+    }
+
+    if (sscanf(message, "%15s %255s", method, target) != 2) {
+        free(message);
+        return;
+    }
+    cseq = getHeader(message, "CSeq", value, sizeof(value)) ? atoi(value) : 0;
+
+    pthread_mutex_lock(&SessionLock);
+    launched = Session.launched;
+    pthread_mutex_unlock(&SessionLock);
+
+    if (!launched && strcmp(method, "OPTIONS") != 0) {
+        hsLog("RTSP: %s without a launched session\n", method);
+        sendRtspResponse(sock, 454, "Session Not Found", cseq, NULL, NULL);
+    }
+    else if (!strcmp(method, "OPTIONS")) {
+        sendRtspResponse(sock, 200, "OK", cseq, NULL, NULL);
+    }
+    else if (!strcmp(method, "DESCRIBE")) {
+        handleDescribe(sock, cseq);
+    }
+    else if (!strcmp(method, "SETUP")) {
+        handleSetup(sock, cseq, target);
+    }
+    else if (!strcmp(method, "ANNOUNCE")) {
+        handleAnnounce(sock, cseq, body);
+    }
+    else if (!strcmp(method, "PLAY")) {
+        pthread_mutex_lock(&SessionLock);
+        Session.playing = Session.announced;
+        pthread_mutex_unlock(&SessionLock);
+        sendRtspResponse(sock, 200, "OK", cseq, NULL, NULL);
+    }
+    else {
+        sendRtspResponse(sock, 501, "Not Implemented", cseq, NULL, NULL);
+    }
+
+    free(message);
+}
+
+static void* rtspServerThread(void* context) {
+    int listenSock = (int)(intptr_t)context;
+
+    while (!Quitting) {
+        struct timeval timeout = { 5, 0 };
+        int sock = accept(listenSock, NULL, NULL);
+        if (sock < 0) {
+            continue;
+        }
+
+        setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+        handleRtspConnection(sock);
+        close(sock);
+    }
+
+    close(listenSock);
+    return NULL;
+}
+
+bool startRtspServer(void) {
+    int listenSock = hsCreateSocket(SOCK_STREAM, HS_RTSP_PORT);
+
+    return listenSock >= 0 && hsStartThread(rtspServerThread, (void*)(intptr_t)listenSock);
+}
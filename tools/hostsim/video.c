@@ -0,0 +1,372 @@
+/*
+ * Moonlight is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * Moonlight is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with Moonlight; if not, see <http://www.gnu.org/licenses/>.
+ */
+
+// Video RTP packetizer. Frames are split into packetSize payloads with the
+// 8 byte Sunshine frame header in front, grouped into up to 4 FEC blocks and
+// protected with Reed-Solomon parity exactly as RtpVideoQueue expects it.
+
+#include "hostsim.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <sys/socket.h>
+
+#include <rs.h>
+
+#define RTP_HEADER_LENGTH 16 // Fixed header and the 4 byte extension
+#define NV_HEADER_LENGTH 16
+#define FRAME_HEADER_LENGTH 8
+
+#define FLAG_CONTAINS_PIC_DATA 0x1
+#define FLAG_EOF 0x2
+#define FLAG_SOF 0x4
+
+#define MAX_FEC_BLOCKS 4
+#define MAX_BLOCK_SHARDS DATA_SHARDS_MAX
+#define MAX_BLOCK_DATA_SHARDS 1023 // Width of the fecInfo data shard field
+
+typedef struct _VIDEO_STATE {
+    int sock;
+    uint32_t generation;
+    uint32_t frameIndex;
+    uint32_t streamPacketIndex;
+    uint16_t sequenceNumber;
+
+    uint8_t* packets;
+    int packetCapacity;
+
+    // Indexed by [dataShards][parityShards]
+    reed_solomon* rsCache[MAX_BLOCK_SHARDS + 1][MAX_BLOCK_SHARDS + 1];
+
+    uint64_t statsStartMs;
+    uint32_t statsFrames;
+    uint64_t statsBytes;
+} VIDEO_STATE, *PVIDEO_STATE;
+
+static void putLe16(uint8_t* p, uint16_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+}
+
+static void putLe32(uint8_t* p, uint32_t value) {
+    p[0] = (uint8_t)value;
+    p[1] = (uint8_t)(value >> 8);
+    p[2] = (uint8_t)(value >> 16);
+    p[3] = (uint8_t)(value >> 24);
+}
+
+static reed_solomon* getReedSolomon(PVIDEO_STATE state, int dataShards, int parityShards) {
+    if (state->rsCache[dataShards][parityShards] == NULL) {
+        state->rsCache[dataShards][parityShards] = reed_solomon_new(dataShards, parityShards);
+    }
+    return state->rsCache[dataShards][parityShards];
+}
+
+// Returns the FEC percentage to advertise for a block of dataShards so that
+// the client's parity count ((d * pct + 99) / 100) meets minRequired.
+static int getBlockFecPercentage(int dataShards, int minRequired) {
+    int fecPercentage = Config.fecPercentage;
+
+    if (fecPercentage == 0) {
+        return 0;
+    }
+
+    while ((dataShards * fecPercentage + 99) / 100 < minRequired && fecPercentage < 255) {
+        fecPercentage++;
+    }
+    return fecPercentage;
+}
+
+// Writes the RTP header and the NV_VIDEO_PACKET fields that identify the
+// packet's frame and FEC block. The client restores these itself for data
+// packets recovered from parity, so they may be stamped over parity shards.
+static void writeFecHeaders(PVIDEO_STATE state, uint8_t* packet, uint32_t timestamp,
+                            int block, int lastBlock, int dataShards, int fecIndex, int fecPercentage) {
+    // RTP with the extension bit set
+    packet[0] = 0x90;
+    packet[1] = 0;
+    packet[2] = (uint8_t)(state->sequenceNumber >> 8);
+    packet[3] = (uint8_t)state->sequenceNumber;
+    packet[4] = (uint8_t)(timestamp >> 24);
+    packet[5] = (uint8_t)(timestamp >> 16);
+    packet[6] = (uint8_t)(timestamp >> 8);
+    packet[7] = (uint8_t)timestamp;
+    memset(&packet[8], 0, 4);
+    state->sequenceNumber++;
+
+    putLe32(&packet[RTP_HEADER_LENGTH + 4], state->frameIndex);
+    packet[RTP_HEADER_LENGTH + 10] = 0x10;
+    packet[RTP_HEADER_LENGTH + 11] = (uint8_t)((lastBlock << 6) | (block << 4));
+    putLe32(&packet[RTP_HEADER_LENGTH + 12],
+            ((uint32_t)dataShards << 22) | ((uint32_t)fecIndex << 12) | ((uint32_t)fecPercentage << 4));
+}
+
+static bool sendFrame(PVIDEO_STATE state, const struct sockaddr_in* addr, PHS_VIDEO_FRAME frame,
+                      int packetSize, int minRequiredFecPackets, uint16_t hostLatency) {
+    int payloadSize = packetSize - NV_HEADER_LENGTH;
+    int shardSize = packetSize + RTP_HEADER_LENGTH;
+    int totalLength = FRAME_HEADER_LENGTH + frame->length;
+    int dataPackets = (totalLength + payloadSize - 1) / payloadSize;
+    int lastPacketLength = totalLength - (dataPackets - 1) * payloadSize;
+    uint32_t timestamp = (uint32_t)(hsGetMillis() * 90);
+    int blocks, blockShards, fecPercentage;
+    int offset = 0;
+
+    // Use the fewest FEC blocks that keep every block within the RS shard
+    // limit. Frames too large for that are sent without parity.
+    for (blocks = 1; blocks <= MAX_FEC_BLOCKS; blocks++) {
+        blockShards = (dataPackets + blocks - 1) / blocks;
+        fecPercentage = getBlockFecPercentage(blockShards, minRequiredFecPackets);
+        if (blockShards + (blockShards * fecPercentage + 99) / 100 <= MAX_BLOCK_SHARDS) {
+            break;
+        }
+    }
+    if (blocks > MAX_FEC_BLOCKS) {
+        blocks = (dataPackets + MAX_BLOCK_DATA_SHARDS - 1) / MAX_BLOCK_DATA_SHARDS;
+        if (blocks > MAX_FEC_BLOCKS) {
+            hsLog("Video: dropping %d byte frame that exceeds the maximum packet count\n", frame->length);
+            return false;
+        }
+        blockShards = (dataPackets + blocks - 1) / blocks;
+        fecPercentage = 0;
+    }
+    // Spreading the packets evenly can leave trailing blocks empty
+    blocks = (dataPackets + blockShards - 1) / blockShards;
+
+    if (state->packetCapacity < MAX_BLOCK_DATA_SHARDS * shardSize) {
+        free(state->packets);
+        state->packetCapacity = MAX_BLOCK_DATA_SHARDS * shardSize;
+        state->packets = malloc(state->packetCapacity);
+        if (state->packets == NULL) {
+            state->packetCapacity = 0;
+            return false;
+        }
+    }
+
+    for (int block = 0; block < blocks; block++) {
+        int dataShards = block < blocks - 1 ? blockShards : dataPackets - block * blockShards;
+        int blockFecPercentage = fecPercentage ? getBlockFecPercentage(dataShards, minRequiredFecPackets) : 0;
+        int parityShards = (dataShards * blockFecPercentage + 99) / 100;
+        uint8_t* shards[MAX_BLOCK_DATA_SHARDS];
+        int lengths[MAX_BLOCK_DATA_SHARDS];
+        reed_solomon* rs = NULL;
+
+        if (parityShards > 0) {
+            rs = getReedSolomon(state, dataShards, parityShards);
+            if (rs == NULL) {
+                blockFecPercentage = 0;
+                parityShards = 0;
+            }
+        }
+
+        for (int i = 0; i < dataShards; i++) {
+            uint8_t* packet = &state->packets[i * shardSize];
+            uint8_t* payload = &packet[RTP_HEADER_LENGTH + NV_HEADER_LENGTH];
+            bool lastPacket = block == blocks - 1 && i == dataShards - 1;
+            int payloadLength = lastPacket ? lastPacketLength : payloadSize;
+            uint8_t flags = FLAG_CONTAINS_PIC_DATA;
+            int copied = 0;
+
+            if (i == 0) {
+                flags |= FLAG_SOF;
+            }
+            if (i == dataShards - 1) {
+                flags |= FLAG_EOF;
+            }
+
+            memset(&packet[12], 0, 4);
+            writeFecHeaders(state, packet, timestamp, block, blocks - 1, dataShards, i, blockFecPercentage);
+            putLe32(&packet[RTP_HEADER_LENGTH], state->streamPacketIndex << 8);
+            packet[RTP_HEADER_LENGTH + 8] = flags;
+            packet[RTP_HEADER_LENGTH + 9] = 0;
+            state->streamPacketIndex++;
+
+            if (block == 0 && i == 0) {
+                uint16_t lastPayloadLength = (uint16_t)lastPacketLength;
+
+                payload[0] = 0x01;
+                putLe16(&payload[1], hostLatency);
+                payload[3] = frame->keyframe ? 2 : 1;
+                putLe16(&payload[4], lastPayloadLength);
+                payload[6] = 0;
+                payload[7] = 0;
+                copied = FRAME_HEADER_LENGTH;
+            }
+            memcpy(&payload[copied], &frame->data[offset], payloadLength - copied);
+            offset += payloadLength - copied;
+
+            // Parity is computed over zero padded shards
+            memset(&payload[payloadLength], 0, payloadSize - payloadLength);
+
+            shards[i] = packet;
+            lengths[i] = RTP_HEADER_LENGTH + NV_HEADER_LENGTH + payloadLength;
+        }
+
+        if (rs != NULL) {
+            for (int i = 0; i < parityShards; i++) {
+                shards[dataShards + i] = &state->packets[(dataShards + i) * shardSize];
+                lengths[dataShards + i] = shardSize;
+            }
+
+            reed_solomon_encode(rs, shards, dataShards + parityShards, shardSize);
+
+            for (int i = 0; i < parityShards; i++) {
+                writeFecHeaders(state, shards[dataShards + i], timestamp,
+                                block, blocks - 1, dataShards, dataShards + i, blockFecPercentage);
+            }
+        }
+
+        for (int i = 0; i < dataShards + parityShards; i++) {
+            if (sendto(state->sock, shards[i], lengths[i], 0, (const struct sockaddr*)addr, sizeof(*addr)) < 0 &&
+                    errno != EAGAIN && errno != ENOBUFS) {
+                hsLog("Video: sendto() failed: %s\n", strerror(errno));
+                return false;
+            }
+        }
+    }
+
+    state->frameIndex++;
+    state->statsFrames++;
+    state->statsBytes += frame->length;
+    return true;
+}
+
+static void receivePings(PVIDEO_STATE state, int timeoutMs) {
+    struct pollfd pfd = { .fd = state->sock, .events = POLLIN };
+    uint8_t buffer[64];
+
+    while (poll(&pfd, 1, timeoutMs) > 0) {
+        struct sockaddr_in from;
+        socklen_t fromLength = sizeof(from);
+
+        if (recvfrom(state->sock, buffer, sizeof(buffer), 0, (struct sockaddr*)&from, &fromLength) < 0) {
+            break;
+        }
+
+        pthread_mutex_lock(&SessionLock);
+        if (Session.launched && !Session.hasVideoAddr) {
+            char addrString[INET_ADDRSTRLEN];
+
+            Session.videoAddr = from;
+            Session.hasVideoAddr = true;
+            inet_ntop(AF_INET, &from.sin_addr, addrString, sizeof(addrString));
+            hsLog("Video: streaming to %s:%u\n", addrString, ntohs(from.sin_port));
+        }
+        pthread_mutex_unlock(&SessionLock);
+
+        // Drain anything else that's queued without waiting
+        timeoutMs = 0;
+    }
+}
+
+static void* videoStreamThread(void* context) {
+    PVIDEO_STATE state = context;
+    uint64_t nextFrameUs = 0;
+
+    while (!Quitting) {
+        HS_SESSION session;
+        HS_VIDEO_FRAME frame;
+        uint64_t frameStartUs;
+        uint64_t nowUs = hsGetMicros();
+        int waitMs = nextFrameUs > nowUs ? (int)((nextFrameUs - nowUs + 999) / 1000) : 0;
+
+        receivePings(state, waitMs > 0 ? waitMs : 0);
+
+        pthread_mutex_lock(&SessionLock);
+        session = Session;
+        pthread_mutex_unlock(&SessionLock);
+
+        if (!session.playing || !session.hasVideoAddr) {
+            nextFrameUs = hsGetMicros() + 10000;
+            continue;
+        }
+
+        if (session.generation != state->generation) {
+            state->generation = session.generation;
+            state->frameIndex = 1;
+            state->streamPacketIndex = 0;
+            state->sequenceNumber = 0;
+            state->statsStartMs = hsGetMillis();
+            state->statsFrames = 0;
+            state->statsBytes = 0;
+            mediaRewindVideo();
+            nextFrameUs = hsGetMicros();
+        }
+
+        nowUs = hsGetMicros();
+        if (nowUs < nextFrameUs) {
+            continue;
+        }
+
+        frameStartUs = nowUs;
+        if (!mediaNextVideoFrame(&frame, sessionRequestIdr(), session.width, session.height,
+                                 session.bitrateKbps, session.fps)) {
+            continue;
+        }
+        if (frame.keyframe) {
+            hsLog("Video: sending IDR frame %u\n", state->frameIndex);
+        }
+
+        // Host processing latency is reported in units of 100 us
+        uint64_t latencyUs = hsGetMicros() - frameStartUs;
+        sendFrame(state, &session.videoAddr, &frame, session.packetSize,
+                  session.minRequiredFecPackets, (uint16_t)(latencyUs / 100));
+
+        // Schedule from the ideal timeline so pacing doesn't drift, but don't
+        // try to catch up after a stall
+        nextFrameUs += 1000000 / session.fps;
+        if (nextFrameUs + 1000000 / session.fps < hsGetMicros()) {
+            nextFrameUs = hsGetMicros();
+        }
+
+        if (hsGetMillis() - state->statsStartMs >= 10000) {
+            uint64_t elapsedMs = hsGetMillis() - state->statsStartMs;
+            hsLog("Video: %.1f FPS, %.2f Mbps\n",
+                  state->statsFrames * 1000.0 / elapsedMs,
+                  state->statsBytes * 8.0 / 1000.0 / elapsedMs);
+            state->statsStartMs = hsGetMillis();
+            state->statsFrames = 0;
+            state->statsBytes = 0;
+        }
+    }
+
+    close(state->sock);
+    return NULL;
+}
+
+bool startVideoStream(void) {
+    PVIDEO_STATE state = calloc(1, sizeof(*state));
+    int sendBufferSize = 4 * 1024 * 1024;
+
+    if (state == NULL) {
+        return false;
+    }
+
+    state->sock = hsCreateSocket(SOCK_DGRAM, HS_VIDEO_PORT);
+    if (state->sock < 0) {
+        free(state);
+        return false;
+    }
+    setsockopt(state->sock, SOL_SOCKET, SO_SNDBUF, &sendBufferSize, sizeof(sendBufferSize));
+
+    reed_solomon_init();
+    return hsStartThread(videoStreamThread, state);
+}
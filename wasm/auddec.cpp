@@ -28,8 +28,10 @@ static OpusMSDecoder* s_OpusDecoder = nullptr;
 static constexpr int kMaxPacketBytes = 4096;
 
 struct PacketSlot {
-  uint8_t data[kMaxPacketBytes];
-  int     length;
+  uint8_t  data[kMaxPacketBytes];
+  int      length;
+  uint32_t hostTimestampMs;  // for A/V sync
+  uint64_t receiveTimeMs;
 };
 
 static std::vector<PacketSlot> s_pktQueue;  // circular, capacity = s_pktCap
@@ -37,8 +39,8 @@ static int  s_pktHead  = 0;
 static int  s_pktTail  = 0;
 static int  s_pktCount = 0;
 static int  s_pktCap   = 0;
-static std::mutex              s_pktMutex;
-static std::condition_variable s_pktCv;
+static ProfiledMutex               s_pktMutex("AudioPackets");
+static std::condition_variable_any s_pktCv;
 
 // ─── Decoded-frame slot pool ──────────────────────────────────────────────────
 // After decoding each Opus packet the feeder writes PCM into slot[s_slotIdx %
@@ -51,12 +53,21 @@ static constexpr int kMaxFrameElems = 4096;  // 480 * 8 ch = 3840, rounded up
 static opus_int16    s_frameSlots[kNumSlots][kMaxFrameElems];
 static int           s_slotIdx = 0;
 
+// Opus output before clock-drift resampling into the slot
+static opus_int16    s_decodeScratch[kMaxFrameElems];
+
 // ─── Feeder thread ────────────────────────────────────────────────────────────
 static std::thread       s_feederThread;
 static std::atomic<bool> s_feederRunning{false};
 
+static AllocationSite s_FeederAllocations("AudioFeeder");
+static AllocationSite s_AudioAllocations("AudioRenderer");
+
 static void feederLoop() {
   auto lastDiag = std::chrono::steady_clock::now();
+  AllocationScope allocationScope(s_FeederAllocations);
+
+  LiRegisterThreadStats("AudFeeder");
 
   while (s_feederRunning.load(std::memory_order_relaxed)) {
 
@@ -64,42 +75,55 @@ static void feederLoop() {
     {
       auto now = std::chrono::steady_clock::now();
       if (std::chrono::duration_cast<std::chrono::seconds>(now - lastDiag).count() >= 5) {
-        MoonlightInstance::ClLogMessage("AudDec: feeder alive, pktCount=%d\n", s_pktCount);
+        MoonlightInstance::ClLogMessage("AudDec: feeder alive, pktCount=%d drift=%+.0fppm\n",
+                                        s_pktCount, g_Instance->m_AudioResampler.DriftPpm());
         lastDiag = now;
       }
     }
 
     // ── Drain encoded-packet queue → decode → push to JS ─────────────────────
     while (true) {
-      uint8_t pktData[kMaxPacketBytes];
-      int     pktLen = 0;
+      uint8_t  pktData[kMaxPacketBytes];
+      int      pktLen = 0;
+      uint32_t hostTimestampMs;
+      uint64_t receiveTimeMs;
       {
-        std::unique_lock<std::mutex> lk(s_pktMutex);
+        std::unique_lock<ProfiledMutex> lk(s_pktMutex);
         if (s_pktCount == 0) break;
         const PacketSlot& slot = s_pktQueue[s_pktHead];
         pktLen = slot.length;
+        hostTimestampMs = slot.hostTimestampMs;
+        receiveTimeMs = slot.receiveTimeMs;
         __builtin_memcpy(pktData, slot.data, (size_t)pktLen);
         s_pktHead = (s_pktHead + 1) % s_pktCap;
         --s_pktCount;
+        LiRecordFlightEvent(FLIGHT_EVENT_AUDIO_QUEUE, (uint32_t)s_pktCount, 0);
       }  // release lock before decode — Opus is CPU-intensive
 
       opus_int16* dst = s_frameSlots[s_slotIdx % kNumSlots];
       int n = opus_multistream_decode(
         s_OpusDecoder, pktData, pktLen,
-        dst, (int)s_samplesPerFrame, 0);
+        s_decodeScratch, (int)s_samplesPerFrame, 0);
+      if (n > 0) {
+        // Absorb host/AudioContext clock drift; usually yields n samples,
+        // occasionally one more or one less.
+        n = g_Instance->m_AudioResampler.Process(
+          s_decodeScratch, n, dst, kMaxFrameElems / (int)s_channelCount);
+      }
       if (n > 0) {
         // Pass slot pointer + audio params to main-thread JS scheduler.
         // _audReceiveFrame reads HEAP16 at this address and schedules an
         // AudioBufferSourceNode before the feeder cycles back to this slot
         // (kNumSlots frames = 320 ms protection at 10 ms/frame).
         int slotPtr = (int)(size_t)dst;
-        int spf     = (int)s_samplesPerFrame;
+        int spf     = n;
         int ch      = (int)s_channelCount;
         int rate    = s_sampleRate;
         MAIN_THREAD_ASYNC_EM_ASM({
           if (typeof _audReceiveFrame === 'function') _audReceiveFrame($0, $1, $2, $3);
         }, slotPtr, spf, ch, rate);
         s_slotIdx++;
+        g_Instance->m_AvSync.OnAudioFrame(hostTimestampMs, receiveTimeMs, LiGetMillis());
       } else {
         MoonlightInstance::ClLogMessage("AudDec: Opus decode failed rc=%d\n", n);
       }
@@ -107,13 +131,16 @@ static void feederLoop() {
 
     // ── Wait for the next encoded packet ──────────────────────────────────────
     {
-      std::unique_lock<std::mutex> lk(s_pktMutex);
+      std::unique_lock<ProfiledMutex> lk(s_pktMutex);
+      uint64_t waitToken = LiBeginThreadWait();
       s_pktCv.wait_for(lk, std::chrono::milliseconds(1), [] {
         return s_pktCount > 0 || !s_feederRunning.load(std::memory_order_relaxed);
       });
+      LiEndThreadWait(waitToken);
     }
   }
 
+  LiUnregisterThreadStats();
   MoonlightInstance::ClLogMessage("AudDec: feeder thread exiting\n");
 }
 
@@ -140,6 +167,7 @@ int MoonlightInstance::AudDecInit(int audioConfiguration, POPUS_MULTISTREAM_CONF
   s_pktHead = s_pktTail = s_pktCount = 0;
 
   s_slotIdx = 0;
+  g_Instance->m_AudioResampler.Reset((int)s_channelCount);
 
   // ── Create Opus decoder ───────────────────────────────────────────────────
   int rc;
@@ -200,13 +228,15 @@ void MoonlightInstance::AudDecCleanup(void) {
 void MoonlightInstance::AudDecDecodeAndPlaySample(char* sampleData, int sampleLength) {
   if (!s_feederRunning.load(std::memory_order_relaxed)) return;
 
+  AllocationScope allocationScope(s_AudioAllocations);
+
   if (sampleLength <= 0 || sampleLength > kMaxPacketBytes) {
     MoonlightInstance::ClLogMessage("AudDec: packet length %d out of range, dropping\n", sampleLength);
     return;
   }
 
   {
-    std::unique_lock<std::mutex> lk(s_pktMutex);
+    std::unique_lock<ProfiledMutex> lk(s_pktMutex);
     if (s_pktCount >= s_pktCap) {
       s_pktHead = (s_pktHead + 1) % s_pktCap;
       --s_pktCount;
@@ -215,6 +245,8 @@ void MoonlightInstance::AudDecDecodeAndPlaySample(char* sampleData, int sampleLe
     PacketSlot& slot = s_pktQueue[s_pktTail];
     __builtin_memcpy(slot.data, sampleData, (size_t)sampleLength);
     slot.length = sampleLength;
+    slot.hostTimestampMs = LiGetCurrentAudioTimestamp();
+    slot.receiveTimeMs = LiGetMillis();
     s_pktTail = (s_pktTail + 1) % s_pktCap;
     ++s_pktCount;
   }
@@ -0,0 +1,156 @@
+#include "moonlight_wasm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+#include <emscripten.h>
+
+// ─── Tuning ───────────────────────────────────────────────────────────────────
+// EMSS in low latency mode holds roughly this many frames between
+// AppendPacket() and the panel.
+static constexpr double kEmssPipelineFrames = 2.0;
+
+// Smoothing of the per-path latency estimates
+static constexpr double kLatencySmoothing = 0.05;
+
+// The minimum transit time of each path is tracked over two windows of this
+// length, so that a route change or clock drift is picked up eventually.
+static constexpr uint32_t kTransitWindowMs = 10000;
+
+// Corrections are applied in small steps, and audio is never pulled in so far
+// that Web Audio runs out of queued samples.
+static constexpr uint64_t kControlIntervalMs = 500;
+static constexpr double   kMaxStepMs         = 10.0;
+static constexpr double   kMinAudioQueuedMs  = 20.0;
+static constexpr double   kMaxVideoDelayMs   = 200.0;
+
+// ─── Path estimates ───────────────────────────────────────────────────────────
+void AvSyncController::PathEstimate::AddSample(uint32_t hostMs, uint64_t receiveTimeMs, uint64_t doneTimeMs) {
+  // Host and local clocks have unrelated epochs, only differences are meaningful
+  uint32_t nowMs = (uint32_t)receiveTimeMs;
+  uint32_t transit = nowMs - hostMs;
+
+  if (!valid || nowMs - windowStartMs >= kTransitWindowMs) {
+    prevMinTransit = valid ? minTransit : transit;
+    minTransit = transit;
+    windowStartMs = nowMs;
+  } else if ((int32_t)(transit - minTransit) < 0) {
+    minTransit = transit;
+  }
+
+  uint32_t bestTransit = (int32_t)(minTransit - prevMinTransit) < 0 ? minTransit : prevMinTransit;
+  double jitterMs = std::max((int32_t)(transit - bestTransit), 0);
+  double sampleMs = jitterMs + (double)(doneTimeMs - receiveTimeMs);
+
+  latencyMs = valid ? latencyMs + kLatencySmoothing * (sampleMs - latencyMs) : sampleMs;
+  valid = true;
+}
+
+// ─── Controller ───────────────────────────────────────────────────────────────
+void AvSyncController::Reset(PresentationClock* videoClock, uint32_t frameRate, int toleranceMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  m_VideoClock = videoClock;
+  m_ToleranceMs = toleranceMs;
+  m_VideoPipelineMs = kEmssPipelineFrames * 1000.0 / frameRate;
+  m_Video = PathEstimate();
+  m_Audio = PathEstimate();
+  m_AudioQueuedMs = 0.0;
+  m_AudioDeviceMs = 0.0;
+  m_HasAudioOutput = false;
+  m_AudioShiftPending = false;
+  m_VideoDelayMs = 0.0;
+  m_LastControlMs = 0;
+}
+
+void AvSyncController::OnVideoFrame(uint32_t hostPtsMs, uint64_t receiveTimeMs, uint64_t submitTimeMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  if (m_ToleranceMs <= 0) {
+    return;
+  }
+  m_Video.AddSample(hostPtsMs, receiveTimeMs, submitTimeMs);
+  RunControlStep(submitTimeMs);
+}
+
+void AvSyncController::OnAudioFrame(uint32_t hostTimestampMs, uint64_t receiveTimeMs, uint64_t decodeTimeMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  if (m_ToleranceMs <= 0) {
+    return;
+  }
+  m_Audio.AddSample(hostTimestampMs, receiveTimeMs, decodeTimeMs);
+}
+
+void AvSyncController::OnAudioOutput(double queuedMs, double deviceLatencyMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  m_AudioQueuedMs = queuedMs;
+  m_AudioDeviceMs = deviceLatencyMs;
+  m_HasAudioOutput = true;
+  // Any shift sent earlier has been applied by the time JS reports again
+  m_AudioShiftPending = false;
+}
+
+bool AvSyncController::IsValid() const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  return m_ToleranceMs > 0 && m_Video.valid && m_Audio.valid && m_HasAudioOutput;
+}
+
+double AvSyncController::OffsetMs() const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  return OffsetMsLocked();
+}
+
+double AvSyncController::OffsetMsLocked() const {
+  double audioMs = m_Audio.latencyMs + m_AudioQueuedMs + m_AudioDeviceMs;
+  double videoMs = m_Video.latencyMs + m_VideoPipelineMs + m_VideoDelayMs;
+  return audioMs - videoMs;
+}
+
+void AvSyncController::ShiftAudio(double ms) {
+  m_AudioShiftPending = true;
+  MAIN_THREAD_ASYNC_EM_ASM({
+    if (typeof _audShift === 'function') _audShift($0);
+  }, ms);
+}
+
+void AvSyncController::RunControlStep(uint64_t nowMs) {
+  if (!m_Video.valid || !m_Audio.valid || !m_HasAudioOutput || m_VideoClock == nullptr) {
+    return;
+  }
+  if (nowMs - m_LastControlMs < kControlIntervalMs) {
+    return;
+  }
+  m_LastControlMs = nowMs;
+
+  double offsetMs = OffsetMsLocked();
+  if (std::fabs(offsetMs) <= m_ToleranceMs) {
+    return;
+  }
+  double stepMs = std::min(std::fabs(offsetMs), kMaxStepMs);
+
+  if (offsetMs > 0) {
+    // Audio is late. Pulling audio in lowers the total latency, so prefer it
+    // and only hold video back once the audio queue is as short as it can be.
+    if (m_AudioShiftPending) {
+      return;
+    }
+    if (m_AudioQueuedMs - stepMs >= kMinAudioQueuedMs) {
+      ShiftAudio(-stepMs);
+    } else if (m_VideoDelayMs + stepMs <= kMaxVideoDelayMs) {
+      m_VideoDelayMs += stepMs;
+      m_VideoClock->Nudge(stepMs / 1000.0);
+    }
+  } else {
+    // Audio is early. Undo any video delay first, then hold audio back.
+    if (m_VideoDelayMs > 0) {
+      stepMs = std::min(stepMs, m_VideoDelayMs);
+      m_VideoDelayMs -= stepMs;
+      m_VideoClock->Nudge(-stepMs / 1000.0);
+    } else if (!m_AudioShiftPending) {
+      ShiftAudio(stepMs);
+    }
+  }
+}
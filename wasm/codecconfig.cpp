@@ -0,0 +1,306 @@
+#include "moonlight_wasm.hpp"
+
+#include <cstdio>
+
+#include <bs.h>
+#include <h264_stream.h>
+
+// ─── Helpers ──────────────────────────────────────────────────────────────────
+// Returns the NAL unit in a buffer without its Annex B start code
+static bool StripStartCode(PLENTRY entry, const uint8_t** nal, int* length) {
+  const uint8_t* data = (const uint8_t*)entry->data;
+  int i = 0;
+
+  while (i < entry->length && data[i] == 0) {
+    i++;
+  }
+  if (i < 2 || i >= entry->length - 1 || data[i] != 1) {
+    return false;
+  }
+
+  *nal = &data[i + 1];
+  *length = entry->length - (i + 1);
+  return true;
+}
+
+static std::vector<std::vector<uint8_t>> CollectNalUnits(PDECODE_UNIT decodeUnit, int bufferType) {
+  std::vector<std::vector<uint8_t>> nalUnits;
+
+  for (PLENTRY entry = decodeUnit->bufferList; entry != nullptr; entry = entry->next) {
+    const uint8_t* nal;
+    int length;
+    if (entry->bufferType == bufferType && StripStartCode(entry, &nal, &length)) {
+      nalUnits.emplace_back(nal, nal + length);
+    }
+  }
+
+  return nalUnits;
+}
+
+// Removes emulation prevention bytes so that the parameter set can be read
+// with a plain bit reader
+static std::vector<uint8_t> ToRbsp(const std::vector<uint8_t>& nal) {
+  std::vector<uint8_t> rbsp(nal.size());
+  int nalSize = (int)nal.size();
+  int rbspSize = (int)rbsp.size();
+
+  if (nal_to_rbsp(nal.data(), &nalSize, rbsp.data(), &rbspSize) < 0) {
+    return {};
+  }
+  rbsp.resize(rbspSize);
+  return rbsp;
+}
+
+static void PutU16(std::vector<uint8_t>& out, size_t value) {
+  out.push_back((uint8_t)(value >> 8));
+  out.push_back((uint8_t)value);
+}
+
+static std::string MimeType(const char* codecs) {
+  return std::string("video/mp4; codecs=\"") + codecs + "\"";
+}
+
+// ─── H.264 (ISO/IEC 14496-15 section 5.3.3) ───────────────────────────────────
+static bool BuildAvcConfig(PDECODE_UNIT decodeUnit, VideoCodecConfig* config) {
+  auto spsList = CollectNalUnits(decodeUnit, BUFFER_TYPE_SPS);
+  auto ppsList = CollectNalUnits(decodeUnit, BUFFER_TYPE_PPS);
+  if (spsList.empty() || ppsList.empty() || spsList[0].size() < 4) {
+    return false;
+  }
+
+  const std::vector<uint8_t>& sps = spsList[0];
+  uint8_t profile = sps[1], compatibility = sps[2], level = sps[3];
+
+  std::vector<uint8_t>& avcC = config->extradata;
+  avcC.clear();
+  avcC.push_back(1); // configurationVersion
+  avcC.push_back(profile);
+  avcC.push_back(compatibility);
+  avcC.push_back(level);
+  avcC.push_back(0xFC | 3); // lengthSizeMinusOne
+  avcC.push_back(0xE0 | (uint8_t)spsList.size());
+  for (const auto& nal : spsList) {
+    PutU16(avcC, nal.size());
+    avcC.insert(avcC.end(), nal.begin(), nal.end());
+  }
+  avcC.push_back((uint8_t)ppsList.size());
+  for (const auto& nal : ppsList) {
+    PutU16(avcC, nal.size());
+    avcC.insert(avcC.end(), nal.begin(), nal.end());
+  }
+
+  // The High profiles also carry the chroma format and bit depth
+  if (profile == 100 || profile == 110 || profile == 122 || profile == 144) {
+    std::vector<uint8_t> rbsp = ToRbsp(sps);
+    if (rbsp.empty()) {
+      return false;
+    }
+
+    bs_t* b = bs_new(rbsp.data(), rbsp.size());
+    bs_skip_u(b, 32); // NAL header, profile_idc, constraint flags and level_idc
+    bs_read_ue(b); // seq_parameter_set_id
+    uint32_t chromaFormat = bs_read_ue(b);
+    if (chromaFormat == 3) {
+      bs_skip_u1(b); // separate_colour_plane_flag
+    }
+    uint32_t bitDepthLuma = bs_read_ue(b);
+    uint32_t bitDepthChroma = bs_read_ue(b);
+    bool overrun = bs_overrun(b);
+    bs_free(b);
+    if (overrun) {
+      return false;
+    }
+
+    avcC.push_back(0xFC | (uint8_t)(chromaFormat & 0x3));
+    avcC.push_back(0xF8 | (uint8_t)(bitDepthLuma & 0x7));
+    avcC.push_back(0xF8 | (uint8_t)(bitDepthChroma & 0x7));
+    avcC.push_back(0); // numOfSequenceParameterSetExt
+  }
+
+  char codecs[32];
+  snprintf(codecs, sizeof(codecs), "avc1.%02X%02X%02X", profile, compatibility, level);
+  config->mimeType = MimeType(codecs);
+  return true;
+}
+
+// ─── HEVC (ISO/IEC 14496-15 section 8.3.3) ────────────────────────────────────
+static bool BuildHevcConfig(PDECODE_UNIT decodeUnit, VideoCodecConfig* config) {
+  auto vpsList = CollectNalUnits(decodeUnit, BUFFER_TYPE_VPS);
+  auto spsList = CollectNalUnits(decodeUnit, BUFFER_TYPE_SPS);
+  auto ppsList = CollectNalUnits(decodeUnit, BUFFER_TYPE_PPS);
+  if (vpsList.empty() || spsList.empty() || ppsList.empty()) {
+    return false;
+  }
+
+  std::vector<uint8_t> rbsp = ToRbsp(spsList[0]);
+  if (rbsp.empty()) {
+    return false;
+  }
+
+  bs_t* b = bs_new(rbsp.data(), rbsp.size());
+  bs_skip_u(b, 16); // NAL header
+  bs_skip_u(b, 4); // sps_video_parameter_set_id
+  uint32_t maxSubLayersMinus1 = bs_read_u(b, 3);
+  uint32_t temporalIdNesting = bs_read_u1(b);
+
+  // general profile_tier_level(), which is also copied verbatim into hvcC
+  uint32_t profileSpace = bs_read_u(b, 2);
+  uint32_t tier = bs_read_u1(b);
+  uint32_t profileIdc = bs_read_u(b, 5);
+  uint32_t compatibility = bs_read_u(b, 32);
+  uint8_t constraints[6];
+  for (uint8_t& constraint : constraints) {
+    constraint = (uint8_t)bs_read_u(b, 8);
+  }
+  uint32_t levelIdc = bs_read_u(b, 8);
+
+  bool subLayerProfilePresent[8] = {}, subLayerLevelPresent[8] = {};
+  for (uint32_t i = 0; i < maxSubLayersMinus1; i++) {
+    subLayerProfilePresent[i] = bs_read_u1(b);
+    subLayerLevelPresent[i] = bs_read_u1(b);
+  }
+  if (maxSubLayersMinus1 > 0) {
+    bs_skip_u(b, 2 * (8 - maxSubLayersMinus1));
+  }
+  for (uint32_t i = 0; i < maxSubLayersMinus1; i++) {
+    if (subLayerProfilePresent[i]) {
+      bs_skip_u(b, 88);
+    }
+    if (subLayerLevelPresent[i]) {
+      bs_skip_u(b, 8);
+    }
+  }
+
+  bs_read_ue(b); // sps_seq_parameter_set_id
+  uint32_t chromaFormat = bs_read_ue(b);
+  if (chromaFormat == 3) {
+    bs_skip_u1(b); // separate_colour_plane_flag
+  }
+  bs_read_ue(b); // pic_width_in_luma_samples
+  bs_read_ue(b); // pic_height_in_luma_samples
+  if (bs_read_u1(b)) {
+    // conformance window offsets
+    for (int i = 0; i < 4; i++) {
+      bs_read_ue(b);
+    }
+  }
+  uint32_t bitDepthLuma = bs_read_ue(b);
+  uint32_t bitDepthChroma = bs_read_ue(b);
+  bool overrun = bs_overrun(b);
+  bs_free(b);
+  if (overrun) {
+    return false;
+  }
+
+  std::vector<uint8_t>& hvcC = config->extradata;
+  hvcC.clear();
+  hvcC.push_back(1); // configurationVersion
+  hvcC.push_back((uint8_t)((profileSpace << 6) | (tier << 5) | profileIdc));
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    hvcC.push_back((uint8_t)(compatibility >> shift));
+  }
+  hvcC.insert(hvcC.end(), std::begin(constraints), std::end(constraints));
+  hvcC.push_back((uint8_t)levelIdc);
+  PutU16(hvcC, 0xF000); // min_spatial_segmentation_idc
+  hvcC.push_back(0xFC); // parallelismType
+  hvcC.push_back(0xFC | (uint8_t)(chromaFormat & 0x3));
+  hvcC.push_back(0xF8 | (uint8_t)(bitDepthLuma & 0x7));
+  hvcC.push_back(0xF8 | (uint8_t)(bitDepthChroma & 0x7));
+  PutU16(hvcC, 0); // avgFrameRate
+  // constantFrameRate, numTemporalLayers, temporalIdNested and lengthSizeMinusOne
+  hvcC.push_back((uint8_t)(((maxSubLayersMinus1 + 1) << 3) | (temporalIdNesting << 2) | 3));
+  hvcC.push_back(3); // numOfArrays
+
+  const std::pair<uint8_t, const std::vector<std::vector<uint8_t>>*> arrays[] = {
+    {32, &vpsList}, {33, &spsList}, {34, &ppsList},
+  };
+  for (const auto& array : arrays) {
+    hvcC.push_back(0x80 | array.first); // array_completeness and NAL_unit_type
+    PutU16(hvcC, array.second->size());
+    for (const auto& nal : *array.second) {
+      PutU16(hvcC, nal.size());
+      hvcC.insert(hvcC.end(), nal.begin(), nal.end());
+    }
+  }
+
+  // The compatibility flags are written in reverse bit order, and trailing
+  // zero constraint bytes are omitted (ISO/IEC 14496-15 Annex E.3)
+  uint32_t reversed = 0;
+  for (int i = 0; i < 32; i++) {
+    reversed |= ((compatibility >> i) & 1) << (31 - i);
+  }
+  static const char* kProfileSpaces[] = {"", "A", "B", "C"};
+  char codecs[64];
+  int len = snprintf(codecs, sizeof(codecs), "hev1.%s%u.%X.%c%u", kProfileSpaces[profileSpace], profileIdc,
+                     reversed, tier ? 'H' : 'L', levelIdc);
+  int lastConstraint = 5;
+  while (lastConstraint >= 0 && constraints[lastConstraint] == 0) {
+    lastConstraint--;
+  }
+  for (int i = 0; i <= lastConstraint && len < (int)sizeof(codecs); i++) {
+    len += snprintf(codecs + len, sizeof(codecs) - len, ".%X", constraints[i]);
+  }
+  config->mimeType = MimeType(codecs);
+  return true;
+}
+
+// ─── AV1 (AV1 Codec ISO Media File Format Binding section 2.3) ────────────────
+static bool BuildAv1Config(PDECODE_UNIT decodeUnit, VideoCodecConfig* config) {
+  PLENTRY seqHdr = decodeUnit->bufferList;
+  while (seqHdr != nullptr && seqHdr->bufferType != BUFFER_TYPE_SPS) {
+    seqHdr = seqHdr->next;
+  }
+
+  AV1_SEQUENCE_INFO info;
+  if (seqHdr == nullptr || !LiParseAv1SequenceHeader(seqHdr->data, seqHdr->length, &info)) {
+    return false;
+  }
+
+  std::vector<uint8_t>& av1C = config->extradata;
+  av1C.clear();
+  av1C.push_back(0x81); // marker and version
+  av1C.push_back((uint8_t)((info.profile << 5) | info.level));
+  av1C.push_back((uint8_t)((info.tier << 7) | ((info.bitDepth > 8) << 6) | ((info.bitDepth == 12) << 5) |
+                           (info.monochrome << 4) | (info.subsamplingX << 3) | (info.subsamplingY << 2) |
+                           info.chromaSamplePosition));
+  av1C.push_back(0); // initial_presentation_delay_present
+  av1C.insert(av1C.end(), (const uint8_t*)seqHdr->data, (const uint8_t*)seqHdr->data + seqHdr->length);
+
+  char codecs[64];
+  snprintf(codecs, sizeof(codecs), "av01.%u.%02u%c.%02u.%u.%u%u%u.%02u.%02u.%02u.%u", info.profile, info.level,
+           info.tier ? 'H' : 'M', info.bitDepth, info.monochrome, info.subsamplingX, info.subsamplingY,
+           info.subsamplingX && info.subsamplingY ? info.chromaSamplePosition : 0, info.colorPrimaries,
+           info.transferCharacteristics, info.matrixCoefficients, info.fullRange);
+  config->mimeType = MimeType(codecs);
+  return true;
+}
+
+// ─── Public ───────────────────────────────────────────────────────────────────
+VideoCodecConfig DefaultVideoCodecConfig(int videoFormat) {
+  VideoCodecConfig config;
+
+  if (videoFormat & VIDEO_FORMAT_H264) {
+    config.mimeType = MimeType("avc1.64002A"); // H.264 High Profile, Level 4.2
+  } else if (videoFormat & VIDEO_FORMAT_H265) {
+    config.mimeType = MimeType("hev1.1.6.L153.B0"); // HEVC Main Profile, Level 5.1
+  } else if (videoFormat & VIDEO_FORMAT_H265_MAIN10) {
+    config.mimeType = MimeType("hev1.2.4.L153.B0"); // HEVC Main10 Profile, Level 5.1
+  } else if (videoFormat & VIDEO_FORMAT_AV1_MAIN8) {
+    config.mimeType = MimeType("av01.0.13M.08"); // AV1 Main Profile, Level 5.1
+  } else if (videoFormat & VIDEO_FORMAT_AV1_MAIN10) {
+    config.mimeType = MimeType("av01.0.13M.10"); // AV1 Main Profile, Level 5.1, 10-bit
+  }
+
+  return config;
+}
+
+bool BuildVideoCodecConfig(int videoFormat, PDECODE_UNIT decodeUnit, VideoCodecConfig* config) {
+  if (videoFormat & VIDEO_FORMAT_MASK_H264) {
+    return BuildAvcConfig(decodeUnit, config);
+  } else if (videoFormat & VIDEO_FORMAT_MASK_H265) {
+    return BuildHevcConfig(decodeUnit, config);
+  } else if (videoFormat & VIDEO_FORMAT_MASK_AV1) {
+    return BuildAv1Config(decodeUnit, config);
+  }
+  return false;
+}
@@ -233,11 +233,11 @@ void MoonlightInstance::PollGamepads() {
           if (!mouseEmulationActive) {
             // Activate mouse emulation and notify the user
             mouseEmulationActive = true;
-            PostToJs(std::string("mouseEmulationOn"));
+            PostToJs(JsMessageKind::MouseEmulationOn);
           } else {
             // Deactivate mouse emulation and notify the user
             mouseEmulationActive = false;
-            PostToJs(std::string("mouseEmulationOff"));
+            PostToJs(JsMessageKind::MouseEmulationOff);
           }
           // Reset the PLAY/START press time to the current time after toggling
           activatePressTime = std::chrono::steady_clock::now();
@@ -314,6 +314,6 @@ void MoonlightInstance::ClControllerRumble(unsigned short controllerNumber, unsi
   if (rumbleFeedbackSwitch) {
     std::ostringstream ss;
     ss << controllerNumber << "," << weakMagnitude << "," << strongMagnitude;
-    PostToJs(std::string("controllerRumble: ") + ss.str());
+    PostToJs(JsMessageKind::ControllerRumble, ss.str());
   }
 }
@@ -87,7 +87,11 @@ MessageResult MoonlightInstance::HttpInit(std::string cert, std::string privateK
   return MessageResult::Resolve();
 }
 
+static AllocationSite s_HttpAllocations("Http");
+
 void MoonlightInstance::OpenUrl_private(int callbackId, std::string url, std::string ppk, bool binaryResponse) {
+  AllocationScope allocationScope(s_HttpAllocations);
+
   // For launch/resume requests, append the additional query parameters
   if (url.find("/launch?") != std::string::npos || url.find("/resume?") != std::string::npos) {
     url += LiGetLaunchUrlQueryParameters();
@@ -122,6 +126,8 @@ void MoonlightInstance::OpenUrl_private(int callbackId, std::string url, std::st
 }
 
 void MoonlightInstance::OpenUrl(int callbackId, std::string url, std::string ppk, bool binaryResponse) {
+  // Includes the dispatcher's job
+  AllocationScope allocationScope(s_HttpAllocations);
   m_Dispatcher.post_job(std::bind(&MoonlightInstance::OpenUrl_private, this, callbackId, url, ppk, binaryResponse), false);
 }
 
@@ -0,0 +1,295 @@
+#include "moonlight_wasm.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <cstdarg>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+
+#include <emscripten.h>
+
+// ─── Log records ──────────────────────────────────────────────────────────────
+// Every logging thread owns a single-producer/single-consumer ring of fixed-size
+// records. The producer only formats the message body into its own slot; the
+// timestamp prefix, console output and network sink all run on the drain thread,
+// so no logging call ever blocks on I/O or on another thread.
+static constexpr int kRecordTextBytes = 1024;
+static constexpr uint32_t kRingSlots  = 32;
+
+struct LogRecord {
+  uint64_t sequence;   // global order across all rings
+  uint32_t timeMs;     // relative to s_logStartMs
+  uint32_t length;
+  char     text[kRecordTextBytes];
+};
+
+struct LogRing {
+  std::atomic<uint32_t> head{0};  // next slot to drain (consumer)
+  std::atomic<uint32_t> tail{0};  // next slot to fill (producer)
+  std::atomic<bool>     inUse{false};
+  LogRing*              next = nullptr;
+  LogRecord             slots[kRingSlots];
+};
+
+// Rings are never freed. When a thread exits its ring is released and the next
+// new logging thread reuses it, so the list is bounded by peak thread count.
+static std::atomic<LogRing*> s_rings{nullptr};
+static std::atomic<uint64_t> s_sequence{0};
+
+struct RingOwner {
+  LogRing* ring = nullptr;
+  ~RingOwner() {
+    if (ring != nullptr) {
+      ring->inUse.store(false, std::memory_order_release);
+    }
+  }
+};
+static thread_local RingOwner t_ringOwner;
+
+// ─── Rate limiting / drop accounting ──────────────────────────────────────────
+// Call sites are identified by the shape of their format string with digits
+// ignored, since moonlight-common-c hands us pre-formatted text. Colliding
+// call sites simply share a budget.
+static constexpr int      kRateBuckets    = 256;
+static constexpr uint32_t kRateWindowMs   = 1000;
+static constexpr uint32_t kRateBurstLimit = 20;
+
+struct RateBucket {
+  std::atomic<uint32_t> windowStartMs{0};
+  std::atomic<uint32_t> count{0};
+};
+static RateBucket s_rateBuckets[kRateBuckets];
+
+static std::atomic<uint32_t> s_droppedRateLimited{0};
+static std::atomic<uint32_t> s_droppedRingFull{0};
+
+// ─── Drain thread / network sink ──────────────────────────────────────────────
+static constexpr int      kDrainIntervalMs   = 10;
+static constexpr uint32_t kDropReportMs      = 5000;
+static constexpr uint32_t kReconnectDelayMs  = 5000;
+static constexpr uint16_t kNetworkSinkPort   = 9999;
+
+static std::once_flag s_drainOnce;
+static uint64_t s_logStartMs = 0;
+
+static std::mutex  s_sinkHostMutex;
+static std::string s_sinkHost;
+
+static uint64_t monotonicMs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static uint32_t callSiteHash(const char* format) {
+  // FNV-1a
+  uint32_t hash = 2166136261u;
+  for (const char* c = format; *c != '\0'; c++) {
+    if (*c >= '0' && *c <= '9') continue;
+    hash = (hash ^ (uint8_t)*c) * 16777619u;
+  }
+  return hash;
+}
+
+static bool rateLimitAllows(const char* format, uint32_t nowMs) {
+  RateBucket& bucket = s_rateBuckets[callSiteHash(format) % kRateBuckets];
+
+  uint32_t windowStart = bucket.windowStartMs.load(std::memory_order_relaxed);
+  if (nowMs - windowStart >= kRateWindowMs &&
+      bucket.windowStartMs.compare_exchange_strong(windowStart, nowMs, std::memory_order_relaxed)) {
+    bucket.count.store(0, std::memory_order_relaxed);
+  }
+
+  return bucket.count.fetch_add(1, std::memory_order_relaxed) < kRateBurstLimit;
+}
+
+static LogRing* claimRing() {
+  for (LogRing* ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+    bool expected = false;
+    if (!ring->inUse.load(std::memory_order_relaxed) &&
+        ring->inUse.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+      return ring;
+    }
+  }
+
+  LogRing* ring = new LogRing();
+  ring->inUse.store(true, std::memory_order_relaxed);
+  LogRing* head = s_rings.load(std::memory_order_relaxed);
+  do {
+    ring->next = head;
+  } while (!s_rings.compare_exchange_weak(head, ring, std::memory_order_release, std::memory_order_relaxed));
+  return ring;
+}
+
+class NetworkSink {
+  public:
+  void Write(const char* line, size_t length, uint32_t nowMs) {
+    if (m_Socket < 0 && !Connect(nowMs)) {
+      return;
+    }
+    if (send(m_Socket, line, length, 0) < 0) {
+      close(m_Socket);
+      m_Socket = -1;  // reconnect on a later message
+      m_LastAttemptMs = nowMs;
+    }
+  }
+
+  private:
+  bool Connect(uint32_t nowMs) {
+    if (m_HasAttempted && nowMs - m_LastAttemptMs < kReconnectDelayMs) {
+      return false;
+    }
+
+    std::string host;
+    {
+      std::lock_guard<std::mutex> lk(s_sinkHostMutex);
+      host = s_sinkHost;
+    }
+    if (host.empty()) {
+      return false;
+    }
+
+    m_HasAttempted = true;
+    m_LastAttemptMs = nowMs;
+
+    // On the PC: nc -l -p 9999 > moonlight.log
+    int sock = socket(AF_INET, SOCK_STREAM, IPPROTO_TCP);
+    if (sock < 0) {
+      return false;
+    }
+    struct sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(kNetworkSinkPort);
+    if (inet_pton(AF_INET, host.c_str(), &addr.sin_addr) != 1 ||
+        connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+      close(sock);
+      return false;
+    }
+
+    m_Socket = sock;
+    const char* banner = "=== moonlight-tizen log stream started ===\n";
+    send(m_Socket, banner, strlen(banner), 0);
+    return true;
+  }
+
+  int m_Socket = -1;
+  bool m_HasAttempted = false;
+  uint32_t m_LastAttemptMs = 0;
+};
+
+static void emitLine(NetworkSink& sink, uint32_t timeMs, const char* text, uint32_t nowMs) {
+  // fprintf(stderr, ...) processes message in parts, so logs from different
+  // threads may interleave. Send whole message at once to minimize this.
+  emscripten_log(EM_LOG_CONSOLE, "%s", text);
+
+  char line[kRecordTextBytes + 32];
+  int n = snprintf(line, sizeof(line), "[%u.%03u] %s", timeMs / 1000, timeMs % 1000, text);
+  if (n > 0) {
+    sink.Write(line, MIN((size_t)n, sizeof(line) - 1), nowMs);
+  }
+}
+
+// Drains every ring in global sequence order so lines from different
+// threads come out in the order they were logged.
+static void drainRings(NetworkSink& sink, uint32_t nowMs) {
+  while (true) {
+    LogRing* oldest = nullptr;
+    uint64_t oldestSequence = UINT64_MAX;
+
+    for (LogRing* ring = s_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+      uint32_t head = ring->head.load(std::memory_order_relaxed);
+      if (head == ring->tail.load(std::memory_order_acquire)) continue;
+      const LogRecord& record = ring->slots[head % kRingSlots];
+      if (record.sequence < oldestSequence) {
+        oldestSequence = record.sequence;
+        oldest = ring;
+      }
+    }
+    if (oldest == nullptr) {
+      return;
+    }
+
+    uint32_t head = oldest->head.load(std::memory_order_relaxed);
+    const LogRecord& record = oldest->slots[head % kRingSlots];
+    emitLine(sink, record.timeMs, record.text, nowMs);
+    oldest->head.store(head + 1, std::memory_order_release);
+  }
+}
+
+static void drainLoop() {
+  NetworkSink sink;
+  uint32_t lastDropReportMs = 0;
+  uint32_t reportedRateLimited = 0;
+  uint32_t reportedRingFull = 0;
+
+  while (true) {
+    uint32_t nowMs = (uint32_t)(monotonicMs() - s_logStartMs);
+
+    drainRings(sink, nowMs);
+
+    if (nowMs - lastDropReportMs >= kDropReportMs) {
+      uint32_t rateLimited = s_droppedRateLimited.load(std::memory_order_relaxed);
+      uint32_t ringFull = s_droppedRingFull.load(std::memory_order_relaxed);
+      if (rateLimited != reportedRateLimited || ringFull != reportedRingFull) {
+        char text[128];
+        snprintf(text, sizeof(text), "Logger: dropped %u rate-limited and %u overflowed messages\n",
+                 rateLimited - reportedRateLimited, ringFull - reportedRingFull);
+        emitLine(sink, nowMs, text, nowMs);
+        reportedRateLimited = rateLimited;
+        reportedRingFull = ringFull;
+      }
+      lastDropReportMs = nowMs;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(kDrainIntervalMs));
+  }
+}
+
+void LogMessageV(const char* format, va_list va) {
+  std::call_once(s_drainOnce, [] {
+    s_logStartMs = monotonicMs();
+    std::thread(drainLoop).detach();
+  });
+
+  uint32_t nowMs = (uint32_t)(monotonicMs() - s_logStartMs);
+  if (!rateLimitAllows(format, nowMs)) {
+    s_droppedRateLimited.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  if (t_ringOwner.ring == nullptr) {
+    t_ringOwner.ring = claimRing();
+  }
+  LogRing* ring = t_ringOwner.ring;
+
+  uint32_t tail = ring->tail.load(std::memory_order_relaxed);
+  if (tail - ring->head.load(std::memory_order_acquire) >= kRingSlots) {
+    s_droppedRingFull.fetch_add(1, std::memory_order_relaxed);
+    return;
+  }
+
+  LogRecord& record = ring->slots[tail % kRingSlots];
+  int n = vsnprintf(record.text, sizeof(record.text), format, va);
+  record.length = n < 0 ? 0 : MIN((uint32_t)n, (uint32_t)sizeof(record.text) - 1);
+  record.timeMs = nowMs;
+  record.sequence = s_sequence.fetch_add(1, std::memory_order_relaxed);
+  ring->tail.store(tail + 1, std::memory_order_release);
+}
+
+void LogSetNetworkSinkHost(const std::string& host) {
+  std::lock_guard<std::mutex> lk(s_sinkHostMutex);
+  s_sinkHost = host;
+}
+
+uint32_t LogGetDroppedMessageCount() {
+  return s_droppedRateLimited.load(std::memory_order_relaxed) +
+         s_droppedRingFull.load(std::memory_order_relaxed);
+}
@@ -22,8 +22,6 @@
 #define MSG_START_REQUEST "startRequest"
 // Requests the Wasm module to stop streaming
 #define MSG_STOP_REQUEST "stopRequest"
-// Sent by the Wasm module when streaming has stopped, whether requested by the user or not
-#define MSG_STREAM_TERMINATED "streamTerminated: "
 // Requests the Wasm module to open the specified URL
 #define MSG_OPENURL "openUrl"
 
@@ -40,6 +38,15 @@ int g_AudioPacketDurationOverride = 0;
 // Set from StartStream before LiStartConnection; read by auddec.cpp via extern.
 int g_AudioJitterMsOverride = 0;
 
+// Video latency budget in ms: frames that waited longer than this between arriving
+// from the network and being submitted to the decoder get dropped. 0 = never drop.
+// Set through setLatencyBudget(); read by wasmplayer.cpp via extern.
+int g_VideoLatencyBudgetMs = 100;
+
+// A/V sync tolerance in ms: audio and video are re-aligned once they drift further
+// apart than this. 0 = disabled. Set through setAvSyncTolerance(); read by wasmplayer.cpp via extern.
+int g_AvSyncToleranceMs = 20;
+
 MoonlightInstance::MoonlightInstance()
   : m_OpusDecoder(NULL),
     m_MouseLocked(false),
@@ -51,7 +58,6 @@ MoonlightInstance::MoonlightInstance()
     m_MouseDeltaY(0),
     m_HttpThreadPoolSequence(0),
     m_Dispatcher("Curl"),
-    m_Mutex(),
     m_EmssStateChanged(),
     m_EmssVideoStateChanged(),
     m_EmssReadyState(EmssReadyState::kDetached),
@@ -71,7 +77,7 @@ MoonlightInstance::~MoonlightInstance() {
 
 void MoonlightInstance::OnConnectionStarted(uint32_t unused) {
   // Tell the front end
-  PostToJs(std::string("Connection Established"));
+  PostToJs(JsMessageKind::ConnectionEstablished);
 }
 
 void MoonlightInstance::OnConnectionStopped(uint32_t error) {
@@ -82,7 +88,7 @@ void MoonlightInstance::OnConnectionStopped(uint32_t error) {
   UnlockMouse();
 
   // Notify the JS code that the stream has ended
-  PostToJs(std::string(MSG_STREAM_TERMINATED + std::to_string((int)error)));
+  PostToJs(JsMessageKind::StreamTerminated, std::to_string((int)error));
 }
 
 void MoonlightInstance::StopConnection() {
@@ -120,20 +126,33 @@ void* MoonlightInstance::StopThreadFunc(void* context) {
 
   // Stop the connection
   LiStopConnection();
+
+  // The profiles stay readable after the connection stops
+  ProfilerPrintLockStats();
+  ProfilerPrintAllocationStats();
   return NULL;
 }
 
+static AllocationSite s_InputAllocations("InputPoll");
+
 void* MoonlightInstance::InputThreadFunc(void* context) {
   MoonlightInstance* me = (MoonlightInstance*)context;
+  AllocationScope allocationScope(s_InputAllocations);
+
+  LiRegisterThreadStats("InputPoll");
 
   while (me->m_Running) {
     me->PollGamepads();
     me->ReportMouseMovement();
 
     // Poll every 5 ms
+    uint64_t waitToken = LiBeginThreadWait();
     usleep(5 * 1000);
+    LiEndThreadWait(waitToken);
   }
 
+  // This thread is joined before the connection is stopped
+  LiUnregisterThreadStats();
   return NULL;
 }
 
@@ -193,12 +212,18 @@ void* MoonlightInstance::ConnectionThreadFunc(void* context) {
   // Apply user-selected jitter buffer target (0 = use default of 100 ms)
   g_AudioJitterMsOverride = me->m_AudioJitterMs;
 
+#if defined(ENABLE_PROFILING)
+  LiSetLockProfilingEnabled(true);
+#endif
+  ProfilerStartAllocationTracking();
+  LiSetFlightRecorderDumpCallback(MoonlightInstance::ClFlightRecorderDump);
+
   err = LiStartConnection(&serverInfo, &me->m_StreamConfig, &MoonlightInstance::s_ClCallbacks,
     &MoonlightInstance::s_DrCallbacks, &MoonlightInstance::s_ArCallbacks, NULL, 0, NULL, 0);
   if (err != 0) {
     // Notify the JS code that the stream has ended!
     // NB: We pass error code 0 here to avoid triggering a "Connection terminated" warning message.
-    PostToJs(MSG_STREAM_TERMINATED + std::to_string(0));
+    PostToJs(JsMessageKind::StreamTerminated, std::to_string(0));
     return NULL;
   }
 
@@ -340,6 +365,7 @@ MessageResult MoonlightInstance::StartStream(std::string host, std::string width
 
   // Store the parameters from the start message
   m_Host = host;
+  LogSetNetworkSinkHost(host);
   m_AppVersion = appversion;
   m_GfeVersion = gfeversion;
   m_RtspUrl = rtspurl;
@@ -515,46 +541,31 @@ void toggleStats() {
   g_Instance->TogglePerformanceStats();
 }
 
-void stun(int callbackId) {
-  g_Instance->STUN(callbackId);
-}
-
-void pair(int callbackId, std::string serverMajorVersion, std::string address, std::string randomNumber) {
-  g_Instance->Pair(callbackId, serverMajorVersion, address, randomNumber);
+void setLatencyBudget(int latencyBudgetMs) {
+  PostToJs("Setting the Video latency budget to: " + (latencyBudgetMs > 0 ? std::to_string(latencyBudgetMs) + " ms" : "unlimited"));
+  g_VideoLatencyBudgetMs = MAX(latencyBudgetMs, 0);
 }
 
-void wakeOnLan(int callbackId, std::string macAddress) {
-  g_Instance->WakeOnLan(callbackId, macAddress);
+void setAvSyncTolerance(int toleranceMs) {
+  PostToJs("Setting the A/V sync tolerance to: " + (toleranceMs > 0 ? std::to_string(toleranceMs) + " ms" : "disabled"));
+  g_AvSyncToleranceMs = MAX(toleranceMs, 0);
 }
 
-void PostToJs(std::string msg) {
-  MAIN_THREAD_EM_ASM({
-    const msg = UTF8ToString($0);
-    handleMessage(msg);
-  }, msg.c_str());
+void reportAudioLatency(double queuedMs, double deviceLatencyMs, double syncOffsetMs) {
+  g_Instance->m_AvSync.OnAudioOutput(queuedMs, deviceLatencyMs);
+  g_Instance->m_AudioResampler.OnQueueDepth(queuedMs - syncOffsetMs);
 }
 
-void PostToJsAsync(std::string msg) {
-  MAIN_THREAD_ASYNC_EM_ASM({
-    const msg = UTF8ToString($0);
-    handleMessage(msg);
-  }, msg.c_str());
+void stun(int callbackId) {
+  g_Instance->STUN(callbackId);
 }
 
-void PostPromiseMessage(int callbackId, const std::string& type, const std::string& response) {
-  MAIN_THREAD_EM_ASM({
-    const type = UTF8ToString($1);
-    const response = UTF8ToString($2);
-    handlePromiseMessage($0, type, response);
-  }, callbackId, type.c_str(), response.c_str());
+void pair(int callbackId, std::string serverMajorVersion, std::string address, std::string randomNumber) {
+  g_Instance->Pair(callbackId, serverMajorVersion, address, randomNumber);
 }
 
-void PostPromiseMessage(int callbackId, const std::string& type, const std::vector<uint8_t>& response) {
-  MAIN_THREAD_EM_ASM({
-    const type = UTF8ToString($1);
-    const response = HEAPU8.slice($2, $2 + $3);
-    handlePromiseMessage($0, type, response);
-  }, callbackId, type.c_str(), response.data(), response.size());
+void wakeOnLan(int callbackId, std::string macAddress) {
+  g_Instance->WakeOnLan(callbackId, macAddress);
 }
 
 EMSCRIPTEN_BINDINGS(handle_message) {
@@ -562,7 +573,11 @@ EMSCRIPTEN_BINDINGS(handle_message) {
   emscripten::function("startStream", &startStream);
   emscripten::function("stopStream", &stopStream);
   emscripten::function("toggleStats", &toggleStats);
+  emscripten::function("setLatencyBudget", &setLatencyBudget);
+  emscripten::function("setAvSyncTolerance", &setAvSyncTolerance);
+  emscripten::function("reportAudioLatency", &reportAudioLatency);
   emscripten::function("stun", &stun);
   emscripten::function("pair", &pair);
   emscripten::function("wakeOnLan", &wakeOnLan);
+  emscripten::function("messageRing", &GetJsMessageRing);
 }
@@ -0,0 +1,156 @@
+#include "moonlight_wasm.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <climits>
+#include <cstddef>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+
+#include <emscripten.h>
+#include <emscripten/threading.h>
+
+// ─── Message ring ─────────────────────────────────────────────────────────────
+// Notifications for the UI are written into a bounded multi-producer ring that
+// lives in the shared WASM heap. The main thread drains it from JavaScript
+// (platform/messages.js) whenever the doorbell is rung or on the next animation
+// frame, so posting a message never waits for the main thread.
+//
+// The JS side reads the header fields below by word offset, so the layout of
+// JsMessageRing must stay in sync with startMessagePump().
+static constexpr uint32_t kMessageSlots        = 128;  // must be a power of two
+static constexpr uint32_t kMessagePayloadBytes = 1024;
+
+struct JsMessageSlot {
+  std::atomic<uint32_t> sequence;  // == position + 1 once the slot is published
+  uint32_t              kind;
+  uint32_t              length;
+  char                  payload[kMessagePayloadBytes];
+};
+
+struct JsMessageRing {
+  std::atomic<uint32_t> enqueuePos;    // word 0: next position to claim (producers)
+  std::atomic<uint32_t> dequeuePos;    // word 1: next position to drain (JS)
+  std::atomic<int32_t>  doorbell;      // word 2: bumped and notified on publish
+  uint32_t              slotCount;     // word 3
+  uint32_t              slotBytes;     // word 4
+  uint32_t              payloadOffset; // word 5: byte offset of payload in a slot
+  std::atomic<uint32_t> overflowed;    // word 6: messages sent via the slow path
+  uint32_t              reserved;      // word 7
+  JsMessageSlot         slots[kMessageSlots];
+
+  JsMessageRing()
+    : enqueuePos(0), dequeuePos(0), doorbell(0), slotCount(kMessageSlots), slotBytes(sizeof(JsMessageSlot)),
+      payloadOffset(offsetof(JsMessageSlot, payload)), overflowed(0), reserved(0) {
+    for (uint32_t i = 0; i < kMessageSlots; i++) {
+      slots[i].sequence.store(i, std::memory_order_relaxed);
+    }
+  }
+};
+
+static_assert((kMessageSlots & (kMessageSlots - 1)) == 0, "slot count must be a power of two");
+static_assert(sizeof(JsMessageSlot) % 4 == 0, "slots must stay word aligned for HEAP32 access");
+static_assert(sizeof(std::atomic<uint32_t>) == 4, "ring words must be plain 32-bit values");
+
+static JsMessageRing s_ring;
+
+static bool tryEnqueue(JsMessageKind kind, const char* payload, size_t length) {
+  uint32_t pos = s_ring.enqueuePos.load(std::memory_order_relaxed);
+  JsMessageSlot* slot;
+
+  while (true) {
+    slot = &s_ring.slots[pos & (kMessageSlots - 1)];
+    uint32_t seq = slot->sequence.load(std::memory_order_acquire);
+    int32_t diff = (int32_t)(seq - pos);
+    if (diff == 0) {
+      if (s_ring.enqueuePos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+        break;
+      }
+    } else if (diff < 0) {
+      // The main thread hasn't caught up with the previous lap yet
+      return false;
+    } else {
+      pos = s_ring.enqueuePos.load(std::memory_order_relaxed);
+    }
+  }
+
+  slot->kind = (uint32_t)kind;
+  slot->length = (uint32_t)std::min(length, (size_t)kMessagePayloadBytes);
+  memcpy(slot->payload, payload, slot->length);
+  slot->sequence.store(pos + 1, std::memory_order_release);
+  return true;
+}
+
+static void ringDoorbell() {
+  s_ring.doorbell.fetch_add(1, std::memory_order_release);
+  emscripten_futex_wake((volatile void*)&s_ring.doorbell, INT_MAX);
+}
+
+// ─── Posting ──────────────────────────────────────────────────────────────────
+void PostToJs(JsMessageKind kind, const std::string& payload) {
+  // Payloads larger than a slot, like flight recorder dumps, always take the slow path
+  if (payload.size() <= kMessagePayloadBytes) {
+    if (tryEnqueue(kind, payload.data(), payload.size())) {
+      ringDoorbell();
+      return;
+    }
+
+    // The ring is full, which only happens if the main thread is stalled or a
+    // burst was posted from the main thread itself.
+    s_ring.overflowed.fetch_add(1, std::memory_order_relaxed);
+  }
+
+  // Hand a heap copy to the main thread instead so that notifications like
+  // stream termination are never lost. The ring is drained first to keep
+  // messages in order.
+  char* copy = (char*)malloc(payload.size() + 1);
+  if (copy == nullptr) {
+    return;
+  }
+  memcpy(copy, payload.data(), payload.size());
+  MAIN_THREAD_ASYNC_EM_ASM({
+    const msg = new TextDecoder().decode(HEAPU8.slice($1, $1 + $2));
+    _free($1);
+    drainMessages();
+    handleMessage($0, msg);
+  }, (uint32_t)kind, copy, payload.size());
+}
+
+void PostToJs(std::string msg) {
+  PostToJs(JsMessageKind::Log, msg);
+}
+
+// Promise replies may carry arbitrarily large bodies, so they don't fit the
+// ring. They are still posted asynchronously from a heap copy that the main
+// thread frees once the promise has been settled.
+void PostPromiseMessage(int callbackId, const std::string& type, const std::string& response) {
+  char* copy = (char*)malloc(response.size() + 1);
+  if (copy == nullptr) {
+    return;
+  }
+  memcpy(copy, response.data(), response.size());
+  MAIN_THREAD_ASYNC_EM_ASM({
+    const response = new TextDecoder().decode(HEAPU8.slice($2, $2 + $3));
+    _free($2);
+    handlePromiseMessage($0, $1 ? 'resolve' : 'reject', response);
+  }, callbackId, type == "resolve", copy, response.size());
+}
+
+void PostPromiseMessage(int callbackId, const std::string& type, const std::vector<uint8_t>& response) {
+  uint8_t* copy = (uint8_t*)malloc(response.size() + 1);
+  if (copy == nullptr) {
+    return;
+  }
+  memcpy(copy, response.data(), response.size());
+  MAIN_THREAD_ASYNC_EM_ASM({
+    const response = HEAPU8.slice($2, $2 + $3);
+    _free($2);
+    handlePromiseMessage($0, $1 ? 'resolve' : 'reject', response);
+  }, callbackId, type == "resolve", copy, response.size());
+}
+
+uintptr_t GetJsMessageRing() {
+  return (uintptr_t)&s_ring;
+}
@@ -1,5 +1,8 @@
 #include <atomic>
+#include <chrono>
+#include <cstdarg>
 #include <memory>
+#include <mutex>
 #include <queue>
 
 #include <emscripten/bind.h>
@@ -53,6 +56,96 @@ struct MessageResult {
   }
 };
 
+// A std::mutex that reports its wait and hold times to the lock profile under its
+// name. The clock is only read while lock profiling is active. Use it with
+// std::condition_variable_any.
+class ProfiledMutex {
+  public:
+  explicit ProfiledMutex(const char* name) : m_Profile(LiCreateLockProfile(name)) {}
+  ProfiledMutex(const ProfiledMutex&) = delete;
+  ProfiledMutex& operator=(const ProfiledMutex&) = delete;
+
+  void lock() {
+    if (!LiIsLockProfilingActive()) {
+      m_Mutex.lock();
+      m_LockedUs = 0;
+      return;
+    }
+
+    if (m_Mutex.try_lock()) {
+      m_LockedUs = NowUs();
+      LiRecordLockAcquired(m_Profile, 0, false);
+      return;
+    }
+
+    uint64_t waitStartUs = NowUs();
+    m_Mutex.lock();
+    m_LockedUs = NowUs();
+    LiRecordLockAcquired(m_Profile, m_LockedUs - waitStartUs, true);
+  }
+
+  bool try_lock() {
+    if (!m_Mutex.try_lock()) {
+      return false;
+    }
+
+    if (LiIsLockProfilingActive()) {
+      m_LockedUs = NowUs();
+      LiRecordLockAcquired(m_Profile, 0, false);
+    } else {
+      m_LockedUs = 0;
+    }
+    return true;
+  }
+
+  void unlock() {
+    if (m_LockedUs != 0) {
+      LiRecordLockReleased(m_Profile, NowUs() - m_LockedUs);
+    }
+    m_Mutex.unlock();
+  }
+
+  private:
+  static uint64_t NowUs() {
+    return std::chrono::duration_cast<std::chrono::microseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  std::mutex m_Mutex;
+  PLOCK_PROFILE m_Profile;
+  uint64_t m_LockedUs = 0;
+};
+
+// Counts the C++ heap allocations of one subsystem. Sites must be static objects.
+// Allocations and frees are counted against the innermost AllocationScope of the
+// calling thread, or the "Other" site. The counting is done by the global operator
+// new, which is only replaced in builds with ENABLE_PROFILING.
+struct AllocationSite {
+  explicit AllocationSite(const char* name);
+
+  const char* name;
+  std::atomic<uint64_t> allocations{0};
+  std::atomic<uint64_t> bytes{0};
+  std::atomic<uint64_t> frees{0};
+
+  // Counts when the connection was established
+  uint64_t steadyStateAllocations = 0;
+  uint64_t steadyStateBytes = 0;
+
+  AllocationSite* next;
+};
+
+class AllocationScope {
+  public:
+  explicit AllocationScope(AllocationSite& site);
+  ~AllocationScope();
+  AllocationScope(const AllocationScope&) = delete;
+  AllocationScope& operator=(const AllocationScope&) = delete;
+
+  private:
+  AllocationSite* m_Previous;
+};
+
 typedef struct _VIDEO_STATS {
   uint32_t receivedFrames;
   uint32_t decodedFrames;
@@ -78,6 +171,154 @@ typedef struct _VIDEO_STATS {
   uint32_t measurementStartTimestamp;
 } VIDEO_STATS, *PVIDEO_STATS;
 
+// Maps host presentation timestamps (DECODE_UNIT::presentationTimeMs) onto the
+// EMSS timeline. The rate of the host clock relative to the local one is tracked
+// by a weighted linear fit of receive time against host time, so host jitter and
+// dropped frames don't skew the schedule the way a fixed per-frame increment does.
+class PresentationClock {
+  public:
+  void Reset(uint32_t frameRate);
+
+  // Returns the EMSS presentation time in seconds of a video frame and feeds
+  // its receive time (LiGetMillis() epoch) into the drift estimator.
+  double MapVideoFrame(uint32_t hostPtsMs, uint64_t receiveTimeMs);
+
+  // Maps any other host timestamp onto the same timeline without updating the
+  // estimator, e.g. to compare audio against video for A/V sync.
+  double MapHostTime(uint32_t hostPtsMs) const;
+
+  // Shifts future presentation times by the given amount, slewed over
+  // subsequent frames so that timestamps stay monotonic.
+  void Nudge(double seconds);
+
+  bool IsValid() const;
+  // Local clock rate relative to the host clock, in parts per million
+  double DriftPpm() const;
+
+  private:
+  void RestartEstimator(uint32_t hostPtsMs, uint64_t receiveTimeMs);
+  void AddSample(double hostMs, double localMs);
+
+  mutable std::mutex m_Mutex;
+  double m_FrameDuration = 0.0;
+  bool m_HasOrigin = false;
+  uint32_t m_HostOrigin = 0;
+  uint64_t m_LocalOrigin = 0;
+  uint32_t m_LastHostPts = 0;
+  double m_Pts = 0.0;
+  double m_PendingNudge = 0.0;
+  double m_Rate = 1.0;
+  double m_Forgetting = 1.0;
+  // Exponentially weighted sums for the least-squares fit
+  double m_SumW = 0.0, m_SumX = 0.0, m_SumY = 0.0, m_SumXX = 0.0, m_SumXY = 0.0;
+};
+
+// Holds lip-sync between the EMSS video track and the Web Audio scheduler
+// (platform/audio.js) by comparing the output latency of both paths and
+// shifting whichever one keeps the total latency lowest.
+class AvSyncController {
+  public:
+  // Video is delayed through videoClock. A tolerance of 0 disables the controller.
+  void Reset(PresentationClock* videoClock, uint32_t frameRate, int toleranceMs);
+
+  void OnVideoFrame(uint32_t hostPtsMs, uint64_t receiveTimeMs, uint64_t submitTimeMs);
+  void OnAudioFrame(uint32_t hostTimestampMs, uint64_t receiveTimeMs, uint64_t decodeTimeMs);
+  // Audio queued in Web Audio and the output latency of the audio context
+  void OnAudioOutput(double queuedMs, double deviceLatencyMs);
+
+  bool IsValid() const;
+  // Positive when audio is heard after the matching video frame is shown
+  double OffsetMs() const;
+
+  private:
+  // Local latency of one path, measured from the earliest arrival time that
+  // its host timestamps allow, so that network jitter counts as latency too
+  struct PathEstimate {
+    bool valid = false;
+    double latencyMs = 0.0;
+    uint32_t windowStartMs = 0;
+    uint32_t minTransit = 0;
+    uint32_t prevMinTransit = 0;
+
+    void AddSample(uint32_t hostMs, uint64_t receiveTimeMs, uint64_t doneTimeMs);
+  };
+
+  double OffsetMsLocked() const;
+  void RunControlStep(uint64_t nowMs);
+  void ShiftAudio(double ms);
+
+  mutable std::mutex m_Mutex;
+  PresentationClock* m_VideoClock = nullptr;
+  int m_ToleranceMs = 0;
+  double m_VideoPipelineMs = 0.0;
+  PathEstimate m_Video;
+  PathEstimate m_Audio;
+  double m_AudioQueuedMs = 0.0;
+  double m_AudioDeviceMs = 0.0;
+  bool m_HasAudioOutput = false;
+  bool m_AudioShiftPending = false;
+  double m_VideoDelayMs = 0.0;
+  uint64_t m_LastControlMs = 0;
+};
+
+// Compensates for the host audio clock and the AudioContext clock running at
+// slightly different rates. A servo on the Web Audio queue depth steers the
+// ratio of a cubic interpolating resampler applied to each decoded frame.
+class AudioDriftResampler {
+  public:
+  static constexpr int kMaxChannels = 8;
+
+  void Reset(int channelCount);
+
+  // Resamples one interleaved frame. Returns the number of output samples per
+  // channel, which differs from inSamples by at most one or two.
+  int Process(const int16_t* in, int inSamples, int16_t* out, int maxOutSamples);
+
+  // Feeds the servo with the Web Audio queue depth, excluding deliberate
+  // shifts made for A/V sync. Called periodically from the main thread.
+  void OnQueueDepth(double queuedMs);
+
+  bool IsValid() const;
+  // Estimated host audio clock rate relative to the audio output, in ppm
+  double DriftPpm() const;
+
+  private:
+  mutable std::mutex m_Mutex;
+  std::atomic<double> m_Step{1.0};
+  std::atomic<double> m_DriftPpm{0.0};
+
+  // Servo state, owned by the main thread
+  int m_Reports = 0;
+  double m_SmoothedMs = 0.0;
+  double m_SetpointMs = 0.0;
+  double m_IntegralPpm = 0.0;
+
+  // Resampler state, owned by the feeder thread
+  int m_Channels = 0;
+  double m_Position = 1.0;
+  int16_t m_History[3 * kMaxChannels] = {};
+};
+
+// Describes the EMSS video track: the MIME type with the exact codec string of
+// the stream, and the matching avcC, hvcC or av1C record as extradata.
+struct VideoCodecConfig {
+  std::string mimeType;
+  std::vector<uint8_t> extradata;
+
+  bool operator==(const VideoCodecConfig& other) const {
+    return mimeType == other.mimeType && extradata == other.extradata;
+  }
+  bool operator!=(const VideoCodecConfig& other) const { return !(*this == other); }
+};
+
+// Generic level-based configuration for a negotiated format, used when an IDR
+// frame doesn't carry codec configuration data that can be parsed
+VideoCodecConfig DefaultVideoCodecConfig(int videoFormat);
+
+// Builds the configuration from the parameter sets (H.264, HEVC) or the
+// sequence header (AV1) at the start of an IDR frame
+bool BuildVideoCodecConfig(int videoFormat, PDECODE_UNIT decodeUnit, VideoCodecConfig* config);
+
 enum class LoadResult {
   Success, CertErr, PrivateKeyErr
 };
@@ -130,6 +371,10 @@ class MoonlightInstance {
   static void ProfilerPrintPackedDeltaFromNow(const char* message, uint32_t packedTime);
   static void ProfilerPrintDeltaFromNow(const char* message, uint64_t time);
   static void ProfilerPrintWarning(const char* message);
+  static void ProfilerPrintLockStats();
+  static void ProfilerStartAllocationTracking();
+  static void ProfilerMarkAllocationSteadyState();
+  static void ProfilerPrintAllocationStats();
 
   static void* ConnectionThreadFunc(void* context);
   static void* InputThreadFunc(void* context);
@@ -144,6 +389,7 @@ class MoonlightInstance {
   static void ClLogMessage(const char* format, ...);
   static void ClControllerRumble(unsigned short controllerNumber, unsigned short lowFreqMotor, unsigned short highFreqMotor);
   static void ClConnectionStatusUpdate(int connectionStatus);
+  static void ClFlightRecorderDump(const char* reason, const char* data, int length);
 
   void DidChangeFocus(bool got_focus);
   bool InitializeRenderingSurface(int width, int height);
@@ -167,9 +413,16 @@ class MoonlightInstance {
 
   LoadResult LoadCert(const char* certStr, const char* keyStr);
 
+  // Timing state shared by the audio and video renderers
+  PresentationClock m_PresentationClock;
+  AvSyncController m_AvSync;
+  AudioDriftResampler m_AudioResampler;
+
   private:
     using EmssReadyState = samsung::wasm::ElementaryMediaStreamSource::ReadyState;
     using EmssTrackCloseReason = samsung::wasm::ElementaryMediaTrack::CloseReason;
+
+  static bool ConfigureVideoTrack(const VideoCodecConfig& config);
   class SourceListener
     : public samsung::wasm::ElementaryMediaStreamSourceListener {
   public:
@@ -190,7 +443,7 @@ class MoonlightInstance {
   private:
     MoonlightInstance* m_Instance;
   };
-  void WaitFor(std::condition_variable* variable, std::function<bool()> condition);
+  void WaitFor(std::condition_variable_any* variable, std::function<bool()> condition);
 
   void OpenUrl_private(int callbackId, std::string url, std::string ppk, bool binaryResponse);
   void STUN_private(int callbackId);
@@ -246,9 +499,9 @@ class MoonlightInstance {
 
   Dispatcher m_Dispatcher;
 
-  std::mutex m_Mutex;
-  std::condition_variable m_EmssStateChanged;
-  std::condition_variable m_EmssVideoStateChanged;
+  ProfiledMutex m_Mutex{"EmssState"};
+  std::condition_variable_any m_EmssStateChanged;
+  std::condition_variable_any m_EmssVideoStateChanged;
   EmssReadyState m_EmssReadyState;
   std::atomic<bool> m_VideoStarted;
   std::atomic<samsung::wasm::SessionId> m_VideoSessionId;
@@ -262,8 +515,33 @@ class MoonlightInstance {
 
 extern MoonlightInstance* g_Instance;
 
+void LogMessageV(const char* format, va_list va);
+void LogSetNetworkSinkHost(const std::string& host);
+uint32_t LogGetDroppedMessageCount();
+
+// Kinds of notifications posted to the UI. Must match MessageKind in
+// platform/messages.js.
+enum class JsMessageKind : uint32_t {
+  Log = 0,
+  ConnectionEstablished,
+  StreamTerminated,
+  Progress,
+  Dialog,
+  Transient,
+  Warning,
+  NoWarning,
+  Stat,
+  NoStat,
+  ControllerRumble,
+  MouseEmulationOn,
+  MouseEmulationOff,
+  FlightRecord,
+};
+
+// Both overloads are fire-and-forget and safe to call from any thread.
+void PostToJs(JsMessageKind kind, const std::string& payload = std::string());
 void PostToJs(std::string msg);
-void PostToJsAsync(std::string msg);
+uintptr_t GetJsMessageRing();
 void PostPromiseMessage(int callbackId, const std::string& type, const std::string& response);
 void PostPromiseMessage(int callbackId, const std::string& type, const std::vector<uint8_t>& response);
 
@@ -280,6 +558,9 @@ MessageResult startStream(std::string host, std::string width, std::string heigh
 MessageResult stopStream();
 
 void toggleStats();
+void setLatencyBudget(int latencyBudgetMs);
+void setAvSyncTolerance(int toleranceMs);
+void reportAudioLatency(double queuedMs, double deviceLatencyMs, double syncOffsetMs);
 void stun(int callbackId);
 void pair(int callbackId, std::string serverMajorVersion, std::string address, std::string randomNumber);
 void wakeOnLan(int callbackId, std::string macAddress);
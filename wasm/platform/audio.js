@@ -7,8 +7,25 @@
 //
 // startAudioScheduler() / stopAudioScheduler() are called from index.js /
 // messages.js; they reset scheduling state around the stream lifetime.
+//
+// The A/V sync controller (avsync.cpp) shifts audio through _audShift() and
+// gets the scheduled-ahead time and output latency back through
+// Module.reportAudioLatency(). The same report drives the clock-drift
+// resampler in C++, which holds the queue depth minus those shifts steady.
 
 var _audNextTime = 0.0;  // next AudioBufferSourceNode start time (Web Audio clock)
+var _audPendingShift = 0.0;  // A/V sync shift not yet applied (s), < 0 = pull in
+var _audSyncDelay = 0.0;  // net delay added for A/V sync on top of the target (s)
+var _audSyncOffset = 0.0;  // signed sum of applied A/V sync shifts (s)
+var _audFrameCount = 0;
+
+// Report latency to the A/V sync controller every this many frames.
+var AUD_REPORT_INTERVAL_FRAMES = 25;
+
+// Called by the C++ A/V sync controller via MAIN_THREAD_ASYNC_EM_ASM.
+function _audShift(ms) {
+  _audPendingShift += ms / 1000.0;
+}
 
 // Called by C++ feeder thread via MAIN_THREAD_ASYNC_EM_ASM for each decoded frame.
 //   ptr      — WASM heap byte offset of interleaved int16 PCM
@@ -31,10 +48,29 @@ function _audReceiveFrame(ptr, spf, channels, sampleRate) {
   // Snap if behind (initial start or gap after suspension).
   if (_audNextTime < now) _audNextTime = now;
 
+  // Apply A/V sync shifts: delay by leaving a gap, pull in by dropping frames.
+  if (_audPendingShift > 0) {
+    _audNextTime += _audPendingShift;
+    _audSyncDelay += _audPendingShift;
+    _audSyncOffset += _audPendingShift;
+    _audPendingShift = 0.0;
+  } else if (_audPendingShift < 0) {
+    var frameS = spf / sampleRate;
+    _audPendingShift = Math.min(_audPendingShift + frameS, 0.0);
+    _audSyncDelay = Math.max(_audSyncDelay - frameS, 0.0);
+    _audSyncOffset -= frameS;
+    return;
+  }
+
   // Discard if already targetMs of audio is queued — handles stale bursts
   // that accumulate in the MAIN_THREAD_ASYNC_EM_ASM task queue while the
   // TV UI is open and the main thread is throttled.
-  if (_audNextTime > now + targetS) return;
+  if (_audNextTime > now + targetS + _audSyncDelay) return;
+
+  if (++_audFrameCount % AUD_REPORT_INTERVAL_FRAMES === 0 && Module.reportAudioLatency) {
+    var deviceS = ctx.outputLatency || ctx.baseLatency || 0.0;
+    Module.reportAudioLatency((_audNextTime - now) * 1000.0, deviceS * 1000.0, _audSyncOffset * 1000.0);
+  }
 
   // Copy PCM from WASM heap into an AudioBuffer.
   var abuf = ctx.createBuffer(channels, spf, sampleRate);
@@ -54,8 +90,16 @@ function _audReceiveFrame(ptr, spf, channels, sampleRate) {
 
 function startAudioScheduler() {
   _audNextTime = 0.0;
+  _audPendingShift = 0.0;
+  _audSyncDelay = 0.0;
+  _audSyncOffset = 0.0;
+  _audFrameCount = 0;
 }
 
 function stopAudioScheduler() {
   _audNextTime = 0.0;
+  _audPendingShift = 0.0;
+  _audSyncDelay = 0.0;
+  _audSyncOffset = 0.0;
+  _audFrameCount = 0;
 }
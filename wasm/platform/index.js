@@ -150,6 +150,7 @@ function changeUiModeForWasmLoad() {
 }
 
 function moduleDidLoad() {
+  startMessagePump();
   loadHTTPCerts();
 }
 
@@ -13,6 +13,10 @@ const SyncFunctions = {
   'stopRequest': (...args) => Module.stopStream(...args),
   // no parameters
   'toggleStats': (...args) => Module.toggleStats(...args),
+  // latencyBudgetMs (0 = never drop frames)
+  'setLatencyBudget': (...args) => Module.setLatencyBudget(...args),
+  // toleranceMs (0 = disable A/V sync)
+  'setAvSyncTolerance': (...args) => Module.setAvSyncTolerance(...args),
 };
 
 const AsyncFunctions = {
@@ -64,16 +68,160 @@ var handlePromiseMessage = function(callbackId, type, msg) {
   delete callbacks[callbackId];
 }
 
+// Kinds of messages posted by the Wasm module. Must match JsMessageKind in moonlight_wasm.hpp.
+const MessageKind = {
+  Log: 0,
+  ConnectionEstablished: 1,
+  StreamTerminated: 2,
+  Progress: 3,
+  Dialog: 4,
+  Transient: 5,
+  Warning: 6,
+  NoWarning: 7,
+  Stat: 8,
+  NoStat: 9,
+  ControllerRumble: 10,
+  MouseEmulationOn: 11,
+  MouseEmulationOff: 12,
+  FlightRecord: 13,
+};
+
+// Flight recorder dumps are kept in the widget private storage, which is r/w (read/write)
+const flightRecordDir = 'wgt-private/flight-recorder';
+const maxFlightRecords = 10;
+
+/**
+ * saveFlightRecord - Saves a flight recorder dump and removes the oldest dumps
+ *
+ * @param  {String} msg The CSV text of the dump
+ * @return {void}
+ */
+function saveFlightRecord(msg) {
+  // The first line names the reason of the dump
+  var reason = (msg.match(/^# reason=([\w-]+)/) || [])[1] || 'dump';
+  var fileName = new Date().toISOString().replace(/[:.]/g, '-') + '-' + reason + '.csv';
+
+  try {
+    if (!tizen.filesystem.pathExists(flightRecordDir)) {
+      tizen.filesystem.createDirectory(flightRecordDir, true);
+    }
+    var fileHandleWrite = tizen.filesystem.openFile(flightRecordDir + '/' + fileName, 'w');
+    fileHandleWrite.writeString(msg);
+    fileHandleWrite.close();
+    console.log('%c[messages.js, saveFlightRecord]', 'color: gray;', 'Saved flight recorder dump: ', fileName);
+  } catch (writeError) {
+    console.error('%c[messages.js, saveFlightRecord]', 'color: gray;', 'Error: Unable to save flight recorder dump: ', writeError);
+    return;
+  }
+
+  // The file names sort by time
+  tizen.filesystem.listDirectory(flightRecordDir, function(fileNames) {
+    fileNames.sort();
+    fileNames.slice(0, Math.max(0, fileNames.length - maxFlightRecords)).forEach(function(oldFileName) {
+      try {
+        tizen.filesystem.deleteFile(flightRecordDir + '/' + oldFileName);
+      } catch (deleteError) {
+        console.warn('%c[messages.js, saveFlightRecord]', 'color: gray;', 'Warning: Unable to delete flight recorder dump: ', deleteError);
+      }
+    });
+  }, function(listError) {
+    console.warn('%c[messages.js, saveFlightRecord]', 'color: gray;', 'Warning: Unable to list flight recorder dumps: ', listError);
+  });
+}
+
+var messageRing = null;
+
+/**
+ * startMessagePump - Starts draining the Wasm module's message ring on the main thread
+ *
+ * The Wasm module never blocks on the UI: it writes messages into a ring in shared memory
+ * and bumps a doorbell. The ring is drained as soon as the doorbell is notified when
+ * Atomics.waitAsync is available, and on every animation frame otherwise.
+ *
+ * @return {void}
+ */
+function startMessagePump() {
+  const base = Module.messageRing() >> 2;
+  // Header layout must match JsMessageRing in messages.cpp
+  messageRing = {
+    enqueuePos: base,
+    dequeuePos: base + 1,
+    doorbell: base + 2,
+    slotCount: Module.HEAPU32[base + 3],
+    slotBytes: Module.HEAPU32[base + 4],
+    payloadOffset: Module.HEAPU32[base + 5],
+    slotsAddr: (base + 8) << 2,
+    decoder: new TextDecoder(),
+  };
+
+  if (typeof Atomics.waitAsync === 'function') {
+    const waitForDoorbell = () => {
+      const doorbell = Atomics.load(Module.HEAP32, messageRing.doorbell);
+      drainMessages();
+      const result = Atomics.waitAsync(Module.HEAP32, messageRing.doorbell, doorbell);
+      if (result.async) {
+        result.value.then(waitForDoorbell);
+      } else {
+        setTimeout(waitForDoorbell, 0);
+      }
+    };
+    waitForDoorbell();
+  } else {
+    const onAnimationFrame = () => {
+      drainMessages();
+      requestAnimationFrame(onAnimationFrame);
+    };
+    requestAnimationFrame(onAnimationFrame);
+  }
+}
+
+/**
+ * drainMessages - Dispatches every message published in the ring so far
+ *
+ * @return {void}
+ */
+function drainMessages() {
+  if (messageRing === null) {
+    return;
+  }
+  const heap32 = Module.HEAP32;
+  let pos = Atomics.load(heap32, messageRing.dequeuePos) >>> 0;
+  while (true) {
+    const slotAddr = messageRing.slotsAddr + (pos & (messageRing.slotCount - 1)) * messageRing.slotBytes;
+    // Slot words: sequence, kind, length, then the payload bytes
+    const slot = slotAddr >> 2;
+    if ((Atomics.load(heap32, slot) >>> 0) !== ((pos + 1) >>> 0)) {
+      break;
+    }
+    const kind = heap32[slot + 1];
+    const length = heap32[slot + 2];
+    const payloadAddr = slotAddr + messageRing.payloadOffset;
+    const msg = messageRing.decoder.decode(Module.HEAPU8.slice(payloadAddr, payloadAddr + length));
+    // Hand the slot back to the producers for the next lap
+    Atomics.store(heap32, slot, (pos + messageRing.slotCount) | 0);
+    pos = (pos + 1) >>> 0;
+    Atomics.store(heap32, messageRing.dequeuePos, pos | 0);
+    handleMessage(kind, msg);
+  }
+}
+
 /**
  * handleMessage - Handles messages from the Wasm module
  *
- * @param  {Object} msg An object given by the Wasm module
+ * @param  {Number} kind One of MessageKind
+ * @param  {String} msg The message payload given by the Wasm module
  * @return {void}
  */
-function handleMessage(msg) {
-  console.log('%c[messages.js, handleMessage]', 'color: gray;', 'Message data: ', msg);
+function handleMessage(kind, msg) {
+  // Dumps are too large for the console
+  if (kind === MessageKind.FlightRecord) {
+    saveFlightRecord(msg);
+    return;
+  }
+
+  console.log('%c[messages.js, handleMessage]', 'color: gray;', 'Message data: ', kind, msg);
   // If it's a recognized event, notify the appropriate function
-  if (msg.indexOf('streamTerminated: ') === 0) {
+  if (kind === MessageKind.StreamTerminated) {
     // Stop the Web Audio scheduler so it doesn't try to read freed WASM memory.
     stopAudioScheduler();
     // Remove the on-screen overlays
@@ -84,7 +232,7 @@ function handleMessage(msg) {
     $('body').css('backgroundColor', '#282C38');
     $('#wasm_module').css('display', 'none');
     // Show a termination snackbar message if the termination was unexpected
-    var errorCode = parseInt(msg.replace('streamTerminated: ', ''));
+    var errorCode = parseInt(msg);
     switch (errorCode) {
       case 0: // ML_ERROR_GRACEFUL_TERMINATION
         break;
@@ -115,34 +263,31 @@ function handleMessage(msg) {
       // Switch to Apps view
       Navigation.change(Views.Apps);
     }, 1500);
-  } else if (msg === 'Connection Established') {
+  } else if (kind === MessageKind.ConnectionEstablished) {
     // Prepare the screen for video stream
     $('#loadingSpinner').css('display', 'none');
     $('body').css('backgroundColor', 'transparent');
     $('#wasm_module').css('display', '');
     $('#wasm_module').focus();
-  } else if (msg.indexOf('ProgressMsg: ') === 0) {
+  } else if (kind === MessageKind.Progress) {
     // Show progress message under loading spinner
-    $('#loadingSpinnerMessage').text(msg.replace('ProgressMsg: ', ''));
-  } else if (msg.indexOf('TransientMsg: ') === 0) {
+    $('#loadingSpinnerMessage').text(msg);
+  } else if (kind === MessageKind.Transient) {
     // Show transient message as notification
-    snackbarLogLong(msg.replace('TransientMsg: ', ''));
-  } else if (msg.indexOf('DialogMsg: ') === 0) {
+    snackbarLogLong(msg);
+  } else if (kind === MessageKind.Dialog) {
     // Show dialog message as notification
     // FIXME: Really use a dialog
-    snackbarLogLong(msg.replace('DialogMsg: ', ''));
-  } else if (msg === 'displayVideo') {
-    // Show the video stream now
-    $('#listener').addClass('fullscreen');
-  } else if (msg.indexOf('NoWarningMsg: ') === 0) {
+    snackbarLogLong(msg);
+  } else if (kind === MessageKind.NoWarning) {
     // Hide the connection warnings overlay
     $('#connection-warnings').css('background', 'transparent');
     $('#connection-warnings').text('');
-  } else if (msg.indexOf('WarningMsg: ') === 0) {
+  } else if (kind === MessageKind.Warning) {
     // Show the connection warnings overlay
     $('#connection-warnings').css('background', 'rgba(0, 0, 0, 0.5)');
-    $('#connection-warnings').text(msg.replace('WarningMsg: ', ''));
-  } else if (msg.indexOf('NoStatMsg: ') === 0) {
+    $('#connection-warnings').text(msg);
+  } else if (kind === MessageKind.NoStat) {
     // Toggle the performance stats switch and save the state
     if ($('#performanceStatsSwitch').prop('checked')) {
       $('#performanceStatsBtn')[0].MaterialSwitch.off();
@@ -152,7 +297,7 @@ function handleMessage(msg) {
     // Hide the performance statistics overlay
     $('#performance-stats').css('background', 'transparent');
     $('#performance-stats').text('');
-  } else if (msg.indexOf('StatMsg: ') === 0) {
+  } else if (kind === MessageKind.Stat) {
     // Toggle the performance stats switch and save the state
     if (!$('#performanceStatsSwitch').prop('checked')) {
       $('#performanceStatsBtn')[0].MaterialSwitch.on();
@@ -161,9 +306,9 @@ function handleMessage(msg) {
     }
     // Show the performance statistics overlay
     $('#performance-stats').css('background', 'rgba(0, 0, 0, 0.5)');
-    $('#performance-stats').text(msg.replace('StatMsg: ', ''));
-  } else if (msg.indexOf('controllerRumble: ') === 0) {
-    const eventData = msg.split(' ')[1].split(',');
+    $('#performance-stats').text(msg);
+  } else if (kind === MessageKind.ControllerRumble) {
+    const eventData = msg.split(',');
     const gamepadIdx = parseInt(eventData[0]);
     const weakMagnitude = parseFloat(eventData[1]);
     const strongMagnitude = parseFloat(eventData[2]);
@@ -181,10 +326,10 @@ function handleMessage(msg) {
     } else {
       console.warn('%c[messages.js, handleMessage]', 'color: gray;', 'Warning: Gamepad ' + gamepadIdx + ' does not support the rumble feature!');
     }
-  } else if (msg.indexOf('mouseEmulationOn') === 0) {
+  } else if (kind === MessageKind.MouseEmulationOn) {
     // Show mouse emulation enable status as a notification
     snackbarLogLong('Mouse emulation is activated');
-  } else if (msg.indexOf('mouseEmulationOff') === 0) {
+  } else if (kind === MessageKind.MouseEmulationOff) {
     // Show mouse emulation disable status as notification
     snackbarLogLong('Mouse emulation is deactivated');
   }
@@ -0,0 +1,141 @@
+#include "moonlight_wasm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+// ─── Tuning ───────────────────────────────────────────────────────────────────
+// Host timestamp jumps larger than this are treated as a discontinuity (host
+// capture restart, long stall) rather than as time that has actually passed.
+static constexpr int32_t kMaxHostGapMs = 1000;
+
+// Time constant of the exponential forgetting applied to the fit. Crystal drift
+// is in the tens of ppm, so it needs tens of seconds to rise above the jitter.
+static constexpr double kEstimatorWindowSec = 30.0;
+
+// The fitted rate is only used once the samples span enough host time
+// (standard deviation of the host timestamps, in ms).
+static constexpr double kMinSampleSpreadMs = 1000.0;
+
+// Anything beyond this is a broken fit rather than real clock drift.
+static constexpr double kMaxRateError = 0.001;
+
+// Sums are rebased onto the latest sample periodically to keep them small.
+static constexpr int32_t kRebaseIntervalMs = 10000;
+
+// Smallest step between two consecutive presentation times, and the largest
+// per-frame correction applied while slewing a Nudge().
+static constexpr double kMinAdvanceSec = 0.001;
+static constexpr double kMaxSlewSec    = 0.001;
+
+void PresentationClock::Reset(uint32_t frameRate) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  m_FrameDuration = 1.0 / (double)frameRate;
+  m_Forgetting = 1.0 - 1.0 / (kEstimatorWindowSec * frameRate);
+  m_HasOrigin = false;
+  m_Pts = 0.0;
+  m_PendingNudge = 0.0;
+  m_Rate = 1.0;
+  m_SumW = m_SumX = m_SumY = m_SumXX = m_SumXY = 0.0;
+}
+
+void PresentationClock::RestartEstimator(uint32_t hostPtsMs, uint64_t receiveTimeMs) {
+  // The rate estimate is kept, since a discontinuity in the host timestamps
+  // doesn't change how fast either clock runs.
+  m_HostOrigin = hostPtsMs;
+  m_LocalOrigin = receiveTimeMs;
+  m_SumW = m_SumX = m_SumY = m_SumXX = m_SumXY = 0.0;
+}
+
+void PresentationClock::AddSample(double hostMs, double localMs) {
+  m_SumW  = m_SumW  * m_Forgetting + 1.0;
+  m_SumX  = m_SumX  * m_Forgetting + hostMs;
+  m_SumY  = m_SumY  * m_Forgetting + localMs;
+  m_SumXX = m_SumXX * m_Forgetting + hostMs * hostMs;
+  m_SumXY = m_SumXY * m_Forgetting + hostMs * localMs;
+
+  double denom = m_SumW * m_SumXX - m_SumX * m_SumX;
+  if (denom / (m_SumW * m_SumW) < kMinSampleSpreadMs * kMinSampleSpreadMs) {
+    return;
+  }
+
+  double rate = (m_SumW * m_SumXY - m_SumX * m_SumY) / denom;
+  m_Rate = std::min(std::max(rate, 1.0 - kMaxRateError), 1.0 + kMaxRateError);
+}
+
+double PresentationClock::MapVideoFrame(uint32_t hostPtsMs, uint64_t receiveTimeMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  if (!m_HasOrigin) {
+    m_HasOrigin = true;
+    m_LastHostPts = hostPtsMs;
+    RestartEstimator(hostPtsMs, receiveTimeMs);
+    AddSample(0.0, 0.0);
+    return m_Pts;
+  }
+
+  double advance;
+  int32_t hostDelta = (int32_t)(hostPtsMs - m_LastHostPts);
+  if (hostDelta > 0 && hostDelta <= kMaxHostGapMs) {
+    // Frames the host dropped or never sent simply show up as a longer delta
+    advance = hostDelta / 1000.0 * m_Rate;
+    m_LastHostPts = hostPtsMs;
+
+    int32_t hostOffset = (int32_t)(hostPtsMs - m_HostOrigin);
+    int64_t localOffset = (int64_t)(receiveTimeMs - m_LocalOrigin);
+    if (hostOffset > kRebaseIntervalMs) {
+      double dx = hostOffset;
+      double dy = (double)localOffset;
+      m_SumXY -= dx * m_SumY + dy * m_SumX - dx * dy * m_SumW;
+      m_SumXX -= 2.0 * dx * m_SumX - dx * dx * m_SumW;
+      m_SumX  -= dx * m_SumW;
+      m_SumY  -= dy * m_SumW;
+      m_HostOrigin = hostPtsMs;
+      m_LocalOrigin = receiveTimeMs;
+      hostOffset = 0;
+      localOffset = 0;
+    }
+    AddSample(hostOffset, (double)localOffset);
+  } else if (hostDelta > kMaxHostGapMs || hostDelta < -kMaxHostGapMs) {
+    // Discontinuity: continue one nominal frame later and start a new fit
+    advance = m_FrameDuration;
+    m_LastHostPts = hostPtsMs;
+    RestartEstimator(hostPtsMs, receiveTimeMs);
+    AddSample(0.0, 0.0);
+  } else {
+    // Repeated or slightly reordered timestamp. EMSS needs increasing times.
+    advance = kMinAdvanceSec;
+  }
+
+  double slew = std::min(std::max(m_PendingNudge, -kMaxSlewSec), kMaxSlewSec);
+  slew = std::max(slew, kMinAdvanceSec - advance);
+  m_PendingNudge -= slew;
+  m_Pts += advance + slew;
+
+  return m_Pts;
+}
+
+double PresentationClock::MapHostTime(uint32_t hostPtsMs) const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  if (!m_HasOrigin) {
+    return 0.0;
+  }
+  return m_Pts + (int32_t)(hostPtsMs - m_LastHostPts) / 1000.0 * m_Rate;
+}
+
+void PresentationClock::Nudge(double seconds) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  m_PendingNudge += seconds;
+}
+
+bool PresentationClock::IsValid() const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  return m_HasOrigin;
+}
+
+double PresentationClock::DriftPpm() const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  return (m_Rate - 1.0) * 1e6;
+}
@@ -1,6 +1,9 @@
 #include "moonlight_wasm.hpp"
 
 #include <stdio.h>
+#include <stdlib.h>
+
+#include <new>
 
 #include <sys/time.h>
 
@@ -79,3 +82,162 @@ void MoonlightInstance::ProfilerPrintDeltaFromNow(const char* message, uint64_t
 void MoonlightInstance::ProfilerPrintDelta(const char* message, uint64_t timeA, uint64_t timeB) {
     printDeltaAboveThreshold(message, (uint32_t)(timeB - timeA));
 }
+
+void MoonlightInstance::ProfilerPrintLockStats() {
+    #if defined(ENABLE_PROFILING)
+        LOCK_STATS stats[32];
+        int count = LiGetLockStats(stats, 32);
+
+        for (int i = 0; i < count; i++) {
+            printf("Lock %s (x%u): %llu acquisitions, %.1f%% contended, wait p99 %u us max %llu us, hold p99 %u us max %llu us\n",
+                   stats[i].name, stats[i].instances,
+                   (unsigned long long)stats[i].acquisitions,
+                   (double)stats[i].contendedAcquisitions * 100 / stats[i].acquisitions,
+                   stats[i].p99WaitUs, (unsigned long long)stats[i].maxWaitUs,
+                   stats[i].p99HoldUs, (unsigned long long)stats[i].maxHoldUs);
+        }
+    #endif
+}
+
+// Sites are linked together while static objects are constructed
+static AllocationSite* s_AllocationSites;
+static thread_local AllocationSite* s_CurrentAllocationSite;
+static AllocationSite s_OtherAllocations("Other");
+static std::atomic<bool> s_AllocationTrackingActive;
+static uint64_t s_SteadyStateStartMs;
+static uint64_t s_TrackingEndMs;
+
+AllocationSite::AllocationSite(const char* name) : name(name), next(s_AllocationSites) {
+    s_AllocationSites = this;
+}
+
+AllocationScope::AllocationScope(AllocationSite& site) : m_Previous(s_CurrentAllocationSite) {
+    s_CurrentAllocationSite = &site;
+}
+
+AllocationScope::~AllocationScope() {
+    s_CurrentAllocationSite = m_Previous;
+}
+
+#if defined(ENABLE_PROFILING)
+static AllocationSite* getAllocationSite() {
+    return s_CurrentAllocationSite != nullptr ? s_CurrentAllocationSite : &s_OtherAllocations;
+}
+
+static void* trackedNew(std::size_t size) {
+    if (s_AllocationTrackingActive.load(std::memory_order_relaxed)) {
+        AllocationSite* site = getAllocationSite();
+        site->allocations.fetch_add(1, std::memory_order_relaxed);
+        site->bytes.fetch_add(size, std::memory_order_relaxed);
+    }
+    return malloc(size != 0 ? size : 1);
+}
+
+static void trackedDelete(void* ptr) {
+    if (ptr != nullptr && s_AllocationTrackingActive.load(std::memory_order_relaxed)) {
+        getAllocationSite()->frees.fetch_add(1, std::memory_order_relaxed);
+    }
+    free(ptr);
+}
+
+void* operator new(std::size_t size) {
+    void* ptr = trackedNew(size);
+    if (ptr == nullptr) {
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    return trackedNew(size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept {
+    return trackedNew(size);
+}
+
+void operator delete(void* ptr) noexcept {
+    trackedDelete(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+    trackedDelete(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    trackedDelete(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept {
+    trackedDelete(ptr);
+}
+#endif
+
+void MoonlightInstance::ProfilerStartAllocationTracking() {
+    #if defined(ENABLE_PROFILING)
+        for (AllocationSite* site = s_AllocationSites; site != nullptr; site = site->next) {
+            site->allocations = 0;
+            site->bytes = 0;
+            site->frees = 0;
+            site->steadyStateAllocations = 0;
+            site->steadyStateBytes = 0;
+        }
+        s_SteadyStateStartMs = 0;
+        s_AllocationTrackingActive = true;
+
+        // The library counts its own allocations per source file
+        LiSetAllocationTrackingEnabled(true);
+    #endif
+}
+
+void MoonlightInstance::ProfilerMarkAllocationSteadyState() {
+    #if defined(ENABLE_PROFILING)
+        for (AllocationSite* site = s_AllocationSites; site != nullptr; site = site->next) {
+            site->steadyStateAllocations = site->allocations;
+            site->steadyStateBytes = site->bytes;
+        }
+        s_SteadyStateStartMs = ProfilerGetMillis();
+    #endif
+}
+
+void MoonlightInstance::ProfilerPrintAllocationStats() {
+    #if defined(ENABLE_PROFILING)
+        ALLOCATION_STATS stats[48];
+        double totalRate = 0;
+        int count;
+
+        if (s_AllocationTrackingActive.exchange(false)) {
+            s_TrackingEndMs = ProfilerGetMillis();
+        }
+
+        count = LiGetAllocationStats(stats, 48);
+        for (int i = 0; i < count; i++) {
+            printf("Allocations in %s: %llu (%llu bytes), %.1f/s (%.0f bytes/s) streaming\n",
+                   stats[i].name, (unsigned long long)stats[i].allocations,
+                   (unsigned long long)stats[i].bytes,
+                   stats[i].allocationsPerSecond, stats[i].bytesPerSecond);
+            totalRate += stats[i].allocationsPerSecond;
+        }
+
+        double seconds = s_SteadyStateStartMs != 0 ? (s_TrackingEndMs - s_SteadyStateStartMs) / 1000.0 : 0;
+        for (AllocationSite* site = s_AllocationSites; site != nullptr; site = site->next) {
+            uint64_t allocations = site->allocations;
+            uint64_t bytes = site->bytes;
+            double rate = seconds > 0 ? (allocations - site->steadyStateAllocations) / seconds : 0;
+
+            if (allocations == 0) {
+                continue;
+            }
+            printf("Allocations in C++ %s: %llu (%llu bytes), %.1f/s (%.0f bytes/s) streaming\n",
+                   site->name, (unsigned long long)allocations, (unsigned long long)bytes,
+                   rate, seconds > 0 ? (bytes - site->steadyStateBytes) / seconds : 0);
+            totalRate += rate;
+        }
+
+        printf("Steady-state allocation rate: %.1f/s\n", totalRate);
+    #endif
+}
@@ -0,0 +1,120 @@
+#include "moonlight_wasm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+
+// ─── Servo tuning ─────────────────────────────────────────────────────────────
+// Queue depth reports arrive every ~250 ms. The setpoint is taken once the
+// queue has settled after startup.
+static constexpr int    kSettleReports     = 20;
+static constexpr double kDepthSmoothing    = 0.1;
+static constexpr double kReportIntervalSec = 0.25;
+
+// Proportional gain corrects a 10 ms depth error in about a minute; the
+// integral term converges on the actual clock drift over a few minutes.
+static constexpr double kProportionalPpmPerMs      = 16.0;
+static constexpr double kIntegralPpmPerMsPerSecond = 0.1;
+
+// Real crystal drift is well inside these limits. At 1000 ppm the pitch
+// change is under 2 cents, far below what is audible.
+static constexpr double kMaxIntegralPpm = 500.0;
+static constexpr double kMaxTotalPpm    = 1000.0;
+
+// ─── Servo ────────────────────────────────────────────────────────────────────
+void AudioDriftResampler::Reset(int channelCount) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  m_Step.store(1.0, std::memory_order_relaxed);
+  m_DriftPpm.store(0.0, std::memory_order_relaxed);
+  m_Reports = 0;
+  m_SmoothedMs = 0.0;
+  m_SetpointMs = 0.0;
+  m_IntegralPpm = 0.0;
+
+  m_Channels = std::min(channelCount, kMaxChannels);
+  m_Position = 1.0;
+  std::fill(std::begin(m_History), std::end(m_History), 0);
+}
+
+void AudioDriftResampler::OnQueueDepth(double queuedMs) {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+
+  m_Reports++;
+  m_SmoothedMs = m_Reports == 1 ? queuedMs : m_SmoothedMs + kDepthSmoothing * (queuedMs - m_SmoothedMs);
+  if (m_Reports < kSettleReports) {
+    return;
+  }
+  if (m_Reports == kSettleReports) {
+    m_SetpointMs = m_SmoothedMs;
+    return;
+  }
+
+  // A deeper queue than intended means the host clock runs fast relative to
+  // the output, so input has to be consumed faster (step above 1)
+  double errorMs = m_SmoothedMs - m_SetpointMs;
+  m_IntegralPpm += errorMs * kIntegralPpmPerMsPerSecond * kReportIntervalSec;
+  m_IntegralPpm = std::min(std::max(m_IntegralPpm, -kMaxIntegralPpm), kMaxIntegralPpm);
+
+  double ppm = m_IntegralPpm + errorMs * kProportionalPpmPerMs;
+  ppm = std::min(std::max(ppm, -kMaxTotalPpm), kMaxTotalPpm);
+
+  m_Step.store(1.0 + ppm / 1e6, std::memory_order_relaxed);
+  m_DriftPpm.store(m_IntegralPpm, std::memory_order_relaxed);
+}
+
+bool AudioDriftResampler::IsValid() const {
+  std::lock_guard<std::mutex> lk(m_Mutex);
+  return m_Reports > kSettleReports;
+}
+
+double AudioDriftResampler::DriftPpm() const {
+  return m_DriftPpm.load(std::memory_order_relaxed);
+}
+
+// ─── Resampler ────────────────────────────────────────────────────────────────
+// Positions are in input samples relative to a window made of the last three
+// samples of the previous frame followed by the current frame. Interpolating
+// between window[i] and window[i + 1] uses window[i - 1 .. i + 2].
+static inline int16_t cubicHermite(int16_t xm1, int16_t x0, int16_t x1, int16_t x2, double t) {
+  double c0 = x0;
+  double c1 = 0.5 * (x1 - xm1);
+  double c2 = xm1 - 2.5 * x0 + 2.0 * x1 - 0.5 * x2;
+  double c3 = 0.5 * (x2 - xm1) + 1.5 * (x0 - x1);
+  double y = ((c3 * t + c2) * t + c1) * t + c0;
+  return (int16_t)std::min(std::max(std::lround(y), -32768L), 32767L);
+}
+
+int AudioDriftResampler::Process(const int16_t* in, int inSamples, int16_t* out, int maxOutSamples) {
+  const int ch = m_Channels;
+  const int windowSamples = inSamples + 3;
+  const double step = m_Step.load(std::memory_order_relaxed);
+
+  auto sampleAt = [&](int index, int c) -> int16_t {
+    return index < 3 ? m_History[index * ch + c] : in[(index - 3) * ch + c];
+  };
+
+  int outSamples = 0;
+  while (outSamples < maxOutSamples) {
+    int i = (int)m_Position;
+    if (i + 2 >= windowSamples) {
+      break;
+    }
+    double t = m_Position - i;
+    for (int c = 0; c < ch; c++) {
+      out[outSamples * ch + c] = cubicHermite(sampleAt(i - 1, c), sampleAt(i, c), sampleAt(i + 1, c), sampleAt(i + 2, c), t);
+    }
+    outSamples++;
+    m_Position += step;
+  }
+
+  // Keep the tail of this frame for the next one and rebase the position
+  for (int k = 0; k < 3; k++) {
+    for (int c = 0; c < ch; c++) {
+      m_History[k * ch + c] = sampleAt(inSamples + k, c);
+    }
+  }
+  m_Position = std::max(m_Position - inSamples, 1.0);
+
+  return outSamples;
+}
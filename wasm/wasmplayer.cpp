@@ -57,27 +57,102 @@ static VIDEO_STATS m_ActiveWndVideoStats;
 static VIDEO_STATS m_LastWndVideoStats;
 static VIDEO_STATS m_GlobalVideoStats;
 
+// Latency budget in ms, 0 = never drop (see main.cpp)
+extern int g_VideoLatencyBudgetMs;
+
+// A/V sync tolerance in ms, 0 = disabled (see main.cpp)
+extern int g_AvSyncToleranceMs;
+
+// Minimum time between two backlog flushes, so that a slow decoder doesn't end up
+// requesting nothing but IDR frames
+static constexpr uint32_t kLatencyRecoveryCooldownMs = 1000;
+
+// An append blocking this long is a visible stutter, so the flight recorder dumps it
+static constexpr uint64_t kAppendStallUs = 50000;
+
+static bool s_LatencyRecoveryPending = false;
+static uint64_t s_LastLatencyRecoveryMs = 0;
+
+// The video track is added once the first IDR frame provides the codec
+// configuration, and is set up again if a later IDR frame changes it
+static bool s_VideoTrackConfigured = false;
+static VideoCodecConfig s_VideoTrackConfig;
+
+// Startup timing, logged once the first frame has been appended
+static uint64_t s_SetupStartMs = 0;
+static uint64_t s_TrackConfiguredMs = 0;
+static bool s_FirstAppendLogged = false;
+
+// Returns true if no other frame can reference this one, so it can be dropped
+// without corrupting the picture. For AV1 the depacketizer has already parsed
+// the frame headers and reports this in the frame flags.
+static bool IsNonReferenceFrame(PDECODE_UNIT decodeUnit) {
+  if (s_VideoFormat & VIDEO_FORMAT_MASK_AV1) {
+    return (decodeUnit->frameFlags & FRAME_FLAG_NON_REFERENCE) != 0;
+  }
+
+  // All slices of a picture share the same reference status, so the first slice NAL is enough
+  for (PLENTRY entry = decodeUnit->bufferList; entry != NULL; entry = entry->next) {
+    if (entry->bufferType != BUFFER_TYPE_PICDATA) {
+      continue;
+    }
+    const uint8_t* data = (const uint8_t*)entry->data;
+    for (int i = 0; i + 3 < entry->length; i++) {
+      if (data[i] != 0 || data[i + 1] != 0 || data[i + 2] != 1) {
+        continue;
+      }
+      uint8_t header = data[i + 3];
+      if (s_VideoFormat & VIDEO_FORMAT_MASK_H264) {
+        // Coded slice: nal_ref_idc == 0 marks a non-reference picture
+        int type = header & 0x1F;
+        if (type == 1 || type == 5) {
+          return (header & 0x60) == 0;
+        }
+      } else {
+        // VCL NAL: the even types up to RSV_VCL_N14 are sub-layer non-reference pictures
+        int type = (header >> 1) & 0x3F;
+        if (type <= 31) {
+          return type <= 14 && (type % 2) == 0;
+        }
+      }
+      i += 3;
+    }
+  }
+
+  return false;
+}
+
+// Accounts for a frame dropped before reaching the decoder
+static void CountPacerDroppedFrame(PDECODE_UNIT decodeUnit) {
+  // Frames missing before this one were still lost by the network
+  m_ActiveWndVideoStats.networkDroppedFrames += decodeUnit->frameNumber - (m_LastFrameNumber + 1);
+  m_ActiveWndVideoStats.totalFrames += decodeUnit->frameNumber - m_LastFrameNumber;
+  m_ActiveWndVideoStats.receivedFrames++;
+  m_ActiveWndVideoStats.pacerDroppedFrames++;
+  m_LastFrameNumber = decodeUnit->frameNumber;
+}
+
 MoonlightInstance::SourceListener::SourceListener(
   MoonlightInstance* instance
 ) : m_Instance(instance) {}
 
 void MoonlightInstance::SourceListener::OnSourceOpen() {
   ClLogMessage("EMSS::OnOpen\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_EmssReadyState = EmssReadyState::kOpen;
   m_Instance->m_EmssStateChanged.notify_all();
 }
 
 void MoonlightInstance::SourceListener::OnSourceOpenPending() {
   ClLogMessage("EMSS::OnOpenPending\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_EmssReadyState = EmssReadyState::kOpenPending;
   m_Instance->m_EmssStateChanged.notify_all();
 }
 
 void MoonlightInstance::SourceListener::OnSourceClosed() {
   ClLogMessage("EMSS::OnClosed\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_EmssReadyState = EmssReadyState::kClosed;
   m_Instance->m_EmssStateChanged.notify_all();
 }
@@ -88,21 +163,22 @@ MoonlightInstance::VideoTrackListener::VideoTrackListener(
 
 void MoonlightInstance::VideoTrackListener::OnTrackOpen() {
   ClLogMessage("VIDEO ElementaryMediaTrack::OnTrackOpen\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_VideoStarted = true;
   m_Instance->m_EmssVideoStateChanged.notify_all();
-  LiRequestIdrFrame();
+  // No IDR frame needs to be requested here: the track is only opened from
+  // VidDecSubmitDecodeUnit(), which appends the IDR frame it was opened for.
 }
 
 void MoonlightInstance::VideoTrackListener::OnTrackClosed(samsung::wasm::ElementaryMediaTrack::CloseReason) {
   ClLogMessage("VIDEO ElementaryMediaTrack::OnTrackClosed\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_VideoStarted = false;
 }
 
 void MoonlightInstance::VideoTrackListener::OnSessionIdChanged(samsung::wasm::SessionId new_session_id) {
   ClLogMessage("VIDEO ElementaryMediaTrack::OnSessionIdChanged\n");
-  std::unique_lock<std::mutex> lock(m_Instance->m_Mutex);
+  std::unique_lock<ProfiledMutex> lock(m_Instance->m_Mutex);
   m_Instance->m_VideoSessionId.store(new_session_id);
 }
 
@@ -125,57 +201,54 @@ int MoonlightInstance::StartupVidDecSetup(int videoFormat, int width, int height
   g_Instance->WaitFor(&g_Instance->m_EmssStateChanged, [] {
     return g_Instance->m_EmssReadyState == EmssReadyState::kClosed;
   });
-  ClLogMessage("Video: source closed, adding track\n");
-
-  {
-    const char *mimetype = "video/mp4"; // MIME-type: Video MP4 Container
-    if (videoFormat & VIDEO_FORMAT_H264) {
-      mimetype = "video/mp4; codecs=\"avc1.64002A\""; // Video codec: H.264 High Level Profile 4.2
-      /* NOTE: Depending on the capabilities of the TV, it may support higher-level codec profiles, such as:
-      5.1 (avc1.640033); */
-      ClLogMessage("Video codec profile selected: H.264 High Level Profile 4.2\n");
-    } else if (videoFormat & VIDEO_FORMAT_H265) {
-      mimetype = "video/mp4; codecs=\"hev1.1.6.L153.B0\""; // Video Codec: HEVC Main Level Profile 5.1
-      /* NOTE: Depending on the capabilities of the TV, it may support higher-level codec profiles, such as:
-      5.2 (hev1.1.6.L156.B0); */
-      ClLogMessage("Video codec profile selected: HEVC Main Level Profile 5.1\n");
-    } else if (videoFormat & VIDEO_FORMAT_H265_MAIN10) {
-      mimetype = "video/mp4; codecs=\"hev1.2.4.L153.B0\""; // Video Codec: HEVC Main10 Level Profile 5.1
-      /* NOTE: Depending on the capabilities of the TV, it may support higher-level codec profiles, such as:
-      5.2 (hev1.2.4.L156.B0); */
-      ClLogMessage("Video codec profile selected: HEVC Main10 Level Profile 5.1\n");
-    } else if (videoFormat & VIDEO_FORMAT_AV1_MAIN8) {
-      mimetype = "video/mp4; codecs=\"av01.0.13M.08\""; // Video Codec: AV1 Main Level Profile 5.1
-      /* NOTE: Depending on the capabilities of the TV, it may support higher-level codec profiles, such as:
-      5.2 (av01.0.14M.08); */
-      ClLogMessage("Video codec profile selected: AV1 Main Level Profile 5.1\n");
-    } else if (videoFormat & VIDEO_FORMAT_AV1_MAIN10) {
-      mimetype = "video/mp4; codecs=\"av01.0.13M.10\""; // Video Codec: AV1 Main10 Level Profile 5.1
-      /* NOTE: Depending on the capabilities of the TV, it may support higher-level codec profiles, such as:
-      5.2 (av01.0.14M.10); */
-      ClLogMessage("Video codec profile selected: AV1 Main10 Level Profile 5.1\n");
-    } else {
-      ClLogMessage("Failed to select video codec profile (videoFormat=0x%x)\n", videoFormat);
-      return -1;
-    }
 
-    ClLogMessage("Using mimeType %s\n", mimetype);
-    auto add_track_result = g_Instance->m_Source->AddTrack(
-      samsung::wasm::ElementaryVideoTrackConfig {
-        mimetype, // MIME-type: Selected Video Format
-        {}, // Extradata: Empty
-        samsung::wasm::DecodingMode::kHardware, // Decoding mode: Hardware
-        static_cast<uint32_t>(width), // Video resolution: Width
-        static_cast<uint32_t>(height), // Video resolution: Height
-        static_cast<uint32_t>(redrawRate), // Framerate: Numerator
-        1, // Framerate: Denominator
-      }
-    );
-    if (add_track_result) {
-      g_Instance->m_VideoTrack = std::move(*add_track_result);
-      g_Instance->m_VideoTrack.SetListener(&g_Instance->m_VideoTrackListener);
+  // Make sure the negotiated format can be described to EMSS at all
+  if (DefaultVideoCodecConfig(videoFormat).mimeType.empty()) {
+    ClLogMessage("Failed to select video codec profile (videoFormat=0x%x)\n", videoFormat);
+    return -1;
+  }
+
+  // The track itself is added by ConfigureVideoTrack() once the first IDR frame
+  // arrives, so the decoder is set up with the actual profile, level and codec
+  // configuration of the stream instead of having to reinitialise on the fly.
+  ClLogMessage("Video: source closed, waiting for the first IDR frame to add the track\n");
+  return 0;
+}
+
+// Adds the video track with the given configuration and waits for it to open.
+// An existing track is removed first, which requires closing the source.
+bool MoonlightInstance::ConfigureVideoTrack(const VideoCodecConfig& config) {
+  uint64_t startMs = LiGetMillis();
+
+  if (s_VideoTrackConfigured) {
+    ClLogMessage("Video: closing source to reconfigure the track\n");
+    g_Instance->m_Source->Close([](EmssOperationResult){});
+    g_Instance->WaitFor(&g_Instance->m_EmssStateChanged, [] {
+      return g_Instance->m_EmssReadyState == EmssReadyState::kClosed;
+    });
+    g_Instance->m_Source->RemoveTrack(g_Instance->m_VideoTrack);
+    g_Instance->m_VideoStarted = false;
+    s_VideoTrackConfigured = false;
+  }
+
+  ClLogMessage("Using mimeType %s with %u bytes of extradata\n", config.mimeType.c_str(), (uint32_t)config.extradata.size());
+  auto add_track_result = g_Instance->m_Source->AddTrack(
+    samsung::wasm::ElementaryVideoTrackConfig {
+      config.mimeType, // MIME-type: Exact codec string of the stream
+      config.extradata, // Extradata: avcC, hvcC or av1C record
+      samsung::wasm::DecodingMode::kHardware, // Decoding mode: Hardware
+      s_Width, // Video resolution: Width
+      s_Height, // Video resolution: Height
+      s_Framerate, // Framerate: Numerator
+      1, // Framerate: Denominator
     }
+  );
+  if (!add_track_result) {
+    ClLogMessage("Video: failed to add track\n");
+    return false;
   }
+  g_Instance->m_VideoTrack = std::move(*add_track_result);
+  g_Instance->m_VideoTrack.SetListener(&g_Instance->m_VideoTrackListener);
 
   ClLogMessage("Video: opening source\n");
   g_Instance->m_Source->Open([](EmssOperationResult){});
@@ -197,8 +270,10 @@ int MoonlightInstance::StartupVidDecSetup(int videoFormat, int width, int height
     return g_Instance->m_VideoStarted.load();
   });
 
-  ClLogMessage("Video track started\n");
-  return 0;
+  ClLogMessage("Video track started in %u ms\n", (uint32_t)(LiGetMillis() - startMs));
+  s_VideoTrackConfigured = true;
+  s_VideoTrackConfig = config;
+  return true;
 }
 
 int MoonlightInstance::VidDecSetup(int videoFormat, int width, int height, int redrawRate, void* context, int drFlags) {
@@ -216,8 +291,12 @@ int MoonlightInstance::VidDecSetup(int videoFormat, int width, int height, int r
   // Calculate frame duration from the frame rate
   s_frameDuration = TimeStamp(1.0 / (float)redrawRate);
 
-  // Initialize packet timestamp to zero
+  // Initialize packet timestamp to zero and restart the host-to-EMSS time mapping
   s_pktPts = 0s;
+  g_Instance->m_PresentationClock.Reset(redrawRate);
+
+  // Restart A/V sync, which delays video through the presentation clock when needed
+  g_Instance->m_AvSync.Reset(&g_Instance->m_PresentationClock, redrawRate, g_AvSyncToleranceMs);
 
   // Flag indicating whether this is the first frame of video to be decoded
   s_hasFirstFrame = false;
@@ -231,8 +310,19 @@ int MoonlightInstance::VidDecSetup(int videoFormat, int width, int height, int r
   // Set the frame pacing flag based on instance configuration
   s_FramePacingEnabled = g_Instance->m_FramePacingEnabled;
 
+  // No backlog flush is in progress for a new session
+  s_LatencyRecoveryPending = false;
+  s_LastLatencyRecoveryMs = 0;
+
+  // The video track is added once the first IDR frame arrives
+  s_VideoTrackConfigured = false;
+  s_VideoTrackConfig = VideoCodecConfig();
+  s_SetupStartMs = LiGetMillis();
+  s_TrackConfiguredMs = 0;
+  s_FirstAppendLogged = false;
+
   // Preallocate space for the performance stats string
-  s_StatString.resize(1000);
+  s_StatString.resize(2048);
 
   // Clear active window video statistics to start fresh
   memset(&m_ActiveWndVideoStats, 0, sizeof(m_ActiveWndVideoStats));
@@ -263,12 +353,61 @@ void MoonlightInstance::VidDecCleanup(void) {
   s_DecodeBuffer.shrink_to_fit();
 }
 
+static AllocationSite s_VideoAllocations("VideoRenderer");
+
 int MoonlightInstance::VidDecSubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
+  AllocationScope allocationScope(s_VideoAllocations);
+
+  // Every IDR frame carries the codec configuration. The track is added for the first
+  // one, and set up again if the configuration changes (e.g. a new AV1 sequence header).
+  if (decodeUnit->frameType == FRAME_TYPE_IDR) {
+    VideoCodecConfig config;
+    if (!BuildVideoCodecConfig(s_VideoFormat, decodeUnit, &config)) {
+      ClLogMessage("Unable to parse the codec configuration of frame %d\n", decodeUnit->frameNumber);
+      config = s_VideoTrackConfigured ? s_VideoTrackConfig : DefaultVideoCodecConfig(s_VideoFormat);
+    }
+    if (!s_VideoTrackConfigured || config != s_VideoTrackConfig) {
+      if (s_VideoTrackConfigured || (decodeUnit->frameFlags & FRAME_FLAG_SEQUENCE_CHANGED)) {
+        ClLogMessage("Codec configuration changed on frame %d\n", decodeUnit->frameNumber);
+      }
+      if (!ConfigureVideoTrack(config)) {
+        return DR_NEED_IDR;
+      }
+      if (s_TrackConfiguredMs == 0) {
+        s_TrackConfiguredMs = LiGetMillis();
+      }
+    }
+  } else if (!s_VideoTrackConfigured) {
+    // The decoder can't be set up without codec configuration data
+    return DR_NEED_IDR;
+  }
+
   // Check if video playback has not started
   if (!g_Instance->m_VideoStarted) {
     return DR_OK;
   }
 
+  // Enforce the latency budget once the stream is running. Frames that have waited too long
+  // are skipped if nothing references them, otherwise the backlog is flushed and decoding
+  // resumes at the next IDR frame, trading smoothness for bounded latency.
+  uint64_t backlogMs = LiGetMillis() - decodeUnit->receiveTimeMs;
+  if (g_VideoLatencyBudgetMs > 0 && backlogMs > (uint64_t)g_VideoLatencyBudgetMs &&
+      decodeUnit->frameType != FRAME_TYPE_IDR && m_LastFrameNumber != 0) {
+    if (IsNonReferenceFrame(decodeUnit)) {
+      CountPacerDroppedFrame(decodeUnit);
+      return DR_OK;
+    }
+    if (LiGetMillis() - s_LastLatencyRecoveryMs >= kLatencyRecoveryCooldownMs) {
+      ClLogMessage("Video backlog of %u ms exceeds the %d ms budget, skipping to the next IDR frame\n",
+                   (uint32_t)backlogMs, g_VideoLatencyBudgetMs);
+      s_LastLatencyRecoveryMs = LiGetMillis();
+      s_LatencyRecoveryPending = true;
+      CountPacerDroppedFrame(decodeUnit);
+      // Flushes the decode unit queue and waits for an IDR frame
+      return DR_NEED_IDR;
+    }
+  }
+
   // Declare variables for entry data, offset, and total length
   PLENTRY entry;
   unsigned int offset;
@@ -316,6 +455,9 @@ int MoonlightInstance::VidDecSubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
     s_hasFirstFrame = true;
   }
 
+  // Place the frame on the EMSS timeline according to its host timestamp
+  s_pktPts = TimeStamp(g_Instance->m_PresentationClock.MapVideoFrame(decodeUnit->presentationTimeMs, decodeUnit->receiveTimeMs));
+
   // Calculate the start of the pacing duration in milliseconds
   uint32_t pacingStart = LiGetMillis();
 
@@ -356,8 +498,14 @@ int MoonlightInstance::VidDecSubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
     m_ActiveWndVideoStats.measurementStartTimestamp = LiGetMillis();
     m_LastFrameNumber = decodeUnit->frameNumber;
   } else {
-    // Any frame number greater than the last frame number + 1 represents a dropped frame
-    m_ActiveWndVideoStats.networkDroppedFrames += decodeUnit->frameNumber - (m_LastFrameNumber + 1);
+    // Any frame number greater than the last frame number + 1 represents a dropped frame.
+    // Right after a backlog flush, those frames were dropped by us rather than the network.
+    if (s_LatencyRecoveryPending) {
+      m_ActiveWndVideoStats.pacerDroppedFrames += decodeUnit->frameNumber - (m_LastFrameNumber + 1);
+      s_LatencyRecoveryPending = false;
+    } else {
+      m_ActiveWndVideoStats.networkDroppedFrames += decodeUnit->frameNumber - (m_LastFrameNumber + 1);
+    }
     m_ActiveWndVideoStats.totalFrames += decodeUnit->frameNumber - (m_LastFrameNumber + 1);
     m_LastFrameNumber = decodeUnit->frameNumber;
   }
@@ -379,7 +527,7 @@ int MoonlightInstance::VidDecSubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
       // Convert the aggregated stats to a display string
       FormatVideoStats(lastTwoWndStats, s_StatString.data(), s_StatString.length());
       // Send the formatted stats string to the JS frontend for overlay display
-      PostToJs(std::string("StatMsg: ") + s_StatString.data());
+      PostToJs(JsMessageKind::Stat, s_StatString.data());
       // Clear the stats string buffer for the next use
       std::fill(s_StatString.begin(), s_StatString.end(), 0);
       // Reset byte count for the next measurement interval
@@ -435,16 +583,32 @@ int MoonlightInstance::VidDecSubmitDecodeUnit(PDECODE_UNIT decodeUnit) {
 
   // Calculate time before rendering
   uint32_t beforeRender = LiGetMillis();
+  auto appendStart = std::chrono::steady_clock::now();
 
   // Attempt to append the packet to the video track for rendering
-  if (g_Instance->m_VideoTrack.AppendPacket(pkt)) {
+  bool appended = (bool)g_Instance->m_VideoTrack.AppendPacket(pkt);
+  uint64_t appendUs = std::chrono::duration_cast<std::chrono::microseconds>(
+    std::chrono::steady_clock::now() - appendStart).count();
+  LiRecordFlightEvent(FLIGHT_EVENT_APPEND_PACKET, decodeUnit->frameNumber, (uint32_t)appendUs);
+  if (appendUs >= kAppendStallUs) {
+    LiTriggerFlightRecorderDump("append-stall");
+  }
+
+  if (appended) {
     // Calculate time after rendering
     uint32_t afterRender = LiGetMillis();
-    // Increment packet timestamp for next frame
-    s_pktPts += s_frameDuration;
     // Track total render time and count rendered frames
     m_ActiveWndVideoStats.totalRenderTime += afterRender - beforeRender;
     m_ActiveWndVideoStats.renderedFrames++;
+    // Report how long the stream took to start, split into waiting for the first IDR
+    // frame and setting up the track for it
+    if (!s_FirstAppendLogged) {
+      s_FirstAppendLogged = true;
+      ClLogMessage("First video frame appended %u ms after decoder setup (track setup took %u ms)\n",
+                   (uint32_t)(afterRender - s_SetupStartMs), (uint32_t)(afterRender - s_TrackConfiguredMs));
+    }
+    // Feed the video path latency to the A/V sync controller
+    g_Instance->m_AvSync.OnVideoFrame(decodeUnit->presentationTimeMs, decodeUnit->receiveTimeMs, afterRender);
   } else {
     ClLogMessage("Append video packet failed\n");
     return DR_NEED_IDR;
@@ -636,6 +800,73 @@ void MoonlightInstance::FormatVideoStats(VIDEO_STATS& stats, char* output, int l
     }
     offset += ret;
   }
+
+  // Show how far audio lags behind video once both paths have been measured
+  if (g_Instance->m_AvSync.IsValid()) {
+    // Print the current A/V offset, positive when audio is late
+    ret = snprintf(
+      &output[offset], length - offset,
+      "A/V sync offset: %+.1f ms\n",
+      g_Instance->m_AvSync.OffsetMs()
+    );
+    // Abort if string formatting failed or buffer overflowed
+    if (ret < 0 || ret >= length - offset) {
+      assert(false);
+      return;
+    }
+    offset += ret;
+  }
+
+  // Show the audio clock drift once the resampler servo has settled
+  if (g_Instance->m_AudioResampler.IsValid()) {
+    // Print the drift being compensated by resampling
+    ret = snprintf(
+      &output[offset], length - offset,
+      "Audio clock drift: %+.0f ppm\n",
+      g_Instance->m_AudioResampler.DriftPpm()
+    );
+    // Abort if string formatting failed or buffer overflowed
+    if (ret < 0 || ret >= length - offset) {
+      assert(false);
+      return;
+    }
+    offset += ret;
+  }
+
+  // Show the clock drift tracked by the presentation clock once it has started
+  if (g_Instance->m_PresentationClock.IsValid()) {
+    // Print the estimated TV clock rate relative to the host clock
+    ret = snprintf(
+      &output[offset], length - offset,
+      "Host clock drift: %+.0f ppm\n",
+      g_Instance->m_PresentationClock.DriftPpm()
+    );
+    // Abort if string formatting failed or buffer overflowed
+    if (ret < 0 || ret >= length - offset) {
+      assert(false);
+      return;
+    }
+    offset += ret;
+  }
+
+  // Show the CPU use and wakeup rate of each streaming thread
+  THREAD_STATS threads[24];
+  int threadCount = LiGetThreadStats(threads, 24);
+  for (int i = 0; i < threadCount; i++) {
+    // Estimated CPU use (no per-thread CPU clock in WASM) is marked with a tilde
+    ret = snprintf(
+      &output[offset], length - offset,
+      "Thread %s: %s%.1f%% CPU, %.0f wakeups/s\n",
+      threads[i].name, threads[i].cpuTimeEstimated ? "~" : "",
+      threads[i].cpuPercent, threads[i].wakeupsPerSecond
+    );
+    // Abort if string formatting failed or buffer overflowed
+    if (ret < 0 || ret >= length - offset) {
+      assert(false);
+      return;
+    }
+    offset += ret;
+  }
 }
 
 void MoonlightInstance::TogglePerformanceStats() {
@@ -644,14 +875,14 @@ void MoonlightInstance::TogglePerformanceStats() {
 
   // Notify the JS code that performance stats overlay is enabled or disabled
   if (m_PerformanceStatsEnabled) {
-    PostToJs(std::string("StatMsg: ") + s_StatString.data());
+    PostToJs(JsMessageKind::Stat, s_StatString.data());
   } else {
-    PostToJs(std::string("NoStatMsg: "));
+    PostToJs(JsMessageKind::NoStat);
   }
 }
 
-void MoonlightInstance::WaitFor(std::condition_variable* variable, std::function<bool()> condition) {
-  std::unique_lock<std::mutex> lock(m_Mutex);
+void MoonlightInstance::WaitFor(std::condition_variable_any* variable, std::function<bool()> condition) {
+  std::unique_lock<ProfiledMutex> lock(m_Mutex);
   variable->wait(lock, condition);
 }
 